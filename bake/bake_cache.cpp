@@ -0,0 +1,429 @@
+#include "bake_cache.hpp"
+
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <system_error>
+
+#include <cstdio>
+#include <cstring>
+#include <cinttypes>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Cache entry format:
+	//  - char[16] : magic
+	//  - uint64_t : key hash
+	//  - uint64_t : key soup vertex count
+	//  - uint32_t : V = vertex count
+	//  - uint32_t : I = index count
+	//  - uint32_t : T = tangent count (V or 0)
+	//  - uint32_t : padding
+	//  - 5 x uint64_t : cleanup statistics (see TriangleCleanupStats)
+	//  - V x vec3 : positions
+	//  - V x vec3 : normals
+	//  - V x vec2 : texture coordinates
+	//  - I x uint32_t : indices
+	//  - T x vec4 : tangents
+	//  - 2 x vec3 : AABB min and max
+	constexpr char kCacheMagic[16] = "\0\0bake-cache-2";
+	constexpr char kCacheExtension[] = ".bakecache";
+
+	// Texture contents format:
+	//  - char[16] : magic
+	//  - uint32_t : N = number of entries
+	//  - N x TextureEntry_
+	constexpr char kTextureCacheMagic[16] = "\0\0bake-texhash1";
+	constexpr char kTextureCacheName[] = "textures.texhash";
+
+	struct TextureEntry_
+	{
+		std::uint64_t key;
+		std::uint64_t hash;
+		std::uint32_t width, height;
+		std::uint32_t hasAlpha;
+		std::uint32_t pad;
+	};
+
+	struct EntryHeader_
+	{
+		char magic[16];
+		std::uint64_t hash;
+		std::uint64_t soupVertices;
+		std::uint32_t vertexCount;
+		std::uint32_t indexCount;
+		std::uint32_t tangentCount;
+		std::uint32_t pad;
+		std::uint64_t collapsed, nonFinite, zeroArea, duplicate;
+		std::uint64_t cleanupVertices;
+	};
+
+	// XXH64 primes
+	constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+	constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr std::uint64_t kPrime3 = 0x165667B19E3779F9ull;
+	constexpr std::uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+	constexpr std::uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+	std::uint64_t rotl_( std::uint64_t aX, int aR ) noexcept
+	{
+		return (aX << aR) | (aX >> (64-aR));
+	}
+	std::uint64_t round_( std::uint64_t aAcc, std::uint64_t aInput ) noexcept
+	{
+		aAcc += aInput * kPrime2;
+		aAcc = rotl_( aAcc, 31 );
+		return aAcc * kPrime1;
+	}
+	std::uint64_t merge_round_( std::uint64_t aAcc, std::uint64_t aVal ) noexcept
+	{
+		aAcc ^= round_( 0, aVal );
+		return aAcc * kPrime1 + kPrime4;
+	}
+
+	template< typename tType >
+	tType load_( unsigned char const* aPtr ) noexcept
+	{
+		tType ret;
+		std::memcpy( &ret, aPtr, sizeof(tType) );
+		return ret;
+	}
+
+	template< typename tType >
+	bool read_array_( FILE*, std::vector<tType>&, std::size_t aCount );
+	template< typename tType >
+	void write_array_( FILE*, std::vector<tType> const& );
+}
+
+std::uint64_t hash_bytes( void const* aData, std::size_t aSize, std::uint64_t aSeed )
+{
+	auto const* ptr = static_cast<unsigned char const*>(aData);
+	auto const* const end = ptr + aSize;
+
+	std::uint64_t h;
+	if( aSize >= 32 )
+	{
+		std::uint64_t v1 = aSeed + kPrime1 + kPrime2;
+		std::uint64_t v2 = aSeed + kPrime2;
+		std::uint64_t v3 = aSeed;
+		std::uint64_t v4 = aSeed - kPrime1;
+
+		for( ; end - ptr >= 32; ptr += 32 )
+		{
+			v1 = round_( v1, load_<std::uint64_t>( ptr+ 0 ) );
+			v2 = round_( v2, load_<std::uint64_t>( ptr+ 8 ) );
+			v3 = round_( v3, load_<std::uint64_t>( ptr+16 ) );
+			v4 = round_( v4, load_<std::uint64_t>( ptr+24 ) );
+		}
+
+		h = rotl_( v1, 1 ) + rotl_( v2, 7 ) + rotl_( v3, 12 ) + rotl_( v4, 18 );
+		h = merge_round_( h, v1 );
+		h = merge_round_( h, v2 );
+		h = merge_round_( h, v3 );
+		h = merge_round_( h, v4 );
+	}
+	else
+	{
+		h = aSeed + kPrime5;
+	}
+
+	h += std::uint64_t(aSize);
+
+	for( ; end - ptr >= 8; ptr += 8 )
+	{
+		h ^= round_( 0, load_<std::uint64_t>( ptr ) );
+		h = rotl_( h, 27 ) * kPrime1 + kPrime4;
+	}
+	if( end - ptr >= 4 )
+	{
+		h ^= std::uint64_t(load_<std::uint32_t>( ptr )) * kPrime1;
+		h = rotl_( h, 23 ) * kPrime2 + kPrime3;
+		ptr += 4;
+	}
+	for( ; ptr != end; ++ptr )
+	{
+		h ^= std::uint64_t(*ptr) * kPrime5;
+		h = rotl_( h, 11 ) * kPrime1;
+	}
+
+	h ^= h >> 33;
+	h *= kPrime2;
+	h ^= h >> 29;
+	h *= kPrime3;
+	h ^= h >> 32;
+	return h;
+}
+
+BakeCacheKey bake_cache_key( InputModel const& aModel, InputMeshInfo const& aMesh, std::uint64_t aParameterHash )
+{
+	auto const beg = aMesh.vertexStartIndex;
+	auto const count = aMesh.vertexCount;
+
+	std::uint64_t h = aParameterHash;
+	h = hash_bytes( aModel.positions.data() + beg, count*sizeof(glm::vec3), h );
+	h = hash_bytes( aModel.normals.data() + beg, count*sizeof(glm::vec3), h );
+	h = hash_bytes( aModel.texcoords.data() + beg, count*sizeof(glm::vec2), h );
+
+	return BakeCacheKey{ h, count };
+}
+
+std::filesystem::path bake_cache_entry( std::filesystem::path const& aCacheDir, BakeCacheKey const& aKey )
+{
+	char name[64];
+	std::snprintf( name, sizeof(name), "%016" PRIx64 "-%" PRIu64 "%s", aKey.hash, aKey.soupVertices, kCacheExtension );
+	return aCacheDir / name;
+}
+
+bool load_cached_mesh( std::filesystem::path const& aEntry, BakeCacheKey const& aKey, IndexedMesh& aMesh, std::vector<glm::vec4>& aTangents, TriangleCleanupStats& aCleanup )
+{
+	FILE* fin = std::fopen( aEntry.string().c_str(), "rb" );
+	if( !fin )
+		return false;
+
+	IndexedMesh mesh;
+	std::vector<glm::vec4> tangents;
+
+	EntryHeader_ header;
+	bool ok = 1 == std::fread( &header, sizeof(header), 1, fin )
+		&& 0 == std::memcmp( header.magic, kCacheMagic, sizeof(kCacheMagic) )
+		&& header.hash == aKey.hash
+		&& header.soupVertices == aKey.soupVertices
+		&& header.vertexCount <= header.soupVertices
+		&& header.indexCount <= header.soupVertices
+		&& (0 == header.tangentCount || header.tangentCount == header.vertexCount)
+		&& read_array_( fin, mesh.vert, header.vertexCount )
+		&& read_array_( fin, mesh.norm, header.vertexCount )
+		&& read_array_( fin, mesh.text, header.vertexCount )
+		&& read_array_( fin, mesh.indices, header.indexCount )
+		&& read_array_( fin, tangents, header.tangentCount )
+		&& 1 == std::fread( &mesh.aabbMin, sizeof(glm::vec3), 1, fin )
+		&& 1 == std::fread( &mesh.aabbMax, sizeof(glm::vec3), 1, fin )
+		&& EOF == std::fgetc( fin )
+	;
+
+	std::fclose( fin );
+
+	if( !ok )
+		return false;
+
+	aMesh = std::move(mesh);
+	aTangents = std::move(tangents);
+
+	aCleanup = TriangleCleanupStats{};
+	aCleanup.collapsed = std::size_t(header.collapsed);
+	aCleanup.nonFinite = std::size_t(header.nonFinite);
+	aCleanup.zeroArea = std::size_t(header.zeroArea);
+	aCleanup.duplicate = std::size_t(header.duplicate);
+	aCleanup.vertices = std::size_t(header.cleanupVertices);
+	return true;
+}
+
+void store_cached_mesh( std::filesystem::path const& aEntry, BakeCacheKey const& aKey, IndexedMesh const& aMesh, std::vector<glm::vec4> const& aTangents, TriangleCleanupStats const& aCleanup )
+{
+	// Write to a temporary file first, so that an interrupted bake never
+	// leaves a partial entry under the final name. The temporary name is
+	// unique per thread, in case another thread stores the same entry.
+	char suffix[32];
+	std::snprintf( suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()( std::this_thread::get_id() ) );
+
+	auto temp = aEntry;
+	temp += suffix;
+
+	FILE* fof = std::fopen( temp.string().c_str(), "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", temp.string().c_str() );
+
+	try
+	{
+		EntryHeader_ header{};
+		std::memcpy( header.magic, kCacheMagic, sizeof(kCacheMagic) );
+		header.hash = aKey.hash;
+		header.soupVertices = aKey.soupVertices;
+		header.vertexCount = std::uint32_t(aMesh.vert.size());
+		header.indexCount = std::uint32_t(aMesh.indices.size());
+		header.tangentCount = std::uint32_t(aTangents.size());
+		header.collapsed = aCleanup.collapsed;
+		header.nonFinite = aCleanup.nonFinite;
+		header.zeroArea = aCleanup.zeroArea;
+		header.duplicate = aCleanup.duplicate;
+		header.cleanupVertices = aCleanup.vertices;
+
+		if( 1 != std::fwrite( &header, sizeof(header), 1, fof ) )
+			throw lut::Error( "%s: fwrite() failed", temp.string().c_str() );
+
+		write_array_( fof, aMesh.vert );
+		write_array_( fof, aMesh.norm );
+		write_array_( fof, aMesh.text );
+		write_array_( fof, aMesh.indices );
+		write_array_( fof, aTangents );
+
+		if( 1 != std::fwrite( &aMesh.aabbMin, sizeof(glm::vec3), 1, fof ) || 1 != std::fwrite( &aMesh.aabbMax, sizeof(glm::vec3), 1, fof ) )
+			throw lut::Error( "%s: fwrite() failed", temp.string().c_str() );
+	}
+	catch( ... )
+	{
+		std::fclose( fof );
+		throw;
+	}
+
+	if( 0 != std::fclose( fof ) )
+		throw lut::Error( "%s: fclose() failed", temp.string().c_str() );
+
+	// Entries with the same key have the same contents, so if the entry
+	// exists by now, it is as good as ours.
+	std::error_code ec;
+	std::filesystem::rename( temp, aEntry, ec );
+	if( ec )
+	{
+		std::error_code ignore;
+		std::filesystem::remove( temp, ignore );
+
+		if( !std::filesystem::exists( aEntry, ignore ) )
+			throw lut::Error( "Unable to rename '%s': %s", temp.string().c_str(), ec.message().c_str() );
+	}
+}
+
+std::uint64_t texture_cache_key( std::vector<std::string> const& aSources, TextureRole aRole )
+{
+	auto const role = std::uint32_t(aRole);
+	auto h = hash_bytes( &role, sizeof(role) );
+
+	for( auto const& source : aSources )
+	{
+		std::error_code ec;
+		std::uint64_t const stamp[2] = {
+			std::uint64_t(std::filesystem::file_size( source, ec )),
+			std::uint64_t(std::filesystem::last_write_time( source, ec ).time_since_epoch().count())
+		};
+
+		h = hash_bytes( source.data(), source.size(), h );
+		h = hash_bytes( stamp, sizeof(stamp), h );
+	}
+
+	return h;
+}
+
+std::unordered_map<std::uint64_t,TextureContents> load_cached_texture_contents( std::filesystem::path const& aCacheDir )
+{
+	std::unordered_map<std::uint64_t,TextureContents> ret;
+
+	FILE* fin = std::fopen( (aCacheDir / kTextureCacheName).string().c_str(), "rb" );
+	if( !fin )
+		return ret;
+
+	// The entry count must match the size of the file; a truncated or
+	// corrupt file is a miss, rather than a huge allocation.
+	std::error_code ec;
+	auto const fileSize = std::filesystem::file_size( aCacheDir / kTextureCacheName, ec );
+
+	char magic[sizeof(kTextureCacheMagic)];
+	std::uint32_t count = 0;
+	std::vector<TextureEntry_> entries;
+
+	bool const ok = !ec
+		&& 1 == std::fread( magic, sizeof(magic), 1, fin )
+		&& 0 == std::memcmp( magic, kTextureCacheMagic, sizeof(kTextureCacheMagic) )
+		&& 1 == std::fread( &count, sizeof(count), 1, fin )
+		&& fileSize == sizeof(magic) + sizeof(count) + std::uintmax_t(count)*sizeof(TextureEntry_)
+		&& read_array_( fin, entries, count )
+		&& EOF == std::fgetc( fin )
+	;
+
+	std::fclose( fin );
+
+	if( !ok )
+		return ret;
+
+	for( auto const& entry : entries )
+		ret.emplace( entry.key, TextureContents{ entry.hash, entry.width, entry.height, 0 != entry.hasAlpha } );
+
+	return ret;
+}
+
+void store_cached_texture_contents( std::filesystem::path const& aCacheDir, std::unordered_map<std::uint64_t,TextureContents> const& aContents )
+{
+	std::vector<TextureEntry_> entries;
+	for( auto const& [key, contents] : aContents )
+		entries.emplace_back( TextureEntry_{ key, contents.hash, contents.width, contents.height, contents.hasAlpha ? 1u : 0u, 0 } );
+
+	// As store_cached_mesh()
+	auto const path = aCacheDir / kTextureCacheName;
+	auto temp = path;
+	temp += ".tmp";
+
+	FILE* fof = std::fopen( temp.string().c_str(), "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", temp.string().c_str() );
+
+	try
+	{
+		auto const count = std::uint32_t(entries.size());
+		if( 1 != std::fwrite( kTextureCacheMagic, sizeof(kTextureCacheMagic), 1, fof ) || 1 != std::fwrite( &count, sizeof(count), 1, fof ) )
+			throw lut::Error( "%s: fwrite() failed", temp.string().c_str() );
+
+		write_array_( fof, entries );
+	}
+	catch( ... )
+	{
+		std::fclose( fof );
+		throw;
+	}
+
+	if( 0 != std::fclose( fof ) )
+		throw lut::Error( "%s: fclose() failed", temp.string().c_str() );
+
+	std::error_code ec;
+	std::filesystem::rename( temp, path, ec );
+	if( ec )
+		throw lut::Error( "Unable to rename '%s': %s", temp.string().c_str(), ec.message().c_str() );
+}
+
+std::size_t prune_bake_cache( std::filesystem::path const& aCacheDir, std::vector<std::filesystem::path> const& aKeep )
+{
+	std::error_code ec;
+	if( !std::filesystem::is_directory( aCacheDir, ec ) )
+		return 0;
+
+	std::vector<std::filesystem::path> keep;
+	for( auto const& path : aKeep )
+		keep.emplace_back( path.filename() );
+
+	std::sort( keep.begin(), keep.end() );
+
+	std::size_t removed = 0;
+	for( auto const& entry : std::filesystem::directory_iterator( aCacheDir ) )
+	{
+		auto const name = entry.path().filename();
+		if( name.extension() != kCacheExtension )
+			continue;
+
+		if( std::binary_search( keep.begin(), keep.end(), name ) )
+			continue;
+
+		if( std::filesystem::remove( entry.path(), ec ) )
+			++removed;
+	}
+
+	return removed;
+}
+
+namespace
+{
+	template< typename tType >
+	bool read_array_( FILE* aFin, std::vector<tType>& aOut, std::size_t aCount )
+	{
+		aOut.resize( aCount );
+		return aCount == std::fread( aOut.data(), sizeof(tType), aCount, aFin );
+	}
+
+	template< typename tType >
+	void write_array_( FILE* aFof, std::vector<tType> const& aData )
+	{
+		if( aData.size() != std::fwrite( aData.data(), sizeof(tType), aData.size(), aFof ) )
+			throw lut::Error( "fwrite() failed: %zu elements", aData.size() );
+	}
+}
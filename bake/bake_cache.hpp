@@ -0,0 +1,97 @@
+#ifndef BAKE_CACHE_HPP_5D2E8A61_94C7_4B3F_8E1A_C6F07B2D9435
+#define BAKE_CACHE_HPP_5D2E8A61_94C7_4B3F_8E1A_C6F07B2D9435
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec4.hpp>
+
+#include "index_mesh.hpp"
+#include "input_model.hpp"
+#include "optimize_mesh.hpp"
+#include "compress_texture.hpp"
+
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Persistent per-mesh cache for the expensive parts of the bake (welding,
+ * cleanup and tangent generation). Entries also keep the mesh's cleanup
+ * statistics, so that reports are the same for cached meshes.
+ *
+ * Each mesh is keyed by a hash of its triangle soup (positions, normals and
+ * texture coordinates) and of the bake parameters. Entries are stored as one
+ * file per mesh in the cache directory. Anything that cannot be read back
+ * exactly (missing, truncated, from a different cache version, ...) is
+ * treated as a miss.
+ *
+ * Note: the bake parameters must include a version number that is bumped
+ * whenever the welding or tangent code changes its output.
+ */
+struct BakeCacheKey
+{
+	std::uint64_t hash;
+	std::uint64_t soupVertices;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// 64-bit non-cryptographic hash (XXH64).
+std::uint64_t hash_bytes( void const*, std::size_t, std::uint64_t aSeed = 0 );
+
+BakeCacheKey bake_cache_key( InputModel const&, InputMeshInfo const&, std::uint64_t aParameterHash );
+
+std::filesystem::path bake_cache_entry( std::filesystem::path const& aCacheDir, BakeCacheKey const& );
+
+bool load_cached_mesh(
+	std::filesystem::path const& aEntry,
+	BakeCacheKey const&,
+	IndexedMesh&,
+	std::vector<glm::vec4>& aTangents,
+	TriangleCleanupStats&
+);
+
+void store_cached_mesh(
+	std::filesystem::path const& aEntry,
+	BakeCacheKey const&,
+	IndexedMesh const&,
+	std::vector<glm::vec4> const& aTangents,
+	TriangleCleanupStats const&
+);
+
+/* Texture contents (see texture_contents()) from previous bakes, so that
+ * unchanged textures need not be decoded again. They are keyed by the
+ * texture's role and the path, size and modification time of its sources,
+ * and are kept together in a single file in the cache directory. A missing
+ * or unreadable file yields an empty table.
+ */
+std::uint64_t texture_cache_key(
+	std::vector<std::string> const& aSources,
+	TextureRole
+);
+
+std::unordered_map<std::uint64_t,TextureContents> load_cached_texture_contents(
+	std::filesystem::path const& aCacheDir
+);
+
+void store_cached_texture_contents(
+	std::filesystem::path const& aCacheDir,
+	std::unordered_map<std::uint64_t,TextureContents> const&
+);
+
+/* Remove cache entries that are not in aKeep. Returns the number of removed
+ * entries.
+ */
+std::size_t prune_bake_cache(
+	std::filesystem::path const& aCacheDir,
+	std::vector<std::filesystem::path> const& aKeep
+);
+
+#endif // BAKE_CACHE_HPP_5D2E8A61_94C7_4B3F_8E1A_C6F07B2D9435
@@ -0,0 +1,242 @@
+#include "bake_report.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <sys/time.h>
+#	include <sys/resource.h>
+#endif
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	void write_json_string_( FILE*, std::string const& );
+
+#	if defined(__linux__)
+	std::uint64_t read_peak_rss_() noexcept;
+	bool reset_peak_rss_() noexcept;
+#	endif
+}
+
+ProcessUsage process_usage() noexcept
+{
+	ProcessUsage ret;
+	ret.wallSeconds = std::chrono::duration<double>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+
+#	if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if( GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) )
+	{
+		auto const seconds_ = [] (FILETIME const& aTime) {
+			return double((std::uint64_t(aTime.dwHighDateTime) << 32) | aTime.dwLowDateTime) * 1e-7;
+		};
+		ret.cpuSeconds = seconds_( kernel ) + seconds_( user );
+	}
+
+	PROCESS_MEMORY_COUNTERS counters{};
+	if( GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof(counters) ) )
+		ret.peakRssBytes = counters.PeakWorkingSetSize;
+#	else
+	rusage usage{};
+	if( 0 == getrusage( RUSAGE_SELF, &usage ) )
+	{
+		auto const seconds_ = [] (timeval const& aTime) {
+			return double(aTime.tv_sec) + double(aTime.tv_usec) * 1e-6;
+		};
+		ret.cpuSeconds = seconds_( usage.ru_utime ) + seconds_( usage.ru_stime );
+
+#		if defined(__APPLE__)
+		ret.peakRssBytes = std::uint64_t(usage.ru_maxrss); // bytes
+#		else
+		ret.peakRssBytes = std::uint64_t(usage.ru_maxrss) * 1024; // kilobytes
+#		endif
+	}
+
+#	if defined(__linux__)
+	// ru_maxrss cannot be reset, but VmHWM can. Only use it if the reset
+	// works; it then covers the time since the previous snapshot.
+	if( auto const peak = read_peak_rss_(); 0 != peak && reset_peak_rss_() )
+	{
+		ret.peakRssBytes = peak;
+		ret.stagePeak = true;
+	}
+#	endif
+#	endif
+
+	return ret;
+}
+
+BakeStageReport& add_bake_stage( BakeReport& aReport, char const* aName, ProcessUsage const& aStart, ProcessUsage const& aEnd )
+{
+	for( auto& stage : aReport.stages )
+	{
+		if( stage.name == aName )
+		{
+			stage.wallSeconds += aEnd.wallSeconds - aStart.wallSeconds;
+			stage.cpuSeconds += aEnd.cpuSeconds - aStart.cpuSeconds;
+			stage.peakRssBytes = aEnd.stagePeak ? std::max( stage.peakRssBytes, aEnd.peakRssBytes ) : aEnd.peakRssBytes;
+			stage.stagePeak = stage.stagePeak && aEnd.stagePeak;
+			return stage;
+		}
+	}
+
+	BakeStageReport stage;
+	stage.name = aName;
+	stage.wallSeconds = aEnd.wallSeconds - aStart.wallSeconds;
+	stage.cpuSeconds = aEnd.cpuSeconds - aStart.cpuSeconds;
+	stage.peakRssBytes = aEnd.peakRssBytes;
+	stage.stagePeak = aEnd.stagePeak;
+
+	aReport.stages.emplace_back( std::move(stage) );
+	return aReport.stages.back();
+}
+
+void add_bake_count( BakeStageReport& aStage, char const* aName, std::uint64_t aValue )
+{
+	for( auto& count : aStage.counts )
+	{
+		if( count.first == aName )
+		{
+			count.second += aValue;
+			return;
+		}
+	}
+
+	aStage.counts.emplace_back( aName, aValue );
+}
+
+void write_bake_report( char const* aPath, BakeReport const& aReport )
+{
+	FILE* fof = std::fopen( aPath, "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", aPath );
+
+	double wall = 0.0, cpu = 0.0;
+	std::uint64_t peak = 0;
+	bool stagePeaks = !aReport.stages.empty();
+	for( auto const& stage : aReport.stages )
+	{
+		wall += stage.wallSeconds;
+		cpu += stage.cpuSeconds;
+		peak = std::max( peak, stage.peakRssBytes );
+		stagePeaks = stagePeaks && stage.stagePeak;
+	}
+
+	std::fprintf( fof, "{\n\t\"input\": " );
+	write_json_string_( fof, aReport.input );
+	std::fprintf( fof, ",\n\t\"output\": " );
+	write_json_string_( fof, aReport.output );
+	std::fprintf( fof, ",\n\t\"threads\": %zu,\n", aReport.threads );
+	std::fprintf( fof, "\t\"peak_rss_scope\": \"%s\",\n", stagePeaks ? "stage" : "process" );
+	std::fprintf( fof, "\t\"total\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"peak_rss_kb\": %llu },\n", wall*1000.0, cpu*1000.0, (unsigned long long)(peak/1024) );
+
+	std::fprintf( fof, "\t\"stages\": [" );
+	for( std::size_t i = 0; i < aReport.stages.size(); ++i )
+	{
+		auto const& stage = aReport.stages[i];
+
+		std::fprintf( fof, "%s\n\t\t{ \"name\": ", i ? "," : "" );
+		write_json_string_( fof, stage.name );
+		std::fprintf( fof, ", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"peak_rss_kb\": %llu, \"counts\": {", stage.wallSeconds*1000.0, stage.cpuSeconds*1000.0, (unsigned long long)(stage.peakRssBytes/1024) );
+
+		for( std::size_t j = 0; j < stage.counts.size(); ++j )
+		{
+			std::fprintf( fof, "%s ", j ? "," : "" );
+			write_json_string_( fof, stage.counts[j].first );
+			std::fprintf( fof, ": %llu", (unsigned long long)stage.counts[j].second );
+		}
+
+		std::fprintf( fof, "%s} }", stage.counts.empty() ? "" : " " );
+	}
+	std::fprintf( fof, "\n\t],\n" );
+
+	std::fprintf( fof, "\t\"meshes\": [" );
+	for( std::size_t i = 0; i < aReport.meshes.size(); ++i )
+	{
+		auto const& mesh = aReport.meshes[i];
+		auto const ratio = mesh.soupVertices ? double(mesh.weldedVertices) / double(mesh.soupVertices) : 0.0;
+
+		std::fprintf( fof, "%s\n\t\t{ \"name\": ", i ? "," : "" );
+		write_json_string_( fof, mesh.name );
+		std::fprintf( fof, ", \"cached\": %s, \"soup_vertices\": %zu, \"welded_vertices\": %zu, \"weld_ratio\": %.4f, \"removed_triangles\": %zu, \"weld_ms\": %.3f, \"tangent_ms\": %.3f }",
+			mesh.cached ? "true" : "false",
+			mesh.soupVertices,
+			mesh.weldedVertices,
+			ratio,
+			mesh.removedTriangles,
+			mesh.weldSeconds*1000.0,
+			mesh.tangentSeconds*1000.0
+		);
+	}
+	std::fprintf( fof, "\n\t]\n}\n" );
+
+	bool const failed = 0 != std::ferror( fof );
+	std::fclose( fof );
+
+	if( failed )
+		throw lut::Error( "Unable to write bake report to '%s'", aPath );
+}
+
+namespace
+{
+	void write_json_string_( FILE* aOut, std::string const& aString )
+	{
+		std::fputc( '"', aOut );
+		for( unsigned char const c : aString )
+		{
+			if( '"' == c || '\\' == c )
+				std::fprintf( aOut, "\\%c", c );
+			else if( c < 0x20 )
+				std::fprintf( aOut, "\\u%04x", unsigned(c) );
+			else
+				std::fputc( c, aOut );
+		}
+		std::fputc( '"', aOut );
+	}
+
+#	if defined(__linux__)
+	std::uint64_t read_peak_rss_() noexcept
+	{
+		FILE* fin = std::fopen( "/proc/self/status", "r" );
+		if( !fin )
+			return 0;
+
+		std::uint64_t ret = 0;
+
+		char line[256];
+		while( std::fgets( line, sizeof(line), fin ) )
+		{
+			unsigned long long kb = 0;
+			if( 1 == std::sscanf( line, "VmHWM: %llu kB", &kb ) )
+			{
+				ret = std::uint64_t(kb) * 1024;
+				break;
+			}
+		}
+
+		std::fclose( fin );
+		return ret;
+	}
+
+	bool reset_peak_rss_() noexcept
+	{
+		// "5" resets the peak RSS to the current RSS (Linux 4.0 and later)
+		FILE* fof = std::fopen( "/proc/self/clear_refs", "w" );
+		if( !fof )
+			return false;
+
+		bool const ok = EOF != std::fputs( "5", fof );
+		return 0 == std::fclose( fof ) && ok;
+	}
+#	endif
+}
@@ -0,0 +1,127 @@
+#ifndef BAKE_REPORT_HPP_E3A94F07_2C5B_4D81_9F6E_7B18C0D4A253
+#define BAKE_REPORT_HPP_E3A94F07_2C5B_4D81_9F6E_7B18C0D4A253
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <cstddef>
+#include <cstdint>
+
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Snapshot of the resources used by the process so far.
+ *
+ * Where possible (Linux), the peak resident set size only covers the time
+ * since the previous snapshot: taking a snapshot resets the kernel's high-
+ * water mark (VmHWM, via /proc/self/clear_refs). Stages are delimited by
+ * consecutive snapshots, so each one gets its own peak. Elsewhere, or if
+ * the reset fails, it is the peak over the process' lifetime so far, and
+ * stagePeak is false.
+ */
+struct ProcessUsage
+{
+	double wallSeconds = 0.0; // steady clock; only differences are meaningful
+	double cpuSeconds = 0.0; // user + system time of all threads
+	std::uint64_t peakRssBytes = 0; // peak resident set size, see above
+	bool stagePeak = false; // peakRssBytes is since the previous snapshot
+};
+
+/* Measurements for one stage of the bake. The CPU time includes all threads,
+ * so cpu/wall approaches the number of threads for stages that scale.
+ *
+ * The peak RSS is the highest resident set size during the stage (the
+ * largest over all runs of a repeated stage). Without per-stage peaks (see
+ * ProcessUsage), it is the process' peak at the end of the stage, i.e., a
+ * stage with a higher value than the one before raised the peak.
+ */
+struct BakeStageReport
+{
+	std::string name;
+
+	double wallSeconds = 0.0;
+	double cpuSeconds = 0.0;
+	std::uint64_t peakRssBytes = 0;
+	bool stagePeak = false;
+
+	std::vector<std::pair<std::string,std::uint64_t>> counts; // e.g., {"vertices", 1234}
+};
+
+/* Per (input) mesh measurements. Times are zero for meshes that were taken
+ * from the bake cache.
+ */
+struct BakeMeshReport
+{
+	std::string name;
+	bool cached = false;
+
+	std::size_t soupVertices = 0;
+	std::size_t weldedVertices = 0;
+
+	std::size_t removedTriangles = 0; // degenerate and duplicate triangles
+
+	double weldSeconds = 0.0;
+	double tangentSeconds = 0.0;
+};
+
+struct BakeReport
+{
+	std::string input, output;
+	std::size_t threads = 0;
+
+	std::vector<BakeStageReport> stages;
+	std::vector<BakeMeshReport> meshes;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+// Note: resets the peak RSS, see ProcessUsage
+ProcessUsage process_usage() noexcept;
+
+/* Record a stage that ran from aStart to aEnd. Returns the stage, so that
+ * counts can be added to it.
+ *
+ * Stages that run repeatedly, e.g., once per batch of meshes, are recorded
+ * once: the times of later runs are added to the existing stage, and its peak
+ * RSS is the largest of all runs.
+ */
+BakeStageReport& add_bake_stage(
+	BakeReport&,
+	char const* aName,
+	ProcessUsage const& aStart,
+	ProcessUsage const& aEnd = process_usage()
+);
+
+// Add aValue to the stage's count aName (which is created if necessary)
+void add_bake_count(
+	BakeStageReport&,
+	char const* aName,
+	std::uint64_t aValue
+);
+
+/* Write the report as JSON:
+ *
+ *  {
+ *    "input": ..., "output": ..., "threads": N,
+ *    "peak_rss_scope": "stage" | "process",
+ *    "total": { "wall_ms": ..., "cpu_ms": ..., "peak_rss_kb": ... },
+ *    "stages": [ { "name": ..., "wall_ms": ..., "cpu_ms": ...,
+ *                  "peak_rss_kb": ..., "counts": { ... } }, ... ],
+ *    "meshes": [ { "name": ..., "cached": false, "soup_vertices": ...,
+ *                  "welded_vertices": ..., "weld_ratio": ...,
+ *                  "removed_triangles": ..., "weld_ms": ...,
+ *                  "tangent_ms": ... }, ... ]
+ *  }
+ *
+ * The weld ratio is the number of welded vertices divided by the number of
+ * soup vertices. The total covers the recorded stages. peak_rss_scope is
+ * "stage" if each stage's peak_rss_kb is its own high-water mark, and
+ * "process" if it is the cumulative peak of the process (see ProcessUsage).
+ */
+void write_bake_report( char const* aPath, BakeReport const& );
+
+#endif // BAKE_REPORT_HPP_E3A94F07_2C5B_4D81_9F6E_7B18C0D4A253
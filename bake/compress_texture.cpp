@@ -0,0 +1,633 @@
+#include "compress_texture.hpp"
+
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <glm/glm.hpp>
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include "bake_cache.hpp"
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	/* File magic and variant, see write_compressed_texture(). Change the
+	 * variant whenever the format or the encoders change; outdated textures
+	 * are then recompressed by the next bake.
+	 */
+	constexpr char kTextureMagic[16] = "\0\0COMP5822Mtex";
+	constexpr char kTextureVariant[16] = "sc20mh-bc-v1";
+
+	constexpr std::uint32_t kBlockDim = 4;
+	constexpr std::size_t kBlockTexels = kBlockDim*kBlockDim;
+
+	// Refinement iterations for BC1 endpoints (least squares fit to the
+	// current index assignment)
+	constexpr int kBc1Refinements = 2;
+
+	struct Image_
+	{
+		std::uint32_t width, height;
+		std::vector<glm::vec4> texels; // linear values; see load_image_()
+	};
+
+	struct Bc1Fit_
+	{
+		std::uint16_t c0, c1;
+		std::uint32_t indices;
+		float error;
+	};
+
+	Image_ load_image_( std::filesystem::path const&, TextureRole, bool& aHasAlpha );
+	TextureContents hash_image_( std::filesystem::path const&, std::uint64_t aSeed );
+	Image_ load_packed_( std::filesystem::path const& aRed, std::filesystem::path const& aGreen );
+
+	CompressedTexture compress_image_( Image_, TextureRole, TextureFormat );
+	Image_ downsample_( Image_ const&, TextureRole );
+
+	std::vector<std::uint8_t> encode_level_( Image_ const&, TextureRole, TextureFormat );
+	void fetch_block_( Image_ const&, std::uint32_t aBX, std::uint32_t aBY, TextureRole, glm::vec4 (&aBlock)[kBlockTexels] );
+
+	void encode_bc1_( glm::vec4 const (&aBlock)[kBlockTexels], std::uint8_t* aOut );
+	void encode_bc4_( float const (&aValues)[kBlockTexels], std::uint8_t* aOut );
+
+	Bc1Fit_ fit_bc1_( glm::vec4 const (&aBlock)[kBlockTexels], glm::vec3 aE0, glm::vec3 aE1 );
+
+	std::uint16_t pack_565_( glm::vec3 const& ) noexcept;
+	glm::vec3 unpack_565_( std::uint16_t ) noexcept;
+
+	float srgb_to_linear_( float ) noexcept;
+	float linear_to_srgb_( float ) noexcept;
+
+	void checked_write_( FILE*, std::size_t aBytes, void const* aData );
+}
+
+CompressedTexture compress_texture( std::filesystem::path const& aSource, TextureRole aRole )
+{
+	bool hasAlpha = false;
+	auto image = load_image_( aSource, aRole, hasAlpha );
+
+	auto const format = compressed_texture_format( aRole, hasAlpha );
+	return compress_image_( std::move(image), aRole, format );
+}
+
+CompressedTexture compress_packed_texture( std::filesystem::path const& aRed, std::filesystem::path const& aGreen )
+{
+	return compress_image_( load_packed_( aRed, aGreen ), TextureRole::packed, TextureFormat::bc5_unorm );
+}
+
+void write_packed_image( std::filesystem::path const& aPath, std::filesystem::path const& aRed, std::filesystem::path const& aGreen )
+{
+	auto const image = load_packed_( aRed, aGreen );
+
+	// Undo the vertical flip from load_image_()
+	std::vector<std::uint8_t> rgb( std::size_t(image.width)*image.height*3, 0 );
+	for( std::uint32_t y = 0; y < image.height; ++y )
+	{
+		auto const* src = image.texels.data() + std::size_t(image.height-1-y)*image.width;
+		auto* dst = rgb.data() + std::size_t(y)*image.width*3;
+
+		for( std::uint32_t x = 0; x < image.width; ++x, dst += 3 )
+		{
+			dst[0] = std::uint8_t(std::lround( std::clamp( src[x].r, 0.f, 1.f ) * 255.f ));
+			dst[1] = std::uint8_t(std::lround( std::clamp( src[x].g, 0.f, 1.f ) * 255.f ));
+		}
+	}
+
+	if( !stbi_write_png( aPath.string().c_str(), int(image.width), int(image.height), 3, rgb.data(), int(image.width*3) ) )
+		throw lut::Error( "%s: unable to write image", aPath.string().c_str() );
+}
+
+TextureContents texture_contents( std::filesystem::path const& aSource, TextureRole aRole )
+{
+	return hash_image_( aSource, std::uint64_t(aRole) );
+}
+
+TextureContents packed_texture_contents( std::filesystem::path const& aRed, std::filesystem::path const& aGreen )
+{
+	auto const red = hash_image_( aRed, std::uint64_t(TextureRole::packed) );
+	auto const green = hash_image_( aGreen, red.hash );
+
+	// Same size as load_packed_()
+	return TextureContents{ green.hash, std::max( red.width, green.width ), std::max( red.height, green.height ), false };
+}
+
+TextureFormat compressed_texture_format( TextureRole aRole, bool aHasAlpha ) noexcept
+{
+	switch( aRole )
+	{
+		case TextureRole::color: return aHasAlpha ? TextureFormat::bc3_srgb : TextureFormat::bc1_srgb;
+		case TextureRole::scalar: return TextureFormat::bc4_unorm;
+		case TextureRole::normal: return TextureFormat::bc5_unorm;
+		case TextureRole::packed: return TextureFormat::bc5_unorm;
+	}
+
+	return TextureFormat::bc1_srgb;
+}
+
+void write_compressed_texture( std::filesystem::path const& aPath, CompressedTexture const& aTexture )
+{
+	// Format:
+	//  - 16*char: magic = kTextureMagic
+	//  - 16*char: variant = kTextureVariant
+	//  - uint32_t : format (TextureFormat)
+	//  - uint32_t : L = number of mip levels
+	//  - repeat L times:
+	//    - uint32_t : width
+	//    - uint32_t : height
+	//    - uint64_t : offset of the level's blocks, relative to the payload
+	//    - uint64_t : size of the level's blocks in bytes
+	//  - payload: the blocks of all levels, largest level first
+	//
+	// The payload can be copied into a staging buffer as-is; the level table
+	// maps directly to VkBufferImageCopy regions.
+	FILE* fof = std::fopen( aPath.string().c_str(), "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", aPath.string().c_str() );
+
+	try
+	{
+		checked_write_( fof, sizeof(kTextureMagic), kTextureMagic );
+		checked_write_( fof, sizeof(kTextureVariant), kTextureVariant );
+
+		std::uint32_t const format = std::uint32_t(aTexture.format);
+		checked_write_( fof, sizeof(format), &format );
+
+		std::uint32_t const levelCount = std::uint32_t(aTexture.levels.size());
+		checked_write_( fof, sizeof(levelCount), &levelCount );
+
+		std::uint64_t offset = 0;
+		for( auto const& level : aTexture.levels )
+		{
+			std::uint64_t const size = level.blocks.size();
+
+			checked_write_( fof, sizeof(level.width), &level.width );
+			checked_write_( fof, sizeof(level.height), &level.height );
+			checked_write_( fof, sizeof(offset), &offset );
+			checked_write_( fof, sizeof(size), &size );
+
+			offset += size;
+		}
+
+		for( auto const& level : aTexture.levels )
+			checked_write_( fof, level.blocks.size(), level.blocks.data() );
+	}
+	catch( ... )
+	{
+		std::fclose( fof );
+		throw;
+	}
+
+	std::fclose( fof );
+}
+
+bool compressed_texture_is_current( std::filesystem::path const& aPath, std::filesystem::path const& aSource )
+{
+	std::error_code ec;
+	auto const outTime = std::filesystem::last_write_time( aPath, ec );
+	if( ec )
+		return false;
+
+	auto const srcTime = std::filesystem::last_write_time( aSource, ec );
+	if( ec || outTime < srcTime )
+		return false;
+
+	FILE* fin = std::fopen( aPath.string().c_str(), "rb" );
+	if( !fin )
+		return false;
+
+	char header[sizeof(kTextureMagic)+sizeof(kTextureVariant)];
+	bool const current = 1 == std::fread( header, sizeof(header), 1, fin )
+		&& 0 == std::memcmp( header, kTextureMagic, sizeof(kTextureMagic) )
+		&& 0 == std::memcmp( header+sizeof(kTextureMagic), kTextureVariant, sizeof(kTextureVariant) )
+	;
+
+	std::fclose( fin );
+	return current;
+}
+
+std::size_t texture_block_size( TextureFormat aFormat ) noexcept
+{
+	switch( aFormat )
+	{
+		case TextureFormat::bc1_srgb: return 8;
+		case TextureFormat::bc3_srgb: return 16;
+		case TextureFormat::bc4_unorm: return 8;
+		case TextureFormat::bc5_unorm: return 16;
+	}
+
+	return 0;
+}
+
+namespace
+{
+	Image_ load_image_( std::filesystem::path const& aSource, TextureRole aRole, bool& aHasAlpha )
+	{
+		int width, height, channels;
+		stbi_uc* data = stbi_load( aSource.string().c_str(), &width, &height, &channels, 4 );
+		if( !data )
+			throw lut::Error( "%s: unable to load image (%s)", aSource.string().c_str(), stbi_failure_reason() );
+
+		Image_ ret{ std::uint32_t(width), std::uint32_t(height), {} };
+		ret.texels.resize( std::size_t(width)*height );
+
+		aHasAlpha = false;
+		for( std::uint32_t y = 0; y < ret.height; ++y )
+		{
+			// The runtime loads images flipped vertically. Do the same here.
+			auto const* src = data + std::size_t(ret.height-1-y)*ret.width*4;
+			auto* dst = ret.texels.data() + std::size_t(y)*ret.width;
+
+			for( std::uint32_t x = 0; x < ret.width; ++x, src += 4 )
+			{
+				glm::vec4 const v( src[0]/255.f, src[1]/255.f, src[2]/255.f, src[3]/255.f );
+				aHasAlpha = aHasAlpha || src[3] != 255;
+
+				switch( aRole )
+				{
+					case TextureRole::color:
+						dst[x] = glm::vec4( srgb_to_linear_( v.r ), srgb_to_linear_( v.g ), srgb_to_linear_( v.b ), v.a );
+						break;
+					case TextureRole::scalar:
+						dst[x] = glm::vec4( v.r, 0.f, 0.f, 1.f );
+						break;
+					case TextureRole::packed:
+						dst[x] = glm::vec4( v.r, v.g, 0.f, 1.f );
+						break;
+					case TextureRole::normal:
+					{
+						auto const n = glm::vec3( v ) * 2.f - 1.f;
+						auto const l = glm::length( n );
+						dst[x] = glm::vec4( l > 0.f ? n / l : glm::vec3( 0.f, 0.f, 1.f ), 1.f );
+					} break;
+				}
+			}
+		}
+
+		stbi_image_free( data );
+		return ret;
+	}
+
+	TextureContents hash_image_( std::filesystem::path const& aSource, std::uint64_t aSeed )
+	{
+		int width, height, channels;
+		stbi_uc* data = stbi_load( aSource.string().c_str(), &width, &height, &channels, 4 );
+		if( !data )
+			throw lut::Error( "%s: unable to load image (%s)", aSource.string().c_str(), stbi_failure_reason() );
+
+		auto const bytes = std::size_t(width)*height*4;
+
+		bool hasAlpha = false;
+		for( std::size_t i = 3; i < bytes && !hasAlpha; i += 4 )
+			hasAlpha = 255 != data[i];
+
+		std::uint32_t const size[2] = { std::uint32_t(width), std::uint32_t(height) };
+		auto hash = hash_bytes( size, sizeof(size), aSeed );
+		hash = hash_bytes( data, bytes, hash );
+
+		stbi_image_free( data );
+		return TextureContents{ hash, size[0], size[1], hasAlpha };
+	}
+
+	Image_ load_packed_( std::filesystem::path const& aRed, std::filesystem::path const& aGreen )
+	{
+		bool hasAlpha = false;
+		auto const red = load_image_( aRed, TextureRole::scalar, hasAlpha );
+		auto const green = load_image_( aGreen, TextureRole::scalar, hasAlpha );
+
+		Image_ ret{ std::max( red.width, green.width ), std::max( red.height, green.height ), {} };
+		ret.texels.resize( std::size_t(ret.width)*ret.height );
+
+		// Nearest neighbour, in case the sizes differ (e.g., with the 1x1
+		// fallback textures)
+		auto const at = [&] (Image_ const& aImage, std::uint32_t aX, std::uint32_t aY) {
+			auto const x = std::uint64_t(aX) * aImage.width / ret.width;
+			auto const y = std::uint64_t(aY) * aImage.height / ret.height;
+			return aImage.texels[y*aImage.width + x].r;
+		};
+
+		for( std::uint32_t y = 0; y < ret.height; ++y )
+		{
+			for( std::uint32_t x = 0; x < ret.width; ++x )
+				ret.texels[std::size_t(y)*ret.width + x] = glm::vec4( at( red, x, y ), at( green, x, y ), 0.f, 1.f );
+		}
+
+		return ret;
+	}
+
+	CompressedTexture compress_image_( Image_ aImage, TextureRole aRole, TextureFormat aFormat )
+	{
+		CompressedTexture ret;
+		ret.format = aFormat;
+
+		while( true )
+		{
+			ret.levels.emplace_back( CompressedLevel{ aImage.width, aImage.height, encode_level_( aImage, aRole, aFormat ) } );
+
+			if( 1 == aImage.width && 1 == aImage.height )
+				break;
+
+			aImage = downsample_( aImage, aRole );
+		}
+
+		return ret;
+	}
+
+	Image_ downsample_( Image_ const& aImage, TextureRole aRole )
+	{
+		// 2x2 box filter. Odd edges are clamped, which drops the last row or
+		// column. Colors are averaged in linear space.
+		Image_ ret{ std::max( aImage.width/2, 1u ), std::max( aImage.height/2, 1u ), {} };
+		ret.texels.resize( std::size_t(ret.width)*ret.height );
+
+		auto const at = [&] (std::uint32_t aX, std::uint32_t aY) {
+			return aImage.texels[std::size_t(std::min( aY, aImage.height-1 ))*aImage.width + std::min( aX, aImage.width-1 )];
+		};
+
+		for( std::uint32_t y = 0; y < ret.height; ++y )
+		{
+			for( std::uint32_t x = 0; x < ret.width; ++x )
+			{
+				auto v = 0.25f * (at( 2*x, 2*y ) + at( 2*x+1, 2*y ) + at( 2*x, 2*y+1 ) + at( 2*x+1, 2*y+1 ));
+
+				if( TextureRole::normal == aRole )
+				{
+					auto const l = glm::length( glm::vec3( v ) );
+					v = glm::vec4( l > 0.f ? glm::vec3( v ) / l : glm::vec3( 0.f, 0.f, 1.f ), 1.f );
+				}
+
+				ret.texels[std::size_t(y)*ret.width + x] = v;
+			}
+		}
+
+		return ret;
+	}
+
+	std::vector<std::uint8_t> encode_level_( Image_ const& aImage, TextureRole aRole, TextureFormat aFormat )
+	{
+		auto const bw = (aImage.width + kBlockDim-1) / kBlockDim;
+		auto const bh = (aImage.height + kBlockDim-1) / kBlockDim;
+		auto const blockSize = texture_block_size( aFormat );
+
+		std::vector<std::uint8_t> ret( std::size_t(bw)*bh*blockSize );
+
+		glm::vec4 block[kBlockTexels];
+		float channel[kBlockTexels];
+
+		auto* out = ret.data();
+		for( std::uint32_t by = 0; by < bh; ++by )
+		{
+			for( std::uint32_t bx = 0; bx < bw; ++bx, out += blockSize )
+			{
+				fetch_block_( aImage, bx, by, aRole, block );
+
+				switch( aFormat )
+				{
+					case TextureFormat::bc1_srgb:
+						encode_bc1_( block, out );
+						break;
+					case TextureFormat::bc3_srgb:
+						for( std::size_t i = 0; i < kBlockTexels; ++i )
+							channel[i] = block[i].a;
+						encode_bc4_( channel, out );
+						encode_bc1_( block, out+8 );
+						break;
+					case TextureFormat::bc4_unorm:
+						for( std::size_t i = 0; i < kBlockTexels; ++i )
+							channel[i] = block[i].r;
+						encode_bc4_( channel, out );
+						break;
+					case TextureFormat::bc5_unorm:
+						for( std::size_t i = 0; i < kBlockTexels; ++i )
+							channel[i] = block[i].r;
+						encode_bc4_( channel, out );
+						for( std::size_t i = 0; i < kBlockTexels; ++i )
+							channel[i] = block[i].g;
+						encode_bc4_( channel, out+8 );
+						break;
+				}
+			}
+		}
+
+		return ret;
+	}
+
+	void fetch_block_( Image_ const& aImage, std::uint32_t aBX, std::uint32_t aBY, TextureRole aRole, glm::vec4 (&aBlock)[kBlockTexels] )
+	{
+		// Returns the texels in their stored encoding, scaled to [0, 255].
+		// Blocks that extend past the image repeat the edge texels.
+		for( std::uint32_t j = 0; j < kBlockDim; ++j )
+		{
+			auto const y = std::min( aBY*kBlockDim + j, aImage.height-1 );
+			for( std::uint32_t i = 0; i < kBlockDim; ++i )
+			{
+				auto const x = std::min( aBX*kBlockDim + i, aImage.width-1 );
+				auto const& v = aImage.texels[std::size_t(y)*aImage.width + x];
+
+				glm::vec4 enc = v;
+				switch( aRole )
+				{
+					case TextureRole::color:
+						enc = glm::vec4( linear_to_srgb_( v.r ), linear_to_srgb_( v.g ), linear_to_srgb_( v.b ), v.a );
+						break;
+					case TextureRole::scalar:
+					case TextureRole::packed:
+						break;
+					case TextureRole::normal:
+						enc = glm::vec4( glm::vec3( v ) * 0.5f + 0.5f, 1.f );
+						break;
+				}
+
+				aBlock[j*kBlockDim + i] = glm::clamp( enc, 0.f, 1.f ) * 255.f;
+			}
+		}
+	}
+
+	void encode_bc1_( glm::vec4 const (&aBlock)[kBlockTexels], std::uint8_t* aOut )
+	{
+		// Initial endpoints: extent of the block along its principal axis
+		glm::vec3 mean( 0.f );
+		for( auto const& c : aBlock )
+			mean += glm::vec3( c );
+		mean /= float(kBlockTexels);
+
+		glm::mat3 cov( 0.f );
+		for( auto const& c : aBlock )
+		{
+			auto const d = glm::vec3( c ) - mean;
+			cov += glm::outerProduct( d, d );
+		}
+
+		glm::vec3 axis( 1.f, 1.f, 1.f );
+		for( int i = 0; i < 8; ++i )
+		{
+			auto const next = cov * axis;
+			auto const l = glm::length( next );
+			if( l <= 0.f )
+				break;
+
+			axis = next / l;
+		}
+		axis = glm::normalize( axis );
+
+		float tmin = std::numeric_limits<float>::max(), tmax = -tmin;
+		for( auto const& c : aBlock )
+		{
+			auto const t = glm::dot( glm::vec3( c ) - mean, axis );
+			tmin = std::min( tmin, t );
+			tmax = std::max( tmax, t );
+		}
+
+		auto best = fit_bc1_( aBlock, mean + axis*tmax, mean + axis*tmin );
+
+		// Refine the endpoints for the chosen indices
+		for( int iter = 0; iter < kBc1Refinements && best.c0 != best.c1; ++iter )
+		{
+			static constexpr float kWeights[4] = { 1.f, 0.f, 2.f/3.f, 1.f/3.f };
+
+			float a = 0.f, b = 0.f, c = 0.f;
+			glm::vec3 x0( 0.f ), x1( 0.f );
+			for( std::size_t i = 0; i < kBlockTexels; ++i )
+			{
+				auto const w = kWeights[(best.indices >> (2*i)) & 3];
+				a += w*w;
+				b += w*(1.f-w);
+				c += (1.f-w)*(1.f-w);
+				x0 += w * glm::vec3( aBlock[i] );
+				x1 += (1.f-w) * glm::vec3( aBlock[i] );
+			}
+
+			auto const det = a*c - b*b;
+			if( std::abs( det ) < 1e-6f )
+				break;
+
+			auto const e0 = (c*x0 - b*x1) / det;
+			auto const e1 = (a*x1 - b*x0) / det;
+
+			auto const fit = fit_bc1_( aBlock, e0, e1 );
+			if( fit.error >= best.error )
+				break;
+
+			best = fit;
+		}
+
+		std::memcpy( aOut+0, &best.c0, sizeof(best.c0) );
+		std::memcpy( aOut+2, &best.c1, sizeof(best.c1) );
+		std::memcpy( aOut+4, &best.indices, sizeof(best.indices) );
+	}
+
+	void encode_bc4_( float const (&aValues)[kBlockTexels], std::uint8_t* aOut )
+	{
+		// Eight-value mode (r0 > r1) with the block's extent as endpoints. If
+		// the block is constant, all indices select r0.
+		auto const [mn, mx] = std::minmax_element( std::begin(aValues), std::end(aValues) );
+		auto const r0 = std::uint8_t(std::lround( *mx ));
+		auto const r1 = std::uint8_t(std::lround( *mn ));
+
+		std::uint64_t indices = 0;
+		if( r0 != r1 )
+		{
+			float palette[8] = { float(r0), float(r1) };
+			for( int i = 2; i < 8; ++i )
+				palette[i] = ((8-i)*float(r0) + (i-1)*float(r1)) / 7.f;
+
+			for( std::size_t i = 0; i < kBlockTexels; ++i )
+			{
+				std::uint64_t best = 0;
+				float bestDist = std::numeric_limits<float>::max();
+				for( std::uint64_t k = 0; k < 8; ++k )
+				{
+					auto const d = std::abs( palette[k] - aValues[i] );
+					if( d < bestDist )
+					{
+						bestDist = d;
+						best = k;
+					}
+				}
+
+				indices |= best << (3*i);
+			}
+		}
+
+		aOut[0] = r0;
+		aOut[1] = r1;
+		for( int i = 0; i < 6; ++i )
+			aOut[2+i] = std::uint8_t(indices >> (8*i));
+	}
+
+	Bc1Fit_ fit_bc1_( glm::vec4 const (&aBlock)[kBlockTexels], glm::vec3 aE0, glm::vec3 aE1 )
+	{
+		// Four-color mode requires c0 > c1. Equal endpoints select the
+		// three-color mode, where index 0 is still c0.
+		Bc1Fit_ ret{ pack_565_( aE0 ), pack_565_( aE1 ), 0, 0.f };
+		if( ret.c0 < ret.c1 )
+			std::swap( ret.c0, ret.c1 );
+
+		auto const p0 = unpack_565_( ret.c0 );
+		auto const p1 = unpack_565_( ret.c1 );
+		glm::vec3 const palette[4] = { p0, p1, (2.f*p0 + p1) / 3.f, (p0 + 2.f*p1) / 3.f };
+
+		auto const colors = ret.c0 == ret.c1 ? 1 : 4;
+		for( std::size_t i = 0; i < kBlockTexels; ++i )
+		{
+			std::uint32_t best = 0;
+			float bestDist = std::numeric_limits<float>::max();
+			for( int k = 0; k < colors; ++k )
+			{
+				auto const d = glm::vec3( aBlock[i] ) - palette[k];
+				auto const dist = glm::dot( d, d );
+				if( dist < bestDist )
+				{
+					bestDist = dist;
+					best = std::uint32_t(k);
+				}
+			}
+
+			ret.indices |= best << (2*i);
+			ret.error += bestDist;
+		}
+
+		return ret;
+	}
+
+	std::uint16_t pack_565_( glm::vec3 const& aColor ) noexcept
+	{
+		auto const c = glm::clamp( aColor, 0.f, 255.f ) / 255.f;
+		auto const r = std::uint16_t(std::lround( c.r * 31.f ));
+		auto const g = std::uint16_t(std::lround( c.g * 63.f ));
+		auto const b = std::uint16_t(std::lround( c.b * 31.f ));
+		return std::uint16_t((r << 11) | (g << 5) | b);
+	}
+	glm::vec3 unpack_565_( std::uint16_t aColor ) noexcept
+	{
+		auto const r = (aColor >> 11) & 31;
+		auto const g = (aColor >> 5) & 63;
+		auto const b = aColor & 31;
+		return glm::vec3( (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) );
+	}
+
+	float srgb_to_linear_( float aValue ) noexcept
+	{
+		return aValue <= 0.04045f ? aValue / 12.92f : std::pow( (aValue + 0.055f) / 1.055f, 2.4f );
+	}
+	float linear_to_srgb_( float aValue ) noexcept
+	{
+		return aValue <= 0.0031308f ? aValue * 12.92f : 1.055f * std::pow( aValue, 1.f/2.4f ) - 0.055f;
+	}
+
+	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	{
+		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+
+		if( ret != aBytes )
+			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+	}
+}
@@ -0,0 +1,137 @@
+#ifndef COMPRESS_TEXTURE_HPP_79F2DA2E_D971_4503_BF53_3CD10615CA97
+#define COMPRESS_TEXTURE_HPP_79F2DA2E_D971_4503_BF53_3CD10615CA97
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+
+//--    constants                               ///{{{1///////////////////////
+
+/* Extension of the compressed texture container. See write_compressed_texture()
+ * for the file format.
+ */
+constexpr char kCompressedTextureExtension[] = ".comp5822tex";
+
+//--    types                                   ///{{{1///////////////////////
+
+/* How the texture is used. This determines the block format and how the mip
+ * chain is filtered.
+ *
+ *  - color: sRGB color, optionally with alpha. Filtered in linear space.
+ *  - scalar: a single linear channel (e.g., roughness). Only red is kept.
+ *  - normal: tangent space normal map. Only x and y are kept; the shader
+ *    reconstructs z. Mip levels are renormalized.
+ *  - packed: two linear channels (red and green) from two separate single
+ *    channel images, e.g., roughness and metalness.
+ */
+enum class TextureRole
+{
+	color,
+	scalar,
+	normal,
+	packed
+};
+
+/* Block compressed formats; values are stored in the file. These map directly
+ * to VK_FORMAT_BC1_RGB_SRGB_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK,
+ * VK_FORMAT_BC4_UNORM_BLOCK and VK_FORMAT_BC5_UNORM_BLOCK.
+ */
+enum class TextureFormat : std::uint32_t
+{
+	bc1_srgb = 1,
+	bc3_srgb = 2,
+	bc4_unorm = 3,
+	bc5_unorm = 4
+};
+
+struct CompressedLevel
+{
+	std::uint32_t width, height;
+	std::vector<std::uint8_t> blocks; // row-major 4x4 blocks
+};
+
+struct CompressedTexture
+{
+	TextureFormat format;
+	std::vector<CompressedLevel> levels; // full mip chain, down to 1x1
+};
+
+/* Contents of a texture's source image(s) after decoding. Two textures with
+ * the same role and hash bake to the same output, whatever their paths.
+ */
+struct TextureContents
+{
+	std::uint64_t hash; // decoded RGBA8 texels, size and role
+	std::uint32_t width, height;
+	bool hasAlpha;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Load an image, build its mip chain and compress each level. Color textures
+ * with non-opaque alpha use BC3; opaque ones use BC1. Scalar textures use BC4
+ * and normal maps BC5.
+ *
+ * Like load_image_texture2d() at runtime, the image is flipped vertically.
+ */
+CompressedTexture compress_texture(
+	std::filesystem::path const& aSource,
+	TextureRole
+);
+
+/* As compress_texture(), but takes the red and green channels (TextureRole::
+ * packed) from the first channel of two images, and compresses to BC5. If
+ * the images differ in size, the smaller one is upscaled (nearest neighbour).
+ */
+CompressedTexture compress_packed_texture(
+	std::filesystem::path const& aRed,
+	std::filesystem::path const& aGreen
+);
+
+/* Uncompressed version of compress_packed_texture() for --copy-textures. The
+ * result is an RGB PNG (blue is zero) in the original orientation.
+ */
+void write_packed_image(
+	std::filesystem::path const&,
+	std::filesystem::path const& aRed,
+	std::filesystem::path const& aGreen
+);
+
+/* Decode the source image(s) of a texture and hash their texels. This does
+ * not depend on the file format or name; the same image stored as a PNG and
+ * as a JPEG only matches if it decodes to exactly the same texels.
+ */
+TextureContents texture_contents(
+	std::filesystem::path const& aSource,
+	TextureRole
+);
+TextureContents packed_texture_contents(
+	std::filesystem::path const& aRed,
+	std::filesystem::path const& aGreen
+);
+
+// Block format that compress_texture() uses for a texture
+TextureFormat compressed_texture_format( TextureRole, bool aHasAlpha ) noexcept;
+
+void write_compressed_texture(
+	std::filesystem::path const&,
+	CompressedTexture const&
+);
+
+/* True if aPath holds a texture in the current container version that is not
+ * older than aSource.
+ */
+bool compressed_texture_is_current(
+	std::filesystem::path const& aPath,
+	std::filesystem::path const& aSource
+);
+
+std::size_t texture_block_size( TextureFormat ) noexcept;
+
+#endif // COMPRESS_TEXTURE_HPP_79F2DA2E_D971_4503_BF53_3CD10615CA97
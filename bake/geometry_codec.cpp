@@ -0,0 +1,214 @@
+#include "geometry_codec.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+	constexpr std::uint8_t kPlaneValues = 0;
+	constexpr std::uint8_t kPlaneDeltas = 1;
+
+	void append_( std::vector<std::uint8_t>&, void const*, std::size_t );
+	void append_stored_( std::vector<std::uint8_t>&, std::uint8_t const*, std::size_t );
+
+	std::vector<std::uint32_t> read_column_( std::uint8_t const*, std::size_t aRows, CodecSection const&, std::uint32_t aColumn );
+	std::vector<std::uint32_t> zigzag_deltas_( std::vector<std::uint32_t> const&, std::uint32_t aWordSize );
+
+	std::uint32_t block_bits_( std::uint32_t const*, std::size_t aCount ) noexcept;
+	std::size_t packed_size_( std::vector<std::uint32_t> const& ) noexcept;
+	void append_plane_( std::vector<std::uint8_t>&, std::uint8_t aMode, std::vector<std::uint32_t> const& );
+}
+
+std::vector<std::uint8_t> encode_geometry_chunk( std::vector<std::uint8_t> const& aData, std::vector<CodecSection> const& aSections )
+{
+	std::vector<std::uint8_t> ret;
+
+	std::uint32_t sectionCount = 0;
+	append_( ret, &sectionCount, sizeof(sectionCount) );
+
+	std::size_t offset = 0;
+	for( auto const& section : aSections )
+	{
+		assert( section.offset >= offset && section.offset + section.size <= aData.size() );
+		assert( 2 == section.wordSize || 4 == section.wordSize );
+		assert( section.wordsPerRow > 0 && section.wordsPerRow < 256 );
+		assert( 0 == section.size % (section.wordSize*section.wordsPerRow) );
+
+		if( section.offset > offset )
+		{
+			append_stored_( ret, aData.data() + offset, section.offset - offset );
+			++sectionCount;
+		}
+
+		if( 0 == section.size )
+		{
+			offset = section.offset;
+			continue;
+		}
+
+		std::uint8_t const header[4] = { std::uint8_t(section.wordSize), std::uint8_t(section.wordsPerRow), 0, 0 };
+		append_( ret, header, sizeof(header) );
+
+		std::uint32_t const size = std::uint32_t(section.size);
+		append_( ret, &size, sizeof(size) );
+
+		auto const rows = section.size / (section.wordSize*section.wordsPerRow);
+		for( std::uint32_t column = 0; column < section.wordsPerRow; ++column )
+		{
+			auto const values = read_column_( aData.data() + section.offset, rows, section, column );
+			auto const deltas = zigzag_deltas_( values, section.wordSize );
+
+			if( packed_size_( deltas ) < packed_size_( values ) )
+				append_plane_( ret, kPlaneDeltas, deltas );
+			else
+				append_plane_( ret, kPlaneValues, values );
+		}
+
+		++sectionCount;
+		offset = section.offset + section.size;
+	}
+
+	if( offset < aData.size() )
+	{
+		append_stored_( ret, aData.data() + offset, aData.size() - offset );
+		++sectionCount;
+	}
+
+	std::memcpy( ret.data(), &sectionCount, sizeof(sectionCount) );
+	return ret;
+}
+
+namespace
+{
+	void append_( std::vector<std::uint8_t>& aOut, void const* aData, std::size_t aBytes )
+	{
+		auto const* bytes = static_cast<std::uint8_t const*>(aData);
+		aOut.insert( aOut.end(), bytes, bytes + aBytes );
+	}
+
+	void append_stored_( std::vector<std::uint8_t>& aOut, std::uint8_t const* aData, std::size_t aBytes )
+	{
+		std::uint8_t const header[4] = { 0, 0, 0, 0 };
+		append_( aOut, header, sizeof(header) );
+
+		std::uint32_t const size = std::uint32_t(aBytes);
+		append_( aOut, &size, sizeof(size) );
+
+		append_( aOut, aData, aBytes );
+	}
+
+	std::vector<std::uint32_t> read_column_( std::uint8_t const* aData, std::size_t aRows, CodecSection const& aSection, std::uint32_t aColumn )
+	{
+		std::vector<std::uint32_t> ret( aRows );
+
+		auto const stride = aSection.wordSize * aSection.wordsPerRow;
+		auto const* src = aData + aColumn*aSection.wordSize;
+
+		for( std::size_t i = 0; i < aRows; ++i, src += stride )
+		{
+			if( 2 == aSection.wordSize )
+			{
+				std::uint16_t word;
+				std::memcpy( &word, src, sizeof(word) );
+				ret[i] = word;
+			}
+			else
+			{
+				std::memcpy( &ret[i], src, sizeof(std::uint32_t) );
+			}
+		}
+
+		return ret;
+	}
+
+	std::vector<std::uint32_t> zigzag_deltas_( std::vector<std::uint32_t> const& aValues, std::uint32_t aWordSize )
+	{
+		// Deltas wrap around at the word size. The decoder adds the
+		// sign-extended deltas with 32-bit arithmetic and truncates, which
+		// gives the same result.
+		std::vector<std::uint32_t> ret( aValues.size() );
+
+		std::uint32_t prev = 0;
+		for( std::size_t i = 0; i < aValues.size(); ++i )
+		{
+			std::int32_t delta = std::int32_t(aValues[i] - prev);
+			if( 2 == aWordSize )
+				delta = std::int16_t(std::uint16_t(aValues[i] - prev));
+
+			ret[i] = (std::uint32_t(delta) << 1) ^ std::uint32_t(delta >> 31);
+			prev = aValues[i];
+		}
+
+		return ret;
+	}
+
+	std::uint32_t block_bits_( std::uint32_t const* aValues, std::size_t aCount ) noexcept
+	{
+		std::uint32_t acc = 0;
+		for( std::size_t i = 0; i < aCount; ++i )
+			acc |= aValues[i];
+
+		std::uint32_t bits = 0;
+		for( ; acc; acc >>= 1 )
+			++bits;
+
+		return bits;
+	}
+
+	std::size_t packed_size_( std::vector<std::uint32_t> const& aValues ) noexcept
+	{
+		std::size_t ret = 0;
+		for( std::size_t i = 0; i < aValues.size(); i += kCodecBlockValues )
+		{
+			auto const count = std::min( kCodecBlockValues, aValues.size() - i );
+			ret += 1 + 16*block_bits_( aValues.data() + i, count );
+		}
+
+		return ret;
+	}
+
+	void append_plane_( std::vector<std::uint8_t>& aOut, std::uint8_t aMode, std::vector<std::uint32_t> const& aValues )
+	{
+		append_( aOut, &aMode, sizeof(aMode) );
+
+		auto const blocks = (aValues.size() + kCodecBlockValues-1) / kCodecBlockValues;
+
+		std::vector<std::uint32_t> widths( blocks );
+		for( std::size_t b = 0; b < blocks; ++b )
+		{
+			auto const first = b*kCodecBlockValues;
+			widths[b] = block_bits_( aValues.data() + first, std::min( kCodecBlockValues, aValues.size() - first ) );
+
+			std::uint8_t const width = std::uint8_t(widths[b]);
+			append_( aOut, &width, sizeof(width) );
+		}
+
+		for( std::size_t b = 0; b < blocks; ++b )
+		{
+			auto const bits = widths[b];
+
+			// 32 values per lane, 4 lanes. Lane l holds values l, l+4, l+8,
+			// ... packed from the least significant bit of its words up.
+			// The last block is padded with zeros.
+			std::uint32_t words[32][4] = {};
+			for( std::size_t i = 0; i < kCodecBlockValues && bits > 0; ++i )
+			{
+				auto const index = b*kCodecBlockValues + i;
+				std::uint64_t const value = index < aValues.size() ? aValues[index] : 0;
+
+				auto const lane = i % 4;
+				auto const bit = (i / 4) * bits;
+				auto const word = bit / 32, shift = bit % 32;
+
+				auto const shifted = value << shift;
+				words[word][lane] |= std::uint32_t(shifted);
+				if( shift + bits > 32 )
+					words[word+1][lane] |= std::uint32_t(shifted >> 32);
+			}
+
+			append_( aOut, words, 16*bits );
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef GEOMETRY_CODEC_HPP_4C0E8B1F_6A2D_4D7E_9B35_E1F07A6C2D94
+#define GEOMETRY_CODEC_HPP_4C0E8B1F_6A2D_4D7E_9B35_E1F07A6C2D94
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+
+//--    constants                               ///{{{1///////////////////////
+
+/* Values are packed in blocks of this many values. Each block uses a single
+ * bit width and occupies 16*width bytes.
+ */
+constexpr std::size_t kCodecBlockValues = 128;
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Part of a chunk that holds an array of rows of 16- or 32-bit words, e.g.,
+ * an u16vec4 position stream (wordSize = 2, wordsPerRow = 4) or an index
+ * buffer (wordsPerRow = 1). Bytes not covered by a section are stored as-is.
+ */
+struct CodecSection
+{
+	std::size_t offset, size; // in bytes
+	std::uint32_t wordSize;
+	std::uint32_t wordsPerRow;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Encode a chunk with the geometry codec. Each column of a section (e.g.,
+ * the x coordinates of the positions) is split into its own plane. A plane
+ * is optionally delta encoded along the rows (deltas are zigzag encoded,
+ * i.e., the sign moves to the lowest bit), whichever is smaller, and then
+ * bit-packed in blocks of kCodecBlockValues values.
+ *
+ * The bit-packed layout follows SIMD-BP128: value i of a block is stored in
+ * 32-bit lane i%4, so that the decoder extracts four values per SSE
+ * instruction.
+ *
+ * Format:
+ *  - uint32_t: S = number of sections
+ *  - repeat S times:
+ *    - uint8_t: word size (2 or 4; 0 = bytes stored as-is)
+ *    - uint8_t: K = words per row (0 for stored bytes)
+ *    - 2*uint8_t: zero
+ *    - uint32_t: size of the section in bytes, decoded
+ *    - stored bytes: the bytes
+ *    - otherwise, repeat K times (one plane per column):
+ *      - uint8_t: 0 = values, 1 = zigzag deltas
+ *      - repeat B times (B = number of blocks): uint8_t bit width
+ *      - repeat B times: 16*width bytes of bit-packed values
+ *
+ * The sections must not overlap and must be sorted by offset.
+ */
+std::vector<std::uint8_t> encode_geometry_chunk(
+	std::vector<std::uint8_t> const&,
+	std::vector<CodecSection> const&
+);
+
+#endif // GEOMETRY_CODEC_HPP_4C0E8B1F_6A2D_4D7E_9B35_E1F07A6C2D94
@@ -1,18 +1,48 @@
 #include "index_mesh.hpp"
 
+#include <limits>
 #include <numeric>
-#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <memory_resource>
 
+#include <cassert>
 #include <cstddef>
+#include <cstring>
 
 #include <glm/glm.hpp>
 
+#if defined(__AVX__)
+#	include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#endif
+
+#include "thread_pool.hpp"
+
 namespace
 {
 	// Tweakables
 	constexpr float kAABBMarginFactor = 10.f;
 	constexpr std::size_t kSparseGridMaxSize = 1024*1024;
 
+	// Number of vertices per task when welding a single mesh in parallel
+	constexpr std::size_t kParallelChunkSize = 16*1024;
+
+	// Initial size of the scratch arena. The per-vertex scratch (packed
+	// vertex, cell key, two radix sort buffers, cell index, collapse map and
+	// vertex mapping) adds up to at most 96 bytes; the base covers the radix
+	// histograms and alignment.
+	constexpr std::size_t kScratchBytesPerVertex = 96;
+	constexpr std::size_t kScratchBaseBytes = 64*1024;
+
+	constexpr std::uint32_t kNotCollapsed = ~std::uint32_t(0);
+
+	// Scratch arrays are allocated from a per-call arena (a monotonic buffer
+	// resource). They are released all at once when the arena goes away.
+	template< typename tType >
+	using Scratch_ = std::pmr::vector<tType>;
+
 	// Discretize mesh positions
 	struct DiscretizedPosition_
 	{
@@ -28,39 +58,87 @@ namespace
 		float scale;
 	};
 
-	// hash discretized mesh positions
-	using VicinityKey_ = std::size_t;
-	inline VicinityKey_ hash_discretized_position_( DiscretizedPosition_ const& aPos );
+	// Grid cell keys. The three discretized coordinates are offset by one
+	// (so that the neighbours of cell zero remain representable) and packed
+	// into 21 bits each. Z occupies the lowest bits, so the cells (x,y,z-1),
+	// (x,y,z) and (x,y,z+1) have consecutive keys.
+	using CellKey_ = std::uint64_t;
 
-	// generate vicinity map 
-	using VicinityMap_ = std::unordered_multimap<VicinityKey_,std::size_t>;
-	void build_vicinity_map_( 
-		VicinityMap_&, 
-		Discretizer_ const&,
-		std::vector<glm::vec3> const&
-	);
+	constexpr unsigned kCellKeyBits = 21;
+	static_assert( (std::size_t(1)<<kCellKeyBits) > kSparseGridMaxSize+2 );
+
+	inline CellKey_ cell_key_( DiscretizedPosition_ const& );
+
+	// Radix sort of (key, index) pairs. The sort is stable, so indices with
+	// identical keys remain in ascending order.
+	struct KeyIndex_
+	{
+		std::uint64_t key;
+		std::uint32_t index;
+	};
+
+	void radix_sort_( Scratch_<KeyIndex_>& );
+
+	// Flat spatial index: unique cell keys in sorted order, with the vertices
+	// of each cell stored contiguously.
+	struct CellIndex_
+	{
+		explicit CellIndex_( std::pmr::memory_resource* );
+
+		Scratch_<CellKey_> keys;
+		Scratch_<std::uint32_t> start; // keys.size()+1 entries
+		Scratch_<std::uint32_t> items;
+	};
+
+	void build_cell_index_( CellIndex_&, Scratch_<CellKey_> const& aVertexKeys );
+
+	template< typename tFunc >
+	void for_each_neighbour_( CellIndex_ const&, CellKey_, tFunc&& );
+
+	// Vertex attributes packed into 32 bytes: position, normal and texture
+	// coordinate. Normals are zero if the soup doesn't have any.
+	struct alignas(32) PackedVertex_
+	{
+		float v[8];
+	};
+
+	Scratch_<PackedVertex_> pack_vertices_( VertexAttributeViews const&, std::pmr::memory_resource* );
 
 	// is a vertex mergable?
-	bool mergable_( 
-		TriangleSoup const&, 
-		std::size_t aVertexAIndex, std::size_t aVertexBIndex,
-		glm::vec3 const& aVertexAPos, glm::vec3 const& aVertexBPos,
+	inline bool mergable_( 
+		PackedVertex_ const&,
+		PackedVertex_ const&,
 		float
 	);
 
 	// collapse vertices
-	using VertexMapping_ = std::vector<std::size_t>;
+	using VertexMapping_ = Scratch_<std::uint32_t>;
 	using IndexBuffer_ = std::vector<std::uint32_t>;
 
 	std::size_t collapse_vertices_( 
 		IndexBuffer_&, 
 		VertexMapping_&, 
-		VicinityMap_ const&, 
-		Discretizer_ const&, 
-		TriangleSoup const&, 
+		CellIndex_ const&, 
+		Scratch_<CellKey_> const&,
+		Scratch_<PackedVertex_> const&,
 		float
 	);
+	std::size_t collapse_vertices_parallel_( 
+		IndexBuffer_&, 
+		VertexMapping_&, 
+		CellIndex_ const&, 
+		Scratch_<CellKey_> const&,
+		Scratch_<PackedVertex_> const&,
+		float,
+		ThreadPool&
+	);
 
+	// collapse bitwise identical vertices (aErrorTolerance == 0)
+	std::size_t collapse_identical_(
+		IndexBuffer_&,
+		VertexMapping_&,
+		Scratch_<PackedVertex_> const&
+	);
 }
 
 //--    IndexedMesh                     ///{{{2///////////////////////////////
@@ -69,9 +147,24 @@ IndexedMesh::IndexedMesh()
 	, aabbMax( std::numeric_limits<float>::min() )
 {}
 
+//--    attribute_views()               ///{{{2///////////////////////////////
+VertexAttributeViews attribute_views( TriangleSoup const& aSoup )
+{
+	return VertexAttributeViews{ aSoup.vert, aSoup.norm, aSoup.text };
+}
+VertexAttributeViews attribute_views( IndexedMesh const& aMesh )
+{
+	return VertexAttributeViews{ aMesh.vert, aMesh.norm, aMesh.text };
+}
+
 //--    make_indexed_mesh()             ///{{{2///////////////////////////////
-IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance )
+IndexedMesh make_indexed_mesh( VertexAttributeViews const& aSoup, float aErrorTolerance, ThreadPool* aPool )
 {
+	assert( aSoup.text.size() == aSoup.vert.size() );
+	assert( aSoup.norm.empty() || aSoup.norm.size() == aSoup.vert.size() );
+
+	std::pmr::monotonic_buffer_resource arena( kScratchBaseBytes + kScratchBytesPerVertex*aSoup.vert.size() );
+
 	// compute bounding volume
 	glm::vec3 bmin( std::numeric_limits<float>::max() );
 	glm::vec3 bmax( std::numeric_limits<float>::min() );
@@ -82,28 +175,46 @@ IndexedMesh make_indexed_mesh( TriangleSoup const& aSoup, float aErrorTolerance
 		bmax = max( bmax, aSoup.vert[vert] );
 	}
 
-	auto const fmin = bmin - glm::vec3( kAABBMarginFactor * aErrorTolerance );
-	auto const fmax = bmax + glm::vec3( kAABBMarginFactor * aErrorTolerance );
+	auto const packed = pack_vertices_( aSoup, &arena );
 
-	// Compute grid size
-	auto const side = fmax - fmin;
-	float const maxSide = std::max( side.x, std::max( side.y, side.z ) );
+	// collapse vertices
+	IndexBuffer_ indices;
+	VertexMapping_ vertexMapping( &arena );
 
-	float const numCells = maxSide / (2.f*aErrorTolerance);
-	std::size_t subdiv = std::min( kSparseGridMaxSize, std::size_t(numCells+.5f) );
+	std::size_t verts;
+	if( aErrorTolerance <= 0.f )
+	{
+		// Exact matches only; no need for a spatial index.
+		verts = collapse_identical_( indices, vertexMapping, packed );
+	}
+	else
+	{
+		auto const fmin = bmin - glm::vec3( kAABBMarginFactor * aErrorTolerance );
+		auto const fmax = bmax + glm::vec3( kAABBMarginFactor * aErrorTolerance );
 
-	// parameters for discretization
-	Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
+		// Compute grid size
+		auto const side = fmax - fmin;
+		float const maxSide = std::max( side.x, std::max( side.y, side.z ) );
 
-	// build the vincinity map
-	VicinityMap_ vincinityMap;
-	build_vicinity_map_( vincinityMap, dis, aSoup.vert );
+		float const numCells = maxSide / (2.f*aErrorTolerance);
+		std::size_t subdiv = std::min( kSparseGridMaxSize, std::size_t(numCells+.5f) );
 
-	// collapse vertices
-	IndexBuffer_ indices;
-	VertexMapping_ vertexMapping;
+		// parameters for discretization
+		Discretizer_ dis( std::uint32_t(subdiv), fmin, maxSide );
 
-	size_t verts = collapse_vertices_( indices, vertexMapping, vincinityMap, dis, aSoup, aErrorTolerance );
+		// build the spatial index
+		Scratch_<CellKey_> vertexKeys( aSoup.vert.size(), &arena );
+		for( std::size_t i = 0; i < aSoup.vert.size(); ++i )
+			vertexKeys[i] = cell_key_( dis.discretize( aSoup.vert[i] ) );
+
+		CellIndex_ cells( &arena );
+		build_cell_index_( cells, vertexKeys );
+
+		if( aPool && aPool->thread_count() > 1 && aSoup.vert.size() > kParallelChunkSize )
+			verts = collapse_vertices_parallel_( indices, vertexMapping, cells, vertexKeys, packed, aErrorTolerance, *aPool );
+		else
+			verts = collapse_vertices_( indices, vertexMapping, cells, vertexKeys, packed, aErrorTolerance );
+	}
 
 	assert( indices.size() == aSoup.vert.size() );
 	assert( verts == vertexMapping.size() );
@@ -204,177 +315,421 @@ namespace
 
 namespace
 {
-	std::hash<VicinityKey_> gHash_;
-
-	inline VicinityKey_ hash_discretized_position_( DiscretizedPosition_ const& aDP )
+	inline CellKey_ cell_key_( DiscretizedPosition_ const& aDP )
 	{
-		// Based on boost::hash_combine.
-		std::size_t hash = gHash_(aDP.x);
-		hash ^= gHash_(aDP.y) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-		hash ^= gHash_(aDP.z) + 0x9e3779b9 + (hash<<6) + (hash>>2);
-		return hash;
+		assert( aDP.x >= 0 && std::size_t(aDP.x) <= kSparseGridMaxSize );
+		assert( aDP.y >= 0 && std::size_t(aDP.y) <= kSparseGridMaxSize );
+		assert( aDP.z >= 0 && std::size_t(aDP.z) <= kSparseGridMaxSize );
+
+		return (CellKey_(aDP.x+1) << (2*kCellKeyBits))
+			| (CellKey_(aDP.y+1) << kCellKeyBits)
+			| CellKey_(aDP.z+1)
+		;
 	}
 }
 
 namespace
 {
-	void build_vicinity_map_( VicinityMap_& aMap, Discretizer_ const& aD, std::vector<glm::vec3> const& aPositions )
+	CellIndex_::CellIndex_( std::pmr::memory_resource* aArena )
+		: keys( aArena )
+		, start( aArena )
+		, items( aArena )
+	{}
+
+	void radix_sort_( Scratch_<KeyIndex_>& aItems )
 	{
-		for( std::size_t index = 0; index < aPositions.size(); ++index )
+		constexpr std::size_t kDigits = sizeof(std::uint64_t);
+
+		// Histogram all digits in a single pass
+		Scratch_<std::size_t> counts( kDigits*256, 0, aItems.get_allocator() );
+		for( auto const& item : aItems )
 		{
-			DiscretizedPosition_ dp = aD.discretize( aPositions[index] );
-			VicinityKey_ vk = hash_discretized_position_( dp );
+			for( std::size_t d = 0; d < kDigits; ++d )
+				++counts[d*256 + ((item.key >> (8*d)) & 0xff)];
+		}
+
+		Scratch_<KeyIndex_> scratch( aItems.size(), aItems.get_allocator() );
+		for( std::size_t d = 0; d < kDigits; ++d )
+		{
+			auto* count = counts.data() + d*256;
+
+			// All keys share this digit? Then this pass wouldn't move anything.
+			if( aItems.size() == count[(aItems.front().key >> (8*d)) & 0xff] )
+				continue;
+
+			std::size_t offset = 0;
+			for( std::size_t b = 0; b < 256; ++b )
+				offset += std::exchange( count[b], offset );
+
+			for( auto const& item : aItems )
+				scratch[count[(item.key >> (8*d)) & 0xff]++] = item;
 
-			aMap.insert( std::make_pair(vk, index) );
+			aItems.swap( scratch );
 		}
 	}
-}
 
-namespace
-{
-	bool mergable_( TriangleSoup const& aSoup, size_t aI, size_t aJ, glm::vec3 const& aIPos, glm::vec3 const& aJPos, float aErrorTolerance )
+	void build_cell_index_( CellIndex_& aIndex, Scratch_<CellKey_> const& aVertexKeys )
 	{
-		// Compare all elements component-wise. 
-		// start with positions, since we've already got those
-		for( std::size_t i = 0; i < 3; ++i )
+		Scratch_<KeyIndex_> sorted( aVertexKeys.size(), aVertexKeys.get_allocator() );
+		for( std::size_t i = 0; i < aVertexKeys.size(); ++i )
+			sorted[i] = KeyIndex_{ aVertexKeys[i], std::uint32_t(i) };
+
+		if( !sorted.empty() )
+			radix_sort_( sorted );
+
+		// Count the cells first. Growing the arrays would leave the old
+		// buffers behind in the arena.
+		std::size_t cellCount = 0;
+		for( std::size_t i = 0; i < sorted.size(); ++i )
 		{
-			if( std::abs(aIPos[i]-aJPos[i]) > aErrorTolerance )
-				return false;
+			if( 0 == i || sorted[i-1].key != sorted[i].key )
+				++cellCount;
 		}
 
-		// Compare normals
-		if( !aSoup.norm.empty() )
+		aIndex.keys.clear();
+		aIndex.keys.reserve( cellCount );
+		aIndex.start.clear();
+		aIndex.start.reserve( cellCount+1 );
+		aIndex.items.resize( sorted.size() );
+
+		for( std::size_t i = 0; i < sorted.size(); ++i )
 		{
-			auto const nI = aSoup.norm[aI];
-			auto const nJ = aSoup.norm[aJ];
-			for( size_t i = 0; i < 3; ++i )
+			if( aIndex.keys.empty() || aIndex.keys.back() != sorted[i].key )
 			{
-				if( std::abs(nI[i]-nJ[i]) > aErrorTolerance )
-					return false;
+				aIndex.keys.emplace_back( sorted[i].key );
+				aIndex.start.emplace_back( std::uint32_t(i) );
 			}
+
+			aIndex.items[i] = sorted[i].index;
 		}
 
-		// Compare tex coord
-		auto const tI = aSoup.text[aI];
-		auto const tJ = aSoup.text[aJ];
-		for( std::size_t i = 0; i < 2; ++i )
+		aIndex.start.emplace_back( std::uint32_t(sorted.size()) );
+	}
+
+	template< typename tFunc >
+	void for_each_neighbour_( CellIndex_ const& aIndex, CellKey_ aKey, tFunc&& aFunc )
+	{
+		// Visit the 3x3x3 neighbourhood. For each (dx,dy), the three cells
+		// along z are adjacent in the sorted key list, so a single search
+		// suffices.
+		constexpr CellKey_ kStepX = CellKey_(1) << (2*kCellKeyBits);
+		constexpr CellKey_ kStepY = CellKey_(1) << kCellKeyBits;
+
+		auto const beg = aIndex.keys.begin();
+		auto const end = aIndex.keys.end();
+
+		for( int dx = -1; dx <= 1; ++dx )
 		{
-			if( std::abs(tI[i]-tJ[i]) > aErrorTolerance )
-				return false;
+			for( int dy = -1; dy <= 1; ++dy )
+			{
+				// Unsigned wrap-around is fine; the offset coordinates never
+				// underflow.
+				CellKey_ const base = aKey + dx*kStepX + dy*kStepY;
+
+				for( auto it = std::lower_bound( beg, end, base-1 ); it != end && *it <= base+1; ++it )
+				{
+					auto const cell = std::size_t(it - beg);
+					for( auto i = aIndex.start[cell]; i < aIndex.start[cell+1]; ++i )
+						aFunc( aIndex.items[i] );
+				}
+			}
 		}
-	
-		return true;
 	}
 }
 
 namespace
 {
-	// neighbours
-	const size_t kNeighbourCount_ = 27;
-
-	DiscretizedPosition_ neighbour_( DiscretizedPosition_ const& aDP, std::size_t aJ )
+	Scratch_<PackedVertex_> pack_vertices_( VertexAttributeViews const& aSoup, std::pmr::memory_resource* aArena )
 	{
-		static constexpr std::int32_t offset[kNeighbourCount_][3] = {
-			{ 0, 0, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
-			{ 0, 1, 0 }, { 0, 1, 1 }, { 0, 1, -1 },
-			{ 0, -1, 0 }, { 0, -1, 1 }, { 0, -1, -1 },
-
-			{ 1, 0, 0 }, { 1, 0, 1 }, { 1, 0, -1 },
-			{ 1, 1, 0 }, { 1, 1, 1 }, { 1, 1, -1 },
-			{ 1, -1, 0 }, { 1, -1, 1 }, { 1, -1, -1 },
-
-			{ -1, 0, 0 }, { -1, 0, 1 }, { -1, 0, -1 },
-			{ -1, 1, 0 }, { -1, 1, 1 }, { -1, 1, -1 },
-			{ -1, -1, 0 }, { -1, -1, 1 }, { -1, -1, -1 },
-		};
+		Scratch_<PackedVertex_> ret( aSoup.vert.size(), aArena );
+
+		for( std::size_t i = 0; i < aSoup.vert.size(); ++i )
+		{
+			auto& v = ret[i].v;
+
+			v[0] = aSoup.vert[i].x;
+			v[1] = aSoup.vert[i].y;
+			v[2] = aSoup.vert[i].z;
+
+			if( !aSoup.norm.empty() )
+			{
+				v[3] = aSoup.norm[i].x;
+				v[4] = aSoup.norm[i].y;
+				v[5] = aSoup.norm[i].z;
+			}
+			else
+			{
+				v[3] = v[4] = v[5] = 0.f;
+			}
+
+			v[6] = aSoup.text[i].x;
+			v[7] = aSoup.text[i].y;
+		}
 
-		assert( aJ < kNeighbourCount_ );
-		
-		DiscretizedPosition_ ret = aDP;
-		ret.x += offset[aJ][0];
-		ret.y += offset[aJ][1];
-		ret.z += offset[aJ][2];
 		return ret;
 	}
 
+	inline
+	bool mergable_( PackedVertex_ const& aI, PackedVertex_ const& aJ, float aErrorTolerance )
+	{
+		// Compare all elements component-wise: |a-b| > tolerance rejects. Like
+		// the scalar version, NaN differences do not reject.
+#		if defined(__AVX__)
+		__m256 const sign = _mm256_set1_ps( -0.f );
+		__m256 const tol = _mm256_set1_ps( aErrorTolerance );
+
+		__m256 const d = _mm256_andnot_ps( sign, _mm256_sub_ps( _mm256_load_ps( aI.v ), _mm256_load_ps( aJ.v ) ) );
+		return 0 == _mm256_movemask_ps( _mm256_cmp_ps( d, tol, _CMP_GT_OQ ) );
+#		elif defined(__SSE2__) || defined(_M_X64)
+		__m128 const sign = _mm_set1_ps( -0.f );
+		__m128 const tol = _mm_set1_ps( aErrorTolerance );
+
+		__m128 const d0 = _mm_andnot_ps( sign, _mm_sub_ps( _mm_load_ps( aI.v+0 ), _mm_load_ps( aJ.v+0 ) ) );
+		__m128 const d1 = _mm_andnot_ps( sign, _mm_sub_ps( _mm_load_ps( aI.v+4 ), _mm_load_ps( aJ.v+4 ) ) );
+		return 0 == _mm_movemask_ps( _mm_or_ps( _mm_cmpgt_ps( d0, tol ), _mm_cmpgt_ps( d1, tol ) ) );
+#		else
+		for( std::size_t i = 0; i < 8; ++i )
+		{
+			if( std::abs(aI.v[i]-aJ.v[i]) > aErrorTolerance )
+				return false;
+		}
+
+		return true;
+#		endif
+	}
+}
+
+namespace
+{
 	// Merge vertices
-	size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, VicinityMap_ const& aVM, Discretizer_ const& aD, TriangleSoup const& aSoup, float aMaxError )
+	//
+	// Vertices are visited in order. A vertex that hasn't been merged yet
+	// starts a new output vertex, and absorbs all unmerged vertices in its
+	// neighbourhood that are within the error tolerance. (Any such vertex
+	// necessarily comes later in the soup.)
+	std::size_t collapse_vertices_( IndexBuffer_& aIndices, VertexMapping_& aVertices, CellIndex_ const& aCells, Scratch_<CellKey_> const& aKeys, Scratch_<PackedVertex_> const& aPacked, float aMaxError )
 	{
+		auto const count = aPacked.size();
+
 		aVertices.clear();
-		aVertices.reserve( aSoup.vert.size() );
+		aVertices.reserve( count );
 
 		aIndices.clear();
-		aIndices.reserve( aSoup.vert.size() );
+		aIndices.reserve( count );
 
-		// initialize collapse map
-		VertexMapping_ collapseMap( aSoup.vert.size() );
-		std::fill( collapseMap.begin(), collapseMap.end(), ~std::size_t(0) );
+		Scratch_<std::uint32_t> collapseMap( count, kNotCollapsed, aVertices.get_allocator() );
 
-		// process vertices
-		std::size_t nextVertex = 0;
-		for( std::size_t i = 0; i < aSoup.vert.size(); ++i )
+		std::uint32_t nextVertex = 0;
+		for( std::size_t i = 0; i < count; ++i )
 		{
 			// check if this vertex already was merged somewhere
-			if( ~size_t(0) != collapseMap[i] )
+			if( kNotCollapsed != collapseMap[i] )
 			{
-				assert( collapseMap[i] < aVertices.size() );
-				aIndices.push_back( std::uint32_t(collapseMap[i]) );
+				aIndices.push_back( collapseMap[i] );
 				continue;
 			}
 
-			// get position and look for possible neighbours
-			auto const self = aSoup.vert[i];
-			DiscretizedPosition_ const dp = aD.discretize( self );
+			auto const toWhere = nextVertex++;
+
+			collapseMap[i] = toWhere;
+			aVertices.push_back( std::uint32_t(i) );
+			aIndices.push_back( toWhere );
+
+			auto const& self = aPacked[i];
+			for_each_neighbour_( aCells, aKeys[i], [&] (std::uint32_t aJ) {
+				if( kNotCollapsed != collapseMap[aJ] ) return; // don't remerge (or merge with self)
+
+				if( mergable_( self, aPacked[aJ], aMaxError ) )
+					collapseMap[aJ] = toWhere;
+			} );
+		}
+
+		return nextVertex;
+	}
+
+	// Merge vertices, in parallel
+	//
+	// Same result as collapse_vertices_(). The expensive part, finding the
+	// mergable pairs (i,j) with j > i, is done in parallel over chunks of
+	// vertices. The greedy assignment is then replayed serially over the
+	// pairs, in chunk order.
+	//
+	// The arena isn't thread safe, so the per-chunk pair lists use the
+	// regular heap.
+	std::size_t collapse_vertices_parallel_( IndexBuffer_& aIndices, VertexMapping_& aVertices, CellIndex_ const& aCells, Scratch_<CellKey_> const& aKeys, Scratch_<PackedVertex_> const& aPacked, float aMaxError, ThreadPool& aPool )
+	{
+		auto const count = aPacked.size();
+		auto const chunks = (count + kParallelChunkSize-1) / kParallelChunkSize;
+
+		std::vector<std::vector<std::uint32_t>> pairs( chunks );
+
+		std::vector<std::size_t> order( chunks );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+
+		parallel_for_order( aPool, order, [&] (std::size_t aChunk) {
+			auto& out = pairs[aChunk];
+
+			auto const beg = aChunk * kParallelChunkSize;
+			auto const end = std::min( count, beg + kParallelChunkSize );
+
+			for( std::size_t i = beg; i < end; ++i )
+			{
+				auto const& self = aPacked[i];
+				for_each_neighbour_( aCells, aKeys[i], [&] (std::uint32_t aJ) {
+					if( aJ <= i ) return;
+
+					if( mergable_( self, aPacked[aJ], aMaxError ) )
+					{
+						out.push_back( std::uint32_t(i) );
+						out.push_back( aJ );
+					}
+				} );
+			}
+		} );
+
+		// Replay
+		aVertices.clear();
+		aVertices.reserve( count );
+
+		aIndices.clear();
+		aIndices.reserve( count );
+
+		Scratch_<std::uint32_t> collapseMap( count, kNotCollapsed, aVertices.get_allocator() );
+
+		std::uint32_t nextVertex = 0;
+		for( std::size_t chunk = 0; chunk < chunks; ++chunk )
+		{
+			auto const& cpairs = pairs[chunk];
+			std::size_t pair = 0;
 
-			bool merged = false;
-			std::size_t target = ~std::size_t(0);
+			auto const beg = chunk * kParallelChunkSize;
+			auto const end = std::min( count, beg + kParallelChunkSize );
 
-			for( std::size_t j = 0; j < kNeighbourCount_; ++j )
+			for( std::size_t i = beg; i < end; ++i )
 			{
-				DiscretizedPosition_ const dq = neighbour_( dp, j );
-				VicinityKey_ const vk = hash_discretized_position_( dq );
+				bool const isNew = kNotCollapsed == collapseMap[i];
+				if( isNew )
+				{
+					collapseMap[i] = nextVertex++;
+					aVertices.push_back( std::uint32_t(i) );
+				}
+
+				auto const toWhere = collapseMap[i];
+				aIndices.push_back( toWhere );
 
-				// get vertices in this bucket
-				for( auto [it, jt] = aVM.equal_range( vk ); it != jt; ++it )
+				for( ; pair < cpairs.size() && cpairs[pair] == i; pair += 2 )
 				{
-					std::size_t const idx =  it->second;
+					auto const j = cpairs[pair+1];
+					if( isNew && kNotCollapsed == collapseMap[j] )
+						collapseMap[j] = toWhere;
+				}
+			}
+
+			assert( pair == cpairs.size() );
+		}
+
+		return nextVertex;
+	}
+}
 
-					if( idx == i ) continue; // don't try to merge with self
-					if( ~std::size_t(0) != collapseMap[idx] ) continue; // don't remerge
+namespace
+{
+	// Merge identical vertices
+	//
+	// Vertices are grouped by a hash of their attributes with a radix sort;
+	// within each group, exact comparisons pick the first occurrence of each
+	// distinct vertex. Vertices with NaN attributes are never merged. The
+	// sign of zero is ignored, matching a (a == b) comparison.
+	std::size_t collapse_identical_( IndexBuffer_& aIndices, VertexMapping_& aVertices, Scratch_<PackedVertex_> const& aPacked )
+	{
+		auto const count = aPacked.size();
+
+		auto const bits_ = [&] (std::size_t aI, std::size_t aJ) {
+			float const f = aPacked[aI].v[aJ] + 0.f; // -0 => +0
+			std::uint32_t u;
+			std::memcpy( &u, &f, sizeof(u) );
+			return u;
+		};
+
+		Scratch_<KeyIndex_> sorted( aVertices.get_allocator() );
+		sorted.reserve( count );
+
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			bool hasNaN = false;
+			std::uint64_t hash = 0;
+			for( std::size_t j = 0; j < 8; ++j )
+			{
+				hasNaN = hasNaN || aPacked[i].v[j] != aPacked[i].v[j];
+
+				hash = (hash ^ bits_( i, j )) * 0x9e3779b97f4a7c15ull;
+				hash ^= hash >> 32;
+			}
 
-					auto const other = aSoup.vert[idx];
-					if( mergable_( aSoup, i, idx, self, other, aMaxError ) )
+			if( !hasNaN )
+				sorted.emplace_back( KeyIndex_{ hash, std::uint32_t(i) } );
+		}
+
+		if( !sorted.empty() )
+			radix_sort_( sorted );
+
+		// Find the first occurrence of each vertex
+		Scratch_<std::uint32_t> firstOf( count, aVertices.get_allocator() );
+		std::iota( firstOf.begin(), firstOf.end(), std::uint32_t(0) );
+
+		Scratch_<std::uint32_t> distinct( aVertices.get_allocator() );
+		for( std::size_t beg = 0; beg < sorted.size(); )
+		{
+			auto end = beg+1;
+			while( end < sorted.size() && sorted[end].key == sorted[beg].key )
+				++end;
+
+			distinct.clear();
+			for( auto k = beg; k < end; ++k )
+			{
+				auto const i = sorted[k].index;
+
+				bool found = false;
+				for( auto const d : distinct )
+				{
+					bool same = true;
+					for( std::size_t j = 0; same && j < 8; ++j )
+						same = bits_( i, j ) == bits_( d, j );
+
+					if( same )
 					{
-						std::size_t toWhere;
-						
-						if( merged )
-						{
-							toWhere = target;
-						}
-						else
-						{
-							toWhere = nextVertex++;
-							aVertices.push_back( i );
-
-							collapseMap[i] = toWhere;
-							aIndices.push_back( std::uint32_t(toWhere) );
-						}
-
-						collapseMap[idx] = toWhere;
-						
-						target = toWhere;
-						merged = true;
+						firstOf[i] = d;
+						found = true;
+						break;
 					}
 				}
+
+				if( !found )
+					distinct.emplace_back( i );
 			}
 
-			if( !merged )
-			{
-				std::size_t toWhere = nextVertex++;
+			beg = end;
+		}
+
+		// Assign output vertices in order of first occurrence
+		aVertices.clear();
+		aVertices.reserve( count );
+
+		aIndices.clear();
+		aIndices.resize( count );
 
-				collapseMap[i] = toWhere;
-				aVertices.push_back( i );
-				aIndices.push_back( std::uint32_t(toWhere) );
+		std::uint32_t nextVertex = 0;
+		for( std::size_t i = 0; i < count; ++i )
+		{
+			if( firstOf[i] == i )
+			{
+				aIndices[i] = nextVertex++;
+				aVertices.push_back( std::uint32_t(i) );
+			}
+			else
+			{
+				assert( firstOf[i] < i );
+				aIndices[i] = aIndices[firstOf[i]];
 			}
 		}
 
@@ -12,6 +12,8 @@
 #include <glm/vec3.hpp>
 //#include <glm/vec4.hpp>
 
+#include "strided_view.hpp"
+
 
 //--    types                                   ///{{{1///////////////////////
 struct TriangleSoup
@@ -35,9 +37,41 @@ struct IndexedMesh
 	IndexedMesh();
 };
 
+/* Views of the per-vertex attributes of a triangle soup or of an indexed
+ * mesh. The normals may be empty; otherwise all views have the same size.
+ */
+struct VertexAttributeViews
+{
+	StridedView<glm::vec3> vert;
+	StridedView<glm::vec3> norm;
+	StridedView<glm::vec2> text;
+};
+
+class ThreadPool;
+
 //--    functions                               ///{{{1///////////////////////
 
+VertexAttributeViews attribute_views( TriangleSoup const& );
+VertexAttributeViews attribute_views( IndexedMesh const& );
+
+/* Weld the triangle soup into an indexed mesh. Vertices are merged if all of
+ * their attributes are within aErrorTol of each other. With aErrorTol == 0,
+ * only bitwise identical vertices (up to the sign of zero) are merged.
+ *
+ * The soup is only read through the views; it is never copied. Scratch data
+ * lives in a per-call arena that is sized up front from the vertex count.
+ *
+ * If a pool is given, the neighbour search is split across its threads. The
+ * result is identical either way.
+ */
 IndexedMesh make_indexed_mesh(
+	VertexAttributeViews const&,
+	float aErrorTol = 1e-6f,
+	ThreadPool* = nullptr
+);
+
+// Original std::unordered_multimap-based implementation. Reference only.
+IndexedMesh make_indexed_mesh_reference(
 	TriangleSoup const&,
 	float aErrorTol = 1e-6f
 );
@@ -9,6 +9,8 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
+#include "mapped_buffer.hpp"
+
 struct InputMaterialInfo
 {
 	std::string materialName;  // This is purely informational and for debugging
@@ -48,9 +50,12 @@ struct InputModel
 	std::vector<InputMaterialInfo> materials;
 	std::vector<InputMeshInfo> meshes;
 
-	std::vector<glm::vec3> positions;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::vec2> texcoords;
+	// Triangle soups of all meshes, in mesh order. They may be backed by
+	// spill files (see MappedBuffer), in which case the model can be larger
+	// than the available memory. Users evict() the parts they are done with.
+	MappedArray<glm::vec3> positions;
+	MappedArray<glm::vec3> normals;
+	MappedArray<glm::vec2> texcoords;
 };
 
 #endif // INPUT_MODEL_HPP_69C371FB_85B1_4E88_B333_F31BCDF073B9
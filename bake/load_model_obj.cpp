@@ -1,8 +1,22 @@
 #include "load_model_obj.hpp"
 
-#include <unordered_set>
+#include <array>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <vector>
+#include <numeric>
+#include <iterator>
+#include <sstream>
+#include <charconv>
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
 
+#include <cfloat>
+#include <cstdio>
 #include <cassert>
+#include <cstdint>
 #include <cstring>
 
 #include <memory>
@@ -12,12 +26,90 @@
 #include <rapidobj/rapidobj.hpp>
 
 #include "input_model.hpp"
+#include "thread_pool.hpp"
 #include "zstdistream.hpp"
+#include "mapped_buffer.hpp"
 
 #include "../labutils/error.hpp"
 namespace lut = labutils;
 
-InputModel load_compressed_wavefront_obj( char const* aPath )
+namespace
+{
+	std::vector<InputMaterialInfo> extract_materials_( rapidobj::Materials const&, std::string const& aPrefix );
+
+	// Chunked parser; see load_wavefront_obj_chunked()
+	constexpr std::size_t kWindowSize_ = 16*1024*1024;
+	constexpr std::size_t kMinChunkSize_ = 1024*1024;
+	constexpr std::size_t kChunksPerThread_ = 4;
+
+	constexpr std::size_t kCopyBlockSize_ = 64*1024; // vertices
+	constexpr std::size_t kCopyRoundSize_ = 512*1024; // vertices
+
+	constexpr std::int64_t kNoIndex_ = std::numeric_limits<std::int64_t>::min();
+
+	struct Corner_
+	{
+		std::int64_t p, t, n; // zero-based; t and n may be kNoIndex_
+	};
+
+	struct Segment_
+	{
+		// A segment starts at an 'o'/'g' and/or 'usemtl' statement, or at the
+		// start of the chunk. It covers faces up to the next segment.
+		std::size_t faceBegin = 0;
+		std::size_t cornerBegin = 0;
+
+		bool newShape = false;
+		bool newMaterial = false;
+		std::string shapeName;
+		std::string materialName;
+
+		// Filled in after parsing
+		std::size_t triangleBegin = 0;
+		std::size_t triangleCount = 0;
+		std::size_t materialIndex = 0;
+		std::size_t soupBegin = 0; // first vertex in the file-order soup
+		std::size_t dstVertex = 0;
+	};
+
+	struct Chunk_
+	{
+		char const* begin = nullptr;
+		char const* end = nullptr;
+
+		std::vector<float> positions; // 3 floats each
+		std::vector<float> texcoords; // 2 floats each
+		std::vector<float> normals; // 3 floats each
+
+		std::vector<Corner_> corners;
+		std::vector<std::uint32_t> faceSizes;
+		std::vector<Segment_> segments;
+
+		std::vector<std::string> materialLibraries;
+
+		// Corners that used relative (negative) indices. These are parsed
+		// relative to the start of the chunk, and need the number of
+		// attributes defined by preceding chunks added.
+		std::vector<std::size_t> relativePositions;
+		std::vector<std::size_t> relativeTexcoords;
+		std::vector<std::size_t> relativeNormals;
+
+		std::size_t positionBase = 0;
+		std::size_t texcoordBase = 0;
+		std::size_t normalBase = 0;
+
+		std::vector<Corner_> triangles;
+		std::size_t soupBase = 0;
+	};
+
+	std::vector<Chunk_> split_chunks_( char const* aText, std::size_t aSize, std::size_t aThreadCount );
+
+	// aTextOffset is the offset of aTextBegin in the OBJ text, for errors
+	void parse_chunk_( Chunk_&, char const* aPath, char const* aTextBegin, std::uint64_t aTextOffset );
+	void triangulate_chunk_( Chunk_&, float const* aPositions, std::size_t aPositionCount, std::size_t aTexcoordCount, std::size_t aNormalCount, char const* aPath );
+}
+
+InputModel load_compressed_wavefront_obj( char const* aPath, ThreadPool* aPool )
 {
 	assert( aPath );
 	
@@ -38,7 +130,7 @@ InputModel load_compressed_wavefront_obj( char const* aPath )
 	std::unique_ptr<std::istream> ins = [&] () -> std::unique_ptr<std::istream> {
 		auto const* last = std::strrchr( aPath, '-' );
 		if( last && 0 == std::strcmp( last+1, "zstd" ) )
-			return std::make_unique<ZStdIStream>( aPath );
+			return std::make_unique<ZStdIStream>( aPath, aPool );
 
 		return std::make_unique<std::ifstream>( aPath );
 	}();
@@ -70,40 +162,7 @@ InputModel load_compressed_wavefront_obj( char const* aPath )
 
 	ret.modelSourcePath = aPath;
 
-	for( auto const& mat : result.materials )
-	{
-		InputMaterialInfo mi;
-
-		mi.materialName  = mat.name;
-
-		mi.baseColor   = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
-
-		mi.baseRoughness  = mat.roughness;
-		mi.baseMetalness  = mat.metallic;
-
-		if( !mat.diffuse_texname.empty() )
-			mi.baseColorTexturePath  = prefix + mat.diffuse_texname;
-
-		if( !mat.roughness_texname.empty() )
-			mi.roughnessTexturePath  = prefix + mat.roughness_texname;
-		if( !mat.metallic_texname.empty() )
-			mi.metalnessTexturePath  = prefix + mat.metallic_texname;
-
-		if( !mat.alpha_texname.empty() )
-			mi.alphaMaskTexturePath  = prefix + mat.alpha_texname;
-
-		if( !mat.normal_texname.empty() )
-			mi.normalMapTexturePath  = prefix + mat.normal_texname;
-
-#	if 0
-		mi.diffuseColor  = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
-
-		if( !mat.diffuse_texname.empty() )
-			mi.diffuseTexturePath  = prefix + mat.diffuse_texname;
-#	endif
-
-		ret.materials.emplace_back( std::move(mi) );
-	}
+	ret.materials = extract_materials_( result.materials, prefix );
 
 	// Next, extract the actual mesh data. There are some complications:
 	// - OBJ use separate indices to positions, normals and texture coords. To
@@ -117,33 +176,52 @@ InputModel load_compressed_wavefront_obj( char const* aPath )
 	//  secondarily by other logical groupings). 
 	//
 	// Unfortunately, RapidOBJ exposes a per-face material index.
+	//
+	// Faces are therefore bucketed per (shape, material) with a counting sort:
+	// a first pass over the per-face material IDs sizes each bucket, and a
+	// second pass scatters the vertices directly into their final place in
+	// the (pre-sized) output arrays.
+	//
+	// Note: we still keep different "shapes" separate. For static meshes,
+	// one could merge all vertices with the same material for a bit more
+	// efficient rendering.
+	std::size_t totalVertices = 0;
+	for( auto const& shape : result.shapes )
+		totalVertices += shape.mesh.indices.size();
+
+	ret.positions.resize( totalVertices );
+	ret.texcoords.resize( totalVertices );
+	ret.normals.resize( totalVertices );
+
+	std::size_t shapeStart = 0;
 
-	std::unordered_set<std::size_t> activeMaterials;
+	std::vector<std::size_t> cursor( ret.materials.size(), 0 );
+	std::vector<std::size_t> activeMaterials;
 	for( auto const& shape : result.shapes )
 	{
 		auto const& shapeName = shape.name;
+		auto const& materialIds = shape.mesh.material_ids;
 
-		// Scan shape for materials
+		assert( 0 == shape.mesh.indices.size() % 3 ); // Always triangles; see Triangulate() above
+		auto const faceCount = shape.mesh.indices.size() / 3;
+		assert( faceCount == materialIds.size() );
+
+		// Size buckets (cursor[] counts faces for now)
 		activeMaterials.clear();
 
-		for( std::size_t i = 0; i < shape.mesh.indices.size(); ++i )
+		for( std::size_t face = 0; face < faceCount; ++face )
 		{
-			auto const faceId = i/3; // Always triangles; see Triangulate() above
-
-			assert( faceId < shape.mesh.material_ids.size() );
-			auto const matId = shape.mesh.material_ids[faceId];
+			auto const matId = materialIds[face];
+			if( matId < 0 || std::size_t(matId) >= ret.materials.size() )
+				throw lut::Error( "OBJ file '%s': shape '%s' uses invalid material ID %d", aPath, shapeName.c_str(), matId );
 
-			assert( matId < int(ret.materials.size()) );
-			activeMaterials.emplace( matId );
+			if( 0 == cursor[matId]++ )
+				activeMaterials.emplace_back( std::size_t(matId) );
 		}
 
-		// Process vertices for active material
-		// This does multiple passes over the vertex data, which is less than
-		// optimal...
-		//
-		// Note: we still keep different "shapes" separate. For static meshes,
-		// one could merge all vertices with the same material for a bit more
-		// efficient rendering.
+		std::sort( activeMaterials.begin(), activeMaterials.end() );
+
+		// Create one mesh per bucket; cursor[] becomes the next free vertex
 		for( auto const matId : activeMaterials )
 		{
 			// Keep track of mesh names; this can be useful for debugging.
@@ -153,48 +231,852 @@ InputModel load_compressed_wavefront_obj( char const* aPath )
 			else
 				meshName = shapeName + "::" + ret.materials[matId].materialName;
 
-			// Extract this material's vertices.
-			auto const firstVertex = ret.positions.size();
-			
-			for( std::size_t i = 0; i < shape.mesh.indices.size(); ++i )
-			{
-				auto const faceId = i/3; // Always triangles; see Triangulate() above
-				auto const faceMat = std::size_t(shape.mesh.material_ids[faceId]);
+			auto const vertexCount = cursor[matId] * 3;
 
-				if( faceMat != matId )
-					continue;
+			ret.meshes.emplace_back( InputMeshInfo{
+				std::move(meshName),
+				matId,
+				shapeStart,
+				vertexCount
+			} );
 
-				auto const& idx = shape.mesh.indices[i];
+			cursor[matId] = shapeStart;
+			shapeStart += vertexCount;
+		}
 
-				ret.positions.emplace_back( glm::vec3{
+		// Scatter vertices
+		for( std::size_t face = 0; face < faceCount; ++face )
+		{
+			auto& dst = cursor[materialIds[face]];
+
+			for( std::size_t corner = 0; corner < 3; ++corner, ++dst )
+			{
+				auto const& idx = shape.mesh.indices[face*3+corner];
+
+				ret.positions[dst] = glm::vec3{
 					result.attributes.positions[idx.position_index*3+0],
 					result.attributes.positions[idx.position_index*3+1],
 					result.attributes.positions[idx.position_index*3+2]
-				} );
+				};
 
-				ret.texcoords.emplace_back( glm::vec2{
+				ret.texcoords[dst] = glm::vec2{
 					result.attributes.texcoords[idx.texcoord_index*2+0],
 					result.attributes.texcoords[idx.texcoord_index*2+1]
-				} );
+				};
 
-				ret.normals.emplace_back( glm::vec3{
+				ret.normals[dst] = glm::vec3{
 					result.attributes.normals[idx.normal_index*3+0],
 					result.attributes.normals[idx.normal_index*3+1],
 					result.attributes.normals[idx.normal_index*3+2]
-				} );
+				};
+			}
+		}
+
+		for( auto const matId : activeMaterials )
+			cursor[matId] = 0;
+	}
+
+	assert( shapeStart == totalVertices );
+
+	return ret;
+}
+
+InputModel load_wavefront_obj_chunked( char const* aPath, ThreadPool& aPool, std::filesystem::path const& aSpillDir, ObjParseStats* aStats )
+{
+	assert( aPath );
+
+	using Clock_ = std::chrono::steady_clock;
+	auto const loadStart = Clock_::now();
+
+	double readSeconds = 0.0;
+	std::uint64_t textBytes = 0;
+
+	// Open the OBJ text. Seekable zstd files are decompressed in parallel.
+	std::unique_ptr<ZStdReader> zstd;
+	std::unique_ptr<FILE,decltype(&std::fclose)> plain( nullptr, &std::fclose );
+
+	auto const* last = std::strrchr( aPath, '-' );
+	if( last && 0 == std::strcmp( last+1, "zstd" ) )
+	{
+		zstd = std::make_unique<ZStdReader>( aPath, &aPool );
+	}
+	else
+	{
+		plain.reset( std::fopen( aPath, "rb" ) );
+		if( !plain )
+			throw lut::Error( "Unable to open '%s'", aPath );
+	}
+
+	auto const read_ = [&] (char* aOut, std::size_t aSize) {
+		auto const readStart = Clock_::now();
+
+		std::size_t got = 0;
+		if( zstd )
+		{
+			got = zstd->read( aOut, aSize );
+		}
+		else
+		{
+			got = std::fread( aOut, 1, aSize, plain.get() );
+			if( std::ferror( plain.get() ) )
+				throw lut::Error( "%s: read error", aPath );
+		}
+
+		readSeconds += std::chrono::duration<double>( Clock_::now() - readStart ).count();
+		return got;
+	};
+
+	// The text is processed in windows of kWindowSize_ bytes, so that neither
+	// the text nor the parsed data are held in memory as a whole. Each window
+	// is split into line-aligned chunks that are parsed independently.
+	// Chunks do not know about the state (current object/group, material)
+	// left by their predecessors, or how many vertices were defined before
+	// them. Each chunk therefore records changes as segments, and relative
+	// indices are patched once the window is parsed.
+	//
+	// Attributes and the triangulated faces (as a triangle soup, in file
+	// order) are appended to arrays backed by spill files in aSpillDir, and
+	// evicted after each window. Faces are resolved as soon as their window
+	// is parsed, so they may not refer to attributes that are defined in a
+	// later window.
+	MappedArray<float> positions( 0, aSpillDir ); // 3 floats each
+	MappedArray<float> texcoords( 0, aSpillDir ); // 2 floats each
+	MappedArray<float> normals( 0, aSpillDir ); // 3 floats each
+	std::size_t positionCount = 0, texcoordCount = 0, normalCount = 0;
+
+	MappedArray<glm::vec3> soupPositions( 0, aSpillDir );
+	MappedArray<glm::vec2> soupTexcoords( 0, aSpillDir );
+	MappedArray<glm::vec3> soupNormals( 0, aSpillDir );
+	std::size_t soupCount = 0;
+
+	std::vector<Segment_> segments;
+	std::vector<std::string> materialLibraries;
+
+	MappedBuffer window( kWindowSize_ );
+	std::size_t carry = 0; // incomplete line from the previous window
+	for( bool done = false; !done; )
+	{
+		auto const want = window.size() - carry;
+		auto const got = read_( window.data() + carry, want );
+		done = got < want;
+
+		// Parse complete lines only; the rest is carried over into the next
+		// window. A window that does not hold a single complete line is
+		// enlarged.
+		auto const size = carry + got;
+
+		auto parseSize = size;
+		if( !done )
+		{
+			while( parseSize > 0 && '\n' != window.data()[parseSize-1] )
+				--parseSize;
+
+			if( 0 == parseSize )
+			{
+				window.resize( 2*window.size() );
+				carry = size;
+				continue;
 			}
+		}
+
+		auto chunks = split_chunks_( window.data(), parseSize, aPool.thread_count() );
+
+		std::vector<std::size_t> order( chunks.size() );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+
+		parallel_for_order( aPool, order, [&] (std::size_t aI) {
+			parse_chunk_( chunks[aI], aPath, window.data(), textBytes );
+		} );
+
+		// Append attributes
+		for( auto& chunk : chunks )
+		{
+			chunk.positionBase = positionCount;
+			chunk.texcoordBase = texcoordCount;
+			chunk.normalBase = normalCount;
+
+			positionCount += chunk.positions.size() / 3;
+			texcoordCount += chunk.texcoords.size() / 2;
+			normalCount += chunk.normals.size() / 3;
+		}
+
+		positions.resize( positionCount*3 );
+		texcoords.resize( texcoordCount*2 );
+		normals.resize( normalCount*3 );
+
+		parallel_for_order( aPool, order, [&] (std::size_t aI) {
+			auto& chunk = chunks[aI];
+
+			std::copy( chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase*3 );
+			std::copy( chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + chunk.texcoordBase*2 );
+			std::copy( chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase*3 );
+
+			chunk.positions = {};
+			chunk.texcoords = {};
+			chunk.normals = {};
+
+			for( auto const slot : chunk.relativePositions )
+				chunk.corners[slot].p += std::int64_t(chunk.positionBase);
+			for( auto const slot : chunk.relativeTexcoords )
+				chunk.corners[slot].t += std::int64_t(chunk.texcoordBase);
+			for( auto const slot : chunk.relativeNormals )
+				chunk.corners[slot].n += std::int64_t(chunk.normalBase);
+		} );
+
+		// Triangulate. This needs the positions (see triangulate_chunk_()).
+		parallel_for_order( aPool, order, [&] (std::size_t aI) {
+			triangulate_chunk_( chunks[aI], positions.data(), positionCount, texcoordCount, normalCount, aPath );
+		} );
+
+		// Append the triangle soup
+		for( auto& chunk : chunks )
+		{
+			chunk.soupBase = soupCount;
+			soupCount += chunk.triangles.size();
+		}
+
+		soupPositions.resize( soupCount );
+		soupTexcoords.resize( soupCount );
+		soupNormals.resize( soupCount );
+
+		parallel_for_order( aPool, order, [&] (std::size_t aI) {
+			auto& chunk = chunks[aI];
+
+			auto dst = chunk.soupBase;
+			for( auto const& corner : chunk.triangles )
+			{
+				soupPositions[dst] = glm::vec3{
+					positions[corner.p*3+0],
+					positions[corner.p*3+1],
+					positions[corner.p*3+2]
+				};
+
+				soupTexcoords[dst] = kNoIndex_ == corner.t ? glm::vec2( 0.f ) : glm::vec2{
+					texcoords[corner.t*2+0],
+					texcoords[corner.t*2+1]
+				};
+
+				soupNormals[dst] = kNoIndex_ == corner.n ? glm::vec3( 0.f ) : glm::vec3{
+					normals[corner.n*3+0],
+					normals[corner.n*3+1],
+					normals[corner.n*3+2]
+				};
+
+				++dst;
+			}
+
+			for( auto& seg : chunk.segments )
+				seg.soupBegin = chunk.soupBase + seg.triangleBegin*3;
+
+			chunk.triangles = {};
+		} );
+
+		for( auto& chunk : chunks )
+		{
+			segments.insert( segments.end(), std::make_move_iterator( chunk.segments.begin() ), std::make_move_iterator( chunk.segments.end() ) );
+			materialLibraries.insert( materialLibraries.end(), chunk.materialLibraries.begin(), chunk.materialLibraries.end() );
+		}
+
+		chunks = {};
+
+		positions.evict();
+		texcoords.evict();
+		normals.evict();
+
+		soupPositions.evict();
+		soupTexcoords.evict();
+		soupNormals.evict();
+
+		// Next window
+		carry = size - parseSize;
+		std::memmove( window.data(), window.data() + parseSize, carry );
+
+		textBytes += parseSize;
+	}
+
+	window = {};
+	positions = {};
+	texcoords = {};
+	normals = {};
+
+	// Find the path to the OBJ file
+	char const* pathBeg = aPath;
+	char const* pathEnd = std::strrchr( pathBeg, '/' );
+	
+	std::string const prefix = pathEnd
+		? std::string( pathBeg, pathEnd+1 )
+		: ""
+	;
+
+	// Convert the OBJ data into a InputModel structure.
+	// First, extract material data. The material library is parsed by
+	// rapidobj, by handing it just the 'mtllib' statement.
+	InputModel ret;
+
+	ret.modelSourcePath = aPath;
+
+	std::string mtllib;
+	for( auto const& lib : materialLibraries )
+	{
+		if( mtllib.empty() )
+			mtllib = lib;
+		else if( lib != mtllib )
+			throw lut::Error( "OBJ file '%s': multiple material libraries ('%s' and '%s')", aPath, mtllib.c_str(), lib.c_str() );
+	}
+
+	std::unordered_map<std::string,std::size_t> materialIds;
+	if( !mtllib.empty() )
+	{
+		rapidobj::MaterialLibrary const mlib = rapidobj::MaterialLibrary::SearchPath( std::filesystem::absolute(std::filesystem::path(aPath).remove_filename()) );
+
+		std::istringstream mtlOnly( "mtllib " + mtllib + "\n" );
+		auto const result = rapidobj::ParseStream( mtlOnly, mlib );
+		if( result.error )
+			throw lut::Error( "Unable to load material library '%s' for '%s': %s", mtllib.c_str(), aPath, result.error.code.message().c_str() );
+
+		ret.materials = extract_materials_( result.materials, prefix );
+
+		for( std::size_t i = 0; i < ret.materials.size(); ++i )
+			materialIds.emplace( ret.materials[i].materialName, i );
+	}
+
+	// Next, resolve the segments into shapes, and the material names into
+	// material IDs. 
+	struct Shape_
+	{
+		std::string name;
+		std::vector<Segment_*> segments;
+	};
+
+	std::vector<Shape_> shapes( 1 ); // Faces before the first 'o'/'g'
+
+	constexpr std::size_t kNoMaterial = ~std::size_t(0);
+	std::size_t currentMaterial = kNoMaterial;
+	for( auto& seg : segments )
+	{
+		if( seg.newShape )
+		{
+			shapes.emplace_back();
+			shapes.back().name = seg.shapeName;
+		}
+
+		if( seg.newMaterial )
+		{
+			auto const it = materialIds.find( seg.materialName );
+			if( materialIds.end() == it )
+				throw lut::Error( "OBJ file '%s': material '%s' not found", aPath, seg.materialName.c_str() );
+
+			currentMaterial = it->second;
+		}
 
-			auto const vertexCount = ret.positions.size() - firstVertex;
+		if( 0 == seg.triangleCount )
+			continue;
+
+		if( kNoMaterial == currentMaterial )
+			throw lut::Error( "OBJ file '%s': shape '%s' has faces without a material", aPath, shapes.back().name.c_str() );
+
+		seg.materialIndex = currentMaterial;
+		shapes.back().segments.emplace_back( &seg );
+	}
+
+	// Bucket faces per (shape, material). This is the same counting sort as
+	// in load_compressed_wavefront_obj(), but since the material is constant
+	// within a segment, it runs over segments rather than faces. Each
+	// segment receives the location of its first vertex in the output.
+	std::size_t totalVertices = 0;
+	for( auto const& shape : shapes )
+	{
+		for( auto const* seg : shape.segments )
+			totalVertices += seg->triangleCount * 3;
+	}
+
+	std::size_t shapeStart = 0;
+
+	std::vector<std::size_t> cursor( ret.materials.size(), 0 );
+	std::vector<std::size_t> activeMaterials;
+	for( auto const& shape : shapes )
+	{
+		// Size buckets (cursor[] counts vertices for now)
+		activeMaterials.clear();
+
+		for( auto const* seg : shape.segments )
+		{
+			if( 0 == cursor[seg->materialIndex] )
+				activeMaterials.emplace_back( seg->materialIndex );
+
+			cursor[seg->materialIndex] += seg->triangleCount * 3;
+		}
+
+		std::sort( activeMaterials.begin(), activeMaterials.end() );
+
+		// Create one mesh per bucket; cursor[] becomes the next free vertex
+		for( auto const matId : activeMaterials )
+		{
+			std::string meshName;
+			if( 1 == activeMaterials.size() )
+				meshName = shape.name;
+			else
+				meshName = shape.name + "::" + ret.materials[matId].materialName;
+
+			auto const vertexCount = cursor[matId];
 
 			ret.meshes.emplace_back( InputMeshInfo{
 				std::move(meshName),
 				matId,
-				firstVertex,
+				shapeStart,
 				vertexCount
 			} );
+
+			cursor[matId] = shapeStart;
+			shapeStart += vertexCount;
+		}
+
+		// Place segments
+		for( auto* seg : shape.segments )
+		{
+			seg->dstVertex = cursor[seg->materialIndex];
+			cursor[seg->materialIndex] += seg->triangleCount * 3;
 		}
+
+		for( auto const matId : activeMaterials )
+			cursor[matId] = 0;
+	}
+
+	assert( shapeStart == totalVertices );
+
+	// Move the soup into mesh order. The output is backed by spill files as
+	// well. Segments are copied in blocks of at most kCopyBlockSize_
+	// vertices, in file order, and the touched pages are evicted after every
+	// kCopyRoundSize_ vertices.
+	ret.positions = MappedArray<glm::vec3>( totalVertices, aSpillDir );
+	ret.texcoords = MappedArray<glm::vec2>( totalVertices, aSpillDir );
+	ret.normals = MappedArray<glm::vec3>( totalVertices, aSpillDir );
+
+	struct Copy_
+	{
+		std::size_t src, dst, count;
+	};
+
+	std::vector<Copy_> copies;
+	for( auto const& seg : segments )
+	{
+		auto const count = seg.triangleCount * 3;
+		for( std::size_t i = 0; i < count; i += kCopyBlockSize_ )
+			copies.emplace_back( Copy_{ seg.soupBegin + i, seg.dstVertex + i, std::min( kCopyBlockSize_, count - i ) } );
+	}
+
+	for( std::size_t beg = 0; beg < copies.size(); )
+	{
+		std::size_t end = beg, count = 0;
+		while( end < copies.size() && (end == beg || count + copies[end].count <= kCopyRoundSize_) )
+			count += copies[end++].count;
+
+		std::vector<std::size_t> order( end - beg );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+
+		parallel_for_order( aPool, order, [&] (std::size_t aI) {
+			auto const& copy = copies[beg+aI];
+
+			std::copy_n( soupPositions.data() + copy.src, copy.count, ret.positions.data() + copy.dst );
+			std::copy_n( soupTexcoords.data() + copy.src, copy.count, ret.texcoords.data() + copy.dst );
+			std::copy_n( soupNormals.data() + copy.src, copy.count, ret.normals.data() + copy.dst );
+		} );
+
+		soupPositions.evict();
+		soupTexcoords.evict();
+		soupNormals.evict();
+
+		ret.positions.evict();
+		ret.texcoords.evict();
+		ret.normals.evict();
+
+		beg = end;
+	}
+
+	if( aStats )
+	{
+		auto const loadEnd = Clock_::now();
+
+		aStats->textBytes = std::size_t(textBytes);
+		aStats->readSeconds = readSeconds;
+		aStats->parseSeconds = std::chrono::duration<double>( loadEnd - loadStart ).count() - readSeconds;
 	}
 
 	return ret;
 }
 
+namespace
+{
+	std::vector<InputMaterialInfo> extract_materials_( rapidobj::Materials const& aMaterials, std::string const& aPrefix )
+	{
+		std::vector<InputMaterialInfo> materials;
+		for( auto const& mat : aMaterials )
+		{
+			InputMaterialInfo mi;
+
+			mi.materialName  = mat.name;
+
+			mi.baseColor   = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
+
+			mi.baseRoughness  = mat.roughness;
+			mi.baseMetalness  = mat.metallic;
+
+			if( !mat.diffuse_texname.empty() )
+				mi.baseColorTexturePath  = aPrefix + mat.diffuse_texname;
+
+			if( !mat.roughness_texname.empty() )
+				mi.roughnessTexturePath  = aPrefix + mat.roughness_texname;
+			if( !mat.metallic_texname.empty() )
+				mi.metalnessTexturePath  = aPrefix + mat.metallic_texname;
+
+			if( !mat.alpha_texname.empty() )
+				mi.alphaMaskTexturePath  = aPrefix + mat.alpha_texname;
+
+			if( !mat.normal_texname.empty() )
+				mi.normalMapTexturePath  = aPrefix + mat.normal_texname;
+
+#		if 0
+			mi.diffuseColor  = glm::vec3( mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] );
+
+			if( !mat.diffuse_texname.empty() )
+				mi.diffuseTexturePath  = aPrefix + mat.diffuse_texname;
+#		endif
+
+			materials.emplace_back( std::move(mi) );
+		}
+
+		return materials;
+	}
+}
+
+namespace
+{
+	std::vector<Chunk_> split_chunks_( char const* aText, std::size_t aSize, std::size_t aThreadCount )
+	{
+		std::size_t const count = std::max<std::size_t>( 1, std::min( aThreadCount*kChunksPerThread_, aSize / kMinChunkSize_ ) );
+
+		std::vector<Chunk_> chunks;
+
+		char const* beg = aText;
+		char const* const end = aText + aSize;
+		for( std::size_t i = 1; i <= count && beg != end; ++i )
+		{
+			char const* split = i == count ? end : std::max( beg, aText + aSize*i/count );
+			if( split != end )
+			{
+				auto const* eol = static_cast<char const*>(std::memchr( split, '\n', std::size_t(end-split) ));
+				split = eol ? eol+1 : end;
+			}
+
+			auto& chunk = chunks.emplace_back();
+			chunk.begin = beg;
+			chunk.end = split;
+
+			beg = split;
+		}
+
+		return chunks;
+	}
+
+	bool is_blank_( char aC ) noexcept
+	{
+		return ' ' == aC || '\t' == aC;
+	}
+	char const* skip_blanks_( char const* aBeg, char const* aEnd ) noexcept
+	{
+		while( aBeg != aEnd && is_blank_( *aBeg ) )
+			++aBeg;
+		return aBeg;
+	}
+	std::string trimmed_( char const* aBeg, char const* aEnd )
+	{
+		aBeg = skip_blanks_( aBeg, aEnd );
+		while( aEnd != aBeg && is_blank_( aEnd[-1] ) )
+			--aEnd;
+		return std::string( aBeg, aEnd );
+	}
+
+	std::size_t parse_floats_( char const*& aPtr, char const* aEnd, std::size_t aMax, float* aOut )
+	{
+		// rapidobj uses fast_float as well, so values are bit-identical.
+		std::size_t count = 0;
+		for( ; count < aMax; ++count )
+		{
+			auto const* beg = skip_blanks_( aPtr, aEnd );
+			auto const res = fast_float::from_chars( beg, aEnd, aOut[count] );
+			if( std::errc() != res.ec )
+				break;
+
+			aPtr = res.ptr;
+		}
+
+		return count;
+	}
+
+	bool parse_index_( char const*& aPtr, char const* aEnd, std::int64_t& aOut )
+	{
+		auto const res = std::from_chars( aPtr, aEnd, aOut );
+		if( std::errc() != res.ec || 0 == aOut )
+			return false;
+
+		aPtr = res.ptr;
+		return true;
+	}
+
+	void parse_chunk_( Chunk_& aChunk, char const* aPath, char const* aTextBegin, std::uint64_t aTextOffset )
+	{
+		// Implicit first segment; continues whatever the previous chunk left
+		aChunk.segments.emplace_back();
+
+		auto const fail_ = [&] (char const* aLine) {
+			throw lut::Error( "OBJ file '%s': parse error at byte %llu", aPath, static_cast<unsigned long long>(aTextOffset + std::uint64_t(aLine-aTextBegin)) );
+		};
+		auto const begin_segment_ = [&] () -> Segment_& {
+			if( aChunk.segments.back().faceBegin == aChunk.faceSizes.size() )
+				return aChunk.segments.back();
+
+			auto& seg = aChunk.segments.emplace_back();
+			seg.faceBegin = aChunk.faceSizes.size();
+			seg.cornerBegin = aChunk.corners.size();
+			return seg;
+		};
+		auto const resolve_ = [] (std::int64_t aIndex, std::size_t aCount, std::size_t aSlot, std::vector<std::size_t>& aRelative) {
+			if( aIndex > 0 )
+				return aIndex - 1;
+
+			aRelative.emplace_back( aSlot );
+			return std::int64_t(aCount) + aIndex;
+		};
+
+		char const* ptr = aChunk.begin;
+		while( ptr != aChunk.end )
+		{
+			auto const* eol = static_cast<char const*>(std::memchr( ptr, '\n', std::size_t(aChunk.end-ptr) ));
+			if( !eol )
+				eol = aChunk.end;
+
+			char const* const line = skip_blanks_( ptr, eol );
+			char const* end = eol;
+			if( end != line && '\r' == end[-1] )
+				--end;
+
+			ptr = eol == aChunk.end ? eol : eol+1;
+
+			if( line == end )
+				continue;
+
+			char const* args = std::find_if( line, end, is_blank_ );
+			std::string_view const key( line, std::size_t(args-line) );
+
+			if( "v" == key )
+			{
+				float v[3];
+				if( 3 != parse_floats_( args, end, 3, v ) )
+					fail_( line );
+
+				aChunk.positions.insert( aChunk.positions.end(), v, v+3 );
+			}
+			else if( "vt" == key )
+			{
+				float v[2];
+				if( 2 != parse_floats_( args, end, 2, v ) )
+					fail_( line );
+
+				aChunk.texcoords.insert( aChunk.texcoords.end(), v, v+2 );
+			}
+			else if( "vn" == key )
+			{
+				float v[3];
+				if( 3 != parse_floats_( args, end, 3, v ) )
+					fail_( line );
+
+				aChunk.normals.insert( aChunk.normals.end(), v, v+3 );
+			}
+			else if( "f" == key )
+			{
+				std::uint32_t count = 0;
+				for( ;; )
+				{
+					args = skip_blanks_( args, end );
+					if( args == end )
+						break;
+
+					auto const slot = aChunk.corners.size();
+					Corner_ corner{ kNoIndex_, kNoIndex_, kNoIndex_ };
+
+					std::int64_t idx;
+					if( !parse_index_( args, end, idx ) )
+						fail_( line );
+
+					corner.p = resolve_( idx, aChunk.positions.size()/3, slot, aChunk.relativePositions );
+
+					if( args != end && '/' == *args )
+					{
+						++args;
+						if( args != end && '/' != *args )
+						{
+							if( !parse_index_( args, end, idx ) )
+								fail_( line );
+
+							corner.t = resolve_( idx, aChunk.texcoords.size()/2, slot, aChunk.relativeTexcoords );
+						}
+
+						if( args != end && '/' == *args )
+						{
+							++args;
+							if( !parse_index_( args, end, idx ) )
+								fail_( line );
+
+							corner.n = resolve_( idx, aChunk.normals.size()/3, slot, aChunk.relativeNormals );
+						}
+					}
+
+					if( args != end && !is_blank_( *args ) )
+						fail_( line );
+
+					aChunk.corners.emplace_back( corner );
+					++count;
+				}
+
+				if( count < 3 )
+					fail_( line );
+
+				aChunk.faceSizes.emplace_back( count );
+			}
+			else if( "o" == key || "g" == key )
+			{
+				auto& seg = begin_segment_();
+				seg.newShape = true;
+				seg.shapeName = trimmed_( args, end );
+			}
+			else if( "usemtl" == key )
+			{
+				auto& seg = begin_segment_();
+				seg.newMaterial = true;
+				seg.materialName = trimmed_( args, end );
+			}
+			else if( "mtllib" == key )
+			{
+				aChunk.materialLibraries.emplace_back( trimmed_( args, end ) );
+			}
+
+			// Anything else (comments, smoothing groups, lines, points, ...)
+			// is ignored.
+		}
+	}
+
+	void triangulate_chunk_( Chunk_& aChunk, float const* aPositions, std::size_t aPositionCount, std::size_t aTexcoordCount, std::size_t aNormalCount, char const* aPath )
+	{
+		auto const positionCount = std::int64_t(aPositionCount);
+
+		for( auto const& corner : aChunk.corners )
+		{
+			if( corner.p < 0 || corner.p >= positionCount )
+				throw lut::Error( "OBJ file '%s': face references position %lld, but there are only %lld", aPath, (long long)corner.p+1, (long long)positionCount );
+			if( kNoIndex_ != corner.t && (corner.t < 0 || corner.t >= std::int64_t(aTexcoordCount)) )
+				throw lut::Error( "OBJ file '%s': face references texture coordinate %lld, but there are only %zu", aPath, (long long)corner.t+1, aTexcoordCount );
+			if( kNoIndex_ != corner.n && (corner.n < 0 || corner.n >= std::int64_t(aNormalCount)) )
+				throw lut::Error( "OBJ file '%s': face references normal %lld, but there are only %zu", aPath, (long long)corner.n+1, aNormalCount );
+		}
+
+		// Faces are triangulated the same way rapidobj::Triangulate() does:
+		// quads are split along the shorter diagonal and larger polygons are
+		// ear-clipped in their dominant projection plane. 
+		auto& out = aChunk.triangles;
+		out.reserve( aChunk.corners.size() );
+
+		auto const position_ = [&] (Corner_ const& aCorner, std::size_t aComp) {
+			return aPositions[aCorner.p*3+aComp];
+		};
+
+		std::size_t face = 0;
+		Corner_ const* corner = aChunk.corners.data();
+		for( std::size_t s = 0; s < aChunk.segments.size(); ++s )
+		{
+			auto& seg = aChunk.segments[s];
+			auto const faceEnd = s+1 < aChunk.segments.size() 
+				? aChunk.segments[s+1].faceBegin
+				: aChunk.faceSizes.size()
+			;
+
+			seg.triangleBegin = out.size() / 3;
+
+			for( ; face < faceEnd; ++face )
+			{
+				auto const* c = corner;
+				auto const n = aChunk.faceSizes[face];
+				corner += n;
+
+				if( 3 == n )
+				{
+					out.insert( out.end(), c, c+3 );
+				}
+				else if( 4 == n )
+				{
+					float const e02x = position_(c[0],0) - position_(c[2],0);
+					float const e02y = position_(c[0],1) - position_(c[2],1);
+					float const e02z = position_(c[0],2) - position_(c[2],2);
+					float const e13x = position_(c[1],0) - position_(c[3],0);
+					float const e13y = position_(c[1],1) - position_(c[3],1);
+					float const e13z = position_(c[1],2) - position_(c[3],2);
+
+					float const d02 = e02x*e02x + e02y*e02y + e02z*e02z;
+					float const d13 = e13x*e13x + e13y*e13y + e13z*e13z;
+
+					if( d02 < d13 )
+						out.insert( out.end(), { c[0], c[1], c[2], c[0], c[2], c[3] } );
+					else
+						out.insert( out.end(), { c[0], c[1], c[3], c[1], c[2], c[3] } );
+				}
+				else
+				{
+					std::vector<float> xs( n ), ys( n ), zs( n );
+					for( std::size_t k = 0; k < n; ++k )
+					{
+						xs[k] = position_(c[k],0);
+						ys[k] = position_(c[k],1);
+						zs[k] = position_(c[k],2);
+					}
+
+					auto const areaX = rapidobj::detail::CalculatePolygonArea( ys.data(), zs.data(), n );
+					auto const areaY = rapidobj::detail::CalculatePolygonArea( xs.data(), zs.data(), n );
+					auto const areaZ = rapidobj::detail::CalculatePolygonArea( xs.data(), ys.data(), n );
+
+					std::vector<std::uint32_t> tris;
+					if( FLT_MIN <= std::max( { areaX, areaY, areaZ } ) )
+					{
+						std::array<std::vector<std::array<float,2>>,1> polygon;
+						for( std::size_t k = 0; k < n; ++k )
+						{
+							if( areaX > areaY && areaX > areaZ )
+								polygon[0].push_back( { ys[k], zs[k] } );
+							else if( areaX <= areaY && areaY > areaZ )
+								polygon[0].push_back( { xs[k], zs[k] } );
+							else
+								polygon[0].push_back( { xs[k], ys[k] } );
+						}
+
+						tris = mapbox::earcut<std::uint32_t>( polygon );
+					}
+
+					if( !tris.empty() && 0 == tris.size() % 3 )
+					{
+						for( std::size_t k = 0; k < tris.size(); k += 3 )
+							out.insert( out.end(), { c[tris[k+1]], c[tris[k]], c[tris[k+2]] } );
+					}
+					else
+					{
+						// rapidobj gives up on degenerate polygons; use a fan.
+						for( std::size_t k = 2; k < n; ++k )
+							out.insert( out.end(), { c[0], c[k-1], c[k] } );
+					}
+				}
+			}
+
+			seg.triangleCount = out.size() / 3 - seg.triangleBegin;
+		}
+
+		aChunk.corners = {};
+		aChunk.faceSizes = {};
+	}
+}
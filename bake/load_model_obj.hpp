@@ -1,10 +1,33 @@
 #ifndef LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 #define LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 
+#include <cstddef>
+#include <filesystem>
+
 #include "input_model.hpp"
 
-// Load a Wavefront OBJ model
-InputModel load_compressed_wavefront_obj( char const* aPath );
+class ThreadPool;
+
+// Load a Wavefront OBJ model. If a thread pool is given, seekable zstd input
+// is decompressed in parallel (see zstdistream.hpp). The model is held in
+// memory in full.
+InputModel load_compressed_wavefront_obj( char const* aPath, ThreadPool* = nullptr );
+
+// Load a Wavefront OBJ model, optionally ZSTD compressed. Unlike the above,
+// the file is read and parsed in fixed-size windows of text, whose
+// line-aligned chunks are parsed in parallel. Parsed data is kept in spill
+// files in aSpillDir (see MappedBuffer), as are the InputModel's vertex
+// arrays, so memory use does not grow with the size of the model. Faces may
+// not refer to attributes ('v', 'vt', 'vn') that follow them in a later
+// window. Otherwise, the output matches load_compressed_wavefront_obj().
+struct ObjParseStats
+{
+	std::size_t textBytes = 0; // size of the decompressed OBJ text
+	double readSeconds = 0.0; // reading and decompressing
+	double parseSeconds = 0.0; // parsing and conversion to InputModel
+};
+
+InputModel load_wavefront_obj_chunked( char const* aPath, ThreadPool&, std::filesystem::path const& aSpillDir, ObjParseStats* = nullptr );
 
 #endif // LOAD_MODEL_OBJ_HPP_7FB6DF28_3D89_48DD_9FD8_4E53FB04723C
 
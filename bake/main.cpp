@@ -1,24 +1,49 @@
+#include <map>
+#include <array>
+#include <tuple>
+#include <chrono>
+#include <limits>
 #include <iterator>
 #include <vector>
+#include <utility>
+#include <numeric>
+#include <algorithm>
 #include <typeinfo>
 #include <exception>
 #include <filesystem>
 #include <system_error>
+#include <unordered_set>
 #include <unordered_map>
 
+#include <cctype>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
-#include <tgen.h>
 #include <glm/glm.hpp>
 
+#include "bake_cache.hpp"
+#include "bake_report.hpp"
 #include "index_mesh.hpp"
 #include "input_model.hpp"
+#include "thread_pool.hpp"
+#include "optimize_mesh.hpp"
+#include "tangent_space.hpp"
+#include "quantize_mesh.hpp"
+#include "vertex_layout.hpp"
+#include "section_file.hpp"
+#include "zstdistream.hpp"
+#include "mapped_buffer.hpp"
+#include "geometry_codec.hpp"
+#include "compress_texture.hpp"
 #include "load_model_obj.hpp"
 
 #include "../labutils/error.hpp"
 namespace lut = labutils;
 
+// Part of stb_image_write (x-stb), but not declared in its header
+extern "C" unsigned char* stbi_zlib_compress( unsigned char*, int, int*, int );
+
 
 namespace
 {
@@ -40,26 +65,208 @@ namespace
 	 * Suggestion: use 'uid-tag'. For example, I would use "scsmbil-tan" to
 	 * indicate that this is a custom format by myself (=scsmbil) with
 	 * additional tangent space information.
+	 *
+	 * Most changes shouldn't require a new variant, though: the file consists
+	 * of typed and versioned sections (see below), and new data can be added
+	 * as a new section type or version.
+	 */
+	constexpr char kFileVariant[16] = "sc20mh-toc-v8";
+
+	/* Sections (see section_file.hpp). A table of contents lists the type
+	 * (a four character tag), version, mesh, codec and location of each
+	 * section. The runtime looks up the sections it needs, and skips the ones
+	 * it doesn't know (or whose version it doesn't know).
+	 *
+	 * Bump the version of a section type if its contents change.
+	 */
+	constexpr std::uint32_t section_tag_( char const (&aTag)[5] ) noexcept
+	{
+		return std::uint32_t(std::uint8_t(aTag[0]))
+			| std::uint32_t(std::uint8_t(aTag[1])) << 8
+			| std::uint32_t(std::uint8_t(aTag[2])) << 16
+			| std::uint32_t(std::uint8_t(aTag[3])) << 24
+		;
+	}
+
+	constexpr std::uint32_t kSectionInfo = section_tag_( "INFO" );
+	constexpr std::uint32_t kSectionTextures = section_tag_( "TEXS" );
+	constexpr std::uint32_t kSectionMaterials = section_tag_( "MATS" );
+	constexpr std::uint32_t kSectionMesh = section_tag_( "MESH" );
+	constexpr std::uint32_t kSectionPositions = section_tag_( "POSN" );
+	constexpr std::uint32_t kSectionNormals = section_tag_( "NORM" );
+	constexpr std::uint32_t kSectionTexcoords = section_tag_( "TEXC" );
+	constexpr std::uint32_t kSectionTangents = section_tag_( "TANG" );
+	constexpr std::uint32_t kSectionAttributes = section_tag_( "ATTR" );
+	constexpr std::uint32_t kSectionIndices = section_tag_( "INDX" );
+	constexpr std::uint32_t kSectionRanges = section_tag_( "RNGS" );
+
+	constexpr std::uint32_t kSectionVersion = 1; // currently the same for all types
+
+	constexpr std::uint32_t kGlobalSection = ~std::uint32_t(0); // mesh of sections that don't belong to a mesh
+
+	/* Per-mesh sections are grouped by type in the file, in this order, so
+	 * that e.g. a depth-only load (positions and indices) reads one
+	 * contiguous part of the file.
+	 */
+	constexpr std::uint32_t kMeshSectionOrder[] = {
+		kSectionMesh,
+		kSectionPositions,
+		kSectionIndices,
+		kSectionRanges,
+		kSectionNormals,
+		kSectionTexcoords,
+		kSectionTangents,
+		kSectionAttributes
+	};
+
+	/* Section codecs. With --mesh-codec, each section is compressed on its
+	 * own, either with deflate (via stb_image_write's zlib compressor, since
+	 * the vendored zstd only includes the decompressor), or with the geometry
+	 * codec (see geometry_codec.hpp), which decodes much faster. Sections
+	 * that don't shrink are stored as-is.
 	 */
-	constexpr char kFileVariant[16] = "sc20mh-tan";
+	constexpr std::uint32_t kCodecStored = 0;
+	constexpr std::uint32_t kCodecDeflate = 1;
+	constexpr std::uint32_t kCodecGeometry = 2;
+
+	constexpr int kDeflateLevel = 5;
+
+	/* Sections start at multiples of this many bytes in the file, so that the
+	 * runtime can use them in place in a memory mapping of the file.
+	 */
+	constexpr std::size_t kSectionAlignment = 16;
+
+	constexpr std::size_t kFp32VertexSize = sizeof(float)*(3+3+2+4);
+	constexpr std::size_t kQuantizedVertexSize = sizeof(std::uint16_t)*(4+2+2+2);
 
 	/* Fallback texture for RGBA 1111 and Grayscale 1
 	 */
 	constexpr char kTextureFallbackR1[] = "assets-src/src/r1.png";
 	constexpr char kTextureFallbackRGBA1111[] = "assets-src/src/rgba1111.png";
 
+	/* Meshes with at least this many soup vertices are welded one at a time,
+	 * each using the whole thread pool, instead of being scheduled as a
+	 * single task.
+	 */
+	constexpr std::size_t kParallelWeldThreshold = 256*1024;
+
+	/* Same for tangents: meshes with at least this many indices get their
+	 * tangents computed one at a time, using the whole pool.
+	 */
+	constexpr std::size_t kParallelTangentThreshold = 256*1024;
+
+	/* Largest acceptable angle between the tangents computed by the bake and
+	 * those of the tgen-based reference (see '--bench-tangents').
+	 */
+	constexpr double kTangentToleranceDegrees = 0.01;
+
+	/* Default batch size, in soup vertices (see process_model_()). A batch
+	 * holds at least one mesh, however large.
+	 */
+	constexpr std::size_t kBatchVertices = 1024*1024;
+
+	// Largest thread count accepted by -j (0 = one per hardware thread)
+	constexpr std::size_t kMaxThreads = 1024;
+
+	// Frame size for --write-seekable, in uncompressed bytes
+	constexpr std::size_t kSeekableFrameSize = 4*1024*1024;
+
+	/* Version of the cached per-mesh results (see bake_cache.hpp). Bump this
+	 * whenever welding or tangent generation change their output, or old
+	 * cache entries will be reused.
+	 */
+	constexpr std::uint32_t kBakeCacheVersion = 4;
+
 	// types
 	struct TextureInfo_
 	{
 		std::uint32_t uniqueId;
 		std::uint8_t channels;
 		std::string newPath;
+
+		TextureRole role;
+
+		// Source image(s). Packed textures take roughness (red) and
+		// metalness (green) from two images.
+		std::vector<std::string> sources;
+
+		// Same contents as an earlier texture, whose uniqueId and newPath
+		// this entry shares. Duplicates are not written.
+		bool duplicate = false;
+	};
+
+	enum class MeshCodec_
+	{
+		none, // plain payload
+		deflate,
+		geometry
+	};
+
+	struct BakeOptions_
+	{
+		std::size_t threads = 0; // 0 = one per hardware thread
+		float errorTolerance = 1e-5f;
+
+		bool benchWeld = false;
+		bool benchTangents = false;
+		bool selfTest = false;
+		bool streamParse = false; // rapidobj via std::istream instead of chunked parse
+		bool useCache = true;
+		bool optimizeMeshes = true;
+		bool dropNonFinite = false; // also remove triangles with NaN/inf attributes
+		float overdrawThreshold = 0.f; // 0 = no overdraw optimization
+		bool quantize = false;
+		VertexLayout layout = VertexLayout::separate;
+		bool benchLayout = false;
+		bool mergeMaterials = false;
+		bool compressTextures = true;
+		bool deduplicate = true; // textures by contents, materials by parameters
+		MeshCodec_ meshCodec = MeshCodec_::none;
+		char const* reportPath = nullptr; // JSON bake report (see bake_report.hpp)
+		std::size_t batchVertices = kBatchVertices; // 0 = all meshes in one batch
+		char const* writeSeekable = nullptr; // re-encode the input and exit
+	};
+
+	// Statistics that are collected over all batches and printed at the end
+	struct MeshOptimizationStats_
+	{
+		explicit MeshOptimizationStats_( std::size_t aMeshCount );
+
+		std::vector<VertexCacheStats> before, after;
+		std::vector<OverdrawStats> overdrawBefore, overdrawAfter;
+		std::vector<char> overdrawApplied;
+		std::vector<std::size_t> triangles;
+	};
+
+	struct IndexBufferStats_
+	{
+		std::size_t split = 0; // input meshes that were split
+		std::size_t meshes = 0, meshes16 = 0;
+		std::size_t indices = 0, bytes = 0;
+	};
+
+	struct QuantizationStats_
+	{
+		std::size_t vertices = 0, indexBytes = 0;
+		QuantizationError worst{ 0.f, 0.f, 0.f, 0.f };
+		float worstRelative = 0.f;
+	};
+
+	struct DeduplicationStats_
+	{
+		std::size_t textures = 0, uniqueTextures = 0, decoded = 0;
+		std::size_t materials = 0, uniqueMaterials = 0;
+		std::size_t vramBytes = 0, savedBytes = 0; // estimated, see texture_vram_bytes_()
+		double hashSeconds = 0.0;
 	};
 
 	// local functions:
+	BakeOptions_ parse_options_( int, char* [] );
+
 	void process_model_(
 		char const* aOutput,
 		char const* aInputOBJ,
+		BakeOptions_ const&,
 		glm::mat4x4 const& aStaticTransform = glm::mat4x4( 1.f ) //TODO
 	);
 
@@ -67,37 +274,249 @@ namespace
 	InputModel normalize_( InputModel );
 
 
-	void write_model_data_(
-		FILE*,
+	// Batches of consecutive meshes (see process_model_()), aMaxVertices = 0
+	// puts all meshes into a single batch.
+	std::vector<std::vector<std::size_t>> mesh_batches_(
 		InputModel const&,
-		std::vector<IndexedMesh> const&,
+		std::size_t aMaxVertices
+	);
+
+	// Return the pages of the triangle soups of all vertices before
+	// aVertexEnd to the OS. They must not be accessed afterwards.
+	void release_soups_(
+		InputModel&,
+		std::size_t aVertexEnd
+	) noexcept;
+
+	// Model information, textures and materials (see the format description
+	// in the function).
+	std::vector<FileSection> global_sections_(
+		InputModel const&,
+		std::uint32_t aMeshCount,
 		std::unordered_map<std::string,TextureInfo_> const&,
-		std::vector<std::vector<glm::vec4>> const&
+		bool aQuantized,
+		VertexLayout,
+		MeshCodec_
+	);
+
+	/* Serialize (and compress) the meshes in parallel and add their sections
+	 * to the writer, in mesh order. The first mesh gets index aFirstMesh in
+	 * the file. Returns the time spent serializing, in seconds.
+	 */
+	double serialize_meshes_(
+		SectionFileWriter&,
+		std::uint32_t aFirstMesh,
+		InputModel const&,
+		std::vector<IndexedMesh> const&,
+		std::vector<std::vector<glm::vec4>> const&,
+		std::vector<std::size_t> const& aMeshSources,
+		std::vector<std::vector<MeshRange>> const& aMeshRanges,
+		std::vector<QuantizedMesh> const*, // nullptr = write fp32 attributes
+		VertexLayout,
+		MeshCodec_,
+		ThreadPool&
+	);
+
+	/* Create a section, compressed with the given codec if that makes it
+	 * smaller. For the geometry codec, aWordSize and aWordsPerRow describe the
+	 * array held by the section (aWordSize = 0 if it isn't an array).
+	 */
+	FileSection make_section_(
+		std::uint32_t aTag,
+		std::uint32_t aMesh,
+		std::vector<std::uint8_t>,
+		std::uint32_t aWordSize,
+		std::uint32_t aWordsPerRow,
+		MeshCodec_
 	);
 
+	/* Attribute streams of a mesh in file order. The position stream is
+	 * returned separately, followed by normals, texcoords and tangents.
+	 */
+	std::vector<VertexStream> vertex_streams_(
+		IndexedMesh const&,
+		std::vector<glm::vec4> const&,
+		QuantizedMesh const*,
+		VertexStream& aPosition
+	);
+
+
+	TriangleSoup extract_soup_( InputModel const&, InputMeshInfo const& );
+
+	// Views of the mesh's triangle soup in the model's arrays
+	VertexAttributeViews soup_views_( InputModel const&, InputMeshInfo const& );
+
+	// Meshes are welded straight from the model's arrays. The per-mesh
+	// aSeconds are only written for the meshes in aMeshIndices.
+	void index_meshes_(
+		InputModel const&,
+		std::vector<std::size_t> const& aMeshIndices,
+		ThreadPool&,
+		float aErrorTolerance,
+		std::vector<IndexedMesh>& aIndexed,
+		std::vector<double>& aSeconds
+	);
+
+	void benchmark_weld_( InputModel const&, ThreadPool&, float aErrorTolerance );
+	void benchmark_tangents_( InputModel const&, ThreadPool&, float aErrorTolerance );
+
+	// Checks of the mesh pipeline on small synthetic models (--self-test).
+	// Throws on failure.
+	void self_test_( std::size_t aThreads );
+
+	void write_seekable_input_( char const* aInputOBJ, char const* aOutput, std::size_t aThreads );
+	void benchmark_layouts_( std::vector<IndexedMesh> const&, std::vector<std::vector<glm::vec4>> const& );
+
+	// Remove degenerate and duplicate triangles (see optimize_mesh.hpp)
+	void clean_meshes_(
+		std::vector<IndexedMesh>&,
+		std::vector<std::size_t> const& aMeshIndices,
+		ThreadPool&,
+		bool aRemoveNonFinite,
+		std::vector<TriangleCleanupStats>& aStats
+	);
+	void print_triangle_cleanup_(
+		InputModel const&,
+		std::vector<TriangleCleanupStats> const&,
+		std::vector<std::size_t> const& aMeshIndices
+	);
+
+	void compute_mesh_tangents_(
+		std::vector<IndexedMesh> const&,
+		std::vector<std::size_t> const& aMeshIndices,
+		ThreadPool&,
+		std::vector<std::vector<glm::vec4>>& aTangents,
+		std::vector<double>& aSeconds
+	);
+
+	void optimize_meshes_(
+		InputModel const&,
+		std::vector<IndexedMesh>&,
+		std::vector<std::vector<glm::vec4>>&,
+		std::vector<std::size_t> const& aMeshIndices,
+		ThreadPool&,
+		float aOverdrawThreshold,
+		MeshOptimizationStats_&
+	);
+	void print_mesh_optimization_(
+		InputModel const&,
+		MeshOptimizationStats_ const&,
+		std::vector<std::size_t> const& aMeshIndices,
+		float aOverdrawThreshold
+	);
+
+	// Remove meshes without triangles (e.g., all were removed by the cleanup),
+	// as there is nothing to draw. Returns the number of removed meshes.
+	std::size_t drop_empty_meshes_(
+		std::vector<IndexedMesh>&,
+		std::vector<std::vector<glm::vec4>>&,
+		std::vector<std::size_t>& aMeshSources
+	);
+
+	// aMeshSources holds the input mesh of each mesh, and is updated along
+	// with the meshes.
+	void split_meshes_(
+		std::vector<IndexedMesh>&,
+		std::vector<std::vector<glm::vec4>>&,
+		std::vector<std::size_t>& aMeshSources,
+		IndexBufferStats_&
+	);
+	void print_index_buffers_( IndexBufferStats_ const& );
 
-	std::vector<IndexedMesh> index_meshes_(
+	std::vector<std::vector<MeshRange>> merge_meshes_(
 		InputModel const&,
-		float aErrorTolerance = 1e-5f
+		std::vector<IndexedMesh>&,
+		std::vector<std::vector<glm::vec4>>&,
+		std::vector<std::size_t>& aMeshSources
+	);
+
+	std::vector<QuantizedMesh> quantize_meshes_(
+		std::vector<IndexedMesh> const&,
+		std::vector<std::vector<glm::vec4>> const&,
+		ThreadPool&,
+		QuantizationStats_&
 	);
+	void print_quantization_( QuantizationStats_ const& );
+
+	std::uint64_t bake_parameter_hash_( BakeOptions_ const& );
 
 	std::unordered_map<std::string,TextureInfo_> find_unique_textures_(
 		InputModel const&
 	);
 
+	std::string packed_texture_key_( InputMaterialInfo const& );
+
+	// Texture indices of a material, as stored in the MATS section
+	std::array<std::uint32_t,4> material_textures_(
+		InputMaterialInfo const&,
+		std::unordered_map<std::string,TextureInfo_> const&
+	);
+
+	// aCacheDir may be null, in which case all textures are decoded
+	void deduplicate_textures_(
+		std::unordered_map<std::string,TextureInfo_>&,
+		bool aCompressed,
+		std::filesystem::path const* aCacheDir,
+		ThreadPool&,
+		DeduplicationStats_&
+	);
+	void deduplicate_materials_(
+		InputModel&,
+		std::unordered_map<std::string,TextureInfo_> const&,
+		DeduplicationStats_&
+	);
+	void print_deduplication_( DeduplicationStats_ const& );
+
+	std::size_t texture_vram_bytes_(
+		TextureInfo_ const&,
+		TextureContents const&,
+		bool aCompressed
+	);
+
 	std::unordered_map<std::string,TextureInfo_> new_paths_(
 		std::unordered_map<std::string,TextureInfo_>,
-		std::filesystem::path const& aTexDir
+		std::filesystem::path const& aTexDir,
+		bool aCompressed
+	);
+
+	// Return the number of textures written
+	std::size_t copy_textures_(
+		std::unordered_map<std::string,TextureInfo_> const&,
+		std::filesystem::path const& aRootDir
+	);
+	bool output_is_current_(
+		std::filesystem::path const&,
+		std::vector<std::string> const& aSources
+	);
+	std::size_t compress_textures_(
+		std::unordered_map<std::string,TextureInfo_> const&,
+		std::filesystem::path const& aRootDir,
+		ThreadPool&
 	);
 
 }
 
 
-int main() try
+int main( int aArgc, char* aArgv[] ) try
 {
+	auto const options = parse_options_( aArgc, aArgv );
+
+	if( options.selfTest )
+	{
+		self_test_( options.threads );
+		return 0;
+	}
+
+	if( options.writeSeekable )
+	{
+		write_seekable_input_( "assets-src/src/suntemple.obj-zstd", options.writeSeekable, options.threads );
+		return 0;
+	}
+
 	process_model_(
 		"assets/src/suntemple.comp5822mesh",
-		"assets-src/src/suntemple.obj-zstd"
+		"assets-src/src/suntemple.obj-zstd",
+		options
 	);
 
 	return 0;
@@ -110,7 +529,144 @@ catch( std::exception const& eErr )
 
 namespace
 {
-	void process_model_( char const* aOutput, char const* aInputOBJ, glm::mat4x4 const& aStaticTransform )
+	BakeOptions_ parse_options_( int aArgc, char* aArgv[] )
+	{
+		BakeOptions_ ret;
+
+		for( int i = 1; i < aArgc; ++i )
+		{
+			if( 0 == std::strcmp( aArgv[i], "-j" ) && i+1 < aArgc )
+			{
+				char const* arg = aArgv[++i];
+				char* end = nullptr;
+				unsigned long const threads = std::strtoul( arg, &end, 10 );
+				if( !std::isdigit( static_cast<unsigned char>(arg[0]) ) || *end || threads > kMaxThreads )
+					throw lut::Error( "-j: expected a thread count between 0 and %zu, got '%s'", kMaxThreads, arg );
+
+				ret.threads = threads;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--weld-tolerance" ) && i+1 < aArgc )
+			{
+				ret.errorTolerance = std::strtof( aArgv[++i], nullptr );
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--bench-weld" ) )
+			{
+				ret.benchWeld = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--bench-tangents" ) )
+			{
+				ret.benchTangents = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--self-test" ) )
+			{
+				ret.selfTest = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--stream-parse" ) )
+			{
+				ret.streamParse = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--no-cache" ) )
+			{
+				ret.useCache = false;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--no-mesh-opt" ) )
+			{
+				ret.optimizeMeshes = false;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--drop-nonfinite" ) )
+			{
+				ret.dropNonFinite = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--overdraw" ) && i+1 < aArgc )
+			{
+				ret.overdrawThreshold = std::strtof( aArgv[++i], nullptr );
+				if( !(ret.overdrawThreshold >= 1.f) )
+					throw lut::Error( "--overdraw: ACMR threshold must be at least 1.0" );
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--quantize" ) )
+			{
+				ret.quantize = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--interleave" ) )
+			{
+				ret.layout = VertexLayout::interleaved;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--bench-layout" ) )
+			{
+				ret.benchLayout = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--merge-materials" ) )
+			{
+				ret.mergeMaterials = true;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--copy-textures" ) )
+			{
+				ret.compressTextures = false;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--no-dedup" ) )
+			{
+				ret.deduplicate = false;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--compress-mesh" ) )
+			{
+				ret.meshCodec = MeshCodec_::deflate;
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--report" ) && i+1 < aArgc )
+			{
+				ret.reportPath = aArgv[++i];
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--write-seekable" ) && i+1 < aArgc )
+			{
+				ret.writeSeekable = aArgv[++i];
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--batch-vertices" ) && i+1 < aArgc )
+			{
+				ret.batchVertices = std::strtoull( aArgv[++i], nullptr, 10 );
+				continue;
+			}
+			if( 0 == std::strcmp( aArgv[i], "--mesh-codec" ) && i+1 < aArgc )
+			{
+				++i;
+				if( 0 == std::strcmp( aArgv[i], "deflate" ) )
+					ret.meshCodec = MeshCodec_::deflate;
+				else if( 0 == std::strcmp( aArgv[i], "geometry" ) )
+					ret.meshCodec = MeshCodec_::geometry;
+				else
+					throw lut::Error( "--mesh-codec: expected 'deflate' or 'geometry', got '%s'", aArgv[i] );
+				continue;
+			}
+
+			throw lut::Error( "Unknown argument '%s'\n"
+				"Usage: %s [-j threads] [--weld-tolerance tol] [--bench-weld] [--bench-tangents] [--self-test] [--stream-parse] [--no-cache] [--no-mesh-opt] [--drop-nonfinite] [--overdraw acmr-threshold] [--quantize] [--interleave] [--bench-layout] [--merge-materials] [--copy-textures] [--no-dedup] [--compress-mesh] [--mesh-codec deflate|geometry] [--report file.json] [--batch-vertices N] [--write-seekable out.obj-zstd]", aArgv[i], aArgv[0]
+			);
+		}
+
+		return ret;
+	}
+}
+
+namespace
+{
+	void process_model_( char const* aOutput, char const* aInputOBJ, BakeOptions_ const& aOptions, glm::mat4x4 const& aStaticTransform )
 	{
 		static constexpr std::size_t vertexSize = sizeof(float)*(3+3+2);
 
@@ -120,157 +676,431 @@ namespace
 		std::filesystem::path const basename = outname.stem();
 		std::filesystem::path const texdir = basename.string() + "-tex";
 
-		// Load input model
-		auto const model = normalize_( load_compressed_wavefront_obj( aInputOBJ ) );
+		// The individual meshes are independent, so indexing and tangent
+		// generation are distributed over all cores. Results are stored by
+		// mesh index, so the output does not depend on the number of threads.
+		// Seekable zstd input is likewise decompressed in parallel, and the
+		// OBJ text is parsed in chunks.
+		ThreadPool pool( aOptions.threads );
+
+		// Each stage records its wall and CPU time, the peak RSS and some
+		// counts for the bake report (--report).
+		BakeReport report;
+		report.input = aInputOBJ;
+		report.output = aOutput;
+		report.threads = pool.thread_count();
+
+		// Load input model. The chunked parser keeps the parsed data and the
+		// triangle soups in spill files next to the output.
+		std::filesystem::create_directories( rootdir );
+
+		ObjParseStats parseStats;
+		auto const loadStart = std::chrono::steady_clock::now();
+		auto const loadUsage = process_usage();
+		auto model = normalize_( aOptions.streamParse
+			? load_compressed_wavefront_obj( aInputOBJ, &pool )
+			: load_wavefront_obj_chunked( aInputOBJ, pool, rootdir.empty() ? std::filesystem::path( "." ) : rootdir, &parseStats )
+		);
+		auto const loadEnd = std::chrono::steady_clock::now();
 
 		std::size_t inputVerts = 0;
 		for( auto const& imesh : model.meshes )
 			inputVerts += imesh.vertexCount;
 
+		auto& loadStage = add_bake_stage( report, "load", loadUsage );
+		if( !aOptions.streamParse )
+			add_bake_count( loadStage, "bytes", parseStats.textBytes );
+
+		add_bake_count( loadStage, "meshes", model.meshes.size() );
+		add_bake_count( loadStage, "materials", model.materials.size() );
+		add_bake_count( loadStage, "vertices", inputVerts );
+
 		std::printf( "%s: %zu meshes, %zu materials\n", aInputOBJ, model.meshes.size(), model.materials.size() );
 		std::printf( " - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts*vertexSize/1024 );
 
-		// Index meshes
-		auto const indexed = index_meshes_( model );
+		if( aOptions.streamParse )
+		{
+			std::printf( " - loaded via rapidobj in %.1f ms\n", std::chrono::duration<double,std::milli>( loadEnd - loadStart ).count() );
+		}
+		else
+		{
+			auto const megabytes = parseStats.textBytes / (1024.0*1024.0);
+			std::printf( " - read %.1f MB of OBJ text in %.1f ms, parsed in %.1f ms => %.1f MB/s\n", 
+				megabytes,
+				parseStats.readSeconds * 1000.0,
+				parseStats.parseSeconds * 1000.0,
+				megabytes / parseStats.parseSeconds
+			);
+		}
+
+		// Index meshes and compute tangents.
+		std::printf( " - baking with %zu threads\n", pool.thread_count() );
+
+		if( aOptions.benchWeld )
+		{
+			benchmark_weld_( model, pool, aOptions.errorTolerance );
+			return;
+		}
+		if( aOptions.benchTangents )
+		{
+			benchmark_tangents_( model, pool, aOptions.errorTolerance );
+			return;
+		}
+
+		// Find the unique textures. Textures that decode to the same texels
+		// are collapsed, after which materials that refer to the same
+		// textures are collapsed as well. Meshes refer to the remaining
+		// materials, so this is done before any meshes are baked.
+		auto usage = process_usage();
+
+		auto const cacheDir = rootdir / (basename.string() + "-cache");
+		if( aOptions.useCache )
+			std::filesystem::create_directories( cacheDir );
+
+		auto textures = new_paths_( find_unique_textures_( model ), texdir, aOptions.compressTextures );
+
+		DeduplicationStats_ dedupStats;
+		dedupStats.textures = dedupStats.uniqueTextures = textures.size();
+		dedupStats.materials = dedupStats.uniqueMaterials = model.materials.size();
+
+		if( aOptions.deduplicate )
+		{
+			deduplicate_textures_( textures, aOptions.compressTextures, aOptions.useCache ? &cacheDir : nullptr, pool, dedupStats );
+			deduplicate_materials_( model, textures, dedupStats );
+		}
+
+		add_bake_stage( report, "dedup", usage ).counts = {
+			{ "textures", dedupStats.textures },
+			{ "unique_textures", dedupStats.uniqueTextures },
+			{ "materials", dedupStats.materials },
+			{ "unique_materials", dedupStats.uniqueMaterials },
+			{ "saved_vram_bytes", dedupStats.savedBytes }
+		};
 
+		// Meshes are baked in batches of consecutive input meshes. Each batch
+		// goes through the cache lookup, welding, tangents, optimization,
+		// splitting, quantization and serialization; its sections are then
+		// appended to the output's spill files (see section_file.hpp) and the
+		// batch is released. The triangle soups live in spill files (see
+		// load_wavefront_obj_chunked()); those of a batch are evicted once it
+		// is welded, so the welded meshes, sections and soups do not
+		// accumulate over the model and the peak memory use is set by the
+		// batch size. Merging by material and the layout benchmark need all
+		// meshes at once and use a single batch. The rapidobj loader
+		// (--stream-parse) holds the whole model in memory.
+		auto const batches = mesh_batches_( model, aOptions.mergeMaterials || aOptions.benchLayout ? 0 : aOptions.batchVertices );
+
+		// Per input mesh results; entries are released with their batch
+		std::vector<IndexedMesh> indexed( model.meshes.size() );
+		std::vector<std::vector<glm::vec4>> tangents( model.meshes.size() );
+
+		std::vector<double> weldSeconds( model.meshes.size(), 0.0 );
+		std::vector<double> tangentSeconds( model.meshes.size(), 0.0 );
+
+		std::vector<BakeCacheKey> cacheKeys( model.meshes.size() );
+		std::vector<std::filesystem::path> cacheEntries( model.meshes.size() );
+
+		auto const cacheParams = bake_parameter_hash_( aOptions );
+
+		// Statistics over all batches, printed at the end
+		std::vector<std::size_t> dirty; // all meshes that were not in the cache
+		std::vector<char> isDirty( model.meshes.size(), 0 );
+		std::vector<TriangleCleanupStats> cleanupStats( model.meshes.size() );
+		MeshOptimizationStats_ optStats( model.meshes.size() );
+		IndexBufferStats_ indexStats;
+		QuantizationStats_ quantStats;
 		std::size_t outputVerts = 0, outputIndices = 0;
+		double serializeSeconds = 0.0;
 
-		std::vector<std::vector<glm::vec4>> tangents;
+		// Output mesh data
+		auto mainpath = rootdir / basename;
+		mainpath.replace_extension( "comp5822mesh" );
+
+		SectionFileWriter writer( mainpath, kFileMagic, kFileVariant, std::vector<std::uint32_t>( std::begin(kMeshSectionOrder), std::end(kMeshSectionOrder) ), kSectionAlignment );
+		std::uint32_t outputMeshes = 0;
 
-		for( auto const& mesh : indexed )
+		for( std::size_t batchIndex = 0; batchIndex < batches.size(); ++batchIndex )
 		{
-			outputVerts += mesh.vert.size();
-			outputIndices += mesh.indices.size();
-			
-			//Convert vertices, texcoords and indices to proper file types (RealT and VIndexT)
-			std::vector<tgen::RealT> verts;
-			std::vector<tgen::RealT> texCoords;
-			std::vector<tgen::RealT> normals;
-			std::vector<tgen::VIndexT> indices;
+			auto const& batch = batches[batchIndex];
+			bool const lastBatch = batchIndex+1 == batches.size();
 
-			for (size_t i = 0; i < mesh.vert.size(); i++)
+			// Reuse results from previous bakes where possible. Only meshes
+			// that are not in the cache are welded and get tangents computed.
+			std::vector<std::size_t> batchDirty;
+			if( aOptions.useCache )
 			{
-				verts.emplace_back(mesh.vert.at(i).x);
-				verts.emplace_back(mesh.vert.at(i).y);
-				verts.emplace_back(mesh.vert.at(i).z);
+				usage = process_usage();
 
-				texCoords.emplace_back(mesh.text.at(i).x);
-				texCoords.emplace_back(mesh.text.at(i).y);
+				std::vector<char> hit( model.meshes.size(), 0 );
+				std::vector<std::size_t> weights;
+				for( auto const meshIndex : batch )
+					weights.emplace_back( model.meshes[meshIndex].vertexCount );
 
-				normals.emplace_back(mesh.norm.at(i).x);
-				normals.emplace_back(mesh.norm.at(i).y);
-				normals.emplace_back(mesh.norm.at(i).z);
-			}
+				parallel_for_order( pool, largest_first_order( weights ), [&] (std::size_t aOrder) {
+					auto const meshIndex = batch[aOrder];
+					cacheKeys[meshIndex] = bake_cache_key( model, model.meshes[meshIndex], cacheParams );
+					cacheEntries[meshIndex] = bake_cache_entry( cacheDir, cacheKeys[meshIndex] );
+					hit[meshIndex] = load_cached_mesh( cacheEntries[meshIndex], cacheKeys[meshIndex], indexed[meshIndex], tangents[meshIndex], cleanupStats[meshIndex] );
+				} );
 
-			//Do the same with indices
-			for (auto const& index : mesh.indices)
-				indices.emplace_back(index);
+				for( auto const meshIndex : batch )
+				{
+					if( !hit[meshIndex] )
+						batchDirty.emplace_back( meshIndex );
+				}
 
-			//Compute tangents
-			std::vector<tgen::RealT> tangents3D;
-			std::vector<tgen::RealT> bitangents3D;
+				auto& stage = add_bake_stage( report, "cache-lookup", usage );
+				add_bake_count( stage, "meshes", batch.size() );
+				add_bake_count( stage, "hits", batch.size()-batchDirty.size() );
+			}
+			else
+			{
+				batchDirty = batch;
+			}
 
-			//std::vector<tgen::RealT> cTangents3D;
-			//std::vector<tgen::RealT> cBitangents3D;
+			dirty.insert( dirty.end(), batchDirty.begin(), batchDirty.end() );
+			for( auto const meshIndex : batchDirty )
+				isDirty[meshIndex] = 1;
 
-			//Compute tangent and bitangents for each corner of a triangle
-			tgen::computeCornerTSpace(indices, indices, verts, texCoords, tangents3D, bitangents3D);
+			std::size_t dirtyVerts = 0;
+			for( auto const meshIndex : batchDirty )
+				dirtyVerts += model.meshes[meshIndex].vertexCount;
 
-			//Compute per-vertex tangents and bitangent for each UV vertex
-			std::vector<tgen::RealT> vTangents3D;
-			std::vector<tgen::RealT> vBitangents3D;
+			usage = process_usage();
+			index_meshes_( model, batchDirty, pool, aOptions.errorTolerance, indexed, weldSeconds );
 
-			tgen::computeVertexTSpace(indices, tangents3D, bitangents3D, mesh.text.size(), vTangents3D, vBitangents3D);
+			// The batch's triangle soups are no longer needed once it is
+			// welded (the cache keys were computed above). Batches are
+			// consecutive meshes, which are stored in order, so the soups up
+			// to the end of the batch are returned to the OS.
+			if( lastBatch )
+			{
+				model.positions = {};
+				model.normals = {};
+				model.texcoords = {};
+			}
+			else
+			{
+				auto const& back = model.meshes[batch.back()];
+				release_soups_( model, back.vertexStartIndex + back.vertexCount );
+			}
 
-			//Make tangent frames orthogonal
-			tgen::orthogonalizeTSpace(normals, vTangents3D, vBitangents3D);
+			std::size_t weldedVerts = 0;
+			for( auto const meshIndex : batchDirty )
+				weldedVerts += indexed[meshIndex].vert.size();
 
-			//Finally, compute the 4-dimensional tangent
-			std::vector<tgen::RealT> tangents4D;
-			tgen::computeTangent4D(normals, vTangents3D, vBitangents3D, tangents4D);
+			{
+				auto& stage = add_bake_stage( report, "weld", usage );
+				add_bake_count( stage, "meshes", batchDirty.size() );
+				add_bake_count( stage, "soup_vertices", dirtyVerts );
+				add_bake_count( stage, "welded_vertices", weldedVerts );
+			}
 
-			//For convenience - convert tangents into glm::vec4
-			std::vector<glm::vec4> tangentVectors;
-			for (size_t i = 0; i < tangents4D.size(); i += 4)
+			usage = process_usage();
+			clean_meshes_( indexed, batchDirty, pool, aOptions.dropNonFinite, cleanupStats );
 			{
-				glm::vec4 tangentVec;
-				tangentVec.x = tangents4D.at(float(i));
-				tangentVec.y = tangents4D.at(float(i + 1));
-				tangentVec.z = tangents4D.at(float(i + 2));
-				tangentVec.w = tangents4D.at(float(i + 3));
+				std::size_t removed = 0;
+				for( auto const meshIndex : batchDirty )
+					removed += cleanupStats[meshIndex].triangles();
 
-				tangentVectors.emplace_back(tangentVec);
+				auto& stage = add_bake_stage( report, "cleanup", usage );
+				add_bake_count( stage, "meshes", batchDirty.size() );
+				add_bake_count( stage, "removed_triangles", removed );
+			}
 
+			usage = process_usage();
+			compute_mesh_tangents_( indexed, batchDirty, pool, tangents, tangentSeconds );
+			{
+				auto& stage = add_bake_stage( report, "tangents", usage );
+				add_bake_count( stage, "meshes", batchDirty.size() );
+				add_bake_count( stage, "vertices", weldedVerts );
 			}
 
-			tangents.emplace_back(tangentVectors);
-		}
+			if( aOptions.optimizeMeshes )
+			{
+				usage = process_usage();
+				optimize_meshes_( model, indexed, tangents, batchDirty, pool, aOptions.overdrawThreshold, optStats );
+				add_bake_count( add_bake_stage( report, "optimize", usage ), "meshes", batchDirty.size() );
+			}
 
-		std::printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+			if( aOptions.useCache )
+			{
+				usage = process_usage();
 
+				// Meshes with identical soups (e.g., the same faces under two
+				// materials) share a cache entry. Store each entry once.
+				std::vector<std::size_t> stores;
+				std::unordered_set<std::string> storedEntries;
+				for( auto const meshIndex : batchDirty )
+				{
+					if( storedEntries.emplace( cacheEntries[meshIndex].string() ).second )
+						stores.emplace_back( meshIndex );
+				}
 
-		// Find list of unique textures
-		auto const textures = new_paths_( find_unique_textures_( model ), texdir );
+				parallel_for_order( pool, stores, [&] (std::size_t aMeshIndex) {
+					store_cached_mesh( cacheEntries[aMeshIndex], cacheKeys[aMeshIndex], indexed[aMeshIndex], tangents[aMeshIndex], cleanupStats[aMeshIndex] );
+				} );
 
-		std::printf( " - unique textures: %zu\n", textures.size() );
+				add_bake_count( add_bake_stage( report, "cache-store", usage ), "meshes", stores.size() );
+			}
 
-		// Ensure output directory exists
-		std::filesystem::create_directories( rootdir );
+			// Take the batch's meshes. Meshes that lost all their triangles
+			// in the cleanup are dropped, as there is nothing to draw. Meshes
+			// that are too large for 16-bit indices are split; meshSources
+			// maps each output mesh to its input mesh (and thereby its
+			// material).
+			usage = process_usage();
 
-		// Output mesh data
-		auto mainpath = rootdir / basename;
-		mainpath.replace_extension( "comp5822mesh" );
+			std::vector<IndexedMesh> meshes;
+			std::vector<std::vector<glm::vec4>> meshTangents;
+			std::vector<std::size_t> meshSources;
 
-		FILE* fof = std::fopen( mainpath.string().c_str(), "wb" );
-		if( !fof )
-			throw lut::Error( "Unable to open '%s' for writing", mainpath.string().c_str() );
+			std::size_t batchVerts = 0, batchIndices = 0;
+			for( auto const meshIndex : batch )
+			{
+				BakeMeshReport mesh;
+				mesh.name = model.meshes[meshIndex].meshName;
+				mesh.cached = !isDirty[meshIndex];
+				mesh.soupVertices = model.meshes[meshIndex].vertexCount;
+				mesh.weldedVertices = indexed[meshIndex].vert.size() + cleanupStats[meshIndex].vertices;
+				mesh.weldSeconds = weldSeconds[meshIndex];
+				mesh.tangentSeconds = tangentSeconds[meshIndex];
+				mesh.removedTriangles = cleanupStats[meshIndex].triangles();
+				report.meshes.emplace_back( std::move(mesh) );
+
+				batchVerts += indexed[meshIndex].vert.size();
+				batchIndices += indexed[meshIndex].indices.size();
+
+				meshes.emplace_back( std::exchange( indexed[meshIndex], IndexedMesh() ) );
+				meshTangents.emplace_back( std::exchange( tangents[meshIndex], {} ) );
+				meshSources.emplace_back( meshIndex );
+			}
 
-		try
-		{
-			write_model_data_( fof, model, indexed, textures, tangents );
-		}
-		catch( ... )
-		{
-			std::fclose( fof );
-			throw;
-		}
+			outputVerts += batchVerts;
+			outputIndices += batchIndices;
 
-		std::fclose( fof );
+			drop_empty_meshes_( meshes, meshTangents, meshSources );
+			split_meshes_( meshes, meshTangents, meshSources, indexStats );
 
-		// Copy textures
-		std::filesystem::create_directories( rootdir / texdir );
+			// Optionally merge meshes with the same material into as few
+			// meshes as possible (while still fitting 16-bit indices). The
+			// source meshes are kept as sub-ranges.
+			std::vector<std::vector<MeshRange>> meshRanges( meshes.size() );
+			if( aOptions.mergeMaterials )
+				meshRanges = merge_meshes_( model, meshes, meshTangents, meshSources );
 
-		std::size_t errors = 0;
-		for( auto const& entry : textures )
-		{
-			auto const dest = rootdir / entry.second.newPath;
+			if( aOptions.benchLayout )
+			{
+				benchmark_layouts_( meshes, meshTangents );
+				return;
+			}
 
-			std::error_code ec;
-			bool ret = std::filesystem::copy_file( 
-				entry.first,
-				dest,
-				std::filesystem::copy_options::none,
-				ec
-			);
+			// Quantize vertex attributes. This is cheap and is done after the
+			// cache, which always holds the full precision data.
+			std::vector<QuantizedMesh> quantized;
+			if( aOptions.quantize )
+				quantized = quantize_meshes_( meshes, meshTangents, pool, quantStats );
 
-			if( !ret )
 			{
-				++errors;
-				std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(), ec.message().c_str(), ec.category().name() );
+				auto& stage = add_bake_stage( report, "prepare", usage );
+				add_bake_count( stage, "meshes", meshes.size() );
+				add_bake_count( stage, "vertices", batchVerts );
+				add_bake_count( stage, "indices", batchIndices );
 			}
+
+			// Serialize (and compress) the batch's meshes and append them to
+			// the output.
+			usage = process_usage();
+			serializeSeconds += serialize_meshes_( writer, outputMeshes, model, meshes, meshTangents, meshSources, meshRanges, aOptions.quantize ? &quantized : nullptr, aOptions.layout, aOptions.meshCodec, pool );
+			outputMeshes += std::uint32_t(meshes.size());
+
+			add_bake_count( add_bake_stage( report, "write", usage ), "meshes", meshes.size() );
 		}
 
-		auto const total = textures.size();
-		std::printf( "Copied %zu textures out of %zu.\n", total-errors, total );
-		if( errors )
+		if( aOptions.useCache )
 		{
-			std::fprintf( stderr, "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n" );
+			std::printf( " - bake cache: reusing %zu out of %zu meshes\n", model.meshes.size()-dirty.size(), model.meshes.size() );
+
+			// Remove entries that no longer belong to any mesh
+			usage = process_usage();
+			prune_bake_cache( cacheDir, cacheEntries );
+			add_bake_stage( report, "cache-store", usage );
 		}
-	}
-}
 
-namespace
-{
+		print_triangle_cleanup_( model, cleanupStats, dirty );
+
+		if( aOptions.optimizeMeshes )
+			print_mesh_optimization_( model, optStats, dirty, aOptions.overdrawThreshold );
+
+		std::printf( " - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices, (outputVerts*vertexSize + outputIndices*sizeof(std::uint32_t))/1024 );
+
+		print_index_buffers_( indexStats );
+
+		if( aOptions.quantize )
+			print_quantization_( quantStats );
+
+		if( aOptions.deduplicate )
+			print_deduplication_( dedupStats );
+		else
+			std::printf( " - unique textures: %zu\n", textures.size() );
+
+		// Write the file: model info, textures and materials, followed by the
+		// mesh sections from the spill files.
+		usage = process_usage();
+
+		for( auto& section : global_sections_( model, outputMeshes, textures, aOptions.quantize, aOptions.layout, aOptions.meshCodec ) )
+			writer.add( std::move(section) );
+
+		if( MeshCodec_::none != aOptions.meshCodec )
+		{
+			std::printf( " - sections (%s): %zu kB => %zu kB (%.1f%%) in %zu sections, compressed in %.1f ms\n",
+				MeshCodec_::geometry == aOptions.meshCodec ? "geometry codec" : "deflate",
+				std::size_t(writer.raw_bytes()/1024), std::size_t(writer.stored_bytes()/1024),
+				100.0 * double(writer.stored_bytes()) / double(writer.raw_bytes()),
+				writer.section_count(),
+				serializeSeconds * 1000.0
+			);
+		}
+
+		auto const fileSize = std::size_t(writer.finish());
+
+		add_bake_count( add_bake_stage( report, "write", usage ), "bytes", fileSize );
+
+		if( aOptions.quantize && MeshCodec_::none == aOptions.meshCodec )
+		{
+			// The fp32 variant stores 48 bytes per vertex.
+			auto const fp32Size = fileSize + outputVerts*(kFp32VertexSize - kQuantizedVertexSize);
+			std::printf( " - output: %zu kB (fp32 variant: %zu kB, %.1f%%)\n", fileSize/1024, fp32Size/1024, 100.0 * double(fileSize) / double(fp32Size) );
+		}
+		else
+		{
+			std::printf( " - output: %zu kB\n", fileSize/1024 );
+		}
+
+		// Compress textures (or copy them verbatim)
+		usage = process_usage();
+		std::filesystem::create_directories( rootdir / texdir );
+
+		auto const written = aOptions.compressTextures
+			? compress_textures_( textures, rootdir, pool )
+			: copy_textures_( textures, rootdir )
+		;
+
+		add_bake_stage( report, "textures", usage ).counts = {
+			{ "textures", dedupStats.uniqueTextures },
+			{ "written", written }
+		};
+
+		if( aOptions.reportPath )
+		{
+			write_bake_report( aOptions.reportPath, report );
+			std::printf( "Wrote bake report to '%s'.\n", aOptions.reportPath );
+		}
+	}
+}
+
+namespace
+{
 	InputModel normalize_( InputModel aModel )
 	{
 		for( auto& mat : aModel.materials )
@@ -289,220 +1119,1518 @@ namespace
 
 namespace
 {
-	void checked_write_( FILE* aOut, std::size_t aBytes, void const* aData )
+	void append_bytes_( std::vector<std::uint8_t>& aOut, std::size_t aBytes, void const* aData )
 	{
-		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
-
-		if( ret != aBytes )
-			throw lut::Error( "fwrite() failed: %zu instead of %zu", ret, aBytes );
+		auto const* bytes = static_cast<std::uint8_t const*>(aData);
+		aOut.insert( aOut.end(), bytes, bytes + aBytes );
 	}
 
-	void write_string_( FILE* aOut, char const* aString )
+	void append_string_( std::vector<std::uint8_t>& aOut, char const* aString )
 	{
-		// Write a string
+		// Append a string
 		// Format:
 		//  - uint32_t : N = length of string in bytes, including terminating '\0'
 		//  - N x char : string
 		std::uint32_t const length = std::uint32_t(std::strlen(aString)+1);
-		checked_write_( aOut, sizeof(std::uint32_t), &length );
+		append_bytes_( aOut, sizeof(std::uint32_t), &length );
 
-		checked_write_( aOut, length, aString );
+		append_bytes_( aOut, length, aString );
 	}
 
-	void write_model_data_( FILE* aOut, InputModel const& aModel, std::vector<IndexedMesh> const& aIndexedMeshes, std::unordered_map<std::string,TextureInfo_> const& aTextures, std::vector<std::vector<glm::vec4>> const& aTangents)
+	std::vector<std::vector<std::size_t>> mesh_batches_( InputModel const& aModel, std::size_t aMaxVertices )
 	{
-		// Write header
-		// Format:
-		//   - char[16] : file magic
-		//   - char[16] : file variant ID
-		checked_write_( aOut, sizeof(char)*16, kFileMagic );
-		checked_write_( aOut, sizeof(char)*16, kFileVariant );
-		
-		// Write list of unique textures
-		// Format:
+		std::vector<std::vector<std::size_t>> ret;
+
+		std::size_t vertices = 0;
+		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+		{
+			auto const count = aModel.meshes[i].vertexCount;
+
+			// The loaders store the soups in mesh order (release_soups_()
+			// relies on this).
+			assert( 0 == i || aModel.meshes[i].vertexStartIndex == aModel.meshes[i-1].vertexStartIndex + aModel.meshes[i-1].vertexCount );
+
+			if( ret.empty() || (aMaxVertices && vertices + count > aMaxVertices) )
+			{
+				ret.emplace_back();
+				vertices = 0;
+			}
+
+			ret.back().emplace_back( i );
+			vertices += count;
+		}
+
+		return ret;
+	}
+
+	void release_soups_( InputModel& aModel, std::size_t aVertexEnd ) noexcept
+	{
+		assert( aVertexEnd <= aModel.positions.size() );
+
+		aModel.positions.evict( 0, aVertexEnd );
+		aModel.normals.evict( 0, aVertexEnd );
+		aModel.texcoords.evict( 0, aVertexEnd );
+	}
+
+	std::vector<FileSection> global_sections_( InputModel const& aModel, std::uint32_t aMeshCount, std::unordered_map<std::string,TextureInfo_> const& aTextures, bool aQuantized, VertexLayout aLayout, MeshCodec_ aCodec )
+	{
+		std::vector<FileSection> sections;
+
+		// Model information
+		// Format (INFO):
+		//   - uint32_t : 0 = separate vertex streams, 1 = position + interleaved attributes
+		//   - uint32_t : 1 if the vertex attributes are quantized, 0 otherwise
+		//   - uint32_t : M = number of meshes
+		{
+			std::uint32_t const info[3] = {
+				std::uint32_t(aLayout),
+				aQuantized ? 1u : 0u,
+				aMeshCount
+			};
+
+			std::vector<std::uint8_t> data;
+			append_bytes_( data, sizeof(info), info );
+			sections.emplace_back( make_section_( kSectionInfo, kGlobalSection, std::move(data), 0, 0, MeshCodec_::none ) );
+		}
+
+		// List of unique textures
+		// Format (TEXS):
 		//  - unit32_t : U = number of unique textures
 		//  - repeat U times:
 		//    - string : path to texture 
 		//    - uint8_t : number of channels in texture
-		std::vector<TextureInfo_ const*> orderedUnqiue( aTextures.size() );
-		for( auto const& tex : aTextures )
 		{
-			assert( !orderedUnqiue[tex.second.uniqueId] );
-			orderedUnqiue[tex.second.uniqueId] = &tex.second;
-		}
+			std::size_t uniqueCount = 0;
+			for( auto const& tex : aTextures )
+			{
+				if( !tex.second.duplicate )
+					++uniqueCount;
+			}
 
-		std::uint32_t const textureCount = std::uint32_t(orderedUnqiue.size());
-		checked_write_( aOut, sizeof(textureCount), &textureCount );
+			std::vector<TextureInfo_ const*> orderedUnqiue( uniqueCount );
+			for( auto const& tex : aTextures )
+			{
+				if( tex.second.duplicate )
+					continue;
 
-		for( auto const& tex : orderedUnqiue )
-		{
-			assert( tex );
-			write_string_( aOut, tex->newPath.c_str() );
+				assert( !orderedUnqiue[tex.second.uniqueId] );
+				orderedUnqiue[tex.second.uniqueId] = &tex.second;
+			}
+
+			std::vector<std::uint8_t> data;
+
+			std::uint32_t const textureCount = std::uint32_t(orderedUnqiue.size());
+			append_bytes_( data, sizeof(textureCount), &textureCount );
+
+			for( auto const& tex : orderedUnqiue )
+			{
+				assert( tex );
+				append_string_( data, tex->newPath.c_str() );
+
+				std::uint8_t channels = tex->channels;
+				append_bytes_( data, sizeof(channels), &channels );
+			}
 
-			std::uint8_t channels = tex->channels;
-			checked_write_( aOut, sizeof(channels), &channels );
+			sections.emplace_back( make_section_( kSectionTextures, kGlobalSection, std::move(data), 0, 0, aCodec ) );
 		}
 
-		// Write material information
-		// Format:
+		// Material information
+		// Format (MATS):
 		//  - uint32_t : M = number of materials
 		//  - repeat M times:
 		//    - uin32_t : base color texture index
-		//    - uin32_t : roughness texture index
-		//    - uin32_t : metalness texture index
+		//    - uin32_t : roughness (red) and metalness (green) texture index
 		//    - uin32_t : alphaMask texture index (or 0xffffffff if none)
 		//    - uin32_t : normalMap texture index (or 0xffffffff if none)
-		std::uint32_t const materialCount = std::uint32_t(aModel.materials.size());
-		checked_write_( aOut, sizeof(materialCount), &materialCount );
-
-		for( auto const& mat : aModel.materials )
 		{
-			auto const write_tex_ = [&] (std::string const& aTexturePath ) {
-				if( aTexturePath.empty() )
-				{
-					static constexpr std::uint32_t sentinel = ~std::uint32_t(0);
-					checked_write_( aOut, sizeof(std::uint32_t), &sentinel );
-					return;
-				}
+			std::vector<std::uint8_t> data;
 
-				auto const it = aTextures.find( aTexturePath );
-				assert( aTextures.end() != it );
+			std::uint32_t const materialCount = std::uint32_t(aModel.materials.size());
+			append_bytes_( data, sizeof(materialCount), &materialCount );
 
-				checked_write_( aOut, sizeof(std::uint32_t), &it->second.uniqueId );
-			};
+			for( auto const& mat : aModel.materials )
+			{
+				auto const ids = material_textures_( mat, aTextures );
+				append_bytes_( data, sizeof(ids), ids.data() );
+			}
 
-			write_tex_( mat.baseColorTexturePath );
-			write_tex_( mat.roughnessTexturePath );
-			write_tex_( mat.metalnessTexturePath );
-			write_tex_( mat.alphaMaskTexturePath );
-			write_tex_( mat.normalMapTexturePath );
+			sections.emplace_back( make_section_( kSectionMaterials, kGlobalSection, std::move(data), 0, 0, aCodec ) );
 		}
 
-		// Write mesh data
+		return sections;
+	}
+
+	double serialize_meshes_( SectionFileWriter& aWriter, std::uint32_t aFirstMesh, InputModel const& aModel, std::vector<IndexedMesh> const& aIndexedMeshes, std::vector<std::vector<glm::vec4>> const& aTangents, std::vector<std::size_t> const& aMeshSources, std::vector<std::vector<MeshRange>> const& aMeshRanges, std::vector<QuantizedMesh> const* aQuantized, VertexLayout aLayout, MeshCodec_ aCodec, ThreadPool& aPool )
+	{
+		assert( aMeshSources.size() == aIndexedMeshes.size() );
+
+		// Mesh data, one set of sections per mesh
 		// Format:
-		//  - uint32_t : M = number of meshes
-		//  - repeat M times:
+		//  - MESH:
 		//    - uint32_t : material index
 		//    - uint32_t : V = number of vertices
 		//    - uint32_t : I = number of indices
-		//    - repeat V times: vec3 position
-		//    - repeat V times: vec3 normal
-		//    - repeat V times: vec2 texture coordinate
-		//    - repeat I times: uint32_t index
-		std::uint32_t const meshCount = std::uint32_t(aModel.meshes.size());
-		checked_write_( aOut, sizeof(meshCount), &meshCount );
-
-		assert( aModel.meshes.size() == aIndexedMeshes.size() );
-		for( std::size_t i = 0; i < aModel.meshes.size(); ++i )
+		//    - uint32_t : S = size of an index in bytes (2 if V <= 65536, 4 otherwise)
+		//    - 2 x vec3 : position bounds (min, max); quantized only, zero/one otherwise
+		//    - 2 x vec2 : texture coordinate bounds (min, max); as above
+		//  - POSN: repeat V times: vec3 position
+		//  - NORM: repeat V times: vec3 normal
+		//  - TEXC: repeat V times: vec2 texture coordinate
+		//  - TANG: repeat V times: vec4 tangent
+		//  - INDX: repeat I times: index (uint16_t or uint32_t)
+		//  - RNGS: sub-ranges; only present if meshes were merged
+		//    - repeat R times:
+		//      - uint32_t : first index
+		//      - uint32_t : index count
+		//      - 2 x vec3 : AABB min and max
+		//
+		// The quantized variant instead stores
+		//  - POSN: repeat V times: u16vec4 position (unorm, w = bitangent sign)
+		//  - NORM: repeat V times: i16vec2 normal (octahedral, snorm)
+		//  - TEXC: repeat V times: u16vec2 texture coordinate (unorm)
+		//  - TANG: repeat V times: i16vec2 tangent (octahedral, snorm)
+		//
+		// With the interleaved layout, NORM, TEXC and TANG are replaced by
+		//  - ATTR: repeat V times: normal, texture coordinate and tangent (36
+		//    bytes per vertex, 12 if quantized)
+		//
+		// Serialize (and compress) meshes in parallel; the output only
+		// depends on the mesh index.
+		std::uint32_t const wordSize = aQuantized ? sizeof(std::uint16_t) : sizeof(float);
+
+		std::vector<std::vector<FileSection>> meshSections( aIndexedMeshes.size() );
+
+		auto const serialize_mesh_ = [&] (std::size_t aMeshIndex) {
+			auto& out = meshSections[aMeshIndex];
+			auto const mesh = aFirstMesh + std::uint32_t(aMeshIndex);
+
+			auto const& mmesh = aModel.meshes[aMeshSources[aMeshIndex]];
+			auto const& imesh = aIndexedMeshes[aMeshIndex];
+
+			std::uint32_t const vertexCount = std::uint32_t(imesh.vert.size());
+			std::uint32_t const indexCount = std::uint32_t(imesh.indices.size());
+			std::uint32_t const indexSize = vertexCount <= kMaxIndex16Vertices ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+
+			QuantizedMesh const* qmesh = nullptr;
+			if( aQuantized )
+			{
+				qmesh = &aQuantized->at(aMeshIndex);
+				assert( qmesh->positions.size() == vertexCount );
+			}
+
+			{
+				std::vector<std::uint8_t> data;
+
+				std::uint32_t const header[4] = { std::uint32_t(mmesh.materialIndex), vertexCount, indexCount, indexSize };
+				append_bytes_( data, sizeof(header), header );
+
+				glm::vec3 const posMin = qmesh ? qmesh->posMin : glm::vec3( 0.f ), posMax = qmesh ? qmesh->posMax : glm::vec3( 1.f );
+				glm::vec2 const texMin = qmesh ? qmesh->texMin : glm::vec2( 0.f ), texMax = qmesh ? qmesh->texMax : glm::vec2( 1.f );
+				append_bytes_( data, sizeof(glm::vec3), &posMin );
+				append_bytes_( data, sizeof(glm::vec3), &posMax );
+				append_bytes_( data, sizeof(glm::vec2), &texMin );
+				append_bytes_( data, sizeof(glm::vec2), &texMax );
+
+				out.emplace_back( make_section_( kSectionMesh, mesh, std::move(data), 0, 0, MeshCodec_::none ) );
+			}
+
+			auto const append_stream_ = [&] (std::uint32_t aTag, VertexStream const& aStream) {
+				std::vector<std::uint8_t> data;
+				append_bytes_( data, aStream.elementSize*vertexCount, aStream.data );
+				out.emplace_back( make_section_( aTag, mesh, std::move(data), wordSize, std::uint32_t(aStream.elementSize/wordSize), aCodec ) );
+			};
+
+			VertexStream position;
+			auto const attributes = vertex_streams_( imesh, aTangents.at(aMeshIndex), qmesh, position );
+
+			append_stream_( kSectionPositions, position );
+
+			if( VertexLayout::interleaved == aLayout )
+			{
+				std::size_t stride = 0;
+				for( auto const& stream : attributes )
+					stride += stream.elementSize;
+
+				auto interleaved = interleave_streams( attributes, vertexCount );
+				out.emplace_back( make_section_( kSectionAttributes, mesh, std::move(interleaved), wordSize, std::uint32_t(stride/wordSize), aCodec ) );
+			}
+			else
+			{
+				assert( 3 == attributes.size() );
+				append_stream_( kSectionNormals, attributes[0] );
+				append_stream_( kSectionTexcoords, attributes[1] );
+				append_stream_( kSectionTangents, attributes[2] );
+			}
+
+			{
+				std::vector<std::uint8_t> data;
+				if( sizeof(std::uint16_t) == indexSize )
+				{
+					std::vector<std::uint16_t> indices16( imesh.indices.begin(), imesh.indices.end() );
+					append_bytes_( data, sizeof(std::uint16_t)*indexCount, indices16.data() );
+				}
+				else
+				{
+					append_bytes_( data, sizeof(std::uint32_t)*indexCount, imesh.indices.data() );
+				}
+
+				out.emplace_back( make_section_( kSectionIndices, mesh, std::move(data), indexSize, 1, aCodec ) );
+			}
+
+			if( auto const& ranges = aMeshRanges.at(aMeshIndex); !ranges.empty() )
+			{
+				std::vector<std::uint8_t> data;
+				for( auto const& range : ranges )
+				{
+					append_bytes_( data, sizeof(range.firstIndex), &range.firstIndex );
+					append_bytes_( data, sizeof(range.indexCount), &range.indexCount );
+					append_bytes_( data, sizeof(glm::vec3), &range.aabbMin );
+					append_bytes_( data, sizeof(glm::vec3), &range.aabbMax );
+				}
+
+				out.emplace_back( make_section_( kSectionRanges, mesh, std::move(data), sizeof(std::uint32_t), 8, aCodec ) );
+			}
+		};
+
+		std::vector<std::size_t> weights;
+		for( auto const& imesh : aIndexedMeshes )
+			weights.emplace_back( imesh.vert.size() + imesh.indices.size() );
+
+		auto const start = std::chrono::steady_clock::now();
+		parallel_for_order( aPool, largest_first_order( weights ), serialize_mesh_ );
+		auto const end = std::chrono::steady_clock::now();
+
+		for( auto& perMesh : meshSections )
 		{
-			auto const& mmesh = aModel.meshes[i];
+			for( auto& section : perMesh )
+				aWriter.add( std::move(section) );
+		}
+
+		return std::chrono::duration<double>( end - start ).count();
+	}
 
-			std::uint32_t materialIndex = std::uint32_t(mmesh.materialIndex);
-			checked_write_( aOut, sizeof(materialIndex), &materialIndex );
+	FileSection make_section_( std::uint32_t aTag, std::uint32_t aMesh, std::vector<std::uint8_t> aData, std::uint32_t aWordSize, std::uint32_t aWordsPerRow, MeshCodec_ aCodec )
+	{
+		FileSection ret{ aTag, kSectionVersion, aMesh, kCodecStored, aData.size(), {} };
+
+		if( MeshCodec_::none == aCodec || aData.empty() )
+		{
+			ret.data = std::move(aData);
+			return ret;
+		}
 
-			auto const& imesh = aIndexedMeshes[i];
+		if( aData.size() > std::size_t(std::numeric_limits<int>::max()) )
+			throw lut::Error( "make_section_(): section too large (%zu bytes)", aData.size() );
 
-			std::uint32_t vertexCount = std::uint32_t(imesh.vert.size());
-			checked_write_( aOut, sizeof(vertexCount), &vertexCount );
-			std::uint32_t indexCount = std::uint32_t(imesh.indices.size());
-			checked_write_( aOut, sizeof(indexCount), &indexCount );
+		if( MeshCodec_::geometry == aCodec )
+		{
+			std::vector<CodecSection> layout;
+			if( 0 != aWordSize )
+				layout.emplace_back( CodecSection{ 0, aData.size(), aWordSize, aWordsPerRow } );
 
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.vert.data() );
-			checked_write_( aOut, sizeof(glm::vec3)*vertexCount, imesh.norm.data() );
-			checked_write_( aOut, sizeof(glm::vec2)*vertexCount, imesh.text.data() );
+			auto encoded = encode_geometry_chunk( aData, layout );
+			if( encoded.size() < aData.size() )
+			{
+				ret.codec = kCodecGeometry;
+				ret.data = std::move(encoded);
+				return ret;
+			}
+		}
+		else
+		{
+			assert( MeshCodec_::deflate == aCodec );
 
-			//NEW - write the vertex tangents
-			checked_write_(aOut, sizeof(glm::vec4)*vertexCount, aTangents.at(i).data());
+			int size = 0;
+			auto* compressed = stbi_zlib_compress( aData.data(), int(aData.size()), &size, kDeflateLevel );
+			if( compressed && std::size_t(size) < aData.size() )
+			{
+				ret.codec = kCodecDeflate;
+				ret.data.assign( compressed, compressed + size );
+			}
 
-			checked_write_( aOut, sizeof(std::uint32_t)*indexCount, imesh.indices.data() );
+			std::free( compressed );
+			if( kCodecDeflate == ret.codec )
+				return ret;
 		}
+
+		ret.data = std::move(aData);
+		return ret;
 	}
 }
 
 namespace
 {
-	std::vector<IndexedMesh> index_meshes_( InputModel const& aModel, float aErrorTolerance )
+	TriangleSoup extract_soup_( InputModel const& aModel, InputMeshInfo const& aMesh )
 	{
-		std::vector<IndexedMesh> indexed;
+		auto const endIndex = aMesh.vertexStartIndex + aMesh.vertexCount;
 
-		for( auto const& imesh : aModel.meshes )
-		{
-			auto const endIndex = imesh.vertexStartIndex + imesh.vertexCount;
+		TriangleSoup soup;
+
+		soup.vert.reserve( aMesh.vertexCount );
+		for( std::size_t i = aMesh.vertexStartIndex; i < endIndex; ++i )
+			soup.vert.emplace_back( aModel.positions[i] );
+
+		soup.text.reserve( aMesh.vertexCount );
+		for( std::size_t i = aMesh.vertexStartIndex; i < endIndex; ++i )
+			soup.text.emplace_back( aModel.texcoords[i] );
+
+		soup.norm.reserve( aMesh.vertexCount );
+		for( std::size_t i = aMesh.vertexStartIndex; i < endIndex; ++i )
+			soup.norm.emplace_back( aModel.normals[i] );
+
+		return soup;
+	}
+
+	VertexAttributeViews soup_views_( InputModel const& aModel, InputMeshInfo const& aMesh )
+	{
+		VertexAttributeViews ret;
+		ret.vert = StridedView<glm::vec3>( aModel.positions.data() + aMesh.vertexStartIndex, aMesh.vertexCount );
+		ret.norm = StridedView<glm::vec3>( aModel.normals.data() + aMesh.vertexStartIndex, aMesh.vertexCount );
+		ret.text = StridedView<glm::vec2>( aModel.texcoords.data() + aMesh.vertexStartIndex, aMesh.vertexCount );
+		return ret;
+	}
 
-			TriangleSoup soup;
+	void index_meshes_( InputModel const& aModel, std::vector<std::size_t> const& aMeshIndices, ThreadPool& aPool, float aErrorTolerance, std::vector<IndexedMesh>& aIndexed, std::vector<double>& aSeconds )
+	{
+		assert( aIndexed.size() == aModel.meshes.size() );
+		assert( aSeconds.size() == aModel.meshes.size() );
 
-			soup.vert.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.vert.emplace_back( aModel.positions[i] );
+		auto const weld_ = [&] (std::size_t aMeshIndex, ThreadPool* aMeshPool) {
+			auto const start = std::chrono::steady_clock::now();
+			aIndexed[aMeshIndex] = make_indexed_mesh( soup_views_( aModel, aModel.meshes[aMeshIndex] ), aErrorTolerance, aMeshPool );
+			auto const end = std::chrono::steady_clock::now();
 
-			soup.text.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.text.emplace_back( aModel.texcoords[i] );
+			aSeconds[aMeshIndex] = std::chrono::duration<double>( end - start ).count();
+		};
 
-			soup.norm.reserve( imesh.vertexCount );
-			for( std::size_t i = imesh.vertexStartIndex; i < endIndex; ++i )
-				soup.norm.emplace_back( aModel.normals[i] );
+		// Schedule the largest meshes first. Welding is roughly linear in the
+		// number of soup vertices. Very large meshes are instead welded one
+		// by one, with the pool parallelizing each of them internally.
+		std::vector<std::size_t> weights;
+		for( auto const meshIndex : aMeshIndices )
+			weights.emplace_back( aModel.meshes[meshIndex].vertexCount );
 
+		std::vector<std::size_t> perMesh;
+		for( auto const order : largest_first_order( weights ) )
+		{
+			auto const meshIndex = aMeshIndices[order];
 
-			indexed.emplace_back( make_indexed_mesh( soup, aErrorTolerance ) );
+			if( aPool.thread_count() > 1 && aModel.meshes[meshIndex].vertexCount >= kParallelWeldThreshold )
+				weld_( meshIndex, &aPool );
+			else
+				perMesh.emplace_back( meshIndex );
 		}
 
-		return indexed;
+		parallel_for_order( aPool, perMesh, [&] (std::size_t aMeshIndex) {
+			weld_( aMeshIndex, nullptr );
+		} );
 	}
 }
 
 namespace
 {
-	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel )
+	void benchmark_weld_( InputModel const& aModel, ThreadPool& aPool, float aErrorTolerance )
 	{
-		std::unordered_map<std::string,TextureInfo_> unique;
+		using Clock_ = std::chrono::steady_clock;
+		using Msf_ = std::chrono::duration<double, std::milli>;
 
-		std::uint32_t texid = 0;
-		auto const add_unique_ = [&] (std::string const& aPath, std::uint8_t aChannels)
+		std::vector<TriangleSoup> soups;
+		for( auto const& imesh : aModel.meshes )
+			soups.emplace_back( extract_soup_( aModel, imesh ) );
+
+		auto const time_ = [&] (char const* aName, auto&& aWeld) {
+			std::vector<IndexedMesh> ret;
+			ret.reserve( soups.size() );
+
+			auto const start = Clock_::now();
+			for( auto const& soup : soups )
+				ret.emplace_back( aWeld( soup ) );
+			auto const ms = std::chrono::duration_cast<Msf_>( Clock_::now() - start ).count();
+
+			std::printf( "   - %-28s %10.1f ms\n", aName, ms );
+			return std::make_pair( std::move(ret), ms );
+		};
+
+		std::printf( " - weld benchmark, tolerance %g, %zu threads\n", double(aErrorTolerance), aPool.thread_count() );
+
+		// The original implementation cannot deal with a zero tolerance.
+		std::vector<IndexedMesh> reference;
+		double refMs = 0.0;
+		if( aErrorTolerance > 0.f )
 		{
-			if( aPath.empty() )
-				return;
+			std::tie( reference, refMs ) = time_( "reference (unordered_multimap)", [&] (TriangleSoup const& aSoup) {
+				return make_indexed_mesh_reference( aSoup, aErrorTolerance );
+			} );
+		}
 
-			TextureInfo_ info{};
-			info.uniqueId = texid;
-			info.channels = aChannels;
+		auto const [serial, serialMs] = time_( "flat index", [&] (TriangleSoup const& aSoup) {
+			return make_indexed_mesh( attribute_views( aSoup ), aErrorTolerance );
+		} );
+		auto const [pooled, pooledMs] = time_( "flat index, pooled", [&] (TriangleSoup const& aSoup) {
+			return make_indexed_mesh( attribute_views( aSoup ), aErrorTolerance, &aPool );
+		} );
 
-			auto const [it, isNew] = unique.emplace( std::make_pair(aPath,info) );
+		auto const same_ = [] (std::vector<IndexedMesh> const& aX, std::vector<IndexedMesh> const& aY) {
+			if( aX.size() != aY.size() )
+				return false;
 
-			if( isNew )
-				++texid;
+			for( std::size_t i = 0; i < aX.size(); ++i )
+			{
+				if( aX[i].indices != aY[i].indices || aX[i].vert != aY[i].vert || aX[i].norm != aY[i].norm || aX[i].text != aY[i].text )
+					return false;
+			}
+
+			return true;
 		};
 
-		for( auto const& mat : aModel.materials )
+		if( !same_( serial, pooled ) )
+			throw lut::Error( "Weld benchmark: pooled results differ from serial results" );
+
+		if( !reference.empty() )
 		{
-			add_unique_( mat.baseColorTexturePath, 4 );
-			add_unique_( mat.roughnessTexturePath, 1 ); 
-			add_unique_( mat.metalnessTexturePath, 1 ); 
-			add_unique_( mat.alphaMaskTexturePath, 4 );  // assume == baseColor
-			add_unique_( mat.normalMapTexturePath, 3 );  // xyz only
+			if( !same_( reference, serial ) )
+				throw lut::Error( "Weld benchmark: results differ from reference implementation" );
+
+			std::printf( "   - speedup: %.2fx serial, %.2fx pooled; results identical\n", refMs / serialMs, refMs / pooledMs );
 		}
+	}
 
-		return unique;
+	void benchmark_tangents_( InputModel const& aModel, ThreadPool& aPool, float aErrorTolerance )
+	{
+		using Clock_ = std::chrono::steady_clock;
+		using Msf_ = std::chrono::duration<double, std::milli>;
+
+		// Tangents are computed on the welded meshes
+		std::vector<std::size_t> all( aModel.meshes.size() );
+		std::iota( all.begin(), all.end(), std::size_t(0) );
+
+		std::vector<IndexedMesh> meshes( aModel.meshes.size() );
+		std::vector<double> weldSeconds( aModel.meshes.size() );
+		index_meshes_( aModel, all, aPool, aErrorTolerance, meshes, weldSeconds );
+
+		std::size_t vertices = 0, triangles = 0;
+		for( auto const& mesh : meshes )
+		{
+			vertices += mesh.vert.size();
+			triangles += mesh.indices.size() / 3;
+		}
+
+		auto const time_ = [&] (char const* aName, auto&& aCompute) {
+			std::vector<std::vector<glm::vec4>> ret;
+			ret.reserve( meshes.size() );
+
+			auto const start = Clock_::now();
+			for( auto const& mesh : meshes )
+				ret.emplace_back( aCompute( mesh ) );
+			auto const ms = std::chrono::duration_cast<Msf_>( Clock_::now() - start ).count();
+
+			std::printf( "   - %-28s %10.1f ms\n", aName, ms );
+			return std::make_pair( std::move(ret), ms );
+		};
+
+		std::printf( " - tangent benchmark, %zu vertices, %zu triangles, %zu threads\n", vertices, triangles, aPool.thread_count() );
+
+		auto const [reference, refMs] = time_( "reference (tgen)", [&] (IndexedMesh const& aMesh) {
+			return compute_tangents_reference( aMesh );
+		} );
+		auto const [serial, serialMs] = time_( "fused SIMD", [&] (IndexedMesh const& aMesh) {
+			return compute_tangents( attribute_views( aMesh ), aMesh.indices );
+		} );
+		auto const [pooled, pooledMs] = time_( "fused SIMD, pooled", [&] (IndexedMesh const& aMesh) {
+			return compute_tangents( attribute_views( aMesh ), aMesh.indices, &aPool );
+		} );
+
+		for( std::size_t i = 0; i < meshes.size(); ++i )
+		{
+			if( serial[i].size() != pooled[i].size() || 0 != std::memcmp( serial[i].data(), pooled[i].data(), serial[i].size()*sizeof(glm::vec4) ) )
+				throw lut::Error( "Tangent benchmark: pooled results differ from serial results" );
+		}
+
+		// Compare against the reference. Vertices whose UVs are degenerate
+		// get NaN tangents in both.
+		double maxDegrees = 0.0;
+		std::size_t above = 0, signs = 0, degenerate = 0, mismatched = 0;
+		for( std::size_t i = 0; i < meshes.size(); ++i )
+		{
+			assert( serial[i].size() == reference[i].size() );
+			for( std::size_t j = 0; j < serial[i].size(); ++j )
+			{
+				glm::dvec4 const t( serial[i][j] );
+				glm::dvec4 const r( reference[i][j] );
+
+				bool const tnan = glm::any( glm::isnan( t ) );
+				bool const rnan = glm::any( glm::isnan( r ) );
+				if( tnan || rnan )
+				{
+					if( tnan == rnan )
+						++degenerate;
+					else
+						++mismatched;
+					continue;
+				}
+
+				if( t.w != r.w )
+					++signs;
+
+				double const c = glm::dot( glm::dvec3(t), glm::dvec3(r) ) / (glm::length( glm::dvec3(t) ) * glm::length( glm::dvec3(r) ));
+				double const degrees = glm::degrees( std::acos( std::clamp( c, -1.0, 1.0 ) ) );
+
+				maxDegrees = std::max( maxDegrees, degrees );
+				if( degrees > kTangentToleranceDegrees )
+					++above;
+			}
+		}
+
+		std::printf( "   - speedup: %.2fx serial, %.2fx pooled\n", refMs / serialMs, refMs / pooledMs );
+		std::printf( "   - vs. reference: max. deviation %.2g deg, %zu vertices above %g deg, %zu sign mismatches, %zu degenerate (NaN in both), %zu mismatched\n", maxDegrees, above, kTangentToleranceDegrees, signs, degenerate, mismatched );
+
+		if( above || signs || mismatched )
+			throw lut::Error( "Tangent benchmark: results differ from reference implementation" );
 	}
 
-	std::unordered_map<std::string,TextureInfo_> new_paths_( std::unordered_map<std::string,TextureInfo_> aTextures, std::filesystem::path const& aTexDir )
+	void self_test_( std::size_t aThreads )
 	{
-		for( auto& entry : aTextures )
+		ThreadPool pool( aThreads );
+
+		std::printf( "Self test (%zu threads)\n", pool.thread_count() );
+
+		// Meshes that lose all their triangles in the cleanup must not reach
+		// the output; the renderer cannot create zero-sized buffers for them.
+		// The model has three meshes: one where the cleanup removes a
+		// zero-area and a collapsed triangle but keeps one, one with only
+		// such triangles, and one that is left alone.
 		{
-			std::filesystem::path const originalPath( entry.first );
-			auto const filename = originalPath.filename();
-			auto const newpath = aTexDir / filename;
-		
-			auto& info = entry.second;
-			info.newPath = newpath.string();
+			glm::vec3 const p[4] = { { 0.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, { 2.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } };
+			int const corners[] = {
+				0, 1, 3,   0, 1, 2,   0, 0, 1,   // kept, zero area, collapsed
+				0, 1, 2,   1, 1, 3,              // zero area, collapsed
+				0, 1, 3                          // kept
+			};
+			std::size_t const triangles[] = { 3, 2, 1 };
+
+			InputModel model;
+			for( auto const c : corners )
+			{
+				model.positions.emplace_back( p[c] );
+				model.normals.emplace_back( 0.f, 0.f, 1.f );
+				model.texcoords.emplace_back( p[c].x, p[c].y );
+			}
+
+			std::size_t start = 0;
+			for( std::size_t i = 0; i < std::size(triangles); ++i )
+			{
+				model.meshes.emplace_back( InputMeshInfo{ "mesh" + std::to_string(i), 0, start, 3*triangles[i] } );
+				start += 3*triangles[i];
+			}
+
+			std::vector<std::size_t> all( model.meshes.size() );
+			std::iota( all.begin(), all.end(), std::size_t(0) );
+
+			std::vector<IndexedMesh> indexed( model.meshes.size() );
+			std::vector<std::vector<glm::vec4>> tangents( model.meshes.size() );
+			std::vector<double> seconds( model.meshes.size() );
+			std::vector<TriangleCleanupStats> cleanup( model.meshes.size() );
+
+			index_meshes_( model, all, pool, BakeOptions_{}.errorTolerance, indexed, seconds );
+			clean_meshes_( indexed, all, pool, false, cleanup );
+			compute_mesh_tangents_( indexed, all, pool, tangents, seconds );
+
+			std::size_t const expectedIndices[] = { 3, 0, 3 };
+			for( std::size_t i = 0; i < model.meshes.size(); ++i )
+			{
+				if( expectedIndices[i] != indexed[i].indices.size() )
+					throw lut::Error( "Self test: mesh %zu has %zu indices after the cleanup, expected %zu", i, indexed[i].indices.size(), expectedIndices[i] );
+			}
+			if( 1 != cleanup[0].zeroArea || 1 != cleanup[0].collapsed || 1 != cleanup[1].zeroArea || 1 != cleanup[1].collapsed || 0 != cleanup[2].triangles() )
+				throw lut::Error( "Self test: unexpected cleanup statistics" );
+
+			std::vector<std::size_t> sources = all;
+			auto const dropped = drop_empty_meshes_( indexed, tangents, sources );
+
+			IndexBufferStats_ indexStats;
+			split_meshes_( indexed, tangents, sources, indexStats );
+
+			if( 1 != dropped || std::vector<std::size_t>{ 0, 2 } != sources )
+				throw lut::Error( "Self test: expected only mesh 1 to be dropped (dropped %zu, %zu meshes left)", dropped, sources.size() );
+
+			for( std::size_t i = 0; i < indexed.size(); ++i )
+			{
+				if( indexed[i].vert.empty() || indexed[i].indices.empty() || tangents[i].size() != indexed[i].vert.size() )
+					throw lut::Error( "Self test: output mesh %zu (input mesh %zu) is empty", i, sources[i] );
+			}
+
+			std::printf( " - empty meshes after cleanup: ok\n" );
 		}
+	}
 
-		// Note: aTextures is still local to the function, so there is no need
-		// to explicitly std::move() it. However, since it is passed in as an
-		// argument, NRVO is unlikely to occur.
-		return aTextures; 
+	void write_seekable_input_( char const* aInputOBJ, char const* aOutput, std::size_t aThreads )
+	{
+		// Re-encode the input into the seekable format, so that it can be
+		// decompressed in parallel, and check that it reads back exactly.
+		ThreadPool pool( aThreads );
+
+		MappedBuffer text;
+		decompress_zstd( aInputOBJ, text, &pool );
+
+		auto const start = std::chrono::steady_clock::now();
+		write_seekable_zstd( aOutput, text.data(), text.size(), kSeekableFrameSize, &pool );
+		auto const end = std::chrono::steady_clock::now();
+
+		MappedBuffer check;
+		if( !decompress_seekable_zstd( aOutput, check, &pool ) )
+			throw lut::Error( "%s: not recognized as a seekable zstd file", aOutput );
+
+		if( check.size() != text.size() || 0 != std::memcmp( check.data(), text.data(), text.size() ) )
+			throw lut::Error( "%s: does not decompress to the contents of '%s'", aOutput, aInputOBJ );
+
+		std::error_code ec;
+		auto const bytes = std::filesystem::file_size( aOutput, ec );
+
+		std::printf( "Wrote '%s': %zu kB in %zu frames => %zu kB in %.1f ms, verified.\n",
+			aOutput,
+			text.size()/1024, (text.size() + kSeekableFrameSize-1) / kSeekableFrameSize,
+			std::size_t(bytes/1024),
+			std::chrono::duration<double,std::milli>( end - start ).count()
+		);
 	}
-}
 
+	void benchmark_layouts_( std::vector<IndexedMesh> const& aMeshes, std::vector<std::vector<glm::vec4>> const& aTangents )
+	{
+		// Compare vertex fetch for the layouts the bake can produce, over all
+		// meshes, for both fp32 and quantized attributes.
+		std::vector<QuantizedMesh> quantized;
+		for( std::size_t i = 0; i < aMeshes.size(); ++i )
+			quantized.emplace_back( quantize_mesh( aMeshes[i], aTangents[i] ) );
+
+		std::printf( " - vertex fetch benchmark (post-transform FIFO %zu, fetch cache %zu x %zu bytes)\n", kVertexCacheSize, kFetchCacheLines, kFetchCacheLineSize );
+		std::printf( "   - %-28s %6s %10s %12s %10s %10s\n", "layout", "B/vert", "transforms", "fetched kB", "gather ms", "checksum" );
+
+		enum class Mode_ { separate, interleaved, positionOnly };
+		auto const run_ = [&] (char const* aName, bool aQuantized, Mode_ aMode) {
+			VertexFetchStats total{ 0, 0, 0.0, 0 };
+			std::size_t vertexBytes = 0;
+
+			for( std::size_t i = 0; i < aMeshes.size(); ++i )
+			{
+				VertexStream position;
+				auto const attributes = vertex_streams_( aMeshes[i], aTangents[i], aQuantized ? &quantized[i] : nullptr, position );
+
+				std::vector<VertexStream> streams{ position };
+				std::vector<std::uint8_t> interleaved;
 
+				if( Mode_::separate == aMode )
+				{
+					streams.insert( streams.end(), attributes.begin(), attributes.end() );
+				}
+				else if( Mode_::interleaved == aMode )
+				{
+					interleaved = interleave_streams( attributes, aMeshes[i].vert.size() );
+
+					std::size_t stride = 0;
+					for( auto const& stream : attributes )
+						stride += stream.elementSize;
 
+					streams.emplace_back( VertexStream{ interleaved.data(), stride, stride } );
+				}
+
+				vertexBytes = 0;
+				for( auto const& stream : streams )
+					vertexBytes += stream.elementSize;
+
+				auto const stats = benchmark_vertex_fetch( aMeshes[i].indices, streams );
+				total.transforms += stats.transforms;
+				total.cacheLines += stats.cacheLines;
+				total.seconds += stats.seconds;
+				total.checksum ^= stats.checksum;
+			}
+
+			std::printf( "   - %-28s %6zu %10zu %12zu %10.2f   %08x\n", aName, vertexBytes, total.transforms, total.cacheLines*kFetchCacheLineSize/1024, total.seconds*1000.0, unsigned(total.checksum) );
+		};
+
+		run_( "fp32, separate", false, Mode_::separate );
+		run_( "fp32, interleaved", false, Mode_::interleaved );
+		run_( "fp32, position only", false, Mode_::positionOnly );
+		run_( "quantized, separate", true, Mode_::separate );
+		run_( "quantized, interleaved", true, Mode_::interleaved );
+		run_( "quantized, position only", true, Mode_::positionOnly );
+	}
+}
+
+namespace
+{
+	void clean_meshes_( std::vector<IndexedMesh>& aMeshes, std::vector<std::size_t> const& aMeshIndices, ThreadPool& aPool, bool aRemoveNonFinite, std::vector<TriangleCleanupStats>& aStats )
+	{
+		assert( aStats.size() == aMeshes.size() );
+
+		std::vector<std::size_t> weights;
+		for( auto const meshIndex : aMeshIndices )
+			weights.emplace_back( aMeshes[meshIndex].indices.size() );
+
+		parallel_for_order( aPool, largest_first_order( weights ), [&] (std::size_t aOrder) {
+			auto const meshIndex = aMeshIndices[aOrder];
+			aStats[meshIndex] = remove_degenerate_triangles( aMeshes[meshIndex], aRemoveNonFinite );
+		} );
+	}
+
+	void print_triangle_cleanup_( InputModel const& aModel, std::vector<TriangleCleanupStats> const& aStats, std::vector<std::size_t> const& aMeshIndices )
+	{
+		if( aMeshIndices.empty() )
+			return;
+
+		// Welding keeps one index per soup vertex, so the index count before
+		// the cleanup is the mesh's soup vertex count.
+		TriangleCleanupStats total;
+		std::size_t indices = 0;
+		for( auto const meshIndex : aMeshIndices )
+		{
+			auto const& stats = aStats[meshIndex];
+			total.collapsed += stats.collapsed;
+			total.nonFinite += stats.nonFinite;
+			total.zeroArea += stats.zeroArea;
+			total.duplicate += stats.duplicate;
+			total.vertices += stats.vertices;
+
+			indices += aModel.meshes[meshIndex].vertexCount;
+		}
+
+		auto const removed = 3*total.triangles();
+
+		std::printf( " - triangle cleanup: removed %zu of %zu triangles (%zu collapsed, %zu zero area, %zu duplicates, %zu non-finite) and %zu vertices\n", total.triangles(), indices/3, total.collapsed, total.zeroArea, total.duplicate, total.nonFinite, total.vertices );
+
+		for( auto const meshIndex : aMeshIndices )
+		{
+			auto const tris = aStats[meshIndex].triangles();
+			if( 0 == tris )
+				continue;
+
+			auto const meshIndices = aModel.meshes[meshIndex].vertexCount;
+			std::printf( "   - %-40s %6zu triangles, %.2f%% of indices%s\n", aModel.meshes[meshIndex].meshName.c_str(), tris, 100.0 * double(3*tris) / double(std::max<std::size_t>( 1, meshIndices )), 3*tris == meshIndices ? " (mesh dropped)" : "" );
+		}
+
+		std::printf( "   - indices: %zu => %zu (-%.2f%%)\n", indices, indices-removed, 100.0 * double(removed) / double(std::max<std::size_t>( 1, indices )) );
+	}
+
+	void compute_mesh_tangents_( std::vector<IndexedMesh> const& aMeshes, std::vector<std::size_t> const& aMeshIndices, ThreadPool& aPool, std::vector<std::vector<glm::vec4>>& aTangents, std::vector<double>& aSeconds )
+	{
+		assert( aTangents.size() == aMeshes.size() );
+		assert( aSeconds.size() == aMeshes.size() );
+
+		auto const tangents_ = [&] (std::size_t aMeshIndex, ThreadPool* aMeshPool) {
+			auto const start = std::chrono::steady_clock::now();
+			aTangents[aMeshIndex] = compute_tangents( attribute_views( aMeshes[aMeshIndex] ), aMeshes[aMeshIndex].indices, aMeshPool );
+			auto const end = std::chrono::steady_clock::now();
+
+			aSeconds[aMeshIndex] = std::chrono::duration<double>( end - start ).count();
+		};
+
+		// The tangent computation is dominated by the per-corner work. As
+		// with welding, very large meshes are processed one by one, with the
+		// pool parallelizing each of them internally.
+		std::vector<std::size_t> weights;
+		for( auto const meshIndex : aMeshIndices )
+			weights.emplace_back( aMeshes[meshIndex].indices.size() );
+
+		std::vector<std::size_t> perMesh;
+		for( auto const order : largest_first_order( weights ) )
+		{
+			auto const meshIndex = aMeshIndices[order];
+
+			if( aPool.thread_count() > 1 && aMeshes[meshIndex].indices.size() >= kParallelTangentThreshold )
+				tangents_( meshIndex, &aPool );
+			else
+				perMesh.emplace_back( meshIndex );
+		}
+
+		parallel_for_order( aPool, perMesh, [&] (std::size_t aMeshIndex) {
+			tangents_( aMeshIndex, nullptr );
+		} );
+	}
+
+	MeshOptimizationStats_::MeshOptimizationStats_( std::size_t aMeshCount )
+		: before( aMeshCount ), after( aMeshCount )
+		, overdrawBefore( aMeshCount ), overdrawAfter( aMeshCount )
+		, overdrawApplied( aMeshCount, 0 )
+		, triangles( aMeshCount, 0 )
+	{}
+
+	void optimize_meshes_( InputModel const& aModel, std::vector<IndexedMesh>& aMeshes, std::vector<std::vector<glm::vec4>>& aTangents, std::vector<std::size_t> const& aMeshIndices, ThreadPool& aPool, float aOverdrawThreshold, MeshOptimizationStats_& aStats )
+	{
+		// Reorder triangles for the post-transform cache first, optionally
+		// followed by the overdraw pass, then renumber vertices by first use.
+		// The tangents were computed before reordering and are permuted along
+		// with the vertices.
+		std::vector<std::size_t> weights;
+		for( auto const meshIndex : aMeshIndices )
+			weights.emplace_back( aMeshes[meshIndex].indices.size() );
+
+		parallel_for_order( aPool, largest_first_order( weights ), [&] (std::size_t aOrder) {
+			auto const meshIndex = aMeshIndices[aOrder];
+			auto& mesh = aMeshes[meshIndex];
+
+			aStats.before[meshIndex] = analyze_vertex_cache( mesh.indices, mesh.vert.size() );
+
+			optimize_vertex_cache( mesh );
+
+			if( aOverdrawThreshold > 0.f )
+			{
+				// Alpha masked materials are rendered without back-face culling
+				auto const& imesh = aModel.meshes[meshIndex];
+				bool const cull = aModel.materials[imesh.materialIndex].alphaMaskTexturePath.empty();
+
+				aStats.overdrawBefore[meshIndex] = analyze_overdraw( mesh, cull );
+				aStats.overdrawApplied[meshIndex] = optimize_overdraw( mesh, aOverdrawThreshold );
+				aStats.overdrawAfter[meshIndex] = aStats.overdrawApplied[meshIndex] 
+					? analyze_overdraw( mesh, cull ) 
+					: aStats.overdrawBefore[meshIndex]
+				;
+			}
+
+			optimize_vertex_fetch( mesh, aTangents[meshIndex] );
+
+			aStats.after[meshIndex] = analyze_vertex_cache( mesh.indices, mesh.vert.size() );
+			aStats.triangles[meshIndex] = mesh.indices.size() / 3;
+		} );
+	}
+
+	void print_mesh_optimization_( InputModel const& aModel, MeshOptimizationStats_ const& aStats, std::vector<std::size_t> const& aMeshIndices, float aOverdrawThreshold )
+	{
+		if( aMeshIndices.empty() )
+			return;
+
+		std::printf( " - vertex cache (FIFO %zu): ACMR / ATVR before => after\n", kVertexCacheSize );
+
+		double misses[2] = { 0.0, 0.0 };
+		std::size_t triangles = 0;
+		for( auto const meshIndex : aMeshIndices )
+		{
+			auto const& b = aStats.before[meshIndex];
+			auto const& a = aStats.after[meshIndex];
+
+			std::printf( "   - %-40s %6.3f / %6.3f => %6.3f / %6.3f\n", aModel.meshes[meshIndex].meshName.c_str(), b.acmr, b.atvr, a.acmr, a.atvr );
+
+			auto const tris = aStats.triangles[meshIndex];
+			misses[0] += double(b.acmr) * double(tris);
+			misses[1] += double(a.acmr) * double(tris);
+			triangles += tris;
+		}
+
+		if( triangles )
+			std::printf( "   - overall ACMR: %.3f => %.3f\n", misses[0] / triangles, misses[1] / triangles );
+
+		if( aOverdrawThreshold > 0.f )
+		{
+			std::printf( " - overdraw (%zu views, %zux%zu, ACMR threshold %.2f): before => after\n", kOverdrawViews, kOverdrawResolution, kOverdrawResolution, double(aOverdrawThreshold) );
+
+			OverdrawStats total[2] = { { 0, 0 }, { 0, 0 } };
+			for( auto const meshIndex : aMeshIndices )
+			{
+				auto const& b = aStats.overdrawBefore[meshIndex];
+				auto const& a = aStats.overdrawAfter[meshIndex];
+
+				std::printf( "   - %-40s %6.3f => %6.3f%s\n", aModel.meshes[meshIndex].meshName.c_str(), b.overdraw(), a.overdraw(), aStats.overdrawApplied[meshIndex] ? "" : " (unchanged)" );
+
+				total[0].shaded += b.shaded;
+				total[0].covered += b.covered;
+				total[1].shaded += a.shaded;
+				total[1].covered += a.covered;
+			}
+
+			std::printf( "   - overall overdraw: %.3f => %.3f\n", total[0].overdraw(), total[1].overdraw() );
+		}
+	}
+
+	std::vector<VertexStream> vertex_streams_( IndexedMesh const& aMesh, std::vector<glm::vec4> const& aTangents, QuantizedMesh const* aQuantized, VertexStream& aPosition )
+	{
+		if( aQuantized )
+		{
+			aPosition = VertexStream{ aQuantized->positions.data(), sizeof(glm::u16vec4), sizeof(glm::u16vec4) };
+			return {
+				VertexStream{ aQuantized->normals.data(), sizeof(glm::i16vec2), sizeof(glm::i16vec2) },
+				VertexStream{ aQuantized->texcoords.data(), sizeof(glm::u16vec2), sizeof(glm::u16vec2) },
+				VertexStream{ aQuantized->tangents.data(), sizeof(glm::i16vec2), sizeof(glm::i16vec2) }
+			};
+		}
+
+		assert( aTangents.size() == aMesh.vert.size() );
+
+		aPosition = VertexStream{ aMesh.vert.data(), sizeof(glm::vec3), sizeof(glm::vec3) };
+		return {
+			VertexStream{ aMesh.norm.data(), sizeof(glm::vec3), sizeof(glm::vec3) },
+			VertexStream{ aMesh.text.data(), sizeof(glm::vec2), sizeof(glm::vec2) },
+			VertexStream{ aTangents.data(), sizeof(glm::vec4), sizeof(glm::vec4) }
+		};
+	}
+
+	std::size_t drop_empty_meshes_( std::vector<IndexedMesh>& aMeshes, std::vector<std::vector<glm::vec4>>& aTangents, std::vector<std::size_t>& aMeshSources )
+	{
+		assert( aMeshes.size() == aTangents.size() && aMeshes.size() == aMeshSources.size() );
+
+		std::size_t out = 0;
+		for( std::size_t i = 0; i < aMeshes.size(); ++i )
+		{
+			if( aMeshes[i].indices.empty() )
+				continue;
+
+			if( out != i )
+			{
+				aMeshes[out] = std::move(aMeshes[i]);
+				aTangents[out] = std::move(aTangents[i]);
+				aMeshSources[out] = aMeshSources[i];
+			}
+
+			++out;
+		}
+
+		auto const dropped = aMeshes.size() - out;
+
+		aMeshes.resize( out );
+		aTangents.resize( out );
+		aMeshSources.resize( out );
+
+		return dropped;
+	}
+
+	void split_meshes_( std::vector<IndexedMesh>& aMeshes, std::vector<std::vector<glm::vec4>>& aTangents, std::vector<std::size_t>& aMeshSources, IndexBufferStats_& aStats )
+	{
+		std::vector<IndexedMesh> meshes;
+		std::vector<std::vector<glm::vec4>> tangents;
+		std::vector<std::size_t> sources;
+
+		for( std::size_t i = 0; i < aMeshes.size(); ++i )
+		{
+			if( aMeshes[i].vert.size() <= kMaxIndex16Vertices )
+			{
+				meshes.emplace_back( std::move(aMeshes[i]) );
+				tangents.emplace_back( std::move(aTangents[i]) );
+				sources.emplace_back( aMeshSources[i] );
+				continue;
+			}
+
+			std::vector<std::vector<glm::vec4>> partTangents;
+			auto parts = split_mesh( aMeshes[i], aTangents[i], partTangents );
+
+			for( std::size_t j = 0; j < parts.size(); ++j )
+			{
+				meshes.emplace_back( std::move(parts[j]) );
+				tangents.emplace_back( std::move(partTangents[j]) );
+				sources.emplace_back( aMeshSources[i] );
+			}
+
+			++aStats.split;
+		}
+
+		// Report index memory relative to 32-bit indices everywhere
+		for( auto const& mesh : meshes )
+		{
+			bool const use16 = mesh.vert.size() <= kMaxIndex16Vertices;
+			aStats.indices += mesh.indices.size();
+			aStats.bytes += mesh.indices.size() * (use16 ? sizeof(std::uint16_t) : sizeof(std::uint32_t));
+			aStats.meshes16 += use16 ? 1 : 0;
+		}
+
+		aStats.meshes += meshes.size();
+
+		aMeshes = std::move(meshes);
+		aTangents = std::move(tangents);
+		aMeshSources = std::move(sources);
+	}
+
+	void print_index_buffers_( IndexBufferStats_ const& aStats )
+	{
+		std::printf( " - index buffers: split %zu meshes => %zu meshes, %zu with 16-bit indices\n", aStats.split, aStats.meshes, aStats.meshes16 );
+		std::printf( "   - index data: %zu kB => %zu kB\n", aStats.indices*sizeof(std::uint32_t)/1024, aStats.bytes/1024 );
+	}
+
+	std::vector<std::vector<MeshRange>> merge_meshes_( InputModel const& aModel, std::vector<IndexedMesh>& aMeshes, std::vector<std::vector<glm::vec4>>& aTangents, std::vector<std::size_t>& aMeshSources )
+	{
+		auto const material_ = [&] (std::size_t aMesh) {
+			return aModel.meshes[aMeshSources[aMesh]].materialIndex;
+		};
+
+		// Group by material. Within a material, meshes keep their order and
+		// are packed into merged meshes until these would exceed the 16-bit
+		// index limit.
+		std::vector<std::size_t> order( aMeshes.size() );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+		std::stable_sort( order.begin(), order.end(), [&] (std::size_t aX, std::size_t aY) {
+			return material_( aX ) < material_( aY );
+		} );
+
+		std::vector<IndexedMesh> meshes;
+		std::vector<std::vector<glm::vec4>> tangents;
+		std::vector<std::size_t> sources;
+		std::vector<std::vector<MeshRange>> ranges;
+
+		std::size_t materials = 0;
+		for( auto const i : order )
+		{
+			bool const newMaterial = sources.empty() || material_( sources.back() ) != material_( i );
+			if( newMaterial )
+				++materials;
+
+			if( newMaterial || meshes.back().vert.size() + aMeshes[i].vert.size() > kMaxIndex16Vertices )
+			{
+				meshes.emplace_back();
+				tangents.emplace_back();
+				sources.emplace_back( i );
+				ranges.emplace_back();
+			}
+
+			ranges.back().emplace_back( append_mesh( meshes.back(), tangents.back(), aMeshes[i], aTangents[i] ) );
+		}
+
+		std::printf( " - merged by material: %zu meshes => %zu draws (%zu materials)\n", aMeshes.size(), meshes.size(), materials );
+
+		for( auto& source : sources )
+			source = aMeshSources[source];
+
+		aMeshes = std::move(meshes);
+		aTangents = std::move(tangents);
+		aMeshSources = std::move(sources);
+		return ranges;
+	}
+
+	std::vector<QuantizedMesh> quantize_meshes_( std::vector<IndexedMesh> const& aMeshes, std::vector<std::vector<glm::vec4>> const& aTangents, ThreadPool& aPool, QuantizationStats_& aStats )
+	{
+		std::vector<QuantizedMesh> ret( aMeshes.size() );
+		std::vector<QuantizationError> errors( aMeshes.size() );
+
+		std::vector<std::size_t> weights;
+		for( auto const& mesh : aMeshes )
+			weights.emplace_back( mesh.vert.size() );
+
+		parallel_for_order( aPool, largest_first_order( weights ), [&] (std::size_t aMeshIndex) {
+			ret[aMeshIndex] = quantize_mesh( aMeshes[aMeshIndex], aTangents[aMeshIndex] );
+			errors[aMeshIndex] = measure_quantization_error( aMeshes[aMeshIndex], aTangents[aMeshIndex], ret[aMeshIndex] );
+		} );
+
+		// Track savings and the largest error relative to the fp32 data.
+		for( std::size_t i = 0; i < aMeshes.size(); ++i )
+		{
+			aStats.vertices += aMeshes[i].vert.size();
+			aStats.indexBytes += aMeshes[i].indices.size() * (aMeshes[i].vert.size() <= kMaxIndex16Vertices ? sizeof(std::uint16_t) : sizeof(std::uint32_t));
+
+			auto const& err = errors[i];
+			auto& worst = aStats.worst;
+			worst.position = std::max( worst.position, err.position );
+			worst.texcoord = std::max( worst.texcoord, err.texcoord );
+			worst.normalDegrees = std::max( worst.normalDegrees, err.normalDegrees );
+			worst.tangentDegrees = std::max( worst.tangentDegrees, err.tangentDegrees );
+
+			auto const diagonal = glm::length( ret[i].posMax - ret[i].posMin );
+			if( diagonal > 0.f )
+				aStats.worstRelative = std::max( aStats.worstRelative, err.position / diagonal );
+		}
+
+		return ret;
+	}
+
+	void print_quantization_( QuantizationStats_ const& aStats )
+	{
+		auto const fp32Bytes = aStats.vertices * kFp32VertexSize;
+		auto const quantBytes = aStats.vertices * kQuantizedVertexSize;
+		auto const indexBytes = aStats.indexBytes;
+		auto const& worst = aStats.worst;
+
+		std::printf( " - quantized attributes: %zu => %zu bytes per vertex\n", kFp32VertexSize, kQuantizedVertexSize );
+		std::printf( "   - vertex data: %zu kB => %zu kB\n", fp32Bytes/1024, quantBytes/1024 );
+		std::printf( "   - VRAM incl. indices: %zu kB => %zu kB (%.1f%%)\n", (fp32Bytes+indexBytes)/1024, (quantBytes+indexBytes)/1024, 100.0 * double(quantBytes+indexBytes) / double(std::max<std::size_t>( 1, fp32Bytes+indexBytes )) );
+		std::printf( "   - max. error: position %g (%g of mesh diagonal), texcoord %g, normal %.4f deg, tangent %.4f deg\n", double(worst.position), double(aStats.worstRelative), double(worst.texcoord), double(worst.normalDegrees), double(worst.tangentDegrees) );
+	}
+
+	std::uint64_t bake_parameter_hash_( BakeOptions_ const& aOptions )
+	{
+		std::uint64_t h = hash_bytes( &kBakeCacheVersion, sizeof(kBakeCacheVersion) );
+		h = hash_bytes( kFileVariant, sizeof(kFileVariant), h );
+		h = hash_bytes( &aOptions.errorTolerance, sizeof(aOptions.errorTolerance), h );
+		h = hash_bytes( &aOptions.optimizeMeshes, sizeof(aOptions.optimizeMeshes), h );
+		h = hash_bytes( &kVertexCacheSize, sizeof(kVertexCacheSize), h );
+		h = hash_bytes( &aOptions.overdrawThreshold, sizeof(aOptions.overdrawThreshold), h );
+		h = hash_bytes( &aOptions.dropNonFinite, sizeof(aOptions.dropNonFinite), h );
+		return h;
+	}
+}
+
+namespace
+{
+	std::unordered_map<std::string,TextureInfo_> find_unique_textures_( InputModel const& aModel )
+	{
+		std::unordered_map<std::string,TextureInfo_> unique;
+
+		std::uint32_t texid = 0;
+		auto const add_unique_ = [&] (std::string const& aKey, std::uint8_t aChannels, TextureRole aRole, std::vector<std::string> aSources)
+		{
+			if( aKey.empty() )
+				return;
+
+			TextureInfo_ info{};
+			info.uniqueId = texid;
+			info.channels = aChannels;
+			info.role = aRole;
+			info.sources = std::move(aSources);
+
+			auto const [it, isNew] = unique.emplace( std::make_pair(aKey,info) );
+
+			if( isNew )
+				++texid;
+		};
+
+		for( auto const& mat : aModel.materials )
+		{
+			add_unique_( mat.baseColorTexturePath, 4, TextureRole::color, { mat.baseColorTexturePath } );
+			add_unique_( packed_texture_key_( mat ), 2, TextureRole::packed, { mat.roughnessTexturePath, mat.metalnessTexturePath } );
+			add_unique_( mat.alphaMaskTexturePath, 4, TextureRole::color, { mat.alphaMaskTexturePath } );  // assume == baseColor
+			add_unique_( mat.normalMapTexturePath, 3, TextureRole::normal, { mat.normalMapTexturePath } );  // xyz only
+		}
+
+		return unique;
+	}
+
+	std::string packed_texture_key_( InputMaterialInfo const& aMaterial )
+	{
+		// Roughness and metalness are combined into one texture. Both are
+		// always present, see normalize_().
+		return aMaterial.roughnessTexturePath + '\n' + aMaterial.metalnessTexturePath;
+	}
+
+	std::array<std::uint32_t,4> material_textures_( InputMaterialInfo const& aMaterial, std::unordered_map<std::string,TextureInfo_> const& aTextures )
+	{
+		auto const id_ = [&] (std::string const& aKey) {
+			if( aKey.empty() )
+				return ~std::uint32_t(0);
+
+			auto const it = aTextures.find( aKey );
+			assert( aTextures.end() != it );
+			return it->second.uniqueId;
+		};
+
+		return {
+			id_( aMaterial.baseColorTexturePath ),
+			id_( packed_texture_key_( aMaterial ) ),
+			id_( aMaterial.alphaMaskTexturePath ),
+			id_( aMaterial.normalMapTexturePath )
+		};
+	}
+
+	void deduplicate_textures_( std::unordered_map<std::string,TextureInfo_>& aTextures, bool aCompressed, std::filesystem::path const* aCacheDir, ThreadPool& aPool, DeduplicationStats_& aStats )
+	{
+		std::vector<TextureInfo_*> ordered( aTextures.size() );
+		for( auto& entry : aTextures )
+			ordered[entry.second.uniqueId] = &entry.second;
+
+		// Textures whose sources are unchanged since the last bake are not
+		// decoded again.
+		std::unordered_map<std::uint64_t,TextureContents> cached;
+		if( aCacheDir )
+			cached = load_cached_texture_contents( *aCacheDir );
+
+		std::vector<std::uint64_t> keys;
+		std::vector<TextureContents> contents( ordered.size() );
+		std::vector<std::size_t> pending;
+		for( std::size_t i = 0; i < ordered.size(); ++i )
+		{
+			keys.emplace_back( texture_cache_key( ordered[i]->sources, ordered[i]->role ) );
+
+			auto const it = cached.find( keys.back() );
+			if( cached.end() != it )
+				contents[i] = it->second;
+			else
+				pending.emplace_back( i );
+		}
+
+		// Decoding dominates, so the largest files go first
+		std::vector<std::size_t> weights;
+		for( auto const index : pending )
+		{
+			auto const* info = ordered[index];
+
+			std::size_t bytes = 0;
+			for( auto const& source : info->sources )
+			{
+				std::error_code ec;
+				bytes += std::size_t(std::filesystem::file_size( source, ec ));
+			}
+			weights.emplace_back( bytes );
+		}
+
+		auto const start = std::chrono::steady_clock::now();
+		parallel_for_order( aPool, largest_first_order( weights ), [&] (std::size_t aOrder) {
+			auto const index = pending[aOrder];
+			auto const* info = ordered[index];
+
+			contents[index] = TextureRole::packed == info->role
+				? packed_texture_contents( info->sources[0], info->sources[1] )
+				: texture_contents( info->sources.front(), info->role )
+			;
+		} );
+		auto const end = std::chrono::steady_clock::now();
+
+		// Only keep the entries of the current textures
+		if( aCacheDir && (!pending.empty() || cached.size() != ordered.size()) )
+		{
+			std::unordered_map<std::uint64_t,TextureContents> current;
+			for( std::size_t i = 0; i < ordered.size(); ++i )
+				current.emplace( keys[i], contents[i] );
+
+			store_cached_texture_contents( *aCacheDir, current );
+		}
+
+		// Textures are renumbered in their original order. A duplicate takes
+		// the id and path of the first texture with the same contents. The
+		// role is part of the hash, so e.g. a normal map never matches a
+		// color texture.
+		std::unordered_map<std::uint64_t,TextureInfo_ const*> byContents;
+
+		std::uint32_t texid = 0;
+		for( std::size_t i = 0; i < ordered.size(); ++i )
+		{
+			auto& info = *ordered[i];
+
+			auto const bytes = texture_vram_bytes_( info, contents[i], aCompressed );
+			aStats.vramBytes += bytes;
+
+			auto const [it, isNew] = byContents.emplace( contents[i].hash, &info );
+			if( isNew )
+			{
+				info.uniqueId = texid++;
+				continue;
+			}
+
+			info.uniqueId = it->second->uniqueId;
+			info.newPath = it->second->newPath;
+			info.duplicate = true;
+
+			aStats.savedBytes += bytes;
+		}
+
+		aStats.uniqueTextures = texid;
+		aStats.decoded = pending.size();
+		aStats.hashSeconds = std::chrono::duration<double>( end - start ).count();
+	}
+
+	void deduplicate_materials_( InputModel& aModel, std::unordered_map<std::string,TextureInfo_> const& aTextures, DeduplicationStats_& aStats )
+	{
+		// In the output, a material consists only of its textures (see MATS
+		// in global_sections_()); the scalar factors are not stored. With
+		// the textures deduplicated, materials that differ only in their
+		// texture paths thus become identical. Each one gets a descriptor set
+		// at runtime.
+		std::map<std::array<std::uint32_t,4>,std::size_t> unique;
+		std::vector<std::size_t> remap( aModel.materials.size() );
+
+		std::vector<InputMaterialInfo> kept;
+		for( std::size_t i = 0; i < aModel.materials.size(); ++i )
+		{
+			auto const [it, isNew] = unique.emplace( material_textures_( aModel.materials[i], aTextures ), kept.size() );
+			if( isNew )
+				kept.emplace_back( std::move(aModel.materials[i]) );
+
+			remap[i] = it->second;
+		}
+
+		aStats.uniqueMaterials = kept.size();
+		aModel.materials = std::move(kept);
+
+		for( auto& mesh : aModel.meshes )
+			mesh.materialIndex = remap[mesh.materialIndex];
+	}
+
+	void print_deduplication_( DeduplicationStats_ const& aStats )
+	{
+		std::printf( " - unique textures: %zu => %zu by contents (%zu decoded in %.1f ms), VRAM: %zu kB => %zu kB\n",
+			aStats.textures, aStats.uniqueTextures,
+			aStats.decoded, aStats.hashSeconds * 1000.0,
+			aStats.vramBytes/1024, (aStats.vramBytes - aStats.savedBytes)/1024
+		);
+		std::printf( " - materials: %zu => %zu (%zu fewer descriptor sets)\n", aStats.materials, aStats.uniqueMaterials, aStats.materials - aStats.uniqueMaterials );
+	}
+
+	std::size_t texture_vram_bytes_( TextureInfo_ const& aInfo, TextureContents const& aContents, bool aCompressed )
+	{
+		// Full mip chain. Compressed textures use the block format picked by
+		// compress_texture(). Otherwise, the runtime uploads color textures
+		// as RGBA8, normal maps as R8G8 and the others with one byte per
+		// channel (see src/main.cpp).
+		std::size_t blockBytes = 0, texelBytes = 0;
+		if( aCompressed )
+			blockBytes = texture_block_size( compressed_texture_format( aInfo.role, aContents.hasAlpha ) );
+		else
+			texelBytes = TextureRole::color == aInfo.role ? 4 : TextureRole::normal == aInfo.role ? 2 : aInfo.channels;
+
+		std::size_t bytes = 0;
+		for( std::size_t w = aContents.width, h = aContents.height; ; w = std::max<std::size_t>( 1, w/2 ), h = std::max<std::size_t>( 1, h/2 ) )
+		{
+			bytes += aCompressed
+				? ((w+3)/4) * ((h+3)/4) * blockBytes
+				: w * h * texelBytes
+			;
+
+			if( 1 == w && 1 == h )
+				break;
+		}
+
+		return bytes;
+	}
+
+	std::unordered_map<std::string,TextureInfo_> new_paths_( std::unordered_map<std::string,TextureInfo_> aTextures, std::filesystem::path const& aTexDir, bool aCompressed )
+	{
+		for( auto& entry : aTextures )
+		{
+			std::filesystem::path const originalPath( entry.second.sources.front() );
+			auto filename = originalPath.filename();
+
+			if( TextureRole::packed == entry.second.role )
+			{
+				auto const other = std::filesystem::path( entry.second.sources.back() ).stem();
+				filename = filename.stem().string() + "-" + other.string() + ".png";
+			}
+
+			if( aCompressed )
+				filename.replace_extension( kCompressedTextureExtension );
+
+			auto const newpath = aTexDir / filename;
+		
+			auto& info = entry.second;
+			info.newPath = newpath.string();
+		}
+
+		// Note: aTextures is still local to the function, so there is no need
+		// to explicitly std::move() it. However, since it is passed in as an
+		// argument, NRVO is unlikely to occur.
+		return aTextures; 
+	}
+}
+
+namespace
+{
+	std::size_t copy_textures_( std::unordered_map<std::string,TextureInfo_> const& aTextures, std::filesystem::path const& aRootDir )
+	{
+		std::size_t errors = 0, written = 0, total = 0;
+		for( auto const& entry : aTextures )
+		{
+			if( entry.second.duplicate )
+				continue;
+
+			++total;
+			auto const dest = aRootDir / entry.second.newPath;
+
+			// Packed textures don't exist in the input and are created here
+			if( TextureRole::packed == entry.second.role )
+			{
+				if( !output_is_current_( dest, entry.second.sources ) )
+				{
+					write_packed_image( dest, entry.second.sources[0], entry.second.sources[1] );
+					++written;
+				}
+				continue;
+			}
+
+			std::error_code ec;
+			bool ret = std::filesystem::copy_file( 
+				entry.second.sources.front(),
+				dest,
+				std::filesystem::copy_options::none,
+				ec
+			);
+
+			if( !ret )
+			{
+				++errors;
+				std::fprintf( stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(), ec.message().c_str(), ec.category().name() );
+			}
+			else
+			{
+				++written;
+			}
+		}
+
+		std::printf( "Copied %zu textures out of %zu.\n", total-errors, total );
+		if( errors )
+		{
+			std::fprintf( stderr, "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n" );
+		}
+
+		return written;
+	}
+
+	std::size_t compress_textures_( std::unordered_map<std::string,TextureInfo_> const& aTextures, std::filesystem::path const& aRootDir, ThreadPool& aPool )
+	{
+		// Textures are only recompressed if the source is newer than the
+		// output, or if the output is from an older version of the bake.
+		std::vector<TextureInfo_ const*> pending;
+		std::size_t total = 0;
+		for( auto const& entry : aTextures )
+		{
+			if( entry.second.duplicate )
+				continue;
+
+			++total;
+			auto const dest = aRootDir / entry.second.newPath;
+
+			bool current = true;
+			for( auto const& source : entry.second.sources )
+				current = current && compressed_texture_is_current( dest, source );
+
+			if( !current )
+				pending.emplace_back( &entry.second );
+		}
+
+		std::vector<std::size_t> weights;
+		for( auto const* info : pending )
+		{
+			std::size_t bytes = 0;
+			for( auto const& source : info->sources )
+			{
+				std::error_code ec;
+				bytes += std::size_t(std::filesystem::file_size( source, ec ));
+			}
+			weights.emplace_back( bytes );
+		}
+
+		std::vector<std::size_t> rawBytes( pending.size(), 0 ), outBytes( pending.size(), 0 );
+
+		auto const start = std::chrono::steady_clock::now();
+		parallel_for_order( aPool, largest_first_order( weights ), [&] (std::size_t aIndex) {
+			auto const* info = pending[aIndex];
+
+			auto const texture = TextureRole::packed == info->role
+				? compress_packed_texture( info->sources[0], info->sources[1] )
+				: compress_texture( info->sources.front(), info->role )
+			;
+			write_compressed_texture( aRootDir / info->newPath, texture );
+
+			for( auto const& level : texture.levels )
+			{
+				rawBytes[aIndex] += std::size_t(level.width) * level.height * 4;
+				outBytes[aIndex] += level.blocks.size();
+			}
+		} );
+		auto const end = std::chrono::steady_clock::now();
+
+		auto const raw = std::accumulate( rawBytes.begin(), rawBytes.end(), std::size_t(0) );
+		auto const out = std::accumulate( outBytes.begin(), outBytes.end(), std::size_t(0) );
+
+		std::printf( "Compressed %zu textures out of %zu (others are up to date) in %.1f ms.\n", pending.size(), total, std::chrono::duration<double,std::milli>( end - start ).count() );
+		if( !pending.empty() )
+			std::printf( " - with mips: %zu kB (RGBA8: %zu kB, %.1f%%)\n", out/1024, raw/1024, 100.0 * double(out) / double(raw) );
+
+		return pending.size();
+	}
+
+	bool output_is_current_( std::filesystem::path const& aPath, std::vector<std::string> const& aSources )
+	{
+		std::error_code ec;
+		auto const outTime = std::filesystem::last_write_time( aPath, ec );
+		if( ec )
+			return false;
+
+		for( auto const& source : aSources )
+		{
+			auto const srcTime = std::filesystem::last_write_time( source, ec );
+			if( ec || outTime < srcTime )
+				return false;
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,263 @@
+#include "mapped_buffer.hpp"
+
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#endif
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	char* map_anonymous_( std::size_t aSize );
+	char* map_file_( std::intptr_t aFile, std::size_t aSize );
+	void unmap_( char* aData, std::size_t aSize ) noexcept;
+
+	std::intptr_t create_spill_file_( std::filesystem::path const& aDir );
+	void set_file_size_( std::intptr_t aFile, std::size_t aSize );
+	void close_file_( std::intptr_t aFile ) noexcept;
+
+	std::size_t page_size_() noexcept;
+}
+
+MappedBuffer::MappedBuffer() noexcept = default;
+
+MappedBuffer::MappedBuffer( std::size_t aSize )
+	: mData( map_anonymous_( aSize ) )
+	, mSize( mData ? aSize : 0 )
+{}
+
+MappedBuffer::MappedBuffer( std::size_t aSize, std::filesystem::path const& aSpillDir )
+	: mFile( create_spill_file_( aSpillDir ) )
+{
+	try
+	{
+		set_file_size_( mFile, aSize );
+		mData = map_file_( mFile, aSize );
+		mSize = mData ? aSize : 0;
+	}
+	catch( ... )
+	{
+		close_file_( mFile );
+		throw;
+	}
+}
+
+MappedBuffer::~MappedBuffer()
+{
+	unmap_( mData, mSize );
+
+	if( spilled() )
+		close_file_( mFile );
+}
+
+MappedBuffer::MappedBuffer( MappedBuffer&& aOther ) noexcept
+	: mData( std::exchange( aOther.mData, nullptr ) )
+	, mSize( std::exchange( aOther.mSize, 0 ) )
+	, mFile( std::exchange( aOther.mFile, -1 ) )
+{}
+
+MappedBuffer& MappedBuffer::operator=( MappedBuffer&& aOther ) noexcept
+{
+	std::swap( mData, aOther.mData );
+	std::swap( mSize, aOther.mSize );
+	std::swap( mFile, aOther.mFile );
+	return *this;
+}
+
+void MappedBuffer::resize( std::size_t aSize )
+{
+	if( aSize == mSize )
+		return;
+
+	if( spilled() )
+	{
+		// The contents live in the file; map it again at the new size.
+		unmap_( mData, mSize );
+		mData = nullptr;
+		mSize = 0;
+
+		set_file_size_( mFile, aSize );
+		mData = map_file_( mFile, aSize );
+		mSize = mData ? aSize : 0;
+	}
+	else
+	{
+		char* data = map_anonymous_( aSize );
+		if( mData && data )
+			std::memcpy( data, mData, std::min( mSize, aSize ) );
+
+		unmap_( mData, mSize );
+		mData = data;
+		mSize = data ? aSize : 0;
+	}
+}
+
+void MappedBuffer::evict( std::size_t aOffset, std::size_t aSize ) noexcept
+{
+	if( !mData || aOffset >= mSize )
+		return;
+
+	aSize = std::min( aSize, mSize - aOffset );
+
+	auto const pageSize = std::uintptr_t(page_size_());
+	auto const first = reinterpret_cast<std::uintptr_t>(mData + aOffset);
+	auto const beg = (first + pageSize-1) / pageSize * pageSize;
+	auto const end = (first + aSize) / pageSize * pageSize;
+	if( end <= beg )
+		return;
+
+	// Failures are ignored; the pages then simply stay resident for longer.
+	// Dirty pages of the spill file are written back by the OS.
+#	if defined(_WIN32)
+	if( spilled() )
+		VirtualUnlock( reinterpret_cast<void*>(beg), end-beg ); // removes unlocked pages from the working set
+	else
+		VirtualFree( reinterpret_cast<void*>(beg), end-beg, MEM_DECOMMIT );
+#	else
+	madvise( reinterpret_cast<void*>(beg), end-beg, MADV_DONTNEED );
+#	endif
+}
+
+namespace
+{
+	char* map_anonymous_( std::size_t aSize )
+	{
+		if( 0 == aSize )
+			return nullptr;
+
+#		if defined(_WIN32)
+		void* ptr = VirtualAlloc( nullptr, aSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+		if( !ptr )
+			throw lut::Error( "VirtualAlloc(): unable to map %zu bytes (error %lu)", aSize, GetLastError() );
+#		else
+		void* ptr = mmap( nullptr, aSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if( MAP_FAILED == ptr )
+			throw lut::Error( "mmap(): unable to map %zu bytes: %s", aSize, std::strerror(errno) );
+#		endif
+
+		return static_cast<char*>(ptr);
+	}
+
+	char* map_file_( std::intptr_t aFile, std::size_t aSize )
+	{
+		if( 0 == aSize )
+			return nullptr;
+
+#		if defined(_WIN32)
+		auto const size = std::uint64_t(aSize);
+		HANDLE mapping = CreateFileMappingW( reinterpret_cast<HANDLE>(aFile), nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), nullptr );
+		if( !mapping )
+			throw lut::Error( "CreateFileMapping(): unable to map %zu bytes (error %lu)", aSize, GetLastError() );
+
+		// The view keeps the mapping object alive
+		void* ptr = MapViewOfFile( mapping, FILE_MAP_ALL_ACCESS, 0, 0, aSize );
+		auto const err = GetLastError();
+		CloseHandle( mapping );
+
+		if( !ptr )
+			throw lut::Error( "MapViewOfFile(): unable to map %zu bytes (error %lu)", aSize, err );
+#		else
+		void* ptr = mmap( nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED, int(aFile), 0 );
+		if( MAP_FAILED == ptr )
+			throw lut::Error( "mmap(): unable to map %zu bytes of spill file: %s", aSize, std::strerror(errno) );
+#		endif
+
+		return static_cast<char*>(ptr);
+	}
+
+	void unmap_( char* aData, std::size_t aSize ) noexcept
+	{
+		if( !aData )
+			return;
+
+#		if defined(_WIN32)
+		// Anonymous buffers come from VirtualAlloc(), spilled ones are views
+		MEMORY_BASIC_INFORMATION info;
+		if( VirtualQuery( aData, &info, sizeof(info) ) && MEM_MAPPED == info.Type )
+			UnmapViewOfFile( aData );
+		else
+			VirtualFree( aData, 0, MEM_RELEASE );
+		(void)aSize;
+#		else
+		munmap( aData, aSize );
+#		endif
+	}
+
+	std::intptr_t create_spill_file_( std::filesystem::path const& aDir )
+	{
+#		if defined(_WIN32)
+		wchar_t name[MAX_PATH];
+		if( !GetTempFileNameW( aDir.wstring().c_str(), L"spl", 0, name ) )
+			throw lut::Error( "Unable to create a spill file in '%s' (error %lu)", aDir.string().c_str(), GetLastError() );
+
+		HANDLE file = CreateFileW( name, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, nullptr );
+		if( INVALID_HANDLE_VALUE == file )
+		{
+			auto const err = GetLastError();
+			DeleteFileW( name );
+			throw lut::Error( "Unable to open spill file in '%s' (error %lu)", aDir.string().c_str(), err );
+		}
+
+		return reinterpret_cast<std::intptr_t>(file);
+#		else
+		// The file is unlinked right away; it disappears with the last
+		// reference, even if the process is killed.
+		std::string name = (aDir / ".spill-map-XXXXXX").string();
+
+		int const fd = mkstemp( name.data() );
+		if( -1 == fd )
+			throw lut::Error( "Unable to create a spill file in '%s': %s", aDir.string().c_str(), std::strerror(errno) );
+
+		unlink( name.c_str() );
+		return fd;
+#		endif
+	}
+
+	void set_file_size_( std::intptr_t aFile, std::size_t aSize )
+	{
+#		if defined(_WIN32)
+		LARGE_INTEGER size;
+		size.QuadPart = LONGLONG(aSize);
+		if( !SetFilePointerEx( reinterpret_cast<HANDLE>(aFile), size, nullptr, FILE_BEGIN ) || !SetEndOfFile( reinterpret_cast<HANDLE>(aFile) ) )
+			throw lut::Error( "Unable to resize spill file to %zu bytes (error %lu)", aSize, GetLastError() );
+#		else
+		if( 0 != ftruncate( int(aFile), off_t(aSize) ) )
+			throw lut::Error( "Unable to resize spill file to %zu bytes: %s", aSize, std::strerror(errno) );
+#		endif
+	}
+
+	void close_file_( std::intptr_t aFile ) noexcept
+	{
+#		if defined(_WIN32)
+		CloseHandle( reinterpret_cast<HANDLE>(aFile) );
+#		else
+		close( int(aFile) );
+#		endif
+	}
+
+	std::size_t page_size_() noexcept
+	{
+#		if defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		return info.dwPageSize;
+#		else
+		return std::size_t(sysconf( _SC_PAGESIZE ));
+#		endif
+	}
+}
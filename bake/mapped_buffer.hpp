@@ -0,0 +1,145 @@
+#ifndef MAPPED_BUFFER_HPP_9B1E6C24_0F6A_4C8D_A3B7_2E5D81F04C6A
+#define MAPPED_BUFFER_HPP_9B1E6C24_0F6A_4C8D_A3B7_2E5D81F04C6A
+
+#include <new>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+#include <type_traits>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Large, page-backed scratch buffer.
+ *
+ * The memory is obtained directly from the OS as an anonymous mapping
+ * (mmap() / VirtualAlloc()). Unlike a std::vector, it is not value-
+ * initialized, so pages are only touched once they are written, e.g. by the
+ * threads that fill them.
+ *
+ * Alternatively, the buffer is backed by a temporary spill file in a given
+ * directory. The OS may then write its pages out and drop them, so that the
+ * buffer can be larger than the available memory; evict() does so right
+ * away. The spill file is removed when the buffer is destroyed.
+ */
+class MappedBuffer
+{
+	public:
+		MappedBuffer() noexcept;
+		explicit MappedBuffer( std::size_t aSize );
+		MappedBuffer( std::size_t aSize, std::filesystem::path const& aSpillDir );
+
+		~MappedBuffer();
+
+		MappedBuffer( MappedBuffer const& ) = delete;
+		MappedBuffer& operator= (MappedBuffer const&) = delete;
+
+		MappedBuffer( MappedBuffer&& ) noexcept;
+		MappedBuffer& operator= (MappedBuffer&&) noexcept;
+
+	public:
+		char* data() noexcept { return mData; }
+		char const* data() const noexcept { return mData; }
+
+		std::size_t size() const noexcept { return mSize; }
+
+		bool spilled() const noexcept { return -1 != mFile; }
+
+		// Change the size; the contents up to the smaller of the two sizes
+		// are kept. The buffer may move.
+		void resize( std::size_t aSize );
+
+		/* Drop the resident pages that lie entirely within [aOffset,
+		 * aOffset+aSize). A spilled buffer keeps its contents, which are read
+		 * back from the spill file when accessed again. The contents of an
+		 * anonymous buffer are lost, and the range must not be accessed
+		 * afterwards.
+		 */
+		void evict( std::size_t aOffset, std::size_t aSize ) noexcept;
+
+	private:
+		char* mData = nullptr;
+		std::size_t mSize = 0;
+
+		std::intptr_t mFile = -1; // file descriptor or HANDLE of the spill file
+};
+
+/* Array of tType in a MappedBuffer. Elements are not initialized; new ones
+ * read as zero. Growing with resize() or emplace_back() reserves capacity
+ * geometrically, like a std::vector.
+ */
+template< typename tType >
+class MappedArray
+{
+	static_assert( std::is_trivially_copyable<tType>::value, "MappedArray: tType must be trivially copyable" );
+
+	public:
+		MappedArray() noexcept = default;
+		explicit MappedArray( std::size_t aCount );
+		MappedArray( std::size_t aCount, std::filesystem::path const& aSpillDir );
+
+	public:
+		tType* data() noexcept { return reinterpret_cast<tType*>(mBuffer.data()); }
+		tType const* data() const noexcept { return reinterpret_cast<tType const*>(mBuffer.data()); }
+
+		std::size_t size() const noexcept { return mCount; }
+		bool empty() const noexcept { return 0 == mCount; }
+
+		tType& operator[] (std::size_t aI) noexcept { return data()[aI]; }
+		tType const& operator[] (std::size_t aI) const noexcept { return data()[aI]; }
+
+		tType* begin() noexcept { return data(); }
+		tType* end() noexcept { return data() + mCount; }
+		tType const* begin() const noexcept { return data(); }
+		tType const* end() const noexcept { return data() + mCount; }
+
+		void resize( std::size_t aCount );
+
+		template< typename... tArgs >
+		tType& emplace_back( tArgs&&... );
+
+		// See MappedBuffer::evict()
+		void evict( std::size_t aFirst, std::size_t aCount ) noexcept;
+		void evict() noexcept { evict( 0, mCount ); }
+
+	private:
+		MappedBuffer mBuffer;
+		std::size_t mCount = 0;
+};
+
+
+template< typename tType > inline
+MappedArray<tType>::MappedArray( std::size_t aCount )
+	: mBuffer( aCount * sizeof(tType) )
+	, mCount( aCount )
+{}
+template< typename tType > inline
+MappedArray<tType>::MappedArray( std::size_t aCount, std::filesystem::path const& aSpillDir )
+	: mBuffer( aCount * sizeof(tType), aSpillDir )
+	, mCount( aCount )
+{}
+
+template< typename tType > inline
+void MappedArray<tType>::resize( std::size_t aCount )
+{
+	auto const bytes = aCount * sizeof(tType);
+	if( bytes > mBuffer.size() )
+		mBuffer.resize( std::max( bytes, 2*mBuffer.size() ) );
+
+	mCount = aCount;
+}
+
+template< typename tType > template< typename... tArgs > inline
+tType& MappedArray<tType>::emplace_back( tArgs&&... aArgs )
+{
+	resize( mCount+1 );
+	return *::new (data() + mCount-1) tType( std::forward<tArgs>(aArgs)... );
+}
+
+template< typename tType > inline
+void MappedArray<tType>::evict( std::size_t aFirst, std::size_t aCount ) noexcept
+{
+	mBuffer.evict( aFirst * sizeof(tType), aCount * sizeof(tType) );
+}
+
+#endif // MAPPED_BUFFER_HPP_9B1E6C24_0F6A_4C8D_A3B7_2E5D81F04C6A
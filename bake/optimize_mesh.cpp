@@ -0,0 +1,802 @@
+#include "optimize_mesh.hpp"
+
+#include <array>
+#include <tuple>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	constexpr std::uint32_t kNone = ~std::uint32_t(0);
+
+	template< typename tType >
+	void permute_( std::vector<tType>& aData, std::vector<std::uint32_t> const& aRemap, std::size_t aCount );
+
+	// Keep the elements i with aRemap[i] != kNone, in order
+	template< typename tType >
+	void compact_( std::vector<tType>& aData, std::vector<std::uint32_t> const& aRemap );
+
+	template< typename tVec >
+	bool finite_( tVec const& ) noexcept;
+}
+
+TriangleCleanupStats remove_degenerate_triangles( IndexedMesh& aMesh, bool aRemoveNonFinite )
+{
+	auto& indices = aMesh.indices;
+	assert( 0 == indices.size() % 3 );
+
+	auto const vertexCount = aMesh.vert.size();
+	auto const triangleCount = indices.size() / 3;
+
+	TriangleCleanupStats ret;
+
+	std::vector<char> nonFinite;
+	if( aRemoveNonFinite )
+	{
+		nonFinite.resize( vertexCount, 0 );
+		for( std::size_t i = 0; i < vertexCount; ++i )
+		{
+			bool const finite = finite_( aMesh.vert[i] ) && finite_( aMesh.text[i] ) && (aMesh.norm.empty() || finite_( aMesh.norm[i] ));
+			nonFinite[i] = finite ? 0 : 1;
+		}
+	}
+
+	// Per-triangle tests
+	std::vector<char> keep( triangleCount, 0 );
+	for( std::size_t t = 0; t < triangleCount; ++t )
+	{
+		auto const* tri = indices.data() + 3*t;
+		if( tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2] )
+		{
+			++ret.collapsed;
+			continue;
+		}
+
+		if( aRemoveNonFinite && (nonFinite[tri[0]] || nonFinite[tri[1]] || nonFinite[tri[2]]) )
+		{
+			++ret.nonFinite;
+			continue;
+		}
+
+		glm::dvec3 const p0( aMesh.vert[tri[0]] );
+		auto const n = glm::cross( glm::dvec3( aMesh.vert[tri[1]] ) - p0, glm::dvec3( aMesh.vert[tri[2]] ) - p0 );
+		if( 0.0 == n.x && 0.0 == n.y && 0.0 == n.z )
+		{
+			++ret.zeroArea;
+			continue;
+		}
+
+		keep[t] = 1;
+	}
+
+	// Duplicates are equal once rotated such that the smallest vertex comes
+	// first (which keeps the winding). Bucket the kept triangles by that
+	// vertex (a counting sort), then sort each bucket by the other two
+	// vertices and the triangle index, so that duplicates are neighbours
+	// and the first of each set comes first; it is kept. Sorting keeps high
+	// valence vertices (e.g., the centre of a fan) at O(k log k).
+	std::vector<std::array<std::uint32_t,3>> canonical( triangleCount );
+	std::vector<std::uint32_t> first( vertexCount+1, 0 );
+	for( std::size_t t = 0; t < triangleCount; ++t )
+	{
+		if( !keep[t] )
+			continue;
+
+		auto const* tri = indices.data() + 3*t;
+		auto const r = tri[1] < tri[0] && tri[1] < tri[2] ? 1 : (tri[2] < tri[0] && tri[2] < tri[1] ? 2 : 0);
+		canonical[t] = { tri[r], tri[(r+1)%3], tri[(r+2)%3] };
+
+		++first[canonical[t][0]+1];
+	}
+
+	std::partial_sum( first.begin(), first.end(), first.begin() );
+
+	std::vector<std::uint32_t> buckets( first.back() );
+	{
+		std::vector<std::uint32_t> fill( first.begin(), first.end()-1 );
+		for( std::size_t t = 0; t < triangleCount; ++t )
+		{
+			if( keep[t] )
+				buckets[fill[canonical[t][0]]++] = std::uint32_t(t);
+		}
+	}
+
+	for( std::size_t v = 0; v < vertexCount; ++v )
+	{
+		auto const beg = buckets.begin() + first[v], end = buckets.begin() + first[v+1];
+		if( end - beg < 2 )
+			continue;
+
+		std::sort( beg, end, [&] (std::uint32_t aA, std::uint32_t aB) {
+			auto const& a = canonical[aA];
+			auto const& b = canonical[aB];
+			return std::tie( a[1], a[2], aA ) < std::tie( b[1], b[2], aB );
+		} );
+
+		for( auto it = beg+1; it != end; ++it )
+		{
+			auto const& a = canonical[*(it-1)];
+			auto const& b = canonical[*it];
+			if( a[1] == b[1] && a[2] == b[2] )
+			{
+				keep[*it] = 0;
+				++ret.duplicate;
+			}
+		}
+	}
+
+	if( 0 == ret.triangles() )
+		return ret;
+
+	// Compact the index buffer, then drop unreferenced vertices
+	std::size_t out = 0;
+	for( std::size_t t = 0; t < triangleCount; ++t )
+	{
+		if( !keep[t] )
+			continue;
+
+		for( std::size_t j = 0; j < 3; ++j )
+			indices[out++] = indices[3*t+j];
+	}
+
+	indices.resize( out );
+
+	std::vector<std::uint32_t> remap( vertexCount, kNone );
+	for( auto const idx : indices )
+		remap[idx] = 0;
+
+	std::uint32_t next = 0;
+	for( auto& r : remap )
+	{
+		if( kNone != r )
+			r = next++;
+	}
+
+	ret.vertices = vertexCount - next;
+	if( 0 == ret.vertices )
+		return ret;
+
+	for( auto& idx : indices )
+		idx = remap[idx];
+
+	compact_( aMesh.vert, remap );
+	compact_( aMesh.norm, remap );
+	compact_( aMesh.text, remap );
+
+	if( !aMesh.vert.empty() )
+	{
+		aMesh.aabbMin = aMesh.aabbMax = aMesh.vert.front();
+		for( auto const& v : aMesh.vert )
+		{
+			aMesh.aabbMin = glm::min( aMesh.aabbMin, v );
+			aMesh.aabbMax = glm::max( aMesh.aabbMax, v );
+		}
+	}
+
+	return ret;
+}
+
+
+VertexCacheStats analyze_vertex_cache( std::vector<std::uint32_t> const& aIndices, std::size_t aVertexCount, std::size_t aCacheSize )
+{
+	assert( aCacheSize > 0 );
+
+	if( aIndices.empty() || 0 == aVertexCount )
+		return VertexCacheStats{ 0.f, 0.f };
+
+	// FIFO cache. A vertex is in the cache if it was inserted within the
+	// last aCacheSize insertions.
+	std::vector<std::size_t> insertedAt( aVertexCount, 0 );
+	std::size_t time = aCacheSize+1; // Nothing is cached initially
+
+	std::size_t misses = 0;
+	for( auto const idx : aIndices )
+	{
+		assert( idx < aVertexCount );
+		if( time - insertedAt[idx] > aCacheSize )
+		{
+			insertedAt[idx] = time++;
+			++misses;
+		}
+	}
+
+	auto const triangles = aIndices.size() / 3;
+	return VertexCacheStats{
+		float(misses) / float(triangles),
+		float(misses) / float(aVertexCount)
+	};
+}
+
+void optimize_vertex_cache( IndexedMesh& aMesh, std::size_t aCacheSize )
+{
+	auto const& indices = aMesh.indices;
+	assert( 0 == indices.size() % 3 );
+
+	auto const vertexCount = aMesh.vert.size();
+	auto const triangleCount = indices.size() / 3;
+	if( 0 == triangleCount )
+		return;
+
+	// Vertex-triangle adjacency (CSR). live[] counts the not yet emitted
+	// triangles of each vertex.
+	std::vector<std::uint32_t> live( vertexCount, 0 );
+	for( auto const idx : indices )
+		++live[idx];
+
+	std::vector<std::uint32_t> offsets( vertexCount+1, 0 );
+	for( std::size_t v = 0; v < vertexCount; ++v )
+		offsets[v+1] = offsets[v] + live[v];
+
+	std::vector<std::uint32_t> adjacency( indices.size() );
+	{
+		std::vector<std::uint32_t> fill( offsets.begin(), offsets.end()-1 );
+		for( std::size_t i = 0; i < indices.size(); ++i )
+			adjacency[fill[indices[i]]++] = std::uint32_t(i / 3);
+	}
+
+	// Tipsify. Fan around the current vertex, emitting all of its remaining
+	// triangles; then pick the next fanning vertex among the vertices just
+	// emitted, preferring ones that will still be in the cache after their
+	// remaining triangles are emitted.
+	std::vector<std::size_t> cachedAt( vertexCount, 0 );
+	std::vector<char> emitted( triangleCount, 0 );
+	std::vector<std::uint32_t> deadEnd;
+	std::vector<std::uint32_t> candidates;
+
+	std::vector<std::uint32_t> out;
+	out.reserve( indices.size() );
+
+	std::size_t time = aCacheSize+1;
+	std::size_t cursor = 0;
+
+	auto const skip_dead_end_ = [&] () -> std::uint32_t {
+		while( !deadEnd.empty() )
+		{
+			auto const v = deadEnd.back();
+			deadEnd.pop_back();
+
+			if( live[v] > 0 )
+				return v;
+		}
+
+		for( ; cursor < vertexCount; ++cursor )
+		{
+			if( live[cursor] > 0 )
+				return std::uint32_t(cursor);
+		}
+
+		return kNone;
+	};
+
+	std::uint32_t fan = skip_dead_end_();
+	while( kNone != fan )
+	{
+		candidates.clear();
+
+		for( auto a = offsets[fan]; a < offsets[fan+1]; ++a )
+		{
+			auto const tri = adjacency[a];
+			if( emitted[tri] )
+				continue;
+
+			emitted[tri] = 1;
+			for( std::size_t k = 0; k < 3; ++k )
+			{
+				auto const v = indices[tri*3+k];
+				out.emplace_back( v );
+
+				deadEnd.emplace_back( v );
+				candidates.emplace_back( v );
+
+				--live[v];
+				if( time - cachedAt[v] > aCacheSize )
+					cachedAt[v] = time++;
+			}
+		}
+
+		// Next fanning vertex
+		std::uint32_t best = kNone;
+		std::size_t bestPriority = 0;
+		for( auto const v : candidates )
+		{
+			if( 0 == live[v] )
+				continue;
+
+			// Prefer vertices that remain in the cache while fanning; among
+			// these, the oldest one.
+			std::size_t priority = 0;
+			auto const age = time - cachedAt[v];
+			if( age + 2*std::size_t(live[v]) <= aCacheSize )
+				priority = age;
+
+			if( kNone == best || priority > bestPriority )
+			{
+				best = v;
+				bestPriority = priority;
+			}
+		}
+
+		fan = kNone != best ? best : skip_dead_end_();
+	}
+
+	assert( out.size() == indices.size() );
+	aMesh.indices = std::move(out);
+}
+
+bool optimize_overdraw( IndexedMesh& aMesh, float aThreshold, std::size_t aCacheSize )
+{
+	auto const& indices = aMesh.indices;
+	auto const& verts = aMesh.vert;
+
+	auto const triangleCount = indices.size() / 3;
+	if( triangleCount < 2 )
+		return false;
+
+	// FIFO cache simulation; reset by advancing the time stamp
+	std::vector<std::size_t> cachedAt( verts.size(), 0 );
+	std::size_t time = 0;
+
+	auto const reset_ = [&] {
+		time += aCacheSize+1;
+	};
+	auto const misses_ = [&] (std::size_t aTriangle) {
+		std::size_t misses = 0;
+		for( std::size_t k = 0; k < 3; ++k )
+		{
+			auto const v = indices[aTriangle*3+k];
+			if( time - cachedAt[v] > aCacheSize )
+			{
+				cachedAt[v] = time++;
+				++misses;
+			}
+		}
+		return misses;
+	};
+
+	// Hard boundaries: triangles where all three vertices miss typically
+	// start a new, disconnected, run in the cache-optimized order.
+	std::vector<std::size_t> hard;
+
+	reset_();
+	for( std::size_t t = 0; t < triangleCount; ++t )
+	{
+		if( 3 == misses_( t ) || 0 == t )
+			hard.emplace_back( t );
+	}
+	hard.emplace_back( triangleCount );
+
+	// Soft boundaries: split each hard cluster as soon as the ACMR of the
+	// current piece (starting with a cold cache) drops to within aThreshold
+	// of the ACMR of the whole hard cluster. A trailing piece that does not
+	// reach the target is merged into its predecessor.
+	std::vector<std::size_t> clusters;
+	for( std::size_t h = 0; h+1 < hard.size(); ++h )
+	{
+		auto const beg = hard[h], end = hard[h+1];
+
+		reset_();
+		std::size_t clusterMisses = 0;
+		for( auto t = beg; t < end; ++t )
+			clusterMisses += misses_( t );
+
+		auto const target = aThreshold * float(clusterMisses) / float(end-beg);
+
+		clusters.emplace_back( beg );
+
+		reset_();
+		std::size_t misses = 0, count = 0;
+		for( auto t = beg; t < end; ++t )
+		{
+			misses += misses_( t );
+			++count;
+
+			if( float(misses) <= target * float(count) )
+			{
+				clusters.emplace_back( t+1 );
+
+				reset_();
+				misses = count = 0;
+			}
+		}
+
+		// The last boundary is either at the end of the hard cluster or
+		// starts a piece that did not reach the target. Drop it in both
+		// cases, but keep the hard boundary.
+		if( clusters.back() != beg )
+			clusters.pop_back();
+	}
+	clusters.emplace_back( triangleCount );
+
+	auto const clusterCount = clusters.size() - 1;
+	if( clusterCount < 2 )
+		return false;
+
+	// Cluster centroids and normals (area weighted). Cluster sort key is the
+	// distance of the cluster's plane from the mesh centroid; clusters with
+	// large values face outwards.
+	std::vector<glm::vec3> centroids( clusterCount, glm::vec3( 0.f ) );
+	std::vector<glm::vec3> normals( clusterCount, glm::vec3( 0.f ) );
+	std::vector<float> areas( clusterCount, 0.f );
+
+	glm::vec3 meshCentroid( 0.f );
+	float meshArea = 0.f;
+
+	for( std::size_t c = 0; c < clusterCount; ++c )
+	{
+		for( auto t = clusters[c]; t < clusters[c+1]; ++t )
+		{
+			auto const& p0 = verts[indices[t*3+0]];
+			auto const& p1 = verts[indices[t*3+1]];
+			auto const& p2 = verts[indices[t*3+2]];
+
+			auto const n = glm::cross( p1-p0, p2-p0 );
+			auto const area = glm::length( n );
+			auto const center = (p0+p1+p2) / 3.f;
+
+			centroids[c] += center * area;
+			normals[c] += n;
+			areas[c] += area;
+		}
+
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+
+		if( areas[c] > 0.f )
+			centroids[c] /= areas[c];
+	}
+
+	if( meshArea > 0.f )
+		meshCentroid /= meshArea;
+
+	std::vector<float> keys( clusterCount );
+	for( std::size_t c = 0; c < clusterCount; ++c )
+	{
+		auto const len = glm::length( normals[c] );
+		keys[c] = len > 0.f ? glm::dot( centroids[c] - meshCentroid, normals[c] / len ) : 0.f;
+	}
+
+	std::vector<std::size_t> order( clusterCount );
+	std::iota( order.begin(), order.end(), std::size_t(0) );
+	std::stable_sort( order.begin(), order.end(), [&] (std::size_t aX, std::size_t aY) {
+		return keys[aX] > keys[aY];
+	} );
+
+	std::vector<std::uint32_t> out;
+	out.reserve( indices.size() );
+	for( auto const c : order )
+		out.insert( out.end(), indices.begin() + clusters[c]*3, indices.begin() + clusters[c+1]*3 );
+
+	// Guard the cache efficiency
+	auto const before = analyze_vertex_cache( indices, verts.size(), aCacheSize );
+	auto const after = analyze_vertex_cache( out, verts.size(), aCacheSize );
+	if( after.acmr > aThreshold * before.acmr )
+		return false;
+
+	aMesh.indices = std::move(out);
+	return true;
+}
+
+OverdrawStats analyze_overdraw( IndexedMesh const& aMesh, bool aCullBackFaces, std::size_t aViewCount, std::size_t aResolution )
+{
+	OverdrawStats ret{ 0, 0 };
+
+	auto const& indices = aMesh.indices;
+	auto const& verts = aMesh.vert;
+	if( indices.empty() || verts.empty() )
+		return ret;
+
+	// Bounding sphere (roughly) 
+	glm::vec3 bmin( std::numeric_limits<float>::max() ), bmax( -std::numeric_limits<float>::max() );
+	for( auto const& v : verts )
+	{
+		bmin = glm::min( bmin, v );
+		bmax = glm::max( bmax, v );
+	}
+
+	auto const center = (bmin + bmax) * 0.5f;
+
+	float radius = 0.f;
+	for( auto const& v : verts )
+		radius = std::max( radius, glm::length( v - center ) );
+
+	if( !(radius > 0.f) )
+		return ret;
+
+	auto const res = float(aResolution);
+	auto const scale = 0.5f * res / radius;
+
+	std::vector<glm::vec3> projected( verts.size() );
+	std::vector<float> depth( aResolution*aResolution );
+
+	for( std::size_t view = 0; view < aViewCount; ++view )
+	{
+		// Fibonacci sphere
+		auto const y = 1.f - 2.f * (float(view)+0.5f) / float(aViewCount);
+		auto const r = std::sqrt( std::max( 0.f, 1.f - y*y ) );
+		auto const phi = float(view) * 2.39996323f; // golden angle
+		glm::vec3 const dir( r * std::cos( phi ), y, r * std::sin( phi ) );
+
+		auto const up = std::abs( dir.y ) < 0.99f ? glm::vec3( 0.f, 1.f, 0.f ) : glm::vec3( 1.f, 0.f, 0.f );
+		auto const right = glm::normalize( glm::cross( up, dir ) );
+		auto const down = glm::cross( dir, right );
+
+		// Screen space; the viewer looks along +dir
+		for( std::size_t i = 0; i < verts.size(); ++i )
+		{
+			auto const p = verts[i] - center;
+			projected[i] = glm::vec3(
+				glm::dot( p, right ) * scale + 0.5f*res,
+				glm::dot( p, down ) * scale + 0.5f*res,
+				glm::dot( p, dir )
+			);
+		}
+
+		std::fill( depth.begin(), depth.end(), std::numeric_limits<float>::infinity() );
+
+		for( std::size_t t = 0; t+2 < indices.size(); t += 3 )
+		{
+			auto const& w0 = verts[indices[t+0]];
+			auto const& w1 = verts[indices[t+1]];
+			auto const& w2 = verts[indices[t+2]];
+
+			if( aCullBackFaces && glm::dot( glm::cross( w1-w0, w2-w0 ), dir ) >= 0.f )
+				continue;
+
+			auto p0 = projected[indices[t+0]];
+			auto p1 = projected[indices[t+1]];
+			auto p2 = projected[indices[t+2]];
+
+			auto area = (p1.x-p0.x)*(p2.y-p0.y) - (p1.y-p0.y)*(p2.x-p0.x);
+			if( 0.f == area )
+				continue;
+
+			if( area < 0.f )
+			{
+				std::swap( p1, p2 );
+				area = -area;
+			}
+
+			auto const x0 = std::max( 0, int(std::floor( std::min( { p0.x, p1.x, p2.x } ) )) );
+			auto const y0 = std::max( 0, int(std::floor( std::min( { p0.y, p1.y, p2.y } ) )) );
+			auto const x1 = std::min( int(aResolution)-1, int(std::ceil( std::max( { p0.x, p1.x, p2.x } ) )) );
+			auto const y1 = std::min( int(aResolution)-1, int(std::ceil( std::max( { p0.y, p1.y, p2.y } ) )) );
+
+			for( int py = y0; py <= y1; ++py )
+			{
+				for( int px = x0; px <= x1; ++px )
+				{
+					float const sx = float(px) + 0.5f, sy = float(py) + 0.5f;
+
+					auto const e0 = (p2.x-p1.x)*(sy-p1.y) - (p2.y-p1.y)*(sx-p1.x);
+					auto const e1 = (p0.x-p2.x)*(sy-p2.y) - (p0.y-p2.y)*(sx-p2.x);
+					auto const e2 = (p1.x-p0.x)*(sy-p0.y) - (p1.y-p0.y)*(sx-p0.x);
+					if( e0 < 0.f || e1 < 0.f || e2 < 0.f )
+						continue;
+
+					auto const z = (e0*p0.z + e1*p1.z + e2*p2.z) / area;
+
+					auto& d = depth[py*aResolution + px];
+					if( z < d )
+					{
+						d = z;
+						++ret.shaded;
+					}
+				}
+			}
+		}
+
+		for( auto const d : depth )
+		{
+			if( d != std::numeric_limits<float>::infinity() )
+				++ret.covered;
+		}
+	}
+
+	return ret;
+}
+
+void optimize_vertex_fetch( IndexedMesh& aMesh, std::vector<glm::vec4>& aTangents )
+{
+	auto const vertexCount = aMesh.vert.size();
+	assert( aTangents.empty() || aTangents.size() == vertexCount );
+
+	// remap[old] = new
+	std::vector<std::uint32_t> remap( vertexCount, kNone );
+
+	std::uint32_t next = 0;
+	for( auto& idx : aMesh.indices )
+	{
+		if( kNone == remap[idx] )
+			remap[idx] = next++;
+
+		idx = remap[idx];
+	}
+
+	// Unreferenced vertices (there should not be any) go to the end
+	for( auto& r : remap )
+	{
+		if( kNone == r )
+			r = next++;
+	}
+
+	assert( next == vertexCount );
+
+	permute_( aMesh.vert, remap, vertexCount );
+	permute_( aMesh.norm, remap, vertexCount );
+	permute_( aMesh.text, remap, vertexCount );
+	permute_( aTangents, remap, vertexCount );
+}
+
+std::vector<IndexedMesh> split_mesh( IndexedMesh const& aMesh, std::vector<glm::vec4> const& aTangents, std::vector<std::vector<glm::vec4>>& aPartTangents, std::size_t aMaxVertices )
+{
+	assert( aMaxVertices >= 3 );
+	assert( aTangents.empty() || aTangents.size() == aMesh.vert.size() );
+
+	aPartTangents.clear();
+
+	if( aMesh.vert.size() <= aMaxVertices )
+	{
+		aPartTangents.emplace_back( aTangents );
+		return { aMesh };
+	}
+
+	std::vector<IndexedMesh> ret;
+
+	// local[old] = index in the current part; valid only if partOf[old] is
+	// the current part.
+	std::vector<std::uint32_t> local( aMesh.vert.size(), kNone );
+	std::vector<std::uint32_t> partOf( aMesh.vert.size(), kNone );
+
+	auto const triCount = aMesh.indices.size() / 3;
+	for( std::size_t t = 0; t < triCount; ++t )
+	{
+		auto const* tri = aMesh.indices.data() + 3*t;
+
+		std::size_t missing = 0;
+		if( !ret.empty() )
+		{
+			auto const part = std::uint32_t(ret.size()-1);
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				// Count each vertex once, even if the triangle is degenerate
+				bool const dup = (j > 0 && tri[j] == tri[0]) || (j > 1 && tri[j] == tri[1]);
+				if( partOf[tri[j]] != part && !dup )
+					++missing;
+			}
+		}
+
+		if( ret.empty() || ret.back().vert.size() + missing > aMaxVertices )
+		{
+			ret.emplace_back();
+			aPartTangents.emplace_back();
+		}
+
+		auto const part = std::uint32_t(ret.size()-1);
+		auto& mesh = ret.back();
+		auto& tangents = aPartTangents.back();
+
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const idx = tri[j];
+			if( partOf[idx] != part )
+			{
+				partOf[idx] = part;
+				local[idx] = std::uint32_t(mesh.vert.size());
+
+				mesh.vert.emplace_back( aMesh.vert[idx] );
+				mesh.norm.emplace_back( aMesh.norm[idx] );
+				mesh.text.emplace_back( aMesh.text[idx] );
+
+				if( !aTangents.empty() )
+					tangents.emplace_back( aTangents[idx] );
+			}
+
+			mesh.indices.emplace_back( local[idx] );
+		}
+	}
+
+	for( auto& mesh : ret )
+	{
+		mesh.aabbMin = glm::vec3( std::numeric_limits<float>::max() );
+		mesh.aabbMax = glm::vec3( -std::numeric_limits<float>::max() );
+
+		for( auto const& v : mesh.vert )
+		{
+			mesh.aabbMin = glm::min( mesh.aabbMin, v );
+			mesh.aabbMax = glm::max( mesh.aabbMax, v );
+		}
+	}
+
+	return ret;
+}
+
+MeshRange append_mesh( IndexedMesh& aInto, std::vector<glm::vec4>& aIntoTangents, IndexedMesh const& aMesh, std::vector<glm::vec4> const& aTangents )
+{
+	assert( aIntoTangents.size() == aInto.vert.size() );
+	assert( aTangents.size() == aMesh.vert.size() );
+
+	MeshRange range;
+	range.firstIndex = std::uint32_t(aInto.indices.size());
+	range.indexCount = std::uint32_t(aMesh.indices.size());
+	range.aabbMin = glm::vec3( std::numeric_limits<float>::max() );
+	range.aabbMax = glm::vec3( -std::numeric_limits<float>::max() );
+
+	for( auto const& v : aMesh.vert )
+	{
+		range.aabbMin = glm::min( range.aabbMin, v );
+		range.aabbMax = glm::max( range.aabbMax, v );
+	}
+
+	if( aInto.vert.empty() )
+	{
+		aInto.aabbMin = range.aabbMin;
+		aInto.aabbMax = range.aabbMax;
+	}
+	else
+	{
+		aInto.aabbMin = glm::min( aInto.aabbMin, range.aabbMin );
+		aInto.aabbMax = glm::max( aInto.aabbMax, range.aabbMax );
+	}
+
+	auto const base = std::uint32_t(aInto.vert.size());
+	for( auto const idx : aMesh.indices )
+		aInto.indices.emplace_back( base + idx );
+
+	aInto.vert.insert( aInto.vert.end(), aMesh.vert.begin(), aMesh.vert.end() );
+	aInto.norm.insert( aInto.norm.end(), aMesh.norm.begin(), aMesh.norm.end() );
+	aInto.text.insert( aInto.text.end(), aMesh.text.begin(), aMesh.text.end() );
+	aIntoTangents.insert( aIntoTangents.end(), aTangents.begin(), aTangents.end() );
+
+	return range;
+}
+
+namespace
+{
+	template< typename tType >
+	void permute_( std::vector<tType>& aData, std::vector<std::uint32_t> const& aRemap, std::size_t aCount )
+	{
+		if( aData.size() != aCount )
+			return;
+
+		std::vector<tType> out( aCount );
+		for( std::size_t i = 0; i < aCount; ++i )
+			out[aRemap[i]] = aData[i];
+
+		aData = std::move(out);
+	}
+
+	template< typename tType >
+	void compact_( std::vector<tType>& aData, std::vector<std::uint32_t> const& aRemap )
+	{
+		if( aData.size() != aRemap.size() )
+			return;
+
+		std::size_t out = 0;
+		for( std::size_t i = 0; i < aData.size(); ++i )
+		{
+			if( kNone != aRemap[i] )
+				aData[out++] = aData[i];
+		}
+
+		aData.resize( out );
+	}
+
+	template< typename tVec >
+	bool finite_( tVec const& aV ) noexcept
+	{
+		for( typename tVec::length_type i = 0; i < aV.length(); ++i )
+		{
+			if( !std::isfinite( aV[i] ) )
+				return false;
+		}
+
+		return true;
+	}
+}
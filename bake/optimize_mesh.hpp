@@ -0,0 +1,178 @@
+#ifndef OPTIMIZE_MESH_HPP_E4A19C37_2B6D_4F80_9A5E_71C3D8B0F26A
+#define OPTIMIZE_MESH_HPP_E4A19C37_2B6D_4F80_9A5E_71C3D8B0F26A
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec4.hpp>
+
+#include "index_mesh.hpp"
+
+
+//--    constants                               ///{{{1///////////////////////
+
+/* Size of the simulated post-transform vertex cache (FIFO). Actual GPUs
+ * differ, but orders that are good for a small cache remain good for
+ * larger ones.
+ */
+constexpr std::size_t kVertexCacheSize = 16;
+
+/* Overdraw estimation: number of view directions (spread evenly over the
+ * sphere) and resolution of the orthographic views.
+ */
+constexpr std::size_t kOverdrawViews = 16;
+constexpr std::size_t kOverdrawResolution = 128;
+
+/* Largest number of vertices that can be addressed with 16-bit indices.
+ */
+constexpr std::size_t kMaxIndex16Vertices = 65536;
+
+//--    types                                   ///{{{1///////////////////////
+/* Triangles removed by remove_degenerate_triangles(), by reason. Each
+ * triangle is counted once, for the first reason that applies (in the order
+ * below).
+ */
+struct TriangleCleanupStats
+{
+	std::size_t collapsed = 0; // two or more corners share a vertex (e.g., after welding)
+	std::size_t nonFinite = 0; // NaN or infinite vertex attributes
+	std::size_t zeroArea = 0; // distinct, but coincident or collinear corners
+	std::size_t duplicate = 0; // same vertices and winding as an earlier triangle
+
+	std::size_t vertices = 0; // vertices that were only used by removed triangles
+
+	std::size_t triangles() const noexcept { return collapsed + nonFinite + zeroArea + duplicate; }
+};
+
+struct VertexCacheStats
+{
+	float acmr; // average cache miss ratio: misses per triangle (0.5 ... 3)
+	float atvr; // average transform to vertex ratio: misses per vertex (1 is optimal)
+};
+
+struct OverdrawStats
+{
+	std::size_t shaded; // fragments passing the depth test, summed over all views
+	std::size_t covered; // pixels covered, summed over all views
+
+	float overdraw() const noexcept { return covered ? float(shaded) / float(covered) : 1.f; }
+};
+
+/* Part of a (merged) mesh's index buffer that came from a single source
+ * mesh, with that part's bounding box. Allows culling sub-ranges of merged
+ * meshes individually.
+ */
+struct MeshRange
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+	glm::vec3 aabbMin, aabbMax;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Remove triangles that cannot produce any fragments, or only fragments that
+ * an identical triangle already produced: collapsed and zero-area triangles,
+ * exact duplicates (same three vertices with the same winding, in any
+ * rotation) and, if aRemoveNonFinite is set, triangles with NaN or infinite
+ * attributes. A triangle with the opposite winding is not a duplicate.
+ * Zero area is tested exactly, in double precision.
+ *
+ * The remaining triangles keep their order. Vertices that are no longer
+ * referenced are removed (keeping the order of the others), and the
+ * bounding box is updated. Run this before computing tangents.
+ */
+TriangleCleanupStats remove_degenerate_triangles(
+	IndexedMesh&,
+	bool aRemoveNonFinite = false
+);
+
+/* Simulate a FIFO post-transform cache of the given size on the index
+ * buffer.
+ */
+VertexCacheStats analyze_vertex_cache(
+	std::vector<std::uint32_t> const& aIndices,
+	std::size_t aVertexCount,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+/* Reorder triangles for post-transform cache hits, using Tipsify (Sander,
+ * Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+ * Reduced Overdraw", 2007). Only the index buffer is modified; each
+ * triangle keeps its winding.
+ */
+void optimize_vertex_cache(
+	IndexedMesh&,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+/* Reorder triangles to reduce overdraw, independently of the view (Sander,
+ * Nehab and Barczak 2007). The cache-optimized order is split into clusters
+ * that each stay within aThreshold times the ACMR of the part of the mesh
+ * they came from. Clusters are then sorted such that those facing outwards
+ * (away from the mesh centroid) are drawn first, since they are most likely
+ * to occlude others.
+ *
+ * Returns false and leaves the mesh untouched if the result would exceed
+ * aThreshold times the original ACMR.
+ */
+bool optimize_overdraw(
+	IndexedMesh&,
+	float aThreshold = 1.05f,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+/* Estimate overdraw by rasterizing the mesh on the CPU from aViewCount
+ * orthographic views, with a depth test and optional back-face culling
+ * (counter-clockwise front faces).
+ */
+OverdrawStats analyze_overdraw(
+	IndexedMesh const&,
+	bool aCullBackFaces,
+	std::size_t aViewCount = kOverdrawViews,
+	std::size_t aResolution = kOverdrawResolution
+);
+
+/* Renumber vertices in the order in which they are first referenced by the
+ * index buffer, so that vertex fetch walks through memory mostly linearly.
+ * Vertex attributes and the (optional, may be empty) per-vertex tangents are
+ * permuted accordingly.
+ */
+void optimize_vertex_fetch(
+	IndexedMesh&,
+	std::vector<glm::vec4>& aTangents
+);
+
+/* Split the mesh into consecutive runs of triangles, each referencing at most
+ * aMaxVertices vertices, such that every part can use 16-bit indices. The
+ * triangle order is kept, and each part's vertices are numbered in first-use
+ * order, so the vertex cache and vertex fetch optimizations carry over.
+ *
+ * Meshes that already fit are returned as a single part. The (optional, may
+ * be empty) tangents are split accordingly into aPartTangents.
+ */
+std::vector<IndexedMesh> split_mesh(
+	IndexedMesh const&,
+	std::vector<glm::vec4> const& aTangents,
+	std::vector<std::vector<glm::vec4>>& aPartTangents,
+	std::size_t aMaxVertices = kMaxIndex16Vertices
+);
+
+/* Append the vertices and triangles of a mesh to aInto (and the tangents to
+ * aIntoTangents), updating aInto's bounding box. Indices are offset, so the
+ * triangle and vertex order of both meshes is preserved. Returns the range
+ * occupied by the appended triangles.
+ */
+MeshRange append_mesh(
+	IndexedMesh& aInto,
+	std::vector<glm::vec4>& aIntoTangents,
+	IndexedMesh const&,
+	std::vector<glm::vec4> const& aTangents
+);
+
+#endif // OPTIMIZE_MESH_HPP_E4A19C37_2B6D_4F80_9A5E_71C3D8B0F26A
@@ -0,0 +1,219 @@
+#include "quantize_mesh.hpp"
+
+#include <limits>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace
+{
+	constexpr float kUnorm16Max = 65535.f;
+	constexpr float kSnorm16Max = 32767.f;
+
+	template< typename tVec >
+	void bounds_( std::vector<tVec> const&, tVec& aMin, tVec& aMax );
+
+	template< typename tVec >
+	tVec unorm_scale_( tVec const& aMin, tVec const& aMax );
+
+	std::uint16_t to_unorm16_( float ) noexcept;
+
+	glm::vec2 oct_encode_( glm::vec3 const& ) noexcept;
+	glm::vec3 oct_decode_( glm::vec2 const& ) noexcept;
+
+	glm::i16vec2 encode_direction_( glm::vec3 const& ) noexcept;
+	glm::vec3 decode_direction_( glm::i16vec2 const& ) noexcept;
+
+	float angle_degrees_( glm::vec3 const& aRef, glm::vec3 const& aDecoded ) noexcept;
+}
+
+QuantizedMesh quantize_mesh( IndexedMesh const& aMesh, std::vector<glm::vec4> const& aTangents )
+{
+	auto const vertexCount = aMesh.vert.size();
+	assert( aMesh.norm.size() == vertexCount && aMesh.text.size() == vertexCount );
+	assert( aTangents.empty() || aTangents.size() == vertexCount );
+
+	QuantizedMesh ret;
+	bounds_( aMesh.vert, ret.posMin, ret.posMax );
+	bounds_( aMesh.text, ret.texMin, ret.texMax );
+
+	auto const posScale = unorm_scale_( ret.posMin, ret.posMax );
+	auto const texScale = unorm_scale_( ret.texMin, ret.texMax );
+
+	ret.positions.resize( vertexCount );
+	ret.texcoords.resize( vertexCount );
+	ret.normals.resize( vertexCount );
+	ret.tangents.resize( vertexCount );
+
+	for( std::size_t i = 0; i < vertexCount; ++i )
+	{
+		auto const tangent = aTangents.empty() ? glm::vec4( 1.f, 0.f, 0.f, 1.f ) : aTangents[i];
+
+		auto const p = (aMesh.vert[i] - ret.posMin) * posScale;
+		ret.positions[i] = glm::u16vec4(
+			to_unorm16_( p.x ),
+			to_unorm16_( p.y ),
+			to_unorm16_( p.z ),
+			tangent.w < 0.f ? 0 : 0xffff
+		);
+
+		auto const t = (aMesh.text[i] - ret.texMin) * texScale;
+		ret.texcoords[i] = glm::u16vec2( to_unorm16_( t.x ), to_unorm16_( t.y ) );
+
+		ret.normals[i] = encode_direction_( aMesh.norm[i] );
+		ret.tangents[i] = encode_direction_( glm::vec3( tangent ) );
+	}
+
+	return ret;
+}
+
+QuantizationError measure_quantization_error( IndexedMesh const& aMesh, std::vector<glm::vec4> const& aTangents, QuantizedMesh const& aQuantized )
+{
+	QuantizationError ret{ 0.f, 0.f, 0.f, 0.f };
+
+	auto const posExtent = aQuantized.posMax - aQuantized.posMin;
+	auto const texExtent = aQuantized.texMax - aQuantized.texMin;
+
+	for( std::size_t i = 0; i < aQuantized.positions.size(); ++i )
+	{
+		auto const& qp = aQuantized.positions[i];
+		auto const p = aQuantized.posMin + posExtent * (glm::vec3( qp ) / kUnorm16Max);
+		ret.position = std::max( ret.position, glm::length( p - aMesh.vert[i] ) );
+
+		auto const t = aQuantized.texMin + texExtent * (glm::vec2( aQuantized.texcoords[i] ) / kUnorm16Max);
+		ret.texcoord = std::max( ret.texcoord, glm::length( t - aMesh.text[i] ) );
+
+		auto const n = decode_direction_( aQuantized.normals[i] );
+		ret.normalDegrees = std::max( ret.normalDegrees, angle_degrees_( aMesh.norm[i], n ) );
+
+		if( !aTangents.empty() )
+		{
+			auto const tan = decode_direction_( aQuantized.tangents[i] );
+			ret.tangentDegrees = std::max( ret.tangentDegrees, angle_degrees_( glm::vec3( aTangents[i] ), tan ) );
+		}
+	}
+
+	return ret;
+}
+
+namespace
+{
+	template< typename tVec >
+	void bounds_( std::vector<tVec> const& aValues, tVec& aMin, tVec& aMax )
+	{
+		if( aValues.empty() )
+		{
+			aMin = aMax = tVec( 0.f );
+			return;
+		}
+
+		aMin = tVec( std::numeric_limits<float>::max() );
+		aMax = tVec( -std::numeric_limits<float>::max() );
+
+		for( auto const& v : aValues )
+		{
+			aMin = glm::min( aMin, v );
+			aMax = glm::max( aMax, v );
+		}
+	}
+
+	template< typename tVec >
+	tVec unorm_scale_( tVec const& aMin, tVec const& aMax )
+	{
+		// Flat axes (zero extent) quantize to 0 and decode to aMin.
+		auto const extent = aMax - aMin;
+
+		tVec ret;
+		for( typename tVec::length_type i = 0; i < tVec::length(); ++i )
+			ret[i] = extent[i] > 0.f ? kUnorm16Max / extent[i] : 0.f;
+
+		return ret;
+	}
+
+	std::uint16_t to_unorm16_( float aValue ) noexcept
+	{
+		return std::uint16_t(std::lround( std::clamp( aValue, 0.f, kUnorm16Max ) ));
+	}
+
+	glm::vec2 oct_encode_( glm::vec3 const& aDir ) noexcept
+	{
+		// Project onto the octahedron |x|+|y|+|z| = 1, then fold the lower
+		// hemisphere over the diagonals.
+		auto const l1 = std::abs( aDir.x ) + std::abs( aDir.y ) + std::abs( aDir.z );
+		if( l1 <= 0.f )
+			return glm::vec2( 0.f );
+
+		glm::vec2 p( aDir.x / l1, aDir.y / l1 );
+		if( aDir.z < 0.f )
+		{
+			p = glm::vec2(
+				(1.f - std::abs( p.y )) * (p.x >= 0.f ? 1.f : -1.f),
+				(1.f - std::abs( p.x )) * (p.y >= 0.f ? 1.f : -1.f)
+			);
+		}
+
+		return p;
+	}
+	glm::vec3 oct_decode_( glm::vec2 const& aEnc ) noexcept
+	{
+		// Must match oct_decode() in default.vert
+		glm::vec3 v( aEnc.x, aEnc.y, 1.f - std::abs( aEnc.x ) - std::abs( aEnc.y ) );
+		float const t = std::max( -v.z, 0.f );
+		v.x += v.x >= 0.f ? -t : t;
+		v.y += v.y >= 0.f ? -t : t;
+		return glm::normalize( v );
+	}
+
+	glm::i16vec2 encode_direction_( glm::vec3 const& aDir ) noexcept
+	{
+		auto const p = oct_encode_( aDir ) * kSnorm16Max;
+		auto const l = glm::length( aDir );
+		if( l <= 0.f )
+			return glm::i16vec2( 0 );
+
+		// Rounding each component separately is not necessarily the closest
+		// representable direction. Try all four neighbours instead.
+		auto const dir = aDir / l;
+		auto const base = glm::floor( p );
+
+		glm::i16vec2 best( 0 );
+		float bestDot = -2.f;
+		for( int dy = 0; dy < 2; ++dy )
+		{
+			for( int dx = 0; dx < 2; ++dx )
+			{
+				glm::i16vec2 const cand(
+					std::int16_t(std::clamp( base.x + float(dx), -kSnorm16Max, kSnorm16Max )),
+					std::int16_t(std::clamp( base.y + float(dy), -kSnorm16Max, kSnorm16Max ))
+				);
+
+				float const d = glm::dot( dir, decode_direction_( cand ) );
+				if( d > bestDot )
+				{
+					bestDot = d;
+					best = cand;
+				}
+			}
+		}
+
+		return best;
+	}
+	glm::vec3 decode_direction_( glm::i16vec2 const& aEnc ) noexcept
+	{
+		// Vulkan SNORM conversion: max(c / 32767, -1)
+		return oct_decode_( glm::max( glm::vec2( aEnc ) / kSnorm16Max, glm::vec2( -1.f ) ) );
+	}
+
+	float angle_degrees_( glm::vec3 const& aRef, glm::vec3 const& aDecoded ) noexcept
+	{
+		auto const l = glm::length( aRef );
+		if( l <= 0.f )
+			return 0.f;
+
+		float const c = std::clamp( glm::dot( aRef / l, aDecoded ), -1.f, 1.f );
+		return glm::degrees( std::acos( c ) );
+	}
+}
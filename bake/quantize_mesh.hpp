@@ -0,0 +1,72 @@
+#ifndef QUANTIZE_MESH_HPP_A63F0D52_8C1E_4E97_B2D4_3F71C9E85B06
+#define QUANTIZE_MESH_HPP_A63F0D52_8C1E_4E97_B2D4_3F71C9E85B06
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "index_mesh.hpp"
+
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Compact vertex attributes (20 instead of 48 bytes per vertex):
+ *
+ *  - positions: unorm16 x3 relative to the mesh's AABB. The fourth component
+ *    holds the sign of the bitangent (0 = -1, 0xffff = +1), i.e., the 'w' of
+ *    the tangent.
+ *  - texcoords: unorm16 x2 relative to the mesh's texture coordinate bounds.
+ *  - normals and tangents: octahedral encoding, snorm16 x2.
+ *
+ * All of these map directly to Vulkan vertex formats (R16G16B16A16_UNORM,
+ * R16G16_UNORM and R16G16_SNORM). Decoding only requires the bounds, which
+ * are passed to the vertex shader per mesh.
+ */
+struct QuantizedMesh
+{
+	glm::vec3 posMin, posMax;
+	glm::vec2 texMin, texMax;
+
+	std::vector<glm::u16vec4> positions;
+	std::vector<glm::u16vec2> texcoords;
+	std::vector<glm::i16vec2> normals;
+	std::vector<glm::i16vec2> tangents;
+};
+
+/* Largest decoding error over all vertices. Positions and texture coordinates
+ * are absolute distances, directions are angles in degrees.
+ */
+struct QuantizationError
+{
+	float position;
+	float texcoord;
+	float normalDegrees;
+	float tangentDegrees;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+QuantizedMesh quantize_mesh(
+	IndexedMesh const&,
+	std::vector<glm::vec4> const& aTangents
+);
+
+/* Decode the quantized mesh (exactly as the vertex shader does) and compare
+ * the result against the original attributes.
+ */
+QuantizationError measure_quantization_error(
+	IndexedMesh const&,
+	std::vector<glm::vec4> const& aTangents,
+	QuantizedMesh const&
+);
+
+#endif // QUANTIZE_MESH_HPP_A63F0D52_8C1E_4E97_B2D4_3F71C9E85B06
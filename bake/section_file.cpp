@@ -0,0 +1,277 @@
+#include "section_file.hpp"
+
+#include <utility>
+#include <algorithm>
+#include <system_error>
+
+#include <cassert>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// Buffer sizes. Each spill file has its own buffer; the output buffer is
+	// also used to copy the spill files into the output.
+	constexpr std::size_t kSpillBufferSize = 256*1024;
+	constexpr std::size_t kOutputBufferSize = 4*1024*1024;
+
+	// Size of a table of contents entry
+	constexpr std::size_t kEntrySize = 4*sizeof(std::uint32_t) + 3*sizeof(std::uint64_t);
+
+	void checked_write_( std::FILE*, void const*, std::size_t, std::filesystem::path const& );
+	void write_padding_( std::FILE*, std::uint64_t aFrom, std::uint64_t aTo, std::filesystem::path const& );
+
+	std::uint64_t align_( std::uint64_t, std::size_t ) noexcept;
+}
+
+//--    SectionFileWriter               ///{{{2///////////////////////////////
+SectionFileWriter::SectionFileWriter( std::filesystem::path aPath, char const (&aMagic)[16], char const (&aVariant)[16], std::vector<std::uint32_t> aSpilledTags, std::size_t aAlignment )
+	: mPath( std::move(aPath) )
+	, mAlignment( aAlignment )
+{
+	assert( aAlignment > 0 && aAlignment <= 64 );
+
+	std::memcpy( mMagic, aMagic, sizeof(mMagic) );
+	std::memcpy( mVariant, aVariant, sizeof(mVariant) );
+
+	mSpills.resize( aSpilledTags.size() );
+	for( std::size_t i = 0; i < aSpilledTags.size(); ++i )
+	{
+		auto const tag = aSpilledTags[i];
+
+		char suffix[16];
+		std::snprintf( suffix, sizeof(suffix), ".spill-%c%c%c%c", char(tag & 0xff), char((tag >> 8) & 0xff), char((tag >> 16) & 0xff), char((tag >> 24) & 0xff) );
+
+		mSpills[i].tag = tag;
+		mSpills[i].path = mPath;
+		mSpills[i].path += suffix;
+	}
+}
+
+SectionFileWriter::~SectionFileWriter()
+{
+	remove_spills_();
+}
+
+void SectionFileWriter::add( FileSection aSection )
+{
+	mRawBytes += aSection.rawSize;
+	mStoredBytes += aSection.data.size();
+
+	auto* spill = spill_for_( aSection.tag );
+	if( !spill )
+	{
+		mSections.emplace_back( std::move(aSection) );
+		return;
+	}
+
+	// Sections start at aligned offsets in the spill file. The spill file
+	// itself starts at an aligned offset in the output.
+	auto const offset = align_( spill->size, mAlignment );
+	write_padding_( spill->file, spill->size, offset, spill->path );
+	checked_write_( spill->file, aSection.data.data(), aSection.data.size(), spill->path );
+
+	spill->size = offset + aSection.data.size();
+	spill->entries.emplace_back( Entry_{ aSection.tag, aSection.version, aSection.mesh, aSection.codec, offset, aSection.data.size(), aSection.rawSize } );
+}
+
+std::uint64_t SectionFileWriter::finish()
+{
+	std::size_t sectionCount = mSections.size();
+	for( auto const& spill : mSpills )
+		sectionCount += spill.entries.size();
+
+	std::FILE* fof = std::fopen( mPath.string().c_str(), "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", mPath.string().c_str() );
+
+	auto buffer = std::make_unique<char[]>( kOutputBufferSize );
+	std::setvbuf( fof, nullptr, _IOFBF, kOutputBufferSize );
+
+	std::uint64_t written = 0;
+	try
+	{
+		// Header
+		checked_write_( fof, mMagic, sizeof(mMagic), mPath );
+		checked_write_( fof, mVariant, sizeof(mVariant), mPath );
+
+		std::uint32_t const header[2] = { std::uint32_t(sectionCount), 0 };
+		checked_write_( fof, header, sizeof(header), mPath );
+
+		written = sizeof(mMagic) + sizeof(mVariant) + sizeof(header) + sectionCount*kEntrySize;
+
+		// Table of contents
+		auto const write_entry_ = [&] (std::uint32_t aTag, std::uint32_t aVersion, std::uint32_t aMesh, std::uint32_t aCodec, std::uint64_t aOffset, std::uint64_t aSize, std::uint64_t aRawSize) {
+			std::uint32_t const entry[4] = { aTag, aVersion, aMesh, aCodec };
+			checked_write_( fof, entry, sizeof(entry), mPath );
+
+			std::uint64_t const location[3] = { aOffset, aSize, aRawSize };
+			checked_write_( fof, location, sizeof(location), mPath );
+		};
+
+		std::uint64_t offset = written;
+		for( auto const& section : mSections )
+		{
+			offset = align_( offset, mAlignment );
+			write_entry_( section.tag, section.version, section.mesh, section.codec, offset, section.data.size(), section.rawSize );
+			offset += section.data.size();
+		}
+
+		std::vector<std::uint64_t> spillOffsets;
+		for( auto const& spill : mSpills )
+		{
+			if( spill.entries.empty() )
+			{
+				spillOffsets.emplace_back( offset );
+				continue;
+			}
+
+			offset = align_( offset, mAlignment );
+			spillOffsets.emplace_back( offset );
+
+			for( auto const& entry : spill.entries )
+				write_entry_( entry.tag, entry.version, entry.mesh, entry.codec, offset + entry.offset, entry.size, entry.rawSize );
+
+			offset += spill.size;
+		}
+
+		// In-memory sections
+		for( auto& section : mSections )
+		{
+			auto const start = align_( written, mAlignment );
+			write_padding_( fof, written, start, mPath );
+			checked_write_( fof, section.data.data(), section.data.size(), mPath );
+
+			written = start + section.data.size();
+			section.data = std::vector<std::uint8_t>();
+		}
+
+		// Spilled sections
+		for( std::size_t i = 0; i < mSpills.size(); ++i )
+		{
+			auto& spill = mSpills[i];
+			if( !spill.file )
+				continue;
+
+			write_padding_( fof, written, spillOffsets[i], mPath );
+			written = spillOffsets[i];
+
+			if( 0 != std::fflush( spill.file ) || 0 != std::fseek( spill.file, 0, SEEK_SET ) )
+				throw lut::Error( "Unable to read back spill file '%s'", spill.path.string().c_str() );
+
+			for( std::uint64_t left = spill.size; left > 0; )
+			{
+				auto const chunk = std::size_t(std::min<std::uint64_t>( left, kOutputBufferSize ));
+				if( chunk != std::fread( buffer.get(), 1, chunk, spill.file ) )
+					throw lut::Error( "Unable to read back spill file '%s'", spill.path.string().c_str() );
+
+				checked_write_( fof, buffer.get(), chunk, mPath );
+				left -= chunk;
+			}
+
+			written += spill.size;
+		}
+
+		assert( written == offset );
+
+		if( 0 != std::fflush( fof ) )
+			throw lut::Error( "Unable to write '%s'", mPath.string().c_str() );
+	}
+	catch( ... )
+	{
+		std::fclose( fof );
+		remove_spills_();
+		throw;
+	}
+
+	std::fclose( fof );
+	remove_spills_();
+
+	return written;
+}
+
+std::size_t SectionFileWriter::section_count() const noexcept
+{
+	std::size_t ret = mSections.size();
+	for( auto const& spill : mSpills )
+		ret += spill.entries.size();
+
+	return ret;
+}
+
+std::uint64_t SectionFileWriter::raw_bytes() const noexcept
+{
+	return mRawBytes;
+}
+std::uint64_t SectionFileWriter::stored_bytes() const noexcept
+{
+	return mStoredBytes;
+}
+
+SectionFileWriter::Spill_* SectionFileWriter::spill_for_( std::uint32_t aTag )
+{
+	auto const it = std::find_if( mSpills.begin(), mSpills.end(), [aTag] (Spill_ const& aSpill) {
+		return aSpill.tag == aTag;
+	} );
+
+	if( mSpills.end() == it )
+		return nullptr;
+
+	if( !it->file )
+	{
+		it->file = std::fopen( it->path.string().c_str(), "w+b" );
+		if( !it->file )
+			throw lut::Error( "Unable to create spill file '%s'", it->path.string().c_str() );
+
+		it->buffer = std::make_unique<char[]>( kSpillBufferSize );
+		std::setvbuf( it->file, it->buffer.get(), _IOFBF, kSpillBufferSize );
+	}
+
+	return &*it;
+}
+
+void SectionFileWriter::remove_spills_() noexcept
+{
+	for( auto& spill : mSpills )
+	{
+		if( !spill.file )
+			continue;
+
+		std::fclose( spill.file );
+		spill.file = nullptr;
+
+		std::error_code ec;
+		std::filesystem::remove( spill.path, ec );
+	}
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	void checked_write_( std::FILE* aOut, void const* aData, std::size_t aBytes, std::filesystem::path const& aPath )
+	{
+		if( 0 == aBytes )
+			return;
+
+		auto const ret = std::fwrite( aData, 1, aBytes, aOut );
+		if( ret != aBytes )
+			throw lut::Error( "Writing '%s' failed: %zu instead of %zu bytes", aPath.string().c_str(), ret, aBytes );
+	}
+
+	void write_padding_( std::FILE* aOut, std::uint64_t aFrom, std::uint64_t aTo, std::filesystem::path const& aPath )
+	{
+		static constexpr std::uint8_t zeros[64] = {};
+
+		assert( aFrom <= aTo && aTo - aFrom <= sizeof(zeros) );
+		checked_write_( aOut, zeros, std::size_t(aTo - aFrom), aPath );
+	}
+
+	std::uint64_t align_( std::uint64_t aOffset, std::size_t aAlignment ) noexcept
+	{
+		return (aOffset + aAlignment-1) / aAlignment * aAlignment;
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,124 @@
+#ifndef SECTION_FILE_HPP_0B8E5A71_C3D2_4F96_A4E1_7D25B9F6C083
+#define SECTION_FILE_HPP_0B8E5A71_C3D2_4F96_A4E1_7D25B9F6C083
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <memory>
+#include <vector>
+#include <filesystem>
+
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+
+
+//--    types                                   ///{{{1///////////////////////
+
+/* A section of the baked mesh file, as stored in the file (i.e., possibly
+ * compressed; rawSize is the decompressed size).
+ */
+struct FileSection
+{
+	std::uint32_t tag;
+	std::uint32_t version;
+	std::uint32_t mesh;
+	std::uint32_t codec;
+	std::size_t rawSize;
+	std::vector<std::uint8_t> data;
+};
+
+/* Writes a file made of a header, a table of contents and sections, without
+ * holding all sections in memory.
+ *
+ * Format:
+ *   - char[16] : file magic
+ *   - char[16] : file variant ID
+ *   - uint32_t : N = number of sections
+ *   - uint32_t : zero
+ *   - repeat N times:
+ *     - uint32_t : tag
+ *     - uint32_t : version
+ *     - uint32_t : mesh index (0xffffffff if not specific to a mesh)
+ *     - uint32_t : codec (0 = stored, 1 = deflate, 2 = geometry codec)
+ *     - uint64_t : offset of the section, from the start of the file
+ *     - uint64_t : size of the section in the file
+ *     - uint64_t : decompressed size
+ *   - section data; each section starts at a multiple of aAlignment bytes
+ *
+ * See global_sections_() and serialize_meshes_() in main.cpp for the
+ * contents of the sections.
+ *
+ * Sections whose tag is listed in aSpilledTags (the per-mesh sections) are
+ * appended to one temporary spill file per tag as they are added, and only
+ * their table of contents entry is kept. All other sections are kept in
+ * memory. finish() writes the header and the complete table of contents,
+ * followed by the in-memory sections in the order they were added and then
+ * the contents of the spill files in aSpilledTags order. The resulting file
+ * is the same as if all sections had been collected first.
+ *
+ * Spill files are created next to the output (<output>.spill-<TAG>) and are
+ * removed by finish() or the destructor. All files are written through large
+ * buffers.
+ */
+class SectionFileWriter
+{
+	public:
+		SectionFileWriter(
+			std::filesystem::path aPath,
+			char const (&aMagic)[16],
+			char const (&aVariant)[16],
+			std::vector<std::uint32_t> aSpilledTags,
+			std::size_t aAlignment
+		);
+		~SectionFileWriter();
+
+		SectionFileWriter( SectionFileWriter const& ) = delete;
+		SectionFileWriter& operator= (SectionFileWriter const&) = delete;
+
+	public:
+		void add( FileSection );
+
+		// Write the file. Returns its size in bytes.
+		std::uint64_t finish();
+
+	public:
+		std::size_t section_count() const noexcept;
+
+		std::uint64_t raw_bytes() const noexcept; // sum of the sections' rawSize
+		std::uint64_t stored_bytes() const noexcept;
+
+	private:
+		struct Entry_
+		{
+			std::uint32_t tag, version, mesh, codec;
+			std::uint64_t offset; // relative to the start of the spill file
+			std::uint64_t size, rawSize;
+		};
+		struct Spill_
+		{
+			std::uint32_t tag;
+			std::filesystem::path path;
+			std::FILE* file = nullptr;
+			std::unique_ptr<char[]> buffer;
+
+			std::uint64_t size = 0;
+			std::vector<Entry_> entries;
+		};
+
+		Spill_* spill_for_( std::uint32_t aTag );
+		void remove_spills_() noexcept;
+
+	private:
+		std::filesystem::path mPath;
+		char mMagic[16], mVariant[16];
+		std::size_t mAlignment;
+
+		std::vector<FileSection> mSections; // not spilled
+		std::vector<Spill_> mSpills; // in aSpilledTags order; opened when first used
+
+		std::uint64_t mRawBytes = 0;
+		std::uint64_t mStoredBytes = 0;
+};
+
+#endif // SECTION_FILE_HPP_0B8E5A71_C3D2_4F96_A4E1_7D25B9F6C083
@@ -0,0 +1,81 @@
+#ifndef STRIDED_VIEW_HPP_D2A6F9C4_1B7E_4E53_8C0A_6F3E9B21D5A7
+#define STRIDED_VIEW_HPP_D2A6F9C4_1B7E_4E53_8C0A_6F3E9B21D5A7
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Non-owning, read-only view of an array of tType. Consecutive elements are
+ * aStride bytes apart, so a view can refer to a tightly packed array as well
+ * as to one attribute of an array of interleaved vertices.
+ *
+ * The view does not keep the underlying storage alive.
+ */
+template< typename tType >
+class StridedView
+{
+	public:
+		StridedView() noexcept = default;
+		StridedView( tType const* aFirst, std::size_t aCount, std::size_t aStride = sizeof(tType) ) noexcept;
+
+		StridedView( std::vector<tType> const& ) noexcept;
+
+	public:
+		tType const& operator[] (std::size_t) const noexcept;
+
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+
+		// View of aCount elements starting at element aFirst
+		StridedView subview( std::size_t aFirst, std::size_t aCount ) const noexcept;
+
+	private:
+		unsigned char const* mBase = nullptr;
+		std::size_t mCount = 0;
+		std::size_t mStride = sizeof(tType);
+};
+
+//--    inline                                  ///{{{1///////////////////////
+
+template< typename tType > inline
+StridedView<tType>::StridedView( tType const* aFirst, std::size_t aCount, std::size_t aStride ) noexcept
+	: mBase( reinterpret_cast<unsigned char const*>(aFirst) )
+	, mCount( aCount )
+	, mStride( aStride )
+{}
+
+template< typename tType > inline
+StridedView<tType>::StridedView( std::vector<tType> const& aVector ) noexcept
+	: StridedView( aVector.data(), aVector.size() )
+{}
+
+template< typename tType > inline
+tType const& StridedView<tType>::operator[] (std::size_t aIndex) const noexcept
+{
+	return *reinterpret_cast<tType const*>(mBase + aIndex*mStride);
+}
+
+template< typename tType > inline
+std::size_t StridedView<tType>::size() const noexcept
+{
+	return mCount;
+}
+template< typename tType > inline
+bool StridedView<tType>::empty() const noexcept
+{
+	return 0 == mCount;
+}
+
+template< typename tType > inline
+StridedView<tType> StridedView<tType>::subview( std::size_t aFirst, std::size_t aCount ) const noexcept
+{
+	return StridedView( reinterpret_cast<tType const*>(mBase + aFirst*mStride), aCount, mStride );
+}
+
+#endif // STRIDED_VIEW_HPP_D2A6F9C4_1B7E_4E53_8C0A_6F3E9B21D5A7
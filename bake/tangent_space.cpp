@@ -0,0 +1,399 @@
+#include "tangent_space.hpp"
+
+#include <numeric>
+#include <algorithm>
+
+#include <cmath>
+#include <cassert>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#	include <emmintrin.h>
+#	define TANGENT_SPACE_SSE2 1
+#endif
+
+#include "thread_pool.hpp"
+
+namespace
+{
+	// Same as tgen's DenomEps
+	constexpr float kDenomEps = 1e-10f;
+
+	// Work per task when computing the tangents of a single mesh in parallel.
+	// Both are multiples of the SIMD width, so that only the mesh's last few
+	// triangles and vertices take the scalar path, as they do serially.
+	constexpr std::size_t kParallelChunkTriangles = 16*1024;
+	constexpr std::size_t kParallelChunkVertices = 16*1024;
+
+	constexpr std::size_t kSimdWidth = 4;
+
+	// Corner tangents of up to kSimdWidth consecutive triangles, as
+	// [triangle][corner][xyz]. This is also the layout of the corner array
+	// when a mesh is processed in parallel.
+	struct CornerBlock_
+	{
+		float t[kSimdWidth][3][3];
+	};
+
+	// Per-vertex accumulated tangents, one array per component
+	struct TangentPlanes_
+	{
+		float* x;
+		float* y;
+		float* z;
+	};
+
+	void corner_tangents_( VertexAttributeViews const&, std::uint32_t const* aIndices, std::size_t aTriangles, CornerBlock_& );
+#	if TANGENT_SPACE_SSE2
+	void corner_tangents_simd_( VertexAttributeViews const&, std::uint32_t const* aIndices, CornerBlock_& );
+#	endif
+
+	// Corner tangents of triangles [aBegin, aEnd), passed to aOut one block
+	// at a time
+	template< typename tOut >
+	void for_each_corner_block_( VertexAttributeViews const&, std::vector<std::uint32_t> const&, std::size_t aBegin, std::size_t aEnd, tOut&& aOut );
+
+	// Normalize, orthogonalize against the normal and compute the sign for
+	// vertices [aBegin, aEnd), writing aOut[aBegin..aEnd). aPlanes is indexed
+	// relative to aBegin.
+	void finalize_( VertexAttributeViews const&, TangentPlanes_ const&, std::size_t aBegin, std::size_t aEnd, glm::vec4* aOut );
+
+	std::vector<glm::vec4> compute_tangents_parallel_( VertexAttributeViews const&, std::vector<std::uint32_t> const&, ThreadPool& );
+}
+
+//--    compute_tangents()              ///{{{2///////////////////////////////
+std::vector<glm::vec4> compute_tangents( VertexAttributeViews const& aMesh, std::vector<std::uint32_t> const& aIndices, ThreadPool* aPool )
+{
+	auto const count = aMesh.vert.size();
+	auto const triangles = aIndices.size() / 3;
+
+	assert( aMesh.norm.size() == count && aMesh.text.size() == count );
+	assert( 0 == aIndices.size() % 3 );
+
+	if( aPool && aPool->thread_count() > 1 && triangles > kParallelChunkTriangles )
+		return compute_tangents_parallel_( aMesh, aIndices, *aPool );
+
+	// Accumulate the corner tangents into their vertices as they are
+	// computed (computeCornerTSpace and the first half of
+	// computeVertexTSpace).
+	std::vector<float> accum( 3*count, 0.f );
+	TangentPlanes_ const planes{ accum.data(), accum.data()+count, accum.data()+2*count };
+
+	for_each_corner_block_( aMesh, aIndices, 0, triangles, [&] (std::size_t aFirst, std::size_t aCount, CornerBlock_ const& aBlock) {
+		for( std::size_t i = 0; i < aCount; ++i )
+		{
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				auto const idx = aIndices[3*(aFirst+i)+j];
+				planes.x[idx] += aBlock.t[i][j][0];
+				planes.y[idx] += aBlock.t[i][j][1];
+				planes.z[idx] += aBlock.t[i][j][2];
+			}
+		}
+	} );
+
+	// Normalize, orthogonalize against the normal and compute the sign
+	// (computeVertexTSpace, orthogonalizeTSpace and computeTangent4D).
+	std::vector<glm::vec4> ret( count );
+	finalize_( aMesh, planes, 0, count, ret.data() );
+
+	return ret;
+}
+
+//--    $ local functions               ///{{{2///////////////////////////////
+namespace
+{
+	template< typename tOut >
+	void for_each_corner_block_( VertexAttributeViews const& aMesh, std::vector<std::uint32_t> const& aIndices, std::size_t aBegin, std::size_t aEnd, tOut&& aOut )
+	{
+		CornerBlock_ block;
+
+		std::size_t tri = aBegin;
+#		if TANGENT_SPACE_SSE2
+		for( ; tri + kSimdWidth <= aEnd; tri += kSimdWidth )
+		{
+			corner_tangents_simd_( aMesh, aIndices.data() + 3*tri, block );
+			aOut( tri, kSimdWidth, block );
+		}
+#		endif // ~ SSE2
+
+		if( tri < aEnd )
+		{
+			corner_tangents_( aMesh, aIndices.data() + 3*tri, aEnd - tri, block );
+			aOut( tri, aEnd - tri, block );
+		}
+	}
+
+	std::vector<glm::vec4> compute_tangents_parallel_( VertexAttributeViews const& aMesh, std::vector<std::uint32_t> const& aIndices, ThreadPool& aPool )
+	{
+		auto const count = aMesh.vert.size();
+		auto const triangles = aIndices.size() / 3;
+
+		// Corner tangents, in parallel over chunks of triangles
+		std::vector<CornerBlock_> corners( (triangles + kSimdWidth-1) / kSimdWidth );
+
+		std::vector<std::size_t> order( (triangles + kParallelChunkTriangles-1) / kParallelChunkTriangles );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+
+		parallel_for_order( aPool, order, [&] (std::size_t aChunk) {
+			auto const beg = aChunk * kParallelChunkTriangles;
+			auto const end = std::min( triangles, beg + kParallelChunkTriangles );
+
+			for_each_corner_block_( aMesh, aIndices, beg, end, [&] (std::size_t aFirst, std::size_t, CornerBlock_ const& aBlock) {
+				corners[aFirst / kSimdWidth] = aBlock;
+			} );
+		} );
+
+		// List the corners of each vertex, in corner order (a counting sort).
+		// Summing them in this order adds them up exactly as the serial code
+		// does.
+		std::vector<std::uint32_t> first( count+1, 0 );
+		for( auto const idx : aIndices )
+			++first[idx+1];
+
+		std::partial_sum( first.begin(), first.end(), first.begin() );
+
+		std::vector<std::uint32_t> vertexCorners( aIndices.size() );
+		{
+			std::vector<std::uint32_t> fill( first.begin(), first.end()-1 );
+			for( std::size_t i = 0; i < aIndices.size(); ++i )
+				vertexCorners[fill[aIndices[i]]++] = std::uint32_t(i);
+		}
+
+		// Gather and finalize, in parallel over chunks of vertices
+		std::vector<glm::vec4> ret( count );
+
+		order.resize( (count + kParallelChunkVertices-1) / kParallelChunkVertices );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+
+		float const* cornerData = &corners.data()->t[0][0][0];
+
+		parallel_for_order( aPool, order, [&] (std::size_t aChunk) {
+			auto const beg = aChunk * kParallelChunkVertices;
+			auto const end = std::min( count, beg + kParallelChunkVertices );
+			auto const n = end - beg;
+
+			std::vector<float> accum( 3*n, 0.f );
+			TangentPlanes_ const planes{ accum.data(), accum.data()+n, accum.data()+2*n };
+
+			for( std::size_t i = 0; i < n; ++i )
+			{
+				for( auto c = first[beg+i]; c < first[beg+i+1]; ++c )
+				{
+					auto const* t = cornerData + 3*std::size_t(vertexCorners[c]);
+					planes.x[i] += t[0];
+					planes.y[i] += t[1];
+					planes.z[i] += t[2];
+				}
+			}
+
+			finalize_( aMesh, planes, beg, end, ret.data() );
+		} );
+
+		return ret;
+	}
+}
+
+namespace
+{
+	void corner_tangents_( VertexAttributeViews const& aMesh, std::uint32_t const* aIndices, std::size_t aTriangles, CornerBlock_& aBlock )
+	{
+		assert( aTriangles <= kSimdWidth );
+
+		for( std::size_t i = 0; i < aTriangles; ++i )
+		{
+			std::uint32_t const* idx = aIndices + 3*i;
+
+			glm::vec3 edge3D[3];
+			glm::vec2 edgeUV[3];
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				auto const next = (j+1) % 3;
+				edge3D[j] = aMesh.vert[idx[next]] - aMesh.vert[idx[j]];
+				edgeUV[j] = aMesh.text[idx[next]] - aMesh.text[idx[j]];
+			}
+
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				auto const prev = (j+2) % 3;
+
+				auto const& dPos0 = edge3D[j];
+				auto const& dPos1Neg = edge3D[prev];
+				auto const& dUV0 = edgeUV[j];
+				auto const& dUV1Neg = edgeUV[prev];
+
+				float const denom = dUV0[0] * -dUV1Neg[1] - dUV0[1] * -dUV1Neg[0];
+				float const r = std::abs(denom) > kDenomEps ? 1.f / denom : 0.f;
+
+				auto const tangent = dPos0 * (-dUV1Neg[1] * r) - dPos1Neg * (-dUV0[1] * r);
+
+				aBlock.t[i][j][0] = tangent.x;
+				aBlock.t[i][j][1] = tangent.y;
+				aBlock.t[i][j][2] = tangent.z;
+			}
+		}
+	}
+
+#	if TANGENT_SPACE_SSE2
+	void corner_tangents_simd_( VertexAttributeViews const& aMesh, std::uint32_t const* aIndices, CornerBlock_& aBlock )
+	{
+		// One triangle per lane. The vertex attributes are gathered into SoA
+		// registers, one per component and triangle corner.
+		__m128 px[3], py[3], pz[3], tu[3], tv[3];
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const& v0 = aMesh.vert[aIndices[0+j]];
+			auto const& v1 = aMesh.vert[aIndices[3+j]];
+			auto const& v2 = aMesh.vert[aIndices[6+j]];
+			auto const& v3 = aMesh.vert[aIndices[9+j]];
+
+			px[j] = _mm_setr_ps( v0.x, v1.x, v2.x, v3.x );
+			py[j] = _mm_setr_ps( v0.y, v1.y, v2.y, v3.y );
+			pz[j] = _mm_setr_ps( v0.z, v1.z, v2.z, v3.z );
+
+			auto const& t0 = aMesh.text[aIndices[0+j]];
+			auto const& t1 = aMesh.text[aIndices[3+j]];
+			auto const& t2 = aMesh.text[aIndices[6+j]];
+			auto const& t3 = aMesh.text[aIndices[9+j]];
+
+			tu[j] = _mm_setr_ps( t0.x, t1.x, t2.x, t3.x );
+			tv[j] = _mm_setr_ps( t0.y, t1.y, t2.y, t3.y );
+		}
+
+		__m128 ex[3], ey[3], ez[3], eu[3], ev[3];
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const next = (j+1) % 3;
+			ex[j] = _mm_sub_ps( px[next], px[j] );
+			ey[j] = _mm_sub_ps( py[next], py[j] );
+			ez[j] = _mm_sub_ps( pz[next], pz[j] );
+			eu[j] = _mm_sub_ps( tu[next], tu[j] );
+			ev[j] = _mm_sub_ps( tv[next], tv[j] );
+		}
+
+		__m128 const sign = _mm_set1_ps( -0.f );
+		__m128 const eps = _mm_set1_ps( kDenomEps );
+		__m128 const one = _mm_set1_ps( 1.f );
+
+		alignas(16) float out[3][3][kSimdWidth]; // [corner][xyz][triangle]
+		for( std::size_t j = 0; j < 3; ++j )
+		{
+			auto const prev = (j+2) % 3;
+
+			// denom = dUV0.u * -dUV1Neg.v - dUV0.v * -dUV1Neg.u; r = 1/denom
+			// unless |denom| is too small (or NaN), in which case r = 0.
+			__m128 const negU1 = _mm_xor_ps( eu[prev], sign );
+			__m128 const negV1 = _mm_xor_ps( ev[prev], sign );
+			__m128 const negV0 = _mm_xor_ps( ev[j], sign );
+
+			__m128 const denom = _mm_sub_ps( _mm_mul_ps( eu[j], negV1 ), _mm_mul_ps( ev[j], negU1 ) );
+			__m128 const valid = _mm_cmpgt_ps( _mm_andnot_ps( sign, denom ), eps );
+			__m128 const r = _mm_and_ps( valid, _mm_div_ps( one, denom ) );
+
+			// tangent = dPos0 * (-dUV1Neg.v * r) - dPos1Neg * (-dUV0.v * r)
+			__m128 const s0 = _mm_mul_ps( negV1, r );
+			__m128 const s1 = _mm_mul_ps( negV0, r );
+
+			_mm_store_ps( out[j][0], _mm_sub_ps( _mm_mul_ps( ex[j], s0 ), _mm_mul_ps( ex[prev], s1 ) ) );
+			_mm_store_ps( out[j][1], _mm_sub_ps( _mm_mul_ps( ey[j], s0 ), _mm_mul_ps( ey[prev], s1 ) ) );
+			_mm_store_ps( out[j][2], _mm_sub_ps( _mm_mul_ps( ez[j], s0 ), _mm_mul_ps( ez[prev], s1 ) ) );
+		}
+
+		for( std::size_t i = 0; i < kSimdWidth; ++i )
+		{
+			for( std::size_t j = 0; j < 3; ++j )
+			{
+				aBlock.t[i][j][0] = out[j][0][i];
+				aBlock.t[i][j][1] = out[j][1][i];
+				aBlock.t[i][j][2] = out[j][2][i];
+			}
+		}
+	}
+#	endif // ~ SSE2
+}
+
+namespace
+{
+	void finalize_( VertexAttributeViews const& aMesh, TangentPlanes_ const& aPlanes, std::size_t aBegin, std::size_t aEnd, glm::vec4* aOut )
+	{
+		std::size_t i = aBegin;
+
+#		if TANGENT_SPACE_SSE2
+		__m128 const zero = _mm_setzero_ps();
+		__m128 const one = _mm_set1_ps( 1.f );
+		__m128 const minusOne = _mm_set1_ps( -1.f );
+
+		for( ; i + kSimdWidth <= aEnd; i += kSimdWidth )
+		{
+			auto const k = i - aBegin;
+
+			__m128 tx = _mm_loadu_ps( aPlanes.x + k );
+			__m128 ty = _mm_loadu_ps( aPlanes.y + k );
+			__m128 tz = _mm_loadu_ps( aPlanes.z + k );
+
+			auto const& n0 = aMesh.norm[i+0];
+			auto const& n1 = aMesh.norm[i+1];
+			auto const& n2 = aMesh.norm[i+2];
+			auto const& n3 = aMesh.norm[i+3];
+
+			__m128 const nx = _mm_setr_ps( n0.x, n1.x, n2.x, n3.x );
+			__m128 const ny = _mm_setr_ps( n0.y, n1.y, n2.y, n3.y );
+			__m128 const nz = _mm_setr_ps( n0.z, n1.z, n2.z, n3.z );
+
+			// t = normalize(t). Like tgen, a zero tangent becomes NaN.
+			auto const normalize_ = [&] {
+				__m128 const len2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( tx, tx ), _mm_mul_ps( ty, ty ) ), _mm_mul_ps( tz, tz ) );
+				__m128 const inv = _mm_div_ps( one, _mm_sqrt_ps( len2 ) );
+				tx = _mm_mul_ps( tx, inv );
+				ty = _mm_mul_ps( ty, inv );
+				tz = _mm_mul_ps( tz, inv );
+			};
+
+			normalize_();
+
+			// t = normalize(t - n * dot(n,t))
+			__m128 const d = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, tx ), _mm_mul_ps( ny, ty ) ), _mm_mul_ps( nz, tz ) );
+			tx = _mm_sub_ps( tx, _mm_mul_ps( nx, d ) );
+			ty = _mm_sub_ps( ty, _mm_mul_ps( ny, d ) );
+			tz = _mm_sub_ps( tz, _mm_mul_ps( nz, d ) );
+
+			normalize_();
+
+			// b = cross(n,t); sign = dot(b,b) > 0 ? 1 : -1
+			__m128 const bx = _mm_sub_ps( _mm_mul_ps( ny, tz ), _mm_mul_ps( nz, ty ) );
+			__m128 const by = _mm_sub_ps( _mm_mul_ps( nz, tx ), _mm_mul_ps( nx, tz ) );
+			__m128 const bz = _mm_sub_ps( _mm_mul_ps( nx, ty ), _mm_mul_ps( ny, tx ) );
+
+			__m128 const b2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( bx, bx ), _mm_mul_ps( by, by ) ), _mm_mul_ps( bz, bz ) );
+			__m128 const positive = _mm_cmpgt_ps( b2, zero );
+			__m128 tw = _mm_or_ps( _mm_and_ps( positive, one ), _mm_andnot_ps( positive, minusOne ) );
+
+			// SoA to AoS
+			_MM_TRANSPOSE4_PS( tx, ty, tz, tw );
+			_mm_storeu_ps( &aOut[i+0].x, tx );
+			_mm_storeu_ps( &aOut[i+1].x, ty );
+			_mm_storeu_ps( &aOut[i+2].x, tz );
+			_mm_storeu_ps( &aOut[i+3].x, tw );
+		}
+#		endif // ~ SSE2
+
+		for( ; i < aEnd; ++i )
+		{
+			auto const k = i - aBegin;
+			auto const& n = aMesh.norm[i];
+
+			auto t = glm::vec3( aPlanes.x[k], aPlanes.y[k], aPlanes.z[k] );
+			t = t * (1.f / std::sqrt( dot( t, t ) ));
+
+			t = t - n * dot( n, t );
+			t = t * (1.f / std::sqrt( dot( t, t ) ));
+
+			auto const b = cross( n, t );
+			aOut[i] = glm::vec4( t, dot( b, b ) > 0.f ? 1.f : -1.f );
+		}
+	}
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
@@ -0,0 +1,51 @@
+#ifndef TANGENT_SPACE_HPP_7E14C2B9_5F3A_4A8D_B06E_29C8D1F4A753
+#define TANGENT_SPACE_HPP_7E14C2B9_5F3A_4A8D_B06E_29C8D1F4A753
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec4.hpp>
+
+#include "index_mesh.hpp"
+
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Per-vertex tangents (xyz) and bitangent sign (w) of an indexed mesh with
+ * normals.
+ *
+ * This follows tgen's pipeline (computeCornerTSpace, computeVertexTSpace,
+ * orthogonalizeTSpace and computeTangent4D), with the passes fused: the
+ * corner tangents of four triangles at a time are computed with SIMD and
+ * accumulated into per-vertex SoA arrays, which a second SIMD pass then
+ * normalizes, orthogonalizes against the normal and turns into 4D tangents.
+ * The attributes are read through the views; nothing is converted to double
+ * arrays first. The math is done in single precision, so results differ
+ * slightly from tgen's; see compute_tangents_reference() and the bake's
+ * '--bench-tangents' option.
+ *
+ * Like tgen, the sign is taken after orthogonalization, at which point the
+ * bitangent is cross(n,t). It is therefore +1 for all but degenerate frames,
+ * and the bitangents are not accumulated at all.
+ *
+ * If a pool is given, large meshes are split across its threads: corner
+ * tangents are computed in parallel over triangles and gathered per vertex
+ * in parallel over vertices. Each vertex sums its corners in the same order
+ * either way, so the result is identical.
+ */
+std::vector<glm::vec4> compute_tangents(
+	VertexAttributeViews const&,
+	std::vector<std::uint32_t> const& aIndices,
+	ThreadPool* = nullptr
+);
+
+// Original tgen-based implementation (double precision). Reference only.
+std::vector<glm::vec4> compute_tangents_reference(
+	IndexedMesh const&
+);
+
+#endif // TANGENT_SPACE_HPP_7E14C2B9_5F3A_4A8D_B06E_29C8D1F4A753
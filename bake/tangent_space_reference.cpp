@@ -0,0 +1,75 @@
+#include "tangent_space.hpp"
+
+/* Original tangent generation, using tgen. It is no longer used by the bake
+ * itself, but is kept as a reference for validating and benchmarking
+ * compute_tangents(). See the '--bench-tangents' option of the bake.
+ */
+
+#include <cstddef>
+
+#include <tgen.h>
+
+//--    compute_tangents_reference()    ///{{{2///////////////////////////////
+std::vector<glm::vec4> compute_tangents_reference( IndexedMesh const& aMesh )
+{
+	//Convert vertices, texcoords and indices to proper file types (RealT and VIndexT)
+	std::vector<tgen::RealT> verts;
+	std::vector<tgen::RealT> texCoords;
+	std::vector<tgen::RealT> normals;
+	std::vector<tgen::VIndexT> indices;
+
+	for (std::size_t i = 0; i < aMesh.vert.size(); i++)
+	{
+		verts.emplace_back(aMesh.vert.at(i).x);
+		verts.emplace_back(aMesh.vert.at(i).y);
+		verts.emplace_back(aMesh.vert.at(i).z);
+
+		texCoords.emplace_back(aMesh.text.at(i).x);
+		texCoords.emplace_back(aMesh.text.at(i).y);
+
+		normals.emplace_back(aMesh.norm.at(i).x);
+		normals.emplace_back(aMesh.norm.at(i).y);
+		normals.emplace_back(aMesh.norm.at(i).z);
+	}
+
+	//Do the same with indices
+	for (auto const& index : aMesh.indices)
+		indices.emplace_back(index);
+
+	//Compute tangents
+	std::vector<tgen::RealT> tangents3D;
+	std::vector<tgen::RealT> bitangents3D;
+
+	//Compute tangent and bitangents for each corner of a triangle
+	tgen::computeCornerTSpace(indices, indices, verts, texCoords, tangents3D, bitangents3D);
+
+	//Compute per-vertex tangents and bitangent for each UV vertex
+	std::vector<tgen::RealT> vTangents3D;
+	std::vector<tgen::RealT> vBitangents3D;
+
+	tgen::computeVertexTSpace(indices, tangents3D, bitangents3D, aMesh.text.size(), vTangents3D, vBitangents3D);
+
+	//Make tangent frames orthogonal
+	tgen::orthogonalizeTSpace(normals, vTangents3D, vBitangents3D);
+
+	//Finally, compute the 4-dimensional tangent
+	std::vector<tgen::RealT> tangents4D;
+	tgen::computeTangent4D(normals, vTangents3D, vBitangents3D, tangents4D);
+
+	//For convenience - convert tangents into glm::vec4
+	std::vector<glm::vec4> tangentVectors;
+	for (std::size_t i = 0; i < tangents4D.size(); i += 4)
+	{
+		glm::vec4 tangentVec;
+		tangentVec.x = float(tangents4D[i]);
+		tangentVec.y = float(tangents4D[i + 1]);
+		tangentVec.z = float(tangents4D[i + 2]);
+		tangentVec.w = float(tangents4D[i + 3]);
+
+		tangentVectors.emplace_back(tangentVec);
+	}
+
+	return tangentVectors;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
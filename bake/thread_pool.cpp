@@ -0,0 +1,174 @@
+#include "thread_pool.hpp"
+
+#include <numeric>
+#include <utility>
+#include <algorithm>
+
+#include <cassert>
+
+//--    ThreadPool                      ///{{{2///////////////////////////////
+ThreadPool::ThreadPool( std::size_t aThreadCount )
+{
+	if( 0 == aThreadCount )
+		aThreadCount = std::max( 1u, std::thread::hardware_concurrency() );
+
+	// Queue 0 belongs to the thread calling wait().
+	for( std::size_t i = 0; i < aThreadCount; ++i )
+		mQueues.emplace_back( std::make_unique<Queue_>() );
+
+	for( std::size_t i = 1; i < aThreadCount; ++i )
+		mThreads.emplace_back( [this,i] { worker_( i ); } );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		mStop = true;
+	}
+
+	mSignal.notify_all();
+
+	for( auto& thread : mThreads )
+		thread.join();
+}
+
+std::size_t ThreadPool::thread_count() const noexcept
+{
+	return mQueues.size();
+}
+
+void ThreadPool::submit( std::function<void()> aTask )
+{
+	std::size_t target;
+	{
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		target = mNextQueue++ % mQueues.size();
+		++mOutstanding;
+		++mAvailable;
+	}
+
+	{
+		auto& queue = *mQueues[target];
+		std::unique_lock<std::mutex> lock( queue.mutex );
+		queue.tasks.emplace_back( std::move(aTask) );
+	}
+
+	mSignal.notify_all();
+}
+
+void ThreadPool::wait()
+{
+	for( ;; )
+	{
+		if( run_one_( 0 ) )
+			continue;
+
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		mSignal.wait( lock, [this] { return 0 == mOutstanding || 0 != mAvailable; } );
+
+		if( 0 == mOutstanding )
+			break;
+	}
+
+	std::exception_ptr err;
+	{
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		err = std::exchange( mError, nullptr );
+		mNextQueue = 0;
+	}
+
+	if( err )
+		std::rethrow_exception( err );
+}
+
+void ThreadPool::worker_( std::size_t aSelf )
+{
+	for( ;; )
+	{
+		if( run_one_( aSelf ) )
+			continue;
+
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		mSignal.wait( lock, [this] { return mStop || 0 != mAvailable; } );
+
+		if( mStop )
+			break;
+	}
+}
+
+bool ThreadPool::run_one_( std::size_t aSelf )
+{
+	std::function<void()> task;
+
+	// Own queue first (oldest task), then steal from the back of the others.
+	{
+		auto& own = *mQueues[aSelf];
+		std::unique_lock<std::mutex> lock( own.mutex );
+		if( !own.tasks.empty() )
+		{
+			task = std::move(own.tasks.front());
+			own.tasks.pop_front();
+		}
+	}
+
+	for( std::size_t i = 1; !task && i < mQueues.size(); ++i )
+	{
+		auto& other = *mQueues[(aSelf+i) % mQueues.size()];
+		std::unique_lock<std::mutex> lock( other.mutex );
+		if( !other.tasks.empty() )
+		{
+			task = std::move(other.tasks.back());
+			other.tasks.pop_back();
+		}
+	}
+
+	if( !task )
+		return false;
+
+	{
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		assert( mAvailable > 0 );
+		--mAvailable;
+	}
+
+	std::exception_ptr err;
+	try
+	{
+		task();
+	}
+	catch( ... )
+	{
+		err = std::current_exception();
+	}
+
+	bool done;
+	{
+		std::unique_lock<std::mutex> lock( mStateMutex );
+		if( err && !mError )
+			mError = err;
+
+		assert( mOutstanding > 0 );
+		done = 0 == --mOutstanding;
+	}
+
+	if( done )
+		mSignal.notify_all();
+
+	return true;
+}
+
+//--    largest_first_order()           ///{{{2///////////////////////////////
+std::vector<std::size_t> largest_first_order( std::vector<std::size_t> const& aWeights )
+{
+	std::vector<std::size_t> order( aWeights.size() );
+	std::iota( order.begin(), order.end(), std::size_t(0) );
+
+	std::stable_sort( order.begin(), order.end(), [&] (std::size_t aI, std::size_t aJ) {
+		return aWeights[aI] > aWeights[aJ];
+	} );
+
+	return order;
+}
+
+//--///}}}1/////////////// vim:syntax=cpp:foldmethod=marker:ts=4:noexpandtab:
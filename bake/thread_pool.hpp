@@ -0,0 +1,102 @@
+#ifndef THREAD_POOL_HPP_3C0F5B9E_7A41_4D2B_9E61_58B2D4C1A7E3
+#define THREAD_POOL_HPP_3C0F5B9E_7A41_4D2B_9E61_58B2D4C1A7E3
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+#include <cstddef>
+
+
+//--    types                                   ///{{{1///////////////////////
+
+/* Small work-stealing thread pool for the bake.
+ *
+ * Each thread owns a task queue. Tasks are handed out round-robin in
+ * submission order; a thread takes work from the front of its own queue and,
+ * once that runs dry, steals from the back of the other queues. Submitting
+ * the most expensive tasks first therefore gets those started first, while
+ * the cheap ones at the tail are balanced out by stealing.
+ *
+ * The thread calling wait() participates in running tasks. A pool created
+ * with a single thread consequently runs everything on the caller, which is
+ * handy for debugging.
+ *
+ * Tasks may not submit further tasks. Results should be written to
+ * per-task slots; the pool makes no promises about execution order.
+ */
+class ThreadPool
+{
+	public:
+		explicit ThreadPool( std::size_t aThreadCount = 0 );
+		~ThreadPool();
+
+		ThreadPool( ThreadPool const& ) = delete;
+		ThreadPool& operator= (ThreadPool const&) = delete;
+
+	public:
+		std::size_t thread_count() const noexcept;
+
+		void submit( std::function<void()> );
+
+		// Block until all submitted tasks have finished. If any task threw,
+		// the first exception is rethrown here.
+		void wait();
+
+	private:
+		struct Queue_
+		{
+			std::mutex mutex;
+			std::deque<std::function<void()>> tasks;
+		};
+
+		void worker_( std::size_t aSelf );
+		bool run_one_( std::size_t aSelf );
+
+	private:
+		std::vector<std::unique_ptr<Queue_>> mQueues;
+		std::vector<std::thread> mThreads;
+
+		std::mutex mStateMutex;
+		std::condition_variable mSignal;
+
+		std::size_t mAvailable = 0; // queued, not yet picked up
+		std::size_t mOutstanding = 0; // submitted, not yet finished
+		std::size_t mNextQueue = 0;
+		bool mStop = false;
+
+		std::exception_ptr mError;
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Returns the indices 0..N-1 sorted by decreasing weight. Ties keep their
+ * original relative order, so the result is deterministic.
+ */
+std::vector<std::size_t> largest_first_order( std::vector<std::size_t> const& aWeights );
+
+/* Calls aBody(i) for each i in aOrder on the pool and waits for completion.
+ */
+template< typename tBody >
+void parallel_for_order( ThreadPool&, std::vector<std::size_t> const& aOrder, tBody&& aBody );
+
+//--    inline                                  ///{{{1///////////////////////
+
+template< typename tBody > inline
+void parallel_for_order( ThreadPool& aPool, std::vector<std::size_t> const& aOrder, tBody&& aBody )
+{
+	for( auto const idx : aOrder )
+		aPool.submit( [&aBody, idx] { aBody( idx ); } );
+
+	aPool.wait();
+}
+
+#endif // THREAD_POOL_HPP_3C0F5B9E_7A41_4D2B_9E61_58B2D4C1A7E3
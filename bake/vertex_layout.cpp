@@ -0,0 +1,131 @@
+#include "vertex_layout.hpp"
+
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+	constexpr std::size_t kBenchmarkRuns = 5;
+
+	// Elements are gathered in chunks of this size (one vec4); interleaved
+	// elements span several chunks.
+	constexpr std::size_t kGatherChunkSize = 16;
+
+	std::vector<std::uint32_t> transformed_vertices_( std::vector<std::uint32_t> const&, std::size_t aCacheSize );
+}
+
+std::vector<std::uint8_t> interleave_streams( std::vector<VertexStream> const& aStreams, std::size_t aVertexCount )
+{
+	std::size_t stride = 0;
+	for( auto const& stream : aStreams )
+		stride += stream.elementSize;
+
+	std::vector<std::uint8_t> ret( stride * aVertexCount );
+
+	std::size_t offset = 0;
+	for( auto const& stream : aStreams )
+	{
+		auto const* src = static_cast<std::uint8_t const*>(stream.data);
+		for( std::size_t i = 0; i < aVertexCount; ++i )
+			std::memcpy( ret.data() + i*stride + offset, src + i*stream.stride, stream.elementSize );
+
+		offset += stream.elementSize;
+	}
+
+	return ret;
+}
+
+VertexFetchStats benchmark_vertex_fetch( std::vector<std::uint32_t> const& aIndices, std::vector<VertexStream> const& aStreams, std::size_t aCacheSize )
+{
+	VertexFetchStats ret{ 0, 0, 0.0, 0 };
+
+	// Only vertices that miss the post-transform cache are fetched
+	auto const fetches = transformed_vertices_( aIndices, aCacheSize );
+	ret.transforms = fetches.size();
+
+	// Direct-mapped fetch cache. Each stream is treated as a separate buffer
+	// that starts at a line boundary.
+	std::vector<std::uint64_t> tags( kFetchCacheLines, std::numeric_limits<std::uint64_t>::max() );
+
+	for( auto const idx : fetches )
+	{
+		for( std::size_t s = 0; s < aStreams.size(); ++s )
+		{
+			auto const& stream = aStreams[s];
+			auto const first = (idx * stream.stride) / kFetchCacheLineSize;
+			auto const last = (idx * stream.stride + stream.elementSize - 1) / kFetchCacheLineSize;
+
+			for( auto line = first; line <= last; ++line )
+			{
+				auto const tag = (std::uint64_t(s) << 48) | line;
+				auto& slot = tags[(tag ^ (tag >> 48)*0x9E3779B1u) % kFetchCacheLines];
+				if( slot != tag )
+				{
+					slot = tag;
+					++ret.cacheLines;
+				}
+			}
+		}
+	}
+
+	// Time the actual gather
+	ret.seconds = std::numeric_limits<double>::max();
+	for( std::size_t run = 0; run < kBenchmarkRuns; ++run )
+	{
+		auto const start = std::chrono::steady_clock::now();
+
+		std::uint32_t acc = 0;
+		for( auto const idx : fetches )
+		{
+			for( auto const& stream : aStreams )
+			{
+				auto const* src = static_cast<std::uint8_t const*>(stream.data) + idx*stream.stride;
+				for( std::size_t offset = 0; offset < stream.elementSize; offset += kGatherChunkSize )
+				{
+					std::uint32_t chunk[kGatherChunkSize/sizeof(std::uint32_t)] = {};
+					std::memcpy( chunk, src + offset, std::min( kGatherChunkSize, stream.elementSize - offset ) );
+
+					for( auto const word : chunk )
+						acc ^= word;
+				}
+			}
+		}
+
+		auto const end = std::chrono::steady_clock::now();
+		ret.seconds = std::min( ret.seconds, std::chrono::duration<double>( end - start ).count() );
+		ret.checksum = acc;
+	}
+
+	return ret;
+}
+
+namespace
+{
+	std::vector<std::uint32_t> transformed_vertices_( std::vector<std::uint32_t> const& aIndices, std::size_t aCacheSize )
+	{
+		// Same FIFO model as analyze_vertex_cache()
+		std::vector<std::uint32_t> ret;
+
+		std::uint32_t maxIndex = 0;
+		for( auto const idx : aIndices )
+			maxIndex = std::max( maxIndex, idx );
+
+		std::vector<std::size_t> insertedAt( std::size_t(maxIndex)+1, 0 );
+		std::size_t time = aCacheSize+1;
+
+		for( auto const idx : aIndices )
+		{
+			if( time - insertedAt[idx] > aCacheSize )
+			{
+				insertedAt[idx] = time++;
+				ret.emplace_back( idx );
+			}
+		}
+
+		return ret;
+	}
+}
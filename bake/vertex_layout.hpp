@@ -0,0 +1,79 @@
+#ifndef VERTEX_LAYOUT_HPP_2F8B6D14_C3A9_4E5B_8D07_91E4A6C2F358
+#define VERTEX_LAYOUT_HPP_2F8B6D14_C3A9_4E5B_8D07_91E4A6C2F358
+
+//--//////////////////////////////////////////////////////////////////////////
+//--    include                                 ///{{{1///////////////////////
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "optimize_mesh.hpp"
+
+
+//--    constants                               ///{{{1///////////////////////
+
+/* Simulated vertex fetch cache: number of lines and line size in bytes. This
+ * is roughly the size of a GPU's L1 cache.
+ */
+constexpr std::size_t kFetchCacheLines = 256;
+constexpr std::size_t kFetchCacheLineSize = 64;
+
+//--    types                                   ///{{{1///////////////////////
+
+/* How vertex attributes are arranged in the baked file (and in VRAM).
+ *
+ *  - separate: one stream per attribute (position, normal, texcoord,
+ *    tangent).
+ *  - interleaved: a position-only stream, followed by a single stream with
+ *    the remaining attributes (normal, texcoord, tangent) interleaved per
+ *    vertex. Depth-only passes can bind just the position stream.
+ */
+enum class VertexLayout : std::uint32_t
+{
+	separate = 0,
+	interleaved = 1
+};
+
+/* One vertex stream: element i occupies aElementSize bytes at
+ * data + i*stride.
+ */
+struct VertexStream
+{
+	void const* data;
+	std::size_t stride;
+	std::size_t elementSize;
+};
+
+struct VertexFetchStats
+{
+	std::size_t transforms; // vertex shader invocations (post-transform cache misses)
+	std::size_t cacheLines; // fetch cache misses
+	double seconds; // CPU time to gather the attributes, best of several runs
+	std::uint32_t checksum; // XOR of the gathered data; keeps the gather from being optimized out
+};
+
+//--    functions                               ///{{{1///////////////////////
+
+/* Interleave the given tightly packed streams (stride == elementSize) into
+ * one, in the order given.
+ */
+std::vector<std::uint8_t> interleave_streams(
+	std::vector<VertexStream> const&,
+	std::size_t aVertexCount
+);
+
+/* Estimate the cost of fetching vertex attributes while drawing the index
+ * buffer. Vertices that miss the post-transform cache (FIFO, aCacheSize) are
+ * fetched from all streams. Fetches go through a direct-mapped cache of
+ * kFetchCacheLines lines, whose misses are counted. In addition, the gather
+ * is timed on the CPU.
+ */
+VertexFetchStats benchmark_vertex_fetch(
+	std::vector<std::uint32_t> const& aIndices,
+	std::vector<VertexStream> const&,
+	std::size_t aCacheSize = kVertexCacheSize
+);
+
+#endif // VERTEX_LAYOUT_HPP_2F8B6D14_C3A9_4E5B_8D07_91E4A6C2F358
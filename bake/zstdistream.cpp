@@ -1,10 +1,19 @@
 #include "zstdistream.hpp"
 
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <streambuf>
 #include <fstream>
 
 #include <zstd.h>
 
+#include "thread_pool.hpp"
+#include "mapped_buffer.hpp"
+
 #include "../labutils/error.hpp"
 namespace lut = labutils;
 
@@ -30,15 +39,464 @@ namespace
 
 			std::ifstream mStream;
 	};
+
+	class MemoryStreambuf_ : public std::streambuf
+	{
+		public:
+			explicit MemoryStreambuf_( MappedBuffer&& );
+
+		private:
+			MappedBuffer mBuffer;
+	};
+
+	// Seekable format constants; see zstdistream.hpp
+	constexpr std::uint32_t kSeekTableMagic = 0x184D2A5E; // ZSTD_MAGIC_SKIPPABLE_START | 0xE
+	constexpr std::uint32_t kSeekableMagic = 0x8F92EAB1;
+	constexpr std::size_t kSeekTableFooterSize = 9;
+	constexpr std::size_t kSkippableHeaderSize = 8;
+
+	// Frames written by write_seekable_zstd()
+	constexpr std::uint32_t kFrameMagic = 0xFD2FB528;
+	constexpr std::size_t kMaxRawBlockSize = 128*1024; // ZSTD_BLOCKSIZE_MAX
+
+	std::uint32_t read_le32_( unsigned char const* aPtr )
+	{
+		return std::uint32_t(aPtr[0]) 
+			| (std::uint32_t(aPtr[1]) << 8)
+			| (std::uint32_t(aPtr[2]) << 16)
+			| (std::uint32_t(aPtr[3]) << 24)
+		;
+	}
+
+	void checked_read_( FILE*, char const* aPath, std::size_t aBytes, void* aBuffer );
+	void checked_write_( FILE*, char const* aPath, std::size_t aBytes, void const* aBuffer );
+
+	// 64-bit file offsets; long is 32 bits on Windows.
+	void checked_seek_( FILE*, char const* aPath, std::uint64_t aOffset, int aOrigin );
+	std::uint64_t checked_tell_( FILE*, char const* aPath );
+
+	void append_le32_( std::vector<unsigned char>&, std::uint32_t );
+
+	// Frame of a seekable file; offsets are relative to the start of the
+	// file (src) and the decompressed data (dst).
+	struct SeekFrame_
+	{
+		std::uint64_t srcOffset, srcSize;
+		std::uint64_t dstOffset, dstSize;
+	};
+
+	// Returns false if the file does not end in a seek table
+	bool read_seek_table_( FILE*, char const* aPath, std::vector<SeekFrame_>& aFrames );
+
+	void decompress_frame_( char const* aPath, std::size_t aFrame, char* aDst, std::size_t aDstSize, char const* aSrc, std::size_t aSrcSize );
 }
 
-ZStdIStream::ZStdIStream( char const* aPath )
+ZStdIStream::ZStdIStream( char const* aPath, ThreadPool* aPool )
 	: std::istream( nullptr )
-	, mInternal( std::make_unique<ZStdStreambuf_>(aPath) )
 {
+	MappedBuffer buffer;
+	if( decompress_seekable_zstd( aPath, buffer, aPool ) )
+		mInternal = std::make_unique<MemoryStreambuf_>( std::move(buffer) );
+	else
+		mInternal = std::make_unique<ZStdStreambuf_>( aPath );
+
 	rdbuf( mInternal.get() );
 }
 
+bool decompress_seekable_zstd( char const* aPath, MappedBuffer& aOut, ThreadPool* aPool )
+{
+	FILE* fin = std::fopen( aPath, "rb" );
+	if( !fin )
+		throw lut::Error( "Unable to open '%s'", aPath );
+
+	std::vector<SeekFrame_> frames;
+	std::vector<char> compressed;
+	try
+	{
+		if( !read_seek_table_( fin, aPath, frames ) )
+		{
+			std::fclose( fin );
+			return false;
+		}
+
+		// Read all compressed frames
+		compressed.resize( frames.empty() ? 0 : std::size_t(frames.back().srcOffset + frames.back().srcSize) );
+		checked_seek_( fin, aPath, 0, SEEK_SET );
+		checked_read_( fin, aPath, compressed.size(), compressed.data() );
+	}
+	catch( ... )
+	{
+		std::fclose( fin );
+		throw;
+	}
+
+	std::fclose( fin );
+
+	// Decompress frames. Each frame is independent and has a known place in
+	// the output.
+	MappedBuffer out( frames.empty() ? 0 : std::size_t(frames.back().dstOffset + frames.back().dstSize) );
+
+	auto const decompress_ = [&] (std::size_t aFrame) {
+		auto const& frame = frames[aFrame];
+		decompress_frame_( aPath, aFrame, out.data() + frame.dstOffset, std::size_t(frame.dstSize), compressed.data() + frame.srcOffset, std::size_t(frame.srcSize) );
+	};
+
+	if( aPool )
+	{
+		std::vector<std::size_t> weights;
+		for( auto const& frame : frames )
+			weights.emplace_back( std::size_t(frame.dstSize) );
+
+		parallel_for_order( *aPool, largest_first_order( weights ), decompress_ );
+	}
+	else
+	{
+		for( std::size_t i = 0; i < frames.size(); ++i )
+			decompress_( i );
+	}
+
+	aOut = std::move(out);
+	return true;
+}
+
+void decompress_zstd( char const* aPath, MappedBuffer& aOut, ThreadPool* aPool )
+{
+	if( decompress_seekable_zstd( aPath, aOut, aPool ) )
+		return;
+
+	FILE* fin = std::fopen( aPath, "rb" );
+	if( !fin )
+		throw lut::Error( "Unable to open '%s'", aPath );
+
+	std::vector<char> compressed;
+	try
+	{
+		checked_seek_( fin, aPath, 0, SEEK_END );
+
+		compressed.resize( std::size_t(checked_tell_( fin, aPath )) );
+		checked_seek_( fin, aPath, 0, SEEK_SET );
+		checked_read_( fin, aPath, compressed.size(), compressed.data() );
+	}
+	catch( ... )
+	{
+		std::fclose( fin );
+		throw;
+	}
+
+	std::fclose( fin );
+
+	// Single frame with a known size?
+	auto const frameSize = ZSTD_findFrameCompressedSize( compressed.data(), compressed.size() );
+	auto const contentSize = ZSTD_getFrameContentSize( compressed.data(), compressed.size() );
+
+	if( frameSize == compressed.size() && contentSize < ZSTD_CONTENTSIZE_ERROR )
+	{
+		MappedBuffer out( static_cast<std::size_t>(contentSize) );
+
+		auto const ret = ZSTD_decompress( out.data(), out.size(), compressed.data(), compressed.size() );
+		if( ZSTD_isError(ret) )
+			throw lut::Error( "%s: decompression: %s", aPath, ZSTD_getErrorName(ret) );
+		if( ret != out.size() )
+			throw lut::Error( "%s: decompressed to %zu bytes, expected %zu", aPath, std::size_t(ret), out.size() );
+
+		aOut = std::move(out);
+		return;
+	}
+
+	// Otherwise, decompress incrementally
+	std::unique_ptr<ZSTD_DCtx,decltype(&ZSTD_freeDCtx)> ctx( ZSTD_createDCtx(), &ZSTD_freeDCtx );
+	if( !ctx )
+		throw lut::Error( "ZSTD_createDCtx() failed" );
+
+	std::vector<char> decompressed( std::max( compressed.size()*4, ZSTD_DStreamOutSize() ) );
+
+	ZSTD_inBuffer ib{ compressed.data(), compressed.size(), 0 };
+	ZSTD_outBuffer ob{ decompressed.data(), decompressed.size(), 0 };
+	for( ;; )
+	{
+		if( ob.pos == ob.size )
+		{
+			decompressed.resize( decompressed.size()*2 );
+			ob.dst = decompressed.data();
+			ob.size = decompressed.size();
+		}
+
+		auto const ret = ZSTD_decompressStream( ctx.get(), &ob, &ib );
+		if( ZSTD_isError(ret) )
+			throw lut::Error( "%s: decompression: %s", aPath, ZSTD_getErrorName(ret) );
+
+		// All input consumed and nothing left to flush?
+		if( ib.pos == ib.size && ob.pos < ob.size )
+		{
+			if( 0 != ret )
+				throw lut::Error( "%s: truncated zstd frame", aPath );
+			break;
+		}
+	}
+
+	MappedBuffer out( ob.pos );
+	std::memcpy( out.data(), decompressed.data(), ob.pos );
+
+	aOut = std::move(out);
+}
+
+struct ZStdReader::State_
+{
+	std::string path;
+	FILE* file = nullptr;
+	ThreadPool* pool = nullptr;
+
+	// Seekable files
+	bool seekable = false;
+	std::vector<SeekFrame_> frames;
+	std::size_t nextFrame = 0;
+
+	std::vector<char> compressed;
+
+	std::vector<char> pending; // frame that did not fit into the output
+	std::size_t pendingPos = 0;
+
+	// Other files
+	ZSTD_DCtx* ctx = nullptr;
+	std::vector<char> inBuf;
+	ZSTD_inBuffer in{ nullptr, 0, 0 };
+	std::size_t lastRet = 0; // 0 = at a frame boundary
+	bool eof = false;
+
+	~State_()
+	{
+		if( file )
+			std::fclose( file );
+
+		ZSTD_freeDCtx( ctx );
+	}
+};
+
+ZStdReader::ZStdReader( char const* aPath, ThreadPool* aPool )
+	: mState( std::make_unique<State_>() )
+{
+	auto& state = *mState;
+	state.path = aPath;
+	state.pool = aPool;
+
+	state.file = std::fopen( aPath, "rb" );
+	if( !state.file )
+		throw lut::Error( "Unable to open '%s'", aPath );
+
+	state.seekable = read_seek_table_( state.file, aPath, state.frames );
+	checked_seek_( state.file, aPath, 0, SEEK_SET );
+
+	if( !state.seekable )
+	{
+		state.ctx = ZSTD_createDCtx();
+		if( !state.ctx )
+			throw lut::Error( "ZSTD_createDCtx() failed" );
+
+		state.inBuf.resize( ZSTD_DStreamInSize() );
+	}
+}
+
+ZStdReader::~ZStdReader() = default;
+
+std::size_t ZStdReader::read( char* aOut, std::size_t aSize )
+{
+	auto& state = *mState;
+	char const* path = state.path.c_str();
+
+	// Rest of a frame from the previous call
+	std::size_t got = std::min( aSize, state.pending.size() - state.pendingPos );
+	std::memcpy( aOut, state.pending.data() + state.pendingPos, got );
+	state.pendingPos += got;
+
+	if( state.seekable )
+	{
+		auto const& frames = state.frames;
+		while( got < aSize && state.nextFrame < frames.size() )
+		{
+			auto const first = state.nextFrame;
+
+			// Whole frames that fit
+			std::size_t last = first, bytes = 0;
+			while( last < frames.size() && got + bytes + frames[last].dstSize <= aSize )
+				bytes += std::size_t(frames[last++].dstSize);
+
+			bool const partial = last == first;
+			if( partial )
+				++last;
+
+			auto const srcBase = frames[first].srcOffset;
+			state.compressed.resize( std::size_t(frames[last-1].srcOffset + frames[last-1].srcSize - srcBase) );
+			checked_read_( state.file, path, state.compressed.size(), state.compressed.data() );
+
+			if( partial )
+			{
+				auto const& frame = frames[first];
+				state.pending.resize( std::size_t(frame.dstSize) );
+				decompress_frame_( path, first, state.pending.data(), state.pending.size(), state.compressed.data(), state.compressed.size() );
+
+				auto const count = aSize - got;
+				std::memcpy( aOut + got, state.pending.data(), count );
+				state.pendingPos = count;
+				got += count;
+			}
+			else
+			{
+				auto const dstBase = frames[first].dstOffset;
+				char* const out = aOut + got;
+
+				auto const decompress_ = [&] (std::size_t aI) {
+					auto const& frame = frames[first+aI];
+					decompress_frame_( path, first+aI, out + (frame.dstOffset - dstBase), std::size_t(frame.dstSize), state.compressed.data() + (frame.srcOffset - srcBase), std::size_t(frame.srcSize) );
+				};
+
+				if( state.pool )
+				{
+					std::vector<std::size_t> weights;
+					for( std::size_t i = first; i < last; ++i )
+						weights.emplace_back( std::size_t(frames[i].dstSize) );
+
+					parallel_for_order( *state.pool, largest_first_order( weights ), decompress_ );
+				}
+				else
+				{
+					for( std::size_t i = 0; i < last-first; ++i )
+						decompress_( i );
+				}
+
+				got += bytes;
+			}
+
+			state.nextFrame = last;
+		}
+
+		return got;
+	}
+
+	ZSTD_outBuffer ob{ aOut + got, aSize - got, 0 };
+	while( ob.pos < ob.size )
+	{
+		if( state.in.pos == state.in.size && !state.eof )
+		{
+			auto const count = std::fread( state.inBuf.data(), 1, state.inBuf.size(), state.file );
+			if( std::ferror( state.file ) )
+				throw lut::Error( "%s: read error", path );
+
+			state.in = ZSTD_inBuffer{ state.inBuf.data(), count, 0 };
+			state.eof = 0 == count;
+		}
+
+		// Input ended after a complete frame? Decompressing further would
+		// start on a new frame.
+		if( state.eof && state.in.pos == state.in.size && 0 == state.lastRet )
+			break;
+
+		auto const ret = ZSTD_decompressStream( state.ctx, &ob, &state.in );
+		if( ZSTD_isError(ret) )
+			throw lut::Error( "%s: decompression: %s", path, ZSTD_getErrorName(ret) );
+
+		state.lastRet = ret;
+
+		// All input consumed and nothing left to flush?
+		if( state.eof && state.in.pos == state.in.size && ob.pos < ob.size )
+		{
+			if( 0 != ret )
+				throw lut::Error( "%s: truncated zstd frame", path );
+			break;
+		}
+	}
+
+	return got + ob.pos;
+}
+
+void write_seekable_zstd( char const* aPath, char const* aData, std::size_t aSize, std::size_t aFrameSize, ThreadPool* aPool )
+{
+	if( 0 == aFrameSize || aFrameSize > 0xffffffffu/2 )
+		throw lut::Error( "%s: invalid frame size %zu", aPath, aFrameSize );
+
+	// The bundled zstd only has the decoder, so frames consist of raw
+	// (stored) blocks:
+	//  - uint32_t : frame magic
+	//  - uint8_t : frame header descriptor; single segment, 8 byte content size
+	//  - uint64_t : content size
+	//  - repeat: 3 byte block header (last flag, type 0 = raw, size), data
+	std::size_t const frameCount = (aSize + aFrameSize-1) / aFrameSize;
+	std::vector<std::vector<unsigned char>> frames( frameCount );
+
+	auto const encode_ = [&] (std::size_t aFrame) {
+		auto const offset = aFrame * aFrameSize;
+		auto const size = std::min( aFrameSize, aSize - offset );
+
+		auto& frame = frames[aFrame];
+		frame.reserve( 4 + 1 + 8 + size + (size / kMaxRawBlockSize + 1)*3 );
+
+		append_le32_( frame, kFrameMagic );
+		frame.emplace_back( 0xe0 );
+		append_le32_( frame, std::uint32_t(size) );
+		append_le32_( frame, std::uint32_t(std::uint64_t(size) >> 32) );
+
+		std::size_t pos = 0;
+		do
+		{
+			auto const block = std::min( kMaxRawBlockSize, size - pos );
+			auto const last = pos + block == size;
+
+			auto const header = std::uint32_t(block << 3) | (last ? 1u : 0u);
+			frame.emplace_back( static_cast<unsigned char>(header) );
+			frame.emplace_back( static_cast<unsigned char>(header >> 8) );
+			frame.emplace_back( static_cast<unsigned char>(header >> 16) );
+
+			frame.insert( frame.end(), aData + offset + pos, aData + offset + pos + block );
+			pos += block;
+		} while( pos < size );
+	};
+
+	if( aPool )
+	{
+		std::vector<std::size_t> weights( frameCount, 1 );
+		parallel_for_order( *aPool, largest_first_order( weights ), encode_ );
+	}
+	else
+	{
+		for( std::size_t i = 0; i < frameCount; ++i )
+			encode_( i );
+	}
+
+	// Seek table; see zstdistream.hpp. No checksums.
+	std::vector<unsigned char> table;
+	append_le32_( table, kSeekTableMagic );
+	append_le32_( table, std::uint32_t(frameCount*8 + kSeekTableFooterSize) );
+
+	for( std::size_t i = 0; i < frameCount; ++i )
+	{
+		append_le32_( table, std::uint32_t(frames[i].size()) );
+		append_le32_( table, std::uint32_t(std::min( aFrameSize, aSize - i*aFrameSize )) );
+	}
+
+	append_le32_( table, std::uint32_t(frameCount) );
+	table.emplace_back( 0 ); // descriptor
+	append_le32_( table, kSeekableMagic );
+
+	FILE* fof = std::fopen( aPath, "wb" );
+	if( !fof )
+		throw lut::Error( "Unable to open '%s' for writing", aPath );
+
+	try
+	{
+		for( auto const& frame : frames )
+			checked_write_( fof, aPath, frame.size(), frame.data() );
+
+		checked_write_( fof, aPath, table.size(), table.data() );
+	}
+	catch( ... )
+	{
+		std::fclose( fof );
+		throw;
+	}
+
+	if( 0 != std::fclose( fof ) )
+		throw lut::Error( "%s: fclose() failed", aPath );
+}
+
 namespace
 {
 	ZStdStreambuf_::ZStdStreambuf_( char const* aPath )
@@ -115,3 +573,126 @@ namespace
 		;
 	}
 }
+
+namespace
+{
+	MemoryStreambuf_::MemoryStreambuf_( MappedBuffer&& aBuffer )
+		: mBuffer( std::move(aBuffer) )
+	{
+		setg( mBuffer.data(), mBuffer.data(), mBuffer.data() + mBuffer.size() );
+	}
+
+	void checked_read_( FILE* aFin, char const* aPath, std::size_t aBytes, void* aBuffer )
+	{
+		auto const ret = std::fread( aBuffer, 1, aBytes, aFin );
+
+		if( aBytes != ret )
+			throw lut::Error( "%s: expected %zu bytes, got %zu", aPath, aBytes, ret );
+	}
+
+	void checked_write_( FILE* aFof, char const* aPath, std::size_t aBytes, void const* aBuffer )
+	{
+		auto const ret = std::fwrite( aBuffer, 1, aBytes, aFof );
+
+		if( aBytes != ret )
+			throw lut::Error( "%s: wrote %zu bytes instead of %zu", aPath, ret, aBytes );
+	}
+
+	void checked_seek_( FILE* aFin, char const* aPath, std::uint64_t aOffset, int aOrigin )
+	{
+#		if defined(_WIN32)
+		auto const ret = _fseeki64( aFin, static_cast<__int64>(aOffset), aOrigin );
+#		else
+		auto const ret = fseeko( aFin, static_cast<off_t>(aOffset), aOrigin );
+#		endif
+
+		if( 0 != ret )
+			throw lut::Error( "%s: seeking to %llu failed", aPath, static_cast<unsigned long long>(aOffset) );
+	}
+
+	std::uint64_t checked_tell_( FILE* aFin, char const* aPath )
+	{
+#		if defined(_WIN32)
+		auto const ret = _ftelli64( aFin );
+#		else
+		auto const ret = ftello( aFin );
+#		endif
+
+		if( ret < 0 )
+			throw lut::Error( "%s: ftell() failed", aPath );
+
+		return std::uint64_t(ret);
+	}
+
+	void append_le32_( std::vector<unsigned char>& aOut, std::uint32_t aValue )
+	{
+		for( int i = 0; i < 4; ++i )
+			aOut.emplace_back( static_cast<unsigned char>(aValue >> (8*i)) );
+	}
+
+	bool read_seek_table_( FILE* aFin, char const* aPath, std::vector<SeekFrame_>& aFrames )
+	{
+		// Look for the seek table footer at the end of the file
+		checked_seek_( aFin, aPath, 0, SEEK_END );
+
+		auto const fileSize = checked_tell_( aFin, aPath );
+		if( fileSize < kSkippableHeaderSize + kSeekTableFooterSize )
+			return false;
+
+		unsigned char footer[kSeekTableFooterSize];
+		checked_seek_( aFin, aPath, fileSize - kSeekTableFooterSize, SEEK_SET );
+		checked_read_( aFin, aPath, kSeekTableFooterSize, footer );
+
+		if( kSeekableMagic != read_le32_( footer+5 ) )
+			return false;
+
+		std::size_t const frames = read_le32_( footer+0 );
+		bool const checksums = 0 != (footer[4] & 0x80);
+		std::size_t const entrySize = checksums ? 12 : 8;
+
+		std::uint64_t const tableSize = std::uint64_t(frames)*entrySize + kSeekTableFooterSize;
+		if( fileSize < kSkippableHeaderSize + tableSize )
+			throw lut::Error( "%s: seek table (%zu frames) is larger than the file", aPath, frames );
+
+		std::uint64_t const dataSize = fileSize - kSkippableHeaderSize - tableSize;
+
+		std::vector<unsigned char> table( std::size_t(kSkippableHeaderSize + tableSize) );
+		checked_seek_( aFin, aPath, dataSize, SEEK_SET );
+		checked_read_( aFin, aPath, table.size(), table.data() );
+
+		if( kSeekTableMagic != read_le32_( table.data() ) || tableSize != read_le32_( table.data()+4 ) )
+			throw lut::Error( "%s: malformed seek table header", aPath );
+
+		// Lay out the frames
+		aFrames.resize( frames );
+
+		std::uint64_t src = 0, dst = 0;
+		for( std::size_t i = 0; i < frames; ++i )
+		{
+			auto const* entry = table.data() + kSkippableHeaderSize + i*entrySize;
+
+			aFrames[i].srcOffset = src;
+			aFrames[i].srcSize = read_le32_( entry+0 );
+			aFrames[i].dstOffset = dst;
+			aFrames[i].dstSize = read_le32_( entry+4 );
+
+			src += aFrames[i].srcSize;
+			dst += aFrames[i].dstSize;
+		}
+
+		if( src != dataSize )
+			throw lut::Error( "%s: seek table covers %llu bytes, but there are %llu bytes of frames", aPath, static_cast<unsigned long long>(src), static_cast<unsigned long long>(dataSize) );
+
+		return true;
+	}
+
+	void decompress_frame_( char const* aPath, std::size_t aFrame, char* aDst, std::size_t aDstSize, char const* aSrc, std::size_t aSrcSize )
+	{
+		auto const ret = ZSTD_decompress( aDst, aDstSize, aSrc, aSrcSize );
+
+		if( ZSTD_isError(ret) )
+			throw lut::Error( "%s: frame %zu: decompression: %s", aPath, aFrame, ZSTD_getErrorName(ret) );
+		if( ret != aDstSize )
+			throw lut::Error( "%s: frame %zu: decompressed to %zu bytes, expected %zu", aPath, aFrame, std::size_t(ret), aDstSize );
+	}
+}
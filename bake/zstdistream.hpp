@@ -4,19 +4,98 @@
 #include <memory>
 #include <istream>
 
+#include <cstddef>
+
+class ThreadPool;
+class MappedBuffer;
+
 // Rapidobj fortunately allows us to feed it a custom data stream. Somewhat
 // unfortunately, the interface for this is a std::istream.
 //
 // Hence, to to decompress stuff on the fly, we have to write a std::istream /
 // std::streambuf adaptor. :-(
+//
+// Files in the seekable zstd format (see below) are instead decompressed up
+// front, in parallel if a thread pool is given, and then served from memory.
+// Plain single-frame files are still decompressed on the fly.
 
 class ZStdIStream : public std::istream
 {
 	public:
-		explicit ZStdIStream( char const* aPath );
+		explicit ZStdIStream( char const* aPath, ThreadPool* = nullptr );
 
 	private:
 		std::unique_ptr<std::streambuf> mInternal;
 };
 
+/* Seekable zstd files
+ *
+ * This is the format described in zstd's contrib/seekable_format: the input
+ * is split into independently compressed zstd frames, followed by a
+ * skippable frame holding the seek table:
+ *
+ *  - uint32_t: skippable frame magic = 0x184D2A5E
+ *  - uint32_t: S = size of the seek table (excluding these 8 bytes)
+ *  - repeat N times:
+ *    - uint32_t: compressed size of frame
+ *    - uint32_t: decompressed size of frame
+ *    - uint32_t: checksum (only if bit 7 of the descriptor is set)
+ *  - uint32_t: N = number of frames
+ *  - uint8_t: descriptor
+ *  - uint32_t: seekable magic = 0x8F92EAB1
+ *
+ * All values are little endian. Such files can be created with
+ * write_seekable_zstd() or the tools in zstd's contrib/seekable_format. They remain valid zstd files, so the plain
+ * zstd command line tool can still decompress them.
+ *
+ * decompress_seekable_zstd() returns false if the file does not end in a
+ * seek table (e.g. the original single-frame .obj-zstd). Otherwise it
+ * decompresses all frames into aOut, one task per frame.
+ */
+bool decompress_seekable_zstd( char const* aPath, MappedBuffer& aOut, ThreadPool* = nullptr );
+
+/* Decompress the whole zstd file into aOut
+ *
+ * Seekable files are handled by decompress_seekable_zstd(). A single frame
+ * that records its decompressed size is decompressed in one go; anything
+ * else falls back to streaming decompression.
+ */
+void decompress_zstd( char const* aPath, MappedBuffer& aOut, ThreadPool* = nullptr );
+
+/* Incremental decompression of a zstd file, for input that should not be
+ * held in memory as a whole
+ *
+ * read() decompresses the next bytes of the file into a caller-provided
+ * buffer. Frames of seekable files that fit into the buffer are decompressed
+ * in parallel if a thread pool is given; a frame that does not fit is kept
+ * until it has been read. Other files are streamed.
+ */
+class ZStdReader
+{
+	public:
+		explicit ZStdReader( char const* aPath, ThreadPool* = nullptr );
+		~ZStdReader();
+
+		ZStdReader( ZStdReader const& ) = delete;
+		ZStdReader& operator= (ZStdReader const&) = delete;
+
+	public:
+		// Returns the number of bytes written to aOut. This is less than
+		// aSize only at the end of the file.
+		std::size_t read( char* aOut, std::size_t aSize );
+
+	private:
+		struct State_;
+		std::unique_ptr<State_> mState;
+};
+
+/* Write aData as a seekable zstd file, in frames of aFrameSize bytes (the
+ * last one may be smaller). Only zstd's decoder is bundled, so the frames
+ * hold raw (stored) blocks and the file is not smaller than aData. This
+ * exists to produce seekable files for the parallel decompression path,
+ * see the bake's '--write-seekable' option; use zstd's contrib tools for
+ * compressed ones.
+ */
+void write_seekable_zstd( char const* aPath, char const* aData, std::size_t aSize, std::size_t aFrameSize, ThreadPool* = nullptr );
+
 #endif // ZSTDISTREAM_HPP_AEBA1092_C378_4759_AFF4_B32E31EF431B
@@ -45,6 +45,26 @@ namespace
 
 		return res;
 	}
+
+	// Number of 8-bit channels for the uncompressed formats supported by
+	// load_image_texture2d()
+	std::uint32_t format_channels_( VkFormat aFormat )
+	{
+		switch( aFormat )
+		{
+			case VK_FORMAT_R8_UNORM:
+			case VK_FORMAT_R8_SRGB:
+				return 1;
+			case VK_FORMAT_R8G8_UNORM:
+			case VK_FORMAT_R8G8_SRGB:
+				return 2;
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R8G8B8A8_SRGB:
+				return 4;
+			default:
+				throw labutils::Error( "load_image_texture2d(): unsupported format (VkFormat %d)", int(aFormat) );
+		}
+	}
 }
 
 namespace labutils
@@ -100,8 +120,21 @@ namespace labutils
 		auto const baseWidth = std::uint32_t(baseWidthi);
 		auto const baseHeight = std::uint32_t(baseHeighti);
 
+		//Keep only the channels that the target format stores (R8, R8G8 or RGBA8)
+		//The image is always loaded as RGBA, so that e.g. red and green of an RGB image are kept as-is
+		auto const channels = format_channels_(aFormat);
+		if (channels < 4)
+		{
+			std::size_t const texels = std::size_t(baseWidth) * baseHeight;
+			for (std::size_t i = 0; i < texels; ++i)
+			{
+				for (std::uint32_t c = 0; c < channels; ++c)
+					data[i * channels + c] = data[i * 4 + c];
+			}
+		}
+
 		//Create staging buffer and immediately transfer image data to it
-		auto const sizeInBytes = baseWidth * baseHeight * 4;
+		auto const sizeInBytes = baseWidth * baseHeight * channels;
 
 		auto staging = create_buffer(aAllocator, sizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
 
@@ -279,6 +312,114 @@ namespace labutils
 
 	}
 
+	Image upload_image_texture2d( VulkanContext const& aContext, VkCommandPool aCmdPool, Allocator const& aAllocator, VkFormat aFormat, void const* aData, VkDeviceSize aSize, std::vector<ImageLevel> const& aLevels )
+	{
+		if (aLevels.empty())
+			throw Error("upload_image_texture2d(): no image levels");
+
+		auto const baseWidth = aLevels[0].width;
+		auto const baseHeight = aLevels[0].height;
+
+		//create_image_texture2d() always allocates the full mip chain
+		auto const mipLevels = compute_mip_level_count(baseWidth, baseHeight);
+		if (aLevels.size() != mipLevels)
+			throw Error("upload_image_texture2d(): expected %u mip levels, got %zu", mipLevels, aLevels.size());
+
+		//Copy all levels to a staging buffer at once
+		auto staging = create_buffer(aAllocator, aSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+
+		void* sptr = nullptr;
+		if (auto const res = vmaMapMemory(aAllocator.allocator, staging.allocation, &sptr); VK_SUCCESS != res)
+		{
+			throw Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", to_string(res).c_str());
+		}
+
+		std::memcpy(sptr, aData, aSize);
+		vmaUnmapMemory(aAllocator.allocator, staging.allocation);
+
+		Image ret = create_image_texture2d(aAllocator, baseWidth, baseHeight, aFormat);
+
+		//Record the upload
+		VkCommandBuffer cbuff = alloc_command_buffer(aContext, aCmdPool);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (auto const res = vkBeginCommandBuffer(cbuff, &beginInfo); VK_SUCCESS != res)
+		{
+			throw Error("Beginning command buffer recording\n" "vkBeginCommandBuffer() returned %s", to_string(res).c_str());
+		}
+
+		image_barrier(cbuff, ret.image,
+			0,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT,
+			0, mipLevels,
+			0, 1 });
+
+		//One copy region per mip level; no blits are needed
+		std::vector<VkBufferImageCopy> copies(aLevels.size());
+		for (std::uint32_t level = 0; level < aLevels.size(); ++level)
+		{
+			auto& copy = copies[level];
+			copy.bufferOffset = aLevels[level].offset;
+			copy.bufferRowLength = 0;
+			copy.bufferImageHeight = 0;
+			copy.imageSubresource = VkImageSubresourceLayers{
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				level,
+				0, 1
+			};
+			copy.imageOffset = VkOffset3D{ 0,0,0 };
+			copy.imageExtent = VkExtent3D{ aLevels[level].width, aLevels[level].height, 1 };
+		}
+
+		vkCmdCopyBufferToImage(cbuff, staging.buffer, ret.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, std::uint32_t(copies.size()), copies.data());
+
+		image_barrier(cbuff, ret.image,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT,
+			0, mipLevels,
+			0, 1 });
+
+		if (auto const res = vkEndCommandBuffer(cbuff); VK_SUCCESS != res)
+		{
+			throw Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", to_string(res).c_str());
+		}
+
+		//Submit and wait, so that the staging buffer can be destroyed
+		Fence uploadComplete = create_fence(aContext);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &cbuff;
+
+		if (auto const res = vkQueueSubmit(aContext.graphicsQueue, 1, &submitInfo, uploadComplete.handle); VK_SUCCESS != res)
+		{
+			throw Error("Submitting commands\n" "vkQueueSubmit() returned %s", to_string(res).c_str());
+		}
+
+		if (auto const res = vkWaitForFences(aContext.device, 1, &uploadComplete.handle, VK_TRUE, std::numeric_limits<uint64_t>::max()); VK_SUCCESS != res)
+		{
+			throw Error("Waiting for upload to complete\n" "vkWaitForFences() returned %s", to_string(res).c_str());
+		}
+
+		vkFreeCommandBuffers(aContext.device, aCmdPool, 1, &cbuff);
+
+		return ret;
+	}
+
 	Image create_image_texture2d( Allocator const& aAllocator, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat aFormat, VkImageUsageFlags aUsage )
 	{
 		auto const mipLevels = compute_mip_level_count(aWidth, aHeight);
@@ -3,6 +3,7 @@
 #include <volk/volk.h>
 #include <vk_mem_alloc.h>
 
+#include <vector>
 #include <utility>
 
 #include <cassert>
@@ -34,8 +35,21 @@ namespace labutils
 	};
 
 
+	// Supports R8, R8G8 and R8G8B8A8 formats (UNORM or SRGB). Channels that the
+	// format does not store are dropped.
 	Image load_image_texture2d( char const* aPath, VulkanContext const&, VkCommandPool, Allocator const&, VkFormat );
 
+	// One mip level of pre-processed image data (e.g., block compressed)
+	struct ImageLevel
+	{
+		std::uint32_t width, height;
+		VkDeviceSize offset; // start of the level's data
+	};
+
+	// Upload an image with a complete mip chain. aData holds all levels (as
+	// described by aLevels) and is copied into a staging buffer as-is.
+	Image upload_image_texture2d( VulkanContext const&, VkCommandPool, Allocator const&, VkFormat, void const* aData, VkDeviceSize aSize, std::vector<ImageLevel> const& aLevels );
+
 	Image create_image_texture2d( Allocator const&, std::uint32_t aWidth, std::uint32_t aHeight, VkFormat, VkImageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
 
 	std::uint32_t compute_mip_level_count( std::uint32_t aWidth, std::uint32_t aHeight );
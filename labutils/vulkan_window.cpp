@@ -593,8 +593,13 @@ namespace
 			queueInfo.pQueuePriorities  = queuePriorities;
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures{};
+		vkGetPhysicalDeviceFeatures( aPhysicalDev, &supportedFeatures );
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
-		// No extra features for now.
+		// Block compressed textures, if available. Otherwise, textures are
+		// decompressed on the CPU when loaded.
+		deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
 		
 		VkDeviceCreateInfo deviceInfo{};
 		deviceInfo.sType  = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -118,6 +118,7 @@ project "bake"
 	links "labutils" -- for lut::Error
 	links "x-tgen" -- Task 1.4
 	links "x-zstd"
+	links "x-stb"
 
 	dependson "x-glm" 
 	dependson "x-rapidobj"
@@ -1,8 +1,24 @@
 #include "baked_model.hpp"
 
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <unordered_set>
+#include <unordered_map>
+
 #include <cstdio>
 #include <cstring>
 
+#include <stb_image.h>
+
+#include "geometry_codec.hpp"
+
 #include "../labutils/error.hpp"
 namespace lut = labutils;
 
@@ -10,52 +26,320 @@ namespace
 {
 	// See bake/main.cpp for more info
 	constexpr char kFileMagic[16] = "\0\0COMP5822Mmesh";
-	constexpr char kFileVariant[16] = "sc20mh-tan";
+	constexpr char kFileVariant[16] = "sc20mh-toc-v8";
+
+	constexpr std::uint32_t section_tag_( char const (&aTag)[5] ) noexcept
+	{
+		return std::uint32_t(std::uint8_t(aTag[0]))
+			| std::uint32_t(std::uint8_t(aTag[1])) << 8
+			| std::uint32_t(std::uint8_t(aTag[2])) << 16
+			| std::uint32_t(std::uint8_t(aTag[3])) << 24
+		;
+	}
+
+	constexpr std::uint32_t kSectionInfo = section_tag_( "INFO" );
+	constexpr std::uint32_t kSectionTextures = section_tag_( "TEXS" );
+	constexpr std::uint32_t kSectionMaterials = section_tag_( "MATS" );
+	constexpr std::uint32_t kSectionMesh = section_tag_( "MESH" );
+	constexpr std::uint32_t kSectionPositions = section_tag_( "POSN" );
+	constexpr std::uint32_t kSectionNormals = section_tag_( "NORM" );
+	constexpr std::uint32_t kSectionTexcoords = section_tag_( "TEXC" );
+	constexpr std::uint32_t kSectionTangents = section_tag_( "TANG" );
+	constexpr std::uint32_t kSectionAttributes = section_tag_( "ATTR" );
+	constexpr std::uint32_t kSectionIndices = section_tag_( "INDX" );
+	constexpr std::uint32_t kSectionRanges = section_tag_( "RNGS" );
+
+	// Supported version of each of the above
+	constexpr std::uint32_t kSectionVersion = 1;
+
+	constexpr std::uint32_t kGlobalSection = ~std::uint32_t(0);
+
+	constexpr std::uint32_t kLayoutSeparate = 0;
+	constexpr std::uint32_t kLayoutInterleaved = 1;
+
+	constexpr std::uint32_t kCodecStored = 0;
+	constexpr std::uint32_t kCodecDeflate = 1;
+	constexpr std::uint32_t kCodecGeometry = 2;
+
+	constexpr std::size_t kSectionAlignment = 16;
+	constexpr std::size_t kTocEntrySize = 4*sizeof(std::uint32_t) + 3*sizeof(std::uint64_t);
 
 	constexpr std::uint32_t kMaxString = 32*1024;
 
+	// The sub-ranges are referred to in place
+	static_assert( sizeof(BakedMeshRange) == 2*sizeof(std::uint32_t) + 2*sizeof(glm::vec3) );
+
+	// types
+	struct MemoryReader_
+	{
+		std::uint8_t const* data;
+		std::size_t size;
+		std::size_t offset;
+	};
+
+	struct Section_
+	{
+		std::uint32_t tag, version, mesh, codec;
+		std::uint64_t offset, size, rawSize;
+
+		// Decompressed contents, once loaded (refers to the mapping for stored
+		// sections)
+		std::uint8_t const* data = nullptr;
+	};
+
+	struct SectionTable_
+	{
+		std::vector<Section_> sections;
+
+		// (mesh, tag) => index into sections, for supported versions only
+		std::unordered_map<std::uint64_t,std::size_t> lookup;
+	};
+
 	// functions
-	BakedModel load_baked_model_( FILE*, char const* );
+	void checked_read_( MemoryReader_&, std::size_t, void* );
+	std::uint32_t read_uint32_( MemoryReader_& );
+	std::string read_string_( MemoryReader_& );
+
+	SectionTable_ read_section_table_( MemoryReader_&, char const* );
+
+	Section_* find_section_( SectionTable_&, std::uint32_t aTag, std::uint32_t aMesh );
+	Section_ const* find_section_( SectionTable_ const&, std::uint32_t aTag, std::uint32_t aMesh );
+	Section_ const& required_section_( SectionTable_ const&, std::uint32_t aTag, std::uint32_t aMesh, char const* );
+	MemoryReader_ section_reader_( Section_ const& );
+
+	template< typename tType >
+	BakedSpan<tType> section_span_( Section_ const&, std::size_t aCount, char const* );
+
+	BakedMeshView read_mesh_( SectionTable_ const&, BakedModelView const&, std::uint32_t aMeshIndex, bool aLoad, BakedModelParts const&, char const* );
+
+	std::vector<std::uint8_t> decode_sections_( std::uint8_t const* aFileData, std::vector<Section_*> const&, BakedModelView&, char const* );
+	void decode_section_( std::uint8_t const* aFileData, Section_ const&, std::uint8_t* aOut, char const* );
+
+	void run_parallel_( std::vector<std::size_t> const& aOrder, std::function<void(std::size_t)> const& );
+
+	template< typename tType >
+	std::vector<tType> to_vector_( BakedSpan<tType> const& );
 }
 
-BakedModel load_baked_model( char const* aModelPath )
+BakedModelView::BakedModelView( char const* aModelPath, BakedModelParts const& aParts )
+	: mFile( aModelPath )
 {
-	FILE* fin = std::fopen( aModelPath, "rb" );
-	if( !fin )
-		throw lut::Error( "load_baked_model(): unable to open '%s' for reading", aModelPath );
+	MemoryReader_ in{ mFile.data(), mFile.size(), 0 };
+
+	// Figure out base path
+	char const* pathBeg = aModelPath;
+	char const* pathEnd = std::strrchr( pathBeg, '/' );
+
+	std::string const prefix = pathEnd
+		? std::string( pathBeg, pathEnd+1 )
+		: ""
+	;
+
+	// Read header and verify file magic and variant
+	char magic[16];
+	checked_read_( in, 16, magic );
+
+	if( 0 != std::memcmp( magic, kFileMagic, 16 ) )
+		throw lut::Error( "BakedModelView(): %s: invalid file signature!", aModelPath );
+
+	char variant[16];
+	checked_read_( in, 16, variant );
+
+	if( 0 != std::memcmp( variant, kFileVariant, 16 ) )
+		throw lut::Error( "BakedModelView(): %s: file variant is '%.16s', expected '%s'", aModelPath, variant, kFileVariant );
+
+	auto table = read_section_table_( in, aModelPath );
 
-	try
+	// Select sections. The global sections and the mesh headers are always
+	// loaded; the remaining sections only for the selected meshes and parts.
+	std::unordered_set<std::uint32_t> const selected( aParts.meshes.begin(), aParts.meshes.end() );
+
+	bool const attributes = aParts.normals || aParts.texcoords || aParts.tangents;
+
+	std::vector<Section_*> load;
+	bool referencesFile = false;
+	for( auto& section : table.sections )
 	{
-		auto ret = load_baked_model_( fin, aModelPath );
-		std::fclose( fin );
-		return ret;
+		// Skip unknown versions (and duplicates)
+		if( &section != find_section_( table, section.tag, section.mesh ) )
+			continue;
+
+		bool const global = kSectionInfo == section.tag || kSectionTextures == section.tag || kSectionMaterials == section.tag || kSectionMesh == section.tag;
+
+		if( !global )
+		{
+			if( !selected.empty() && !selected.count( section.mesh ) )
+				continue;
+
+			bool const wanted = (kSectionPositions == section.tag && aParts.positions)
+				|| (kSectionNormals == section.tag && aParts.normals)
+				|| (kSectionTexcoords == section.tag && aParts.texcoords)
+				|| (kSectionTangents == section.tag && aParts.tangents)
+				|| (kSectionAttributes == section.tag && attributes)
+				|| ((kSectionIndices == section.tag || kSectionRanges == section.tag) && aParts.indices)
+			;
+
+			if( !wanted )
+				continue;
+
+			if( kCodecStored == section.codec && section.size > 0 )
+				referencesFile = true;
+		}
+
+		if( kCodecStored != section.codec && kCodecDeflate != section.codec && kCodecGeometry != section.codec )
+			throw lut::Error( "BakedModelView(): %s: section '%.4s' uses unknown codec %u", aModelPath, reinterpret_cast<char const*>(&section.tag), section.codec );
+
+		load.emplace_back( &section );
+	}
+
+	// Compressed sections are decoded into mDecoded; stored sections are
+	// referred to in place. (The mapping starts at a page boundary, so the
+	// file offsets determine the alignment.)
+	mDecoded = decode_sections_( mFile.data(), load, *this, aModelPath );
+
+	// Read model information
+	auto info = section_reader_( required_section_( table, kSectionInfo, kGlobalSection, aModelPath ) );
+
+	auto const layout = read_uint32_( info );
+	if( kLayoutSeparate != layout && kLayoutInterleaved != layout )
+		throw lut::Error( "BakedModelView(): %s: unknown vertex layout %u", aModelPath, layout );
+
+	interleaved = kLayoutInterleaved == layout;
+	quantized = 0 != read_uint32_( info );
+
+	auto const meshCount = read_uint32_( info );
+	if( meshCount > table.sections.size() )
+		throw lut::Error( "BakedModelView(): %s: invalid number of meshes (%u)", aModelPath, meshCount );
+
+	for( auto const mesh : aParts.meshes )
+	{
+		if( mesh >= meshCount )
+			throw lut::Error( "BakedModelView(): %s: requested mesh %u, but the model has %u meshes", aModelPath, mesh, meshCount );
+	}
+
+	// Read texture info
+	auto tex = section_reader_( required_section_( table, kSectionTextures, kGlobalSection, aModelPath ) );
+
+	auto const textureCount = read_uint32_( tex );
+	for( std::uint32_t i = 0; i < textureCount; ++i )
+	{
+		BakedTextureInfo info;
+		info.path = prefix + read_string_( tex );
+
+		std::uint8_t channels;
+		checked_read_( tex, sizeof(std::uint8_t), &channels );
+		info.channels = channels;
+
+		textures.emplace_back( std::move(info) );
+	}
+
+	// Read material info
+	auto mat = section_reader_( required_section_( table, kSectionMaterials, kGlobalSection, aModelPath ) );
+
+	auto const materialCount = read_uint32_( mat );
+	for( std::uint32_t i = 0; i < materialCount; ++i )
+	{
+		BakedMaterialInfo info;
+		info.baseColorTextureId = read_uint32_( mat );
+		info.roughnessMetalnessTextureId = read_uint32_( mat );
+		info.alphaMaskTextureId = read_uint32_( mat );
+		info.normalMapTextureId = read_uint32_( mat );
+
+		assert( info.baseColorTextureId < textures.size() );
+		assert( info.roughnessMetalnessTextureId < textures.size() );
+
+		materials.emplace_back( std::move(info) );
 	}
-	catch( ... )
+
+	// Read mesh data
+	meshes.resize( meshCount );
+	for( std::uint32_t i = 0; i < meshCount; ++i )
+		meshes[i] = read_mesh_( table, *this, i, selected.empty() || selected.count( i ), aParts, aModelPath );
+
+	// The mapping is only needed if the meshes refer to it
+	if( !referencesFile )
+		mFile = MappedFile();
+}
+
+void BakedModelView::release_geometry() noexcept
+{
+	meshes.clear();
+	meshes.shrink_to_fit();
+
+	mDecoded.clear();
+	mDecoded.shrink_to_fit();
+
+	mFile = MappedFile();
+}
+
+BakedModel load_baked_model( char const* aModelPath, BakedModelParts const& aParts )
+{
+	BakedModelView const view( aModelPath, aParts );
+
+	BakedModel ret;
+	ret.quantized = view.quantized;
+	ret.interleaved = view.interleaved;
+	ret.textures = view.textures;
+	ret.materials = view.materials;
+
+	ret.chunkBytes = view.chunkBytes;
+	ret.chunkRawBytes = view.chunkRawBytes;
+	ret.chunkDecodeSeconds = view.chunkDecodeSeconds;
+
+	for( auto const& mesh : view.meshes )
 	{
-		std::fclose( fin );
-		throw;
+		BakedMeshData data;
+		data.materialId = mesh.materialId;
+
+		data.positions = to_vector_( mesh.positions );
+		data.texcoords = to_vector_( mesh.texcoords );
+		data.normals = to_vector_( mesh.normals );
+		data.tangents = to_vector_( mesh.tangents );
+
+		data.posMin = mesh.posMin;
+		data.posMax = mesh.posMax;
+		data.texMin = mesh.texMin;
+		data.texMax = mesh.texMax;
+
+		data.qpositions = to_vector_( mesh.qpositions );
+		data.qtexcoords = to_vector_( mesh.qtexcoords );
+		data.qnormals = to_vector_( mesh.qnormals );
+		data.qtangents = to_vector_( mesh.qtangents );
+
+		data.attributes = to_vector_( mesh.attributes );
+
+		data.indexSize = mesh.indexSize;
+		data.indices = to_vector_( mesh.indices );
+		data.indices16 = to_vector_( mesh.indices16 );
+
+		data.ranges = to_vector_( mesh.ranges );
+
+		ret.meshes.emplace_back( std::move(data) );
 	}
+
+	return ret;
 }
 
 namespace
 {
-	void checked_read_( FILE* aFin, std::size_t aBytes, void* aBuffer )
+	void checked_read_( MemoryReader_& aIn, std::size_t aBytes, void* aBuffer )
 	{
-		auto ret = std::fread( aBuffer, 1, aBytes, aFin );
+		if( aBytes > aIn.size - aIn.offset )
+			throw lut::Error( "checked_read_(): expected %zu bytes, got %zu", aBytes, aIn.size - aIn.offset );
 
-		if( aBytes != ret )
-			throw lut::Error( "checked_read_(): expected %zu bytes, got %zu", aBytes, ret );
+		std::memcpy( aBuffer, aIn.data + aIn.offset, aBytes );
+		aIn.offset += aBytes;
 	}
 
-	std::uint32_t read_uint32_( FILE* aFin )
+	std::uint32_t read_uint32_( MemoryReader_& aIn )
 	{
 		std::uint32_t ret;
-		checked_read_( aFin, sizeof(std::uint32_t), &ret );
+		checked_read_( aIn, sizeof(std::uint32_t), &ret );
 		return ret;
 	}
-	std::string read_string_( FILE* aFin )
+	std::string read_string_( MemoryReader_& aIn )
 	{
-		auto const length = read_uint32_( aFin );
+		auto const length = read_uint32_( aIn );
 
 		if( length >= kMaxString )
 			throw lut::Error( "read_string_(): unexpectedly long string (%u bytes)", length );
@@ -63,104 +347,293 @@ namespace
 		std::string ret;
 		ret.resize( length );
 
-		checked_read_( aFin, length, ret.data() );
+		checked_read_( aIn, length, ret.data() );
 		return ret;
 	}
 
-	BakedModel load_baked_model_( FILE* aFin, char const* aInputName )
+	SectionTable_ read_section_table_( MemoryReader_& aIn, char const* aInputName )
 	{
-		BakedModel ret;
+		auto const count = read_uint32_( aIn );
+		read_uint32_( aIn ); // reserved
 
-		// Figure out base path
-		char const* pathBeg = aInputName;
-		char const* pathEnd = std::strrchr( pathBeg, '/' );
-	
-		std::string const prefix = pathEnd
-			? std::string( pathBeg, pathEnd+1 )
-			: ""
-		;
+		if( count > (aIn.size - aIn.offset) / kTocEntrySize )
+			throw lut::Error( "BakedModelView(): %s: invalid number of sections (%u)", aInputName, count );
 
-		// Read header and verify file magic and variant
-		char magic[16];
-		checked_read_( aFin, 16, magic );
+		SectionTable_ ret;
+		ret.sections.resize( count );
 
-		if( 0 != std::memcmp( magic, kFileMagic, 16 ) )
-			throw lut::Error( "load_baked_model_(): %s: invalid file signature!", aInputName );
+		for( std::uint32_t i = 0; i < count; ++i )
+		{
+			auto& section = ret.sections[i];
+			section.tag = read_uint32_( aIn );
+			section.version = read_uint32_( aIn );
+			section.mesh = read_uint32_( aIn );
+			section.codec = read_uint32_( aIn );
+			checked_read_( aIn, sizeof(std::uint64_t), &section.offset );
+			checked_read_( aIn, sizeof(std::uint64_t), &section.size );
+			checked_read_( aIn, sizeof(std::uint64_t), &section.rawSize );
+
+			if( section.offset > aIn.size || section.size > aIn.size - section.offset || 0 != section.offset % kSectionAlignment )
+				throw lut::Error( "BakedModelView(): %s: section '%.4s' out of bounds (%llu bytes at %llu)", aInputName, reinterpret_cast<char const*>(&section.tag), (unsigned long long)section.size, (unsigned long long)section.offset );
+			if( kCodecStored == section.codec && section.size != section.rawSize )
+				throw lut::Error( "BakedModelView(): %s: stored section '%.4s' with mismatched sizes", aInputName, reinterpret_cast<char const*>(&section.tag) );
+
+			if( kSectionVersion == section.version )
+				ret.lookup.emplace( std::uint64_t(section.mesh) << 32 | section.tag, i );
+		}
 
-		char variant[16];
-		checked_read_( aFin, 16, variant );
+		return ret;
+	}
 
-		if( 0 != std::memcmp( variant, kFileVariant, 16 ) )
-			throw lut::Error( "load_baked_model_(): %s: file variant is '%s', expected '%s'", aInputName, variant, kFileVariant );
+	Section_* find_section_( SectionTable_& aTable, std::uint32_t aTag, std::uint32_t aMesh )
+	{
+		auto const it = aTable.lookup.find( std::uint64_t(aMesh) << 32 | aTag );
+		return aTable.lookup.end() != it ? &aTable.sections[it->second] : nullptr;
+	}
+	Section_ const* find_section_( SectionTable_ const& aTable, std::uint32_t aTag, std::uint32_t aMesh )
+	{
+		return find_section_( const_cast<SectionTable_&>(aTable), aTag, aMesh );
+	}
 
-		// Read texture info
-		auto const textureCount = read_uint32_( aFin );
-		for( std::uint32_t i = 0; i < textureCount; ++i )
+	Section_ const& required_section_( SectionTable_ const& aTable, std::uint32_t aTag, std::uint32_t aMesh, char const* aInputName )
+	{
+		auto const* ret = find_section_( aTable, aTag, aMesh );
+		if( !ret )
 		{
-			BakedTextureInfo info;
-			info.path = prefix + read_string_( aFin );
-
-			std::uint8_t channels;
-			checked_read_( aFin, sizeof(std::uint8_t), &channels );
-			info.channels = channels;
+			if( kGlobalSection == aMesh )
+				throw lut::Error( "BakedModelView(): %s: missing section '%.4s' (version %u)", aInputName, reinterpret_cast<char const*>(&aTag), kSectionVersion );
 
-			ret.textures.emplace_back( std::move(info) );
+			throw lut::Error( "BakedModelView(): %s: mesh %u: missing section '%.4s' (version %u)", aInputName, aMesh, reinterpret_cast<char const*>(&aTag), kSectionVersion );
 		}
 
-		// Read material info
-		auto const materialCount = read_uint32_( aFin );
-		for( std::uint32_t i = 0; i < materialCount; ++i )
+		assert( ret->data || 0 == ret->rawSize );
+		return *ret;
+	}
+
+	MemoryReader_ section_reader_( Section_ const& aSection )
+	{
+		return MemoryReader_{ aSection.data, std::size_t(aSection.rawSize), 0 };
+	}
+
+	template< typename tType >
+	BakedSpan<tType> section_span_( Section_ const& aSection, std::size_t aCount, char const* aInputName )
+	{
+		if( aSection.rawSize != aCount*sizeof(tType) )
+			throw lut::Error( "BakedModelView(): %s: mesh %u: section '%.4s' has %llu bytes, expected %zu", aInputName, aSection.mesh, reinterpret_cast<char const*>(&aSection.tag), (unsigned long long)aSection.rawSize, aCount*sizeof(tType) );
+
+		if( 0 != reinterpret_cast<std::uintptr_t>(aSection.data) % alignof(tType) )
+			throw lut::Error( "BakedModelView(): %s: mesh %u: misaligned section '%.4s'", aInputName, aSection.mesh, reinterpret_cast<char const*>(&aSection.tag) );
+
+		return BakedSpan<tType>{ reinterpret_cast<tType const*>(aSection.data), aCount };
+	}
+
+	BakedMeshView read_mesh_( SectionTable_ const& aTable, BakedModelView const& aModel, std::uint32_t aMeshIndex, bool aLoad, BakedModelParts const& aParts, char const* aInputName )
+	{
+		auto header = section_reader_( required_section_( aTable, kSectionMesh, aMeshIndex, aInputName ) );
+
+		BakedMeshView data;
+		data.materialId = read_uint32_( header );
+		if( data.materialId >= aModel.materials.size() )
+			throw lut::Error( "BakedModelView(): %s: mesh %u: invalid material %u", aInputName, aMeshIndex, data.materialId );
+
+		auto const V = read_uint32_( header );
+		auto const I = read_uint32_( header );
+
+		data.indexSize = read_uint32_( header );
+		if( sizeof(std::uint16_t) != data.indexSize && sizeof(std::uint32_t) != data.indexSize )
+			throw lut::Error( "BakedModelView(): %s: invalid index size %u", aInputName, data.indexSize );
+
+		checked_read_( header, sizeof(glm::vec3), &data.posMin );
+		checked_read_( header, sizeof(glm::vec3), &data.posMax );
+		checked_read_( header, sizeof(glm::vec2), &data.texMin );
+		checked_read_( header, sizeof(glm::vec2), &data.texMax );
+
+		if( !aLoad )
+			return data;
+
+		auto const section_ = [&] (std::uint32_t aTag) -> Section_ const& {
+			return required_section_( aTable, aTag, aMeshIndex, aInputName );
+		};
+
+		if( aParts.positions )
 		{
-			BakedMaterialInfo info;
-			info.baseColorTextureId = read_uint32_( aFin );
-			info.roughnessTextureId = read_uint32_( aFin );
-			info.metalnessTextureId = read_uint32_( aFin );
-			info.alphaMaskTextureId = read_uint32_( aFin );
-			info.normalMapTextureId = read_uint32_( aFin );
-
-			assert( info.baseColorTextureId < ret.textures.size() );
-			assert( info.roughnessTextureId < ret.textures.size() );
-			assert( info.metalnessTextureId < ret.textures.size() );
-
-			ret.materials.emplace_back( std::move(info) );
+			if( aModel.quantized )
+				data.qpositions = section_span_<glm::u16vec4>( section_( kSectionPositions ), V, aInputName );
+			else
+				data.positions = section_span_<glm::vec3>( section_( kSectionPositions ), V, aInputName );
 		}
 
-		// Read mesh data
-		auto const meshCount = read_uint32_( aFin );
-		for( std::uint32_t i = 0; i < meshCount; ++i )
+		if( aModel.interleaved )
+		{
+			if( aParts.normals || aParts.texcoords || aParts.tangents )
+			{
+				// Per-vertex size of the interleaved normal/texcoord/tangent data
+				std::size_t const attributeSize = aModel.quantized
+					? sizeof(glm::i16vec2) + sizeof(glm::u16vec2) + sizeof(glm::i16vec2)
+					: sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec4)
+				;
+
+				data.attributes = section_span_<std::uint8_t>( section_( kSectionAttributes ), V*attributeSize, aInputName );
+			}
+		}
+		else if( aModel.quantized )
 		{
-			BakedMeshData data;
-			data.materialId = read_uint32_( aFin );
-			assert( data.materialId < ret.materials.size() );
+			if( aParts.normals )
+				data.qnormals = section_span_<glm::i16vec2>( section_( kSectionNormals ), V, aInputName );
+			if( aParts.texcoords )
+				data.qtexcoords = section_span_<glm::u16vec2>( section_( kSectionTexcoords ), V, aInputName );
+			if( aParts.tangents )
+				data.qtangents = section_span_<glm::i16vec2>( section_( kSectionTangents ), V, aInputName );
+		}
+		else
+		{
+			if( aParts.normals )
+				data.normals = section_span_<glm::vec3>( section_( kSectionNormals ), V, aInputName );
+			if( aParts.texcoords )
+				data.texcoords = section_span_<glm::vec2>( section_( kSectionTexcoords ), V, aInputName );
+			if( aParts.tangents )
+				data.tangents = section_span_<glm::vec4>( section_( kSectionTangents ), V, aInputName );
+		}
 
-			auto const V = read_uint32_( aFin );
-			auto const I = read_uint32_( aFin );
+		if( aParts.indices )
+		{
+			if( sizeof(std::uint16_t) == data.indexSize )
+				data.indices16 = section_span_<std::uint16_t>( section_( kSectionIndices ), I, aInputName );
+			else
+				data.indices = section_span_<std::uint32_t>( section_( kSectionIndices ), I, aInputName );
+
+			// The sub-ranges are optional
+			if( auto const* ranges = find_section_( aTable, kSectionRanges, aMeshIndex ) )
+			{
+				data.ranges = section_span_<BakedMeshRange>( *ranges, std::size_t(ranges->rawSize / sizeof(BakedMeshRange)), aInputName );
+				for( std::size_t j = 0; j < data.ranges.size(); ++j )
+				{
+					auto const& range = data.ranges[j];
+					if( range.firstIndex > I || range.indexCount > I - range.firstIndex )
+						throw lut::Error( "BakedModelView(): %s: mesh %u: sub-range %zu out of bounds", aInputName, aMeshIndex, j );
+				}
+			}
+		}
 
-			data.positions.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.positions.data() );
+		return data;
+	}
 
-			data.normals.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec3), data.normals.data() );
+	std::vector<std::uint8_t> decode_sections_( std::uint8_t const* aFileData, std::vector<Section_*> const& aSections, BakedModelView& aModel, char const* aInputName )
+	{
+		// Stored sections are used in place. The others are decoded into the
+		// returned buffer, each starting at a multiple of kSectionAlignment.
+		std::vector<Section_*> compressed;
+		std::vector<std::size_t> offsets;
 
-			data.texcoords.resize( V );
-			checked_read_( aFin, V*sizeof(glm::vec2), data.texcoords.data() );
+		std::size_t total = 0, rawTotal = 0;
+		for( auto* section : aSections )
+		{
+			if( kCodecStored == section->codec )
+			{
+				section->data = aFileData + section->offset;
+				continue;
+			}
 
-			data.tangents.resize(V);
-			checked_read_(aFin, V * sizeof(glm::vec4), data.tangents.data());
+			if( section->rawSize > std::uint64_t(std::numeric_limits<int>::max()) )
+				throw lut::Error( "BakedModelView(): %s: section '%.4s' too large (%llu bytes)", aInputName, reinterpret_cast<char const*>(&section->tag), (unsigned long long)section->rawSize );
 
-			data.indices.resize( I );
-			checked_read_( aFin, I*sizeof(std::uint32_t), data.indices.data() );
+			compressed.emplace_back( section );
+			offsets.emplace_back( rawTotal );
 
-			ret.meshes.emplace_back( std::move(data) );
+			total += std::size_t(section->size);
+			rawTotal += (std::size_t(section->rawSize) + kSectionAlignment-1) / kSectionAlignment * kSectionAlignment;
 		}
 
-		// Check
-		char byte;
-		auto const check = std::fread( &byte, 1, 1, aFin );
-		
-		if( 0 != check )
-			std::fprintf( stderr, "Note: '%s' contains trailing bytes\n", aInputName );
+		std::vector<std::uint8_t> ret( rawTotal );
+		for( std::size_t i = 0; i < compressed.size(); ++i )
+			compressed[i]->data = ret.data() + offsets[i];
+
+		aModel.chunkBytes = total;
+		aModel.chunkRawBytes = 0;
+		for( auto const* section : compressed )
+			aModel.chunkRawBytes += std::size_t(section->rawSize);
+
+		// Decode in parallel, largest first
+		std::vector<std::size_t> order( compressed.size() );
+		std::iota( order.begin(), order.end(), std::size_t(0) );
+		std::stable_sort( order.begin(), order.end(), [&] (std::size_t aX, std::size_t aY) {
+			return compressed[aX]->rawSize > compressed[aY]->rawSize;
+		} );
+
+		std::vector<double> decodeSeconds( compressed.size(), 0.0 );
+
+		run_parallel_( order, [&] (std::size_t aIndex) {
+			auto const start = std::chrono::steady_clock::now();
+			decode_section_( aFileData, *compressed[aIndex], ret.data() + offsets[aIndex], aInputName );
+			auto const end = std::chrono::steady_clock::now();
+
+			decodeSeconds[aIndex] = std::chrono::duration<double>( end - start ).count();
+		} );
+
+		aModel.chunkDecodeSeconds = std::accumulate( decodeSeconds.begin(), decodeSeconds.end(), 0.0 );
 
 		return ret;
 	}
+
+	void decode_section_( std::uint8_t const* aFileData, Section_ const& aSection, std::uint8_t* aOut, char const* aInputName )
+	{
+		auto const* src = aFileData + aSection.offset;
+
+		if( kCodecGeometry == aSection.codec )
+		{
+			decode_geometry_chunk( src, std::size_t(aSection.size), aOut, std::size_t(aSection.rawSize) );
+			return;
+		}
+
+		assert( kCodecDeflate == aSection.codec );
+		auto const ret = stbi_zlib_decode_buffer( reinterpret_cast<char*>(aOut), int(aSection.rawSize), reinterpret_cast<char const*>(src), int(aSection.size) );
+		if( ret < 0 || std::uint64_t(ret) != aSection.rawSize )
+			throw lut::Error( "BakedModelView(): %s: corrupt section '%.4s' at offset %llu", aInputName, reinterpret_cast<char const*>(&aSection.tag), (unsigned long long)aSection.offset );
+	}
+
+	void run_parallel_( std::vector<std::size_t> const& aOrder, std::function<void(std::size_t)> const& aBody )
+	{
+		// Threads pick the next item from aOrder until none are left. The
+		// first exception is rethrown once all threads have finished.
+		std::atomic<std::size_t> next{ 0 };
+
+		std::mutex errorMutex;
+		std::exception_ptr error;
+
+		auto const worker = [&] {
+			for( std::size_t i; (i = next.fetch_add( 1 )) < aOrder.size(); )
+			{
+				try
+				{
+					aBody( aOrder[i] );
+				}
+				catch( ... )
+				{
+					std::lock_guard<std::mutex> lock( errorMutex );
+					if( !error )
+						error = std::current_exception();
+				}
+			}
+		};
+
+		auto const threadCount = std::min<std::size_t>( std::max( 1u, std::thread::hardware_concurrency() ), aOrder.size() );
+
+		std::vector<std::thread> threads;
+		for( std::size_t i = 1; i < threadCount; ++i )
+			threads.emplace_back( worker );
+
+		worker();
+
+		for( auto& thread : threads )
+			thread.join();
+
+		if( error )
+			std::rethrow_exception( error );
+	}
+
+	template< typename tType >
+	std::vector<tType> to_vector_( BakedSpan<tType> const& aSpan )
+	{
+		return std::vector<tType>( aSpan.begin(), aSpan.end() );
+	}
 }
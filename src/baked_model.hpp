@@ -9,46 +9,111 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "mapped_file.hpp"
 
 
 /* Baked file format:
  *
  *  1. Header:
  *    - 16*char: file magic = "\0\0COMP5822Mmesh"
- *    - 16*char: variant = "default" (changes later)
+ *    - 16*char: variant = "sc20mh-toc-v8"
+ *    - 1*uint32_t: N = number of sections
+ *    - 1*uint32_t: zero
+ *
+ *  2. Table of contents; repeat N times:
+ *    - 4*char: section type (tag, e.g., "POSN")
+ *    - uint32_t: version of the section type
+ *    - uint32_t: mesh index; 0xffffffff for sections that don't belong to a
+ *      mesh
+ *    - uint32_t: codec; 0 = stored, 1 = deflate (zlib stream), 2 = geometry
+ *      codec (see geometry_codec.hpp)
+ *    - uint64_t: offset of the section from the start of the file (a
+ *      multiple of 16)
+ *    - uint64_t: size of the section in the file
+ *    - uint64_t: size of the decompressed section
  *
- *  2. Textures
+ *  3. Section data
+ *
+ * Global sections (all version 1):
+ *  - "INFO":
+ *    - 1*uint32_t: vertex layout; 0 = separate streams, 1 = interleaved
+ *    - 1*uint32_t: 1 if the vertex attributes are quantized, 0 otherwise
+ *    - 1*uint32_t: M = number of meshes
+ *  - "TEXS":
  *    - 1*uint32_t: U = number of (unique) textures
  *    - repeat U times:
- *      - string: path to texture
+ *      - string: path to texture; a block compressed ".comp5822tex" file
+ *        (see baked_texture.hpp), or the original image if the bake was run
+ *        with --copy-textures
  *      - 1*uint8_t: number of channels in texture
- *
- *  3. Material information
+ *  - "MATS":
  *    - 1*uint32_t: M = number of materials
  *    - repeat M times:
  *      - uint32_t: base color texture index
- *      - uint32_t: roughness texture index
- *      - uint32_t: metalness texture index
+ *      - uint32_t: roughness (red) and metalness (green) texture index
  *      - uint32_t: alpha mask texture index; set to 0xffffffff if not available
  *      - uint32_t: normal map texture index; set to 0xffffffff if not available
  *
- *  4. Mesh data
- *    - 1*uint32_t: M = number of meshes
- *    - repeat M times:
- *      - uint32_t : material index
- *      - uint32_t : V = number of vertices
- *      - uint32_t : I = number of indices
- *      - repeat V times: vec3 position
- *      - repeat V times: vec3 normal
- *      - repeat V times: vec2 texture coordinate
- *      - repeat I times: uint32_t index
+ * Mesh sections (all version 1):
+ *  - "MESH":
+ *    - uint32_t : material index
+ *    - uint32_t : V = number of vertices
+ *    - uint32_t : I = number of indices
+ *    - uint32_t : S = size of an index in bytes (2 or 4)
+ *    - 2*vec3: position bounds (min, max); zero and one unless quantized
+ *    - 2*vec2: texture coordinate bounds (min, max); as above
+ *  - "POSN": repeat V times: vec3 position
+ *  - "NORM": repeat V times: vec3 normal
+ *  - "TEXC": repeat V times: vec2 texture coordinate
+ *  - "TANG": repeat V times: vec4 tangent
+ *  - "INDX": repeat I times: uint16_t (S = 2) or uint32_t (S = 4) index
+ *  - "RNGS": optional; repeat R times:
+ *    - uint32_t : first index
+ *    - uint32_t : index count
+ *    - 2*vec3: AABB min and max
+ *
+ *  If quantized, the vertex streams instead hold
+ *  - "POSN": u16vec4 position (unorm16 relative to bounds; w is the bitangent
+ *    sign, 0 = -1 and 0xffff = +1)
+ *  - "NORM": i16vec2 normal (octahedral, snorm16)
+ *  - "TEXC": u16vec2 texture coordinate (unorm16 relative to bounds)
+ *  - "TANG": i16vec2 tangent (octahedral, snorm16)
+ *
+ *  With the interleaved layout, "NORM", "TEXC" and "TANG" are replaced by a
+ *  single "ATTR" section of V elements holding the normal, texture coordinate
+ *  and tangent of each vertex, in this order (36 bytes per vertex, or 12
+ *  bytes if quantized).
+ *
+ * Sections of the same type are stored next to each other, in the order
+ * INFO, TEXS, MATS, MESH, POSN, INDX, RNGS, NORM, TEXC, TANG and ATTR, so
+ * that, e.g., loading only positions and indices reads a contiguous part of
+ * the file.
+ *
+ * The loader only reads the sections that it needs (see BakedModelParts),
+ * and skips sections with unknown types or versions. New data can therefore
+ * be added as a new section type without changing the file variant; changes
+ * to an existing section bump its version.
+ *
+ * Stored sections are aligned in a memory mapping of the file, and
+ * BakedModelView refers to them in place. Compressed sections (bake with
+ * --compress-mesh or --mesh-codec) are independent, and the loader decodes
+ * them in parallel.
+ *
+ * Meshes with more than 65536 vertices are split into several meshes by the
+ * bake, so S is 2 for all but unusual cases. When baking with
+ * --merge-materials, meshes with the same material are merged (as far as
+ * 16-bit indices allow) and are stored next to each other. The original
+ * meshes are then recorded as sub-ranges, which may be culled or drawn
+ * individually.
  *
  * Strings are stored as
  *   - 1*uint32_t: N = length of string in chars, including terminating \0
  *   - repeat N times: char in string
  *
- * See bake/main.cpp (specifically write_model_data_()) for additional
- * information.
+ * See bake/main.cpp (specifically global_sections_() and serialize_meshes_())
+ * and SectionFileWriter in bake/section_file.hpp for additional information.
  *
  *
  * My suggestion for loading the data into Vulkan is as follows:
@@ -59,6 +124,7 @@
  *
  * - Create a Descriptor Set Layout for material information only. Initially,
  *   this would include three textures (base color, metalness, roughness).
+ *   (The bake now packs roughness and metalness into a single texture.)
  *
  * - Create a Descriptor Set for each material. You can easily get the
  *   VkImageViews from the list in the first step by the index in the
@@ -78,12 +144,18 @@ struct BakedTextureInfo
 struct BakedMaterialInfo
 {
 	std::uint32_t baseColorTextureId;
-	std::uint32_t roughnessTextureId;
-	std::uint32_t metalnessTextureId;
+	std::uint32_t roughnessMetalnessTextureId; // roughness in red, metalness in green
 	std::uint32_t alphaMaskTextureId; // May be set to 0xffffffff if no alpha mask
 	std::uint32_t normalMapTextureId; // May be set to 0xffffffff if no normal map
 };
 
+struct BakedMeshRange
+{
+	std::uint32_t firstIndex;
+	std::uint32_t indexCount;
+	glm::vec3 aabbMin, aabbMax;
+};
+
 struct BakedMeshData
 {
 	std::uint32_t materialId;
@@ -94,17 +166,153 @@ struct BakedMeshData
 
 	std::vector<glm::vec4> tangents;
 
+	// Quantized variant only. The attributes above are left empty and are
+	// instead decoded in the vertex shader: position = posMin + (posMax -
+	// posMin) * qpositions.xyz / 65535 (and similarly for the texcoords).
+	glm::vec3 posMin{ 0.f }, posMax{ 1.f };
+	glm::vec2 texMin{ 0.f }, texMax{ 1.f };
+
+	std::vector<glm::u16vec4> qpositions;
+	std::vector<glm::u16vec2> qtexcoords;
+	std::vector<glm::i16vec2> qnormals;
+	std::vector<glm::i16vec2> qtangents;
+
+	// Interleaved layout only: raw normal/texcoord/tangent data (fp32 or
+	// quantized). Only the positions are stored in their own stream.
+	std::vector<std::uint8_t> attributes;
+
+	// Either indices (indexSize = 4) or indices16 (indexSize = 2) is used.
+	std::uint32_t indexSize = 4;
 	std::vector<std::uint32_t> indices;
+	std::vector<std::uint16_t> indices16;
+
+	// Sub-ranges of merged meshes; empty otherwise.
+	std::vector<BakedMeshRange> ranges;
+
+	std::size_t vertex_count() const noexcept { return positions.size() + qpositions.size(); }
+	std::size_t index_count() const noexcept { return indices.size() + indices16.size(); }
 };
 
 struct BakedModel
 {
+	bool quantized = false;
+	bool interleaved = false;
+
 	std::vector<BakedTextureInfo> textures;
 	std::vector<BakedMaterialInfo> materials;
 	std::vector<BakedMeshData> meshes;
+
+	// Compressed sections only: size of the loaded sections in the file and
+	// decoded, and the time spent decoding them (summed over all threads)
+	std::size_t chunkBytes = 0, chunkRawBytes = 0;
+	double chunkDecodeSeconds = 0.0;
+};
+
+// Minimal read-only span (std::span requires C++20)
+template< typename tType >
+struct BakedSpan
+{
+	tType const* ptr = nullptr;
+	std::size_t count = 0;
+
+	tType const* data() const noexcept { return ptr; }
+	std::size_t size() const noexcept { return count; }
+	std::size_t size_bytes() const noexcept { return count * sizeof(tType); }
+	bool empty() const noexcept { return 0 == count; }
+
+	tType const* begin() const noexcept { return ptr; }
+	tType const* end() const noexcept { return ptr + count; }
+
+	tType const& operator[] (std::size_t aIndex) const noexcept { return ptr[aIndex]; }
+};
+
+struct BakedMeshView
+{
+	std::uint32_t materialId;
+
+	// See BakedMeshData; exactly the same arrays are non-empty.
+	BakedSpan<glm::vec3> positions;
+	BakedSpan<glm::vec2> texcoords;
+	BakedSpan<glm::vec3> normals;
+	BakedSpan<glm::vec4> tangents;
+
+	glm::vec3 posMin{ 0.f }, posMax{ 1.f };
+	glm::vec2 texMin{ 0.f }, texMax{ 1.f };
+
+	BakedSpan<glm::u16vec4> qpositions;
+	BakedSpan<glm::u16vec2> qtexcoords;
+	BakedSpan<glm::i16vec2> qnormals;
+	BakedSpan<glm::i16vec2> qtangents;
+
+	BakedSpan<std::uint8_t> attributes;
+
+	std::uint32_t indexSize = 4;
+	BakedSpan<std::uint32_t> indices;
+	BakedSpan<std::uint16_t> indices16;
+
+	BakedSpan<BakedMeshRange> ranges;
+
+	std::size_t vertex_count() const noexcept { return positions.size() + qpositions.size(); }
+	std::size_t index_count() const noexcept { return indices.size() + indices16.size(); }
+};
+
+/* Parts of a baked model to load. Sections that aren't needed are not read
+ * (or decoded), and the corresponding arrays are left empty. For example, a
+ * depth-only pass only needs positions and indices.
+ */
+struct BakedModelParts
+{
+	bool positions = true;
+	bool normals = true;
+	bool texcoords = true;
+	bool tangents = true; // skip if normal mapping is disabled
+	bool indices = true; // including sub-ranges
+
+	// Meshes to load; empty = all meshes. The other meshes only have their
+	// material and bounds.
+	std::vector<std::uint32_t> meshes;
+};
+
+/* Read-only view of a baked model. The file is memory mapped, and the mesh
+ * data refers directly to the mapping, i.e., no copies of the vertex and
+ * index data are made. The data can be copied straight into staging buffers
+ * for upload. Compressed sections are decoded into a single buffer owned by
+ * the view instead (if no stored section is used, the mapping is released
+ * immediately).
+ *
+ * With the interleaved layout, the attributes are loaded if any of the
+ * normals, texture coordinates or tangents are requested.
+ *
+ * Call release_geometry() once the meshes are uploaded. This unmaps the file
+ * (or frees the decoded sections) and clears the meshes, so that no CPU copy
+ * of the geometry remains. Textures and materials remain available.
+ */
+class BakedModelView
+{
+	public:
+		explicit BakedModelView( char const* aModelPath, BakedModelParts const& = {} );
+
+		void release_geometry() noexcept;
+
+	public:
+		bool quantized = false;
+		bool interleaved = false;
+
+		std::vector<BakedTextureInfo> textures;
+		std::vector<BakedMaterialInfo> materials;
+		std::vector<BakedMeshView> meshes;
+
+		// See BakedModel
+		std::size_t chunkBytes = 0, chunkRawBytes = 0;
+		double chunkDecodeSeconds = 0.0;
+
+	private:
+		MappedFile mFile;
+		std::vector<std::uint8_t> mDecoded;
 };
 
-BakedModel load_baked_model( char const* aModelPath );
+// Load a baked model into BakedModel, which owns copies of all data.
+BakedModel load_baked_model( char const* aModelPath, BakedModelParts const& = {} );
 
 #endif // BAKED_MODEL_HPP_7D7BFF3A_1743_43DF_8D4F_D67D80FD8282
 
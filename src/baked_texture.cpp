@@ -0,0 +1,271 @@
+#include "baked_texture.hpp"
+
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// See bake/compress_texture.cpp for more info
+	constexpr char kTextureMagic[16] = "\0\0COMP5822Mtex";
+	constexpr char kTextureVariant[16] = "sc20mh-bc-v1";
+	constexpr char kTextureExtension[] = ".comp5822tex";
+
+	constexpr std::uint32_t kMaxLevels = 32;
+	constexpr std::uint32_t kBlockDim = 4;
+
+	// functions
+	BakedTexture load_baked_texture_( FILE*, char const* );
+
+	std::size_t block_size_( BakedTextureFormat ) noexcept;
+
+	void decode_bc1_( std::uint8_t const*, bool aAlways4, std::uint8_t (&aTexels)[16][4] ) noexcept;
+	void decode_bc4_( std::uint8_t const*, std::size_t aChannel, std::uint8_t (&aTexels)[16][4] ) noexcept;
+}
+
+bool is_baked_texture( char const* aTexturePath )
+{
+	auto const length = std::strlen( aTexturePath );
+	auto const extLength = sizeof(kTextureExtension)-1;
+	return length >= extLength && 0 == std::strcmp( aTexturePath + length - extLength, kTextureExtension );
+}
+
+BakedTexture load_baked_texture( char const* aTexturePath )
+{
+	FILE* fin = std::fopen( aTexturePath, "rb" );
+	if( !fin )
+		throw lut::Error( "load_baked_texture(): unable to open '%s' for reading", aTexturePath );
+
+	try
+	{
+		auto ret = load_baked_texture_( fin, aTexturePath );
+		std::fclose( fin );
+		return ret;
+	}
+	catch( ... )
+	{
+		std::fclose( fin );
+		throw;
+	}
+}
+
+BakedTexture decompress_baked_texture( BakedTexture const& aTexture )
+{
+	auto const blockSize = block_size_( aTexture.format );
+	if( 0 == blockSize )
+		return aTexture; // already uncompressed
+
+	BakedTexture ret;
+
+	std::uint32_t channels = 4;
+	switch( aTexture.format )
+	{
+		case BakedTextureFormat::bc4_unorm:
+			ret.format = BakedTextureFormat::r8_unorm;
+			channels = 1;
+			break;
+		case BakedTextureFormat::bc5_unorm:
+			ret.format = BakedTextureFormat::r8g8_unorm;
+			channels = 2;
+			break;
+		default:
+			ret.format = BakedTextureFormat::rgba8_srgb;
+			break;
+	}
+
+	for( auto const& level : aTexture.levels )
+	{
+		BakedTextureLevel out{ level.width, level.height, ret.data.size(), std::uint64_t(level.width)*level.height*channels };
+		ret.levels.emplace_back( out );
+		ret.data.resize( out.offset + out.size );
+
+		auto const bw = (level.width + kBlockDim-1) / kBlockDim;
+		auto const bh = (level.height + kBlockDim-1) / kBlockDim;
+
+		auto const* src = aTexture.data.data() + level.offset;
+		auto* dst = ret.data.data() + out.offset;
+
+		for( std::uint32_t by = 0; by < bh; ++by )
+		{
+			for( std::uint32_t bx = 0; bx < bw; ++bx, src += blockSize )
+			{
+				std::uint8_t texels[16][4];
+				for( auto& texel : texels )
+					texel[0] = texel[1] = texel[2] = 0, texel[3] = 255;
+
+				switch( aTexture.format )
+				{
+					case BakedTextureFormat::bc1_srgb:
+						decode_bc1_( src, false, texels );
+						break;
+					case BakedTextureFormat::bc3_srgb:
+						decode_bc1_( src+8, true, texels );
+						decode_bc4_( src, 3, texels );
+						break;
+					case BakedTextureFormat::bc4_unorm:
+						decode_bc4_( src, 0, texels );
+						break;
+					case BakedTextureFormat::bc5_unorm:
+						decode_bc4_( src, 0, texels );
+						decode_bc4_( src+8, 1, texels );
+						break;
+					default:
+						break;
+				}
+
+				// Copy the part of the block that lies inside the image
+				auto const w = std::min( kBlockDim, level.width - bx*kBlockDim );
+				auto const h = std::min( kBlockDim, level.height - by*kBlockDim );
+				for( std::uint32_t y = 0; y < h; ++y )
+				{
+					auto* row = dst + (std::size_t(by*kBlockDim + y)*level.width + bx*kBlockDim)*channels;
+					for( std::uint32_t x = 0; x < w; ++x )
+						std::memcpy( row + x*channels, texels[y*kBlockDim + x], channels );
+				}
+			}
+		}
+	}
+
+	return ret;
+}
+
+namespace
+{
+	void checked_read_( FILE* aFin, std::size_t aBytes, void* aBuffer )
+	{
+		auto ret = std::fread( aBuffer, 1, aBytes, aFin );
+
+		if( aBytes != ret )
+			throw lut::Error( "checked_read_(): expected %zu bytes, got %zu", aBytes, ret );
+	}
+
+	BakedTexture load_baked_texture_( FILE* aFin, char const* aInputName )
+	{
+		char magic[sizeof(kTextureMagic)];
+		checked_read_( aFin, sizeof(magic), magic );
+		if( 0 != std::memcmp( magic, kTextureMagic, sizeof(kTextureMagic) ) )
+			throw lut::Error( "load_baked_texture(): %s: invalid file signature!", aInputName );
+
+		char variant[sizeof(kTextureVariant)];
+		checked_read_( aFin, sizeof(variant), variant );
+		if( 0 != std::memcmp( variant, kTextureVariant, sizeof(kTextureVariant) ) )
+			throw lut::Error( "load_baked_texture(): %s: file variant is '%.16s', expected '%s'", aInputName, variant, kTextureVariant );
+
+		BakedTexture ret;
+
+		std::uint32_t format, levelCount;
+		checked_read_( aFin, sizeof(format), &format );
+		checked_read_( aFin, sizeof(levelCount), &levelCount );
+
+		ret.format = BakedTextureFormat(format);
+		auto const blockSize = block_size_( ret.format );
+		if( 0 == blockSize )
+			throw lut::Error( "load_baked_texture(): %s: unknown format %u", aInputName, format );
+
+		if( 0 == levelCount || levelCount > kMaxLevels )
+			throw lut::Error( "load_baked_texture(): %s: invalid number of levels (%u)", aInputName, levelCount );
+
+		std::uint64_t payload = 0;
+		ret.levels.resize( levelCount );
+		for( auto& level : ret.levels )
+		{
+			checked_read_( aFin, sizeof(level.width), &level.width );
+			checked_read_( aFin, sizeof(level.height), &level.height );
+			checked_read_( aFin, sizeof(level.offset), &level.offset );
+			checked_read_( aFin, sizeof(level.size), &level.size );
+
+			auto const expected = std::uint64_t((level.width + kBlockDim-1) / kBlockDim) * ((level.height + kBlockDim-1) / kBlockDim) * blockSize;
+			if( level.size != expected || level.offset != payload )
+				throw lut::Error( "load_baked_texture(): %s: invalid level (%ux%u, %llu bytes at %llu)", aInputName, level.width, level.height, (unsigned long long)level.size, (unsigned long long)level.offset );
+
+			payload += level.size;
+		}
+
+		ret.data.resize( payload );
+		checked_read_( aFin, payload, ret.data.data() );
+
+		return ret;
+	}
+
+	std::size_t block_size_( BakedTextureFormat aFormat ) noexcept
+	{
+		switch( aFormat )
+		{
+			case BakedTextureFormat::bc1_srgb: return 8;
+			case BakedTextureFormat::bc3_srgb: return 16;
+			case BakedTextureFormat::bc4_unorm: return 8;
+			case BakedTextureFormat::bc5_unorm: return 16;
+			default: return 0;
+		}
+	}
+
+	void decode_bc1_( std::uint8_t const* aBlock, bool aAlways4, std::uint8_t (&aTexels)[16][4] ) noexcept
+	{
+		std::uint16_t c[2];
+		std::uint32_t indices;
+		std::memcpy( c, aBlock, sizeof(c) );
+		std::memcpy( &indices, aBlock+4, sizeof(indices) );
+
+		int palette[4][4];
+		for( int i = 0; i < 2; ++i )
+		{
+			int const r = (c[i] >> 11) & 31, g = (c[i] >> 5) & 63, b = c[i] & 31;
+			palette[i][0] = (r << 3) | (r >> 2);
+			palette[i][1] = (g << 2) | (g >> 4);
+			palette[i][2] = (b << 3) | (b >> 2);
+			palette[i][3] = 255;
+		}
+
+		bool const fourColors = aAlways4 || c[0] > c[1];
+		for( int k = 0; k < 4; ++k )
+		{
+			if( fourColors )
+			{
+				palette[2][k] = (2*palette[0][k] + palette[1][k]) / 3;
+				palette[3][k] = (palette[0][k] + 2*palette[1][k]) / 3;
+			}
+			else
+			{
+				palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+				palette[3][k] = 0; // transparent black
+			}
+		}
+
+		for( int i = 0; i < 16; ++i )
+		{
+			auto const& p = palette[(indices >> (2*i)) & 3];
+			for( int k = 0; k < 4; ++k )
+				aTexels[i][k] = std::uint8_t(p[k]);
+		}
+	}
+
+	void decode_bc4_( std::uint8_t const* aBlock, std::size_t aChannel, std::uint8_t (&aTexels)[16][4] ) noexcept
+	{
+		int const r0 = aBlock[0], r1 = aBlock[1];
+
+		int palette[8] = { r0, r1 };
+		if( r0 > r1 )
+		{
+			for( int i = 2; i < 8; ++i )
+				palette[i] = ((8-i)*r0 + (i-1)*r1) / 7;
+		}
+		else
+		{
+			for( int i = 2; i < 6; ++i )
+				palette[i] = ((6-i)*r0 + (i-1)*r1) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		std::uint64_t indices = 0;
+		for( int i = 0; i < 6; ++i )
+			indices |= std::uint64_t(aBlock[2+i]) << (8*i);
+
+		for( int i = 0; i < 16; ++i )
+			aTexels[i][aChannel] = std::uint8_t(palette[(indices >> (3*i)) & 7]);
+	}
+}
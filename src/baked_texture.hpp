@@ -0,0 +1,70 @@
+#ifndef BAKED_TEXTURE_HPP_52CB67CD_E2B5_42ED_A259_E45C2F14846F
+#define BAKED_TEXTURE_HPP_52CB67CD_E2B5_42ED_A259_E45C2F14846F
+
+#include <vector>
+
+#include <cstdint>
+
+
+/* Baked texture format (".comp5822tex"):
+ *
+ *  - 16*char: file magic = "\0\0COMP5822Mtex"
+ *  - 16*char: variant = "sc20mh-bc-v1"
+ *  - 1*uint32_t: format (BakedTextureFormat)
+ *  - 1*uint32_t: L = number of mip levels (complete chain down to 1x1)
+ *  - repeat L times:
+ *    - uint32_t: width
+ *    - uint32_t: height
+ *    - uint64_t: offset of the level's data, relative to the payload
+ *    - uint64_t: size of the level's data in bytes
+ *  - payload: block compressed data of all levels
+ *
+ * The formats correspond to VK_FORMAT_BC1_RGB_SRGB_BLOCK (opaque base
+ * color), VK_FORMAT_BC3_SRGB_BLOCK (base color with alpha),
+ * VK_FORMAT_BC4_UNORM_BLOCK (single channel) and VK_FORMAT_BC5_UNORM_BLOCK
+ * (roughness and metalness packed into red and green, and normal maps; for
+ * the latter, only x and y are stored and the shaders reconstruct z). As with
+ * load_image_texture2d(), the images are flipped vertically.
+ *
+ * The payload can be copied to a staging buffer as-is. Each level maps to one
+ * VkBufferImageCopy. See bake/compress_texture.cpp for details.
+ */
+
+enum class BakedTextureFormat : std::uint32_t
+{
+	bc1_srgb = 1,
+	bc3_srgb = 2,
+	bc4_unorm = 3,
+	bc5_unorm = 4,
+
+	// Only produced by decompress_baked_texture()
+	rgba8_srgb = 0x100,
+	r8_unorm = 0x101,
+	r8g8_unorm = 0x102
+};
+
+struct BakedTextureLevel
+{
+	std::uint32_t width, height;
+	std::uint64_t offset, size;
+};
+
+struct BakedTexture
+{
+	BakedTextureFormat format;
+	std::vector<BakedTextureLevel> levels;
+	std::vector<std::uint8_t> data;
+};
+
+// True if the path refers to a baked texture (by its extension)
+bool is_baked_texture( char const* aTexturePath );
+
+BakedTexture load_baked_texture( char const* aTexturePath );
+
+/* Decode all levels to uncompressed 8-bit formats with the same channels:
+ * rgba8_srgb for BC1/BC3, r8_unorm for BC4 and r8g8_unorm for BC5. This is a
+ * fallback for devices that don't support BC formats.
+ */
+BakedTexture decompress_baked_texture( BakedTexture const& );
+
+#endif // BAKED_TEXTURE_HPP_52CB67CD_E2B5_42ED_A259_E45C2F14846F
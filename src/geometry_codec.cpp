@@ -0,0 +1,272 @@
+#include "geometry_codec.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#	include <emmintrin.h>
+#	define GEOMETRY_CODEC_SSE2 1
+#endif
+
+// AVX2 handles two groups of four values per step. Enabled by the compiler
+// flags (-march=native with gcc and clang, /arch:AVX2 with MSVC).
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define GEOMETRY_CODEC_AVX2 1
+#endif
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+namespace
+{
+	// See bake/geometry_codec.hpp
+	constexpr std::size_t kBlockValues = 128;
+	constexpr std::uint32_t kMaxBits = 32;
+
+	constexpr std::uint8_t kPlaneValues = 0;
+	constexpr std::uint8_t kPlaneDeltas = 1;
+
+	struct Reader_
+	{
+		std::uint8_t const* data;
+		std::size_t size;
+		std::size_t offset;
+
+		std::uint8_t const* take( std::size_t aBytes )
+		{
+			if( aBytes > size - offset )
+				throw lut::Error( "decode_geometry_chunk(): truncated chunk (needed %zu bytes, %zu left)", aBytes, size - offset );
+
+			auto const* ret = data + offset;
+			offset += aBytes;
+			return ret;
+		}
+	};
+
+	void decode_plane_( Reader_&, std::uint32_t aWordSize, std::uint32_t aStride, std::size_t aRows, std::uint8_t* aOut );
+
+	void unpack_block_( std::uint8_t const*, std::uint32_t aBits, std::uint32_t (&aValues)[kBlockValues] ) noexcept;
+	std::uint32_t undelta_block_( std::uint32_t (&aValues)[kBlockValues], std::uint32_t aPrev ) noexcept;
+}
+
+void decode_geometry_chunk( std::uint8_t const* aData, std::size_t aSize, std::uint8_t* aOut, std::size_t aOutSize )
+{
+	Reader_ in{ aData, aSize, 0 };
+
+	std::uint32_t sectionCount;
+	std::memcpy( &sectionCount, in.take( sizeof(sectionCount) ), sizeof(sectionCount) );
+
+	std::size_t offset = 0;
+	for( std::uint32_t i = 0; i < sectionCount; ++i )
+	{
+		auto const* header = in.take( 4 );
+		std::uint32_t const wordSize = header[0];
+		std::uint32_t const wordsPerRow = header[1];
+
+		std::uint32_t size;
+		std::memcpy( &size, in.take( sizeof(size) ), sizeof(size) );
+
+		if( size > aOutSize - offset )
+			throw lut::Error( "decode_geometry_chunk(): section %u exceeds the chunk (%u bytes at %zu of %zu)", i, size, offset, aOutSize );
+
+		if( 0 == wordSize )
+		{
+			std::memcpy( aOut + offset, in.take( size ), size );
+		}
+		else
+		{
+			if( (2 != wordSize && 4 != wordSize) || 0 == wordsPerRow || 0 != size % (wordSize*wordsPerRow) )
+				throw lut::Error( "decode_geometry_chunk(): section %u: invalid layout (%u x %u bytes, %u bytes)", i, wordsPerRow, wordSize, size );
+
+			auto const stride = wordSize*wordsPerRow;
+			auto const rows = size / stride;
+			for( std::uint32_t column = 0; column < wordsPerRow; ++column )
+				decode_plane_( in, wordSize, stride, rows, aOut + offset + column*wordSize );
+		}
+
+		offset += size;
+	}
+
+	if( offset != aOutSize || in.offset != in.size )
+		throw lut::Error( "decode_geometry_chunk(): decoded %zu of %zu bytes, used %zu of %zu input bytes", offset, aOutSize, in.offset, in.size );
+}
+
+namespace
+{
+	void decode_plane_( Reader_& aIn, std::uint32_t aWordSize, std::uint32_t aStride, std::size_t aRows, std::uint8_t* aOut )
+	{
+		auto const mode = *aIn.take( 1 );
+		if( kPlaneValues != mode && kPlaneDeltas != mode )
+			throw lut::Error( "decode_geometry_chunk(): unknown plane mode %u", unsigned(mode) );
+
+		auto const blocks = (aRows + kBlockValues-1) / kBlockValues;
+		auto const* widths = aIn.take( blocks );
+
+		std::uint32_t prev = 0;
+		for( std::size_t b = 0; b < blocks; ++b )
+		{
+			std::uint32_t const bits = widths[b];
+			if( bits > kMaxBits )
+				throw lut::Error( "decode_geometry_chunk(): invalid bit width %u", bits );
+
+			alignas(32) std::uint32_t values[kBlockValues];
+			unpack_block_( aIn.take( 16*bits ), bits, values );
+
+			if( kPlaneDeltas == mode )
+				prev = undelta_block_( values, prev );
+
+			auto const count = std::min( kBlockValues, aRows - b*kBlockValues );
+			auto* dst = aOut + b*kBlockValues*aStride;
+
+			if( 2 == aWordSize )
+			{
+				for( std::size_t i = 0; i < count; ++i, dst += aStride )
+				{
+					auto const word = std::uint16_t(values[i]);
+					std::memcpy( dst, &word, sizeof(word) );
+				}
+			}
+			else
+			{
+				for( std::size_t i = 0; i < count; ++i, dst += aStride )
+					std::memcpy( dst, &values[i], sizeof(std::uint32_t) );
+			}
+		}
+	}
+
+	void unpack_block_( std::uint8_t const* aPacked, std::uint32_t aBits, std::uint32_t (&aValues)[kBlockValues] ) noexcept
+	{
+		// Value i is in lane i%4; each lane holds 32 values of aBits bits
+		// in aBits consecutive 32-bit words (interleaved with the other
+		// lanes). Each step below extracts the values 4j .. 4j+3.
+		if( 0 == aBits )
+		{
+			std::fill( std::begin(aValues), std::end(aValues), 0u );
+			return;
+		}
+
+#		if GEOMETRY_CODEC_AVX2
+		// Values 4j .. 4j+7: the lower half holds step j, the upper half
+		// step j+1, each shifted by its own amount. Shifts of 32 or more
+		// yield zero, so the second word is only added where a value
+		// straddles two words (elsewhere, the load is repeated and the
+		// shift discards it).
+		auto const* words = reinterpret_cast<__m128i const*>(aPacked);
+		auto const mask = _mm256_set1_epi32( int(aBits < 32 ? (1u << aBits) - 1 : ~0u) );
+
+		for( std::uint32_t j = 0; j < 32; j += 2 )
+		{
+			auto const bit0 = j*aBits, bit1 = bit0 + aBits;
+			auto const word0 = bit0 / 32, shift0 = bit0 % 32;
+			auto const word1 = bit1 / 32, shift1 = bit1 % 32;
+
+			bool const split0 = shift0 + aBits > 32, split1 = shift1 + aBits > 32;
+
+			auto const lo = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( words + word0 ) ), _mm_loadu_si128( words + word1 ), 1 );
+			auto const hi = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( words + word0 + (split0 ? 1 : 0) ) ), _mm_loadu_si128( words + word1 + (split1 ? 1 : 0) ), 1 );
+
+			auto const loShift = _mm256_setr_epi32( int(shift0), int(shift0), int(shift0), int(shift0), int(shift1), int(shift1), int(shift1), int(shift1) );
+			auto const hiShift0 = int(split0 ? 32 - shift0 : 32), hiShift1 = int(split1 ? 32 - shift1 : 32);
+			auto const hiShift = _mm256_setr_epi32( hiShift0, hiShift0, hiShift0, hiShift0, hiShift1, hiShift1, hiShift1, hiShift1 );
+
+			auto const value = _mm256_or_si256( _mm256_srlv_epi32( lo, loShift ), _mm256_sllv_epi32( hi, hiShift ) );
+			_mm256_store_si256( reinterpret_cast<__m256i*>(aValues) + j/2, _mm256_and_si256( value, mask ) );
+		}
+#		elif GEOMETRY_CODEC_SSE2
+		auto const* words = reinterpret_cast<__m128i const*>(aPacked);
+		auto const mask = _mm_set1_epi32( int(aBits < 32 ? (1u << aBits) - 1 : ~0u) );
+
+		for( std::uint32_t j = 0; j < 32; ++j )
+		{
+			auto const bit = j*aBits;
+			auto const word = bit / 32, shift = bit % 32;
+
+			auto value = _mm_srl_epi32( _mm_loadu_si128( words + word ), _mm_cvtsi32_si128( int(shift) ) );
+			if( shift + aBits > 32 )
+				value = _mm_or_si128( value, _mm_sll_epi32( _mm_loadu_si128( words + word + 1 ), _mm_cvtsi32_si128( int(32 - shift) ) ) );
+
+			_mm_store_si128( reinterpret_cast<__m128i*>(aValues) + j, _mm_and_si128( value, mask ) );
+		}
+#		else
+		auto const mask = aBits < 32 ? (1u << aBits) - 1 : ~0u;
+
+		for( std::uint32_t j = 0; j < 32; ++j )
+		{
+			auto const bit = j*aBits;
+			auto const word = bit / 32, shift = bit % 32;
+
+			for( std::uint32_t lane = 0; lane < 4; ++lane )
+			{
+				std::uint32_t lo, hi = 0;
+				std::memcpy( &lo, aPacked + (word*4 + lane)*4, sizeof(lo) );
+				if( shift + aBits > 32 )
+					std::memcpy( &hi, aPacked + ((word+1)*4 + lane)*4, sizeof(hi) );
+
+				auto const value = shift ? (lo >> shift) | (hi << (32 - shift)) : lo;
+				aValues[j*4 + lane] = value & mask;
+			}
+		}
+#		endif
+	}
+
+	std::uint32_t undelta_block_( std::uint32_t (&aValues)[kBlockValues], std::uint32_t aPrev ) noexcept
+	{
+		// Undo the zigzag encoding and compute the running sum, continuing
+		// from the previous block. Returns the last value.
+#		if GEOMETRY_CODEC_AVX2
+		auto carry = _mm256_set1_epi32( int(aPrev) );
+		auto const one = _mm256_set1_epi32( 1 );
+		auto const lastOfLower = _mm256_setr_epi32( 0, 0, 0, 0, 3, 3, 3, 3 );
+		auto const last = _mm256_set1_epi32( 7 );
+
+		auto* values = reinterpret_cast<__m256i*>(aValues);
+		for( std::size_t j = 0; j < kBlockValues/8; ++j )
+		{
+			auto const zz = _mm256_load_si256( values + j );
+			auto delta = _mm256_xor_si256( _mm256_srli_epi32( zz, 1 ), _mm256_sub_epi32( _mm256_setzero_si256(), _mm256_and_si256( zz, one ) ) );
+
+			// Inclusive prefix sum within each 128-bit half, then carry the
+			// lower half's total into the upper half
+			delta = _mm256_add_epi32( delta, _mm256_slli_si256( delta, 4 ) );
+			delta = _mm256_add_epi32( delta, _mm256_slli_si256( delta, 8 ) );
+			delta = _mm256_add_epi32( delta, _mm256_blend_epi32( _mm256_setzero_si256(), _mm256_permutevar8x32_epi32( delta, lastOfLower ), 0xf0 ) );
+			delta = _mm256_add_epi32( delta, carry );
+
+			_mm256_store_si256( values + j, delta );
+			carry = _mm256_permutevar8x32_epi32( delta, last );
+		}
+
+		return std::uint32_t(_mm256_cvtsi256_si32( carry ));
+#		elif GEOMETRY_CODEC_SSE2
+		auto carry = _mm_set1_epi32( int(aPrev) );
+		auto const one = _mm_set1_epi32( 1 );
+
+		auto* values = reinterpret_cast<__m128i*>(aValues);
+		for( std::size_t j = 0; j < kBlockValues/4; ++j )
+		{
+			auto const zz = _mm_load_si128( values + j );
+			auto delta = _mm_xor_si128( _mm_srli_epi32( zz, 1 ), _mm_sub_epi32( _mm_setzero_si128(), _mm_and_si128( zz, one ) ) );
+
+			// Inclusive prefix sum over the four lanes
+			delta = _mm_add_epi32( delta, _mm_slli_si128( delta, 4 ) );
+			delta = _mm_add_epi32( delta, _mm_slli_si128( delta, 8 ) );
+			delta = _mm_add_epi32( delta, carry );
+
+			_mm_store_si128( values + j, delta );
+			carry = _mm_shuffle_epi32( delta, _MM_SHUFFLE( 3, 3, 3, 3 ) );
+		}
+
+		return std::uint32_t(_mm_cvtsi128_si32( carry ));
+#		else
+		for( auto& value : aValues )
+		{
+			aPrev += (value >> 1) ^ (0u - (value & 1));
+			value = aPrev;
+		}
+
+		return aPrev;
+#		endif
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef GEOMETRY_CODEC_HPP_0B7D35C2_81F4_4E59_A6C3_5D2E94F1B708
+#define GEOMETRY_CODEC_HPP_0B7D35C2_81F4_4E59_A6C3_5D2E94F1B708
+
+#include <cstddef>
+#include <cstdint>
+
+
+/* Decoder for mesh chunks written with the bake's geometry codec (see
+ * bake/geometry_codec.hpp for the format). Planes of 16- and 32-bit words
+ * are bit-unpacked eight values at a time with AVX2 or four at a time with
+ * SSE2 (on other architectures, a scalar version is used), optionally delta
+ * decoded, and scattered back to their rows.
+ *
+ * aOut must hold exactly the decoded size of the chunk (aOutSize). Throws
+ * labutils::Error if the chunk is malformed.
+ */
+void decode_geometry_chunk(
+	std::uint8_t const* aData,
+	std::size_t aSize,
+	std::uint8_t* aOut,
+	std::size_t aOutSize
+);
+
+#endif // GEOMETRY_CODEC_HPP_0B7D35C2_81F4_4E59_A6C3_5D2E94F1B708
@@ -2,6 +2,7 @@
 #include <chrono>
 #include <limits>
 #include <vector>
+#include <utility>
 #include <stdexcept>
 
 #include <cstdio>
@@ -37,6 +38,7 @@ using namespace labutils::literals;
 namespace lut = labutils;
 
 #include "baked_model.hpp"
+#include "baked_texture.hpp"
 
 
 #include "imgui.h"
@@ -98,6 +100,18 @@ namespace
 
 		static_assert(sizeof(SceneUniform) <= 65536, "SceneUniform must be less than 65536 bytes for vkCmdUpdateBuffer");
 		static_assert(sizeof(SceneUniform) % 4 == 0, "SceneUniform size must be a multiple of 4 bytes");
+
+		//Per-mesh vertex attribute decoding, pushed to the vertex shader after the fragment PushConstants
+		//For quantized meshes, these map the unorm16 positions and texture coordinates back to their bounds
+		//For fp32 meshes, they are the identity (offset 0, scale 1)
+		struct MeshDecode
+		{
+			glm::vec4 posOffset;
+			glm::vec4 posScale;
+			glm::vec4 texOffsetScale; //xy = offset, zw = scale
+		};
+
+		constexpr std::uint32_t kMeshDecodeOffset = 32;
 	}
 
 	// Helpers:
@@ -131,11 +145,11 @@ namespace
 	//Holds all information needed for meshes
 	struct MeshDetails
 	{
-		//Details to pass to the shader
-		lut::Buffer positions;
-		lut::Buffer texCoords;
-		lut::Buffer normals;
-		lut::Buffer tangents;
+		//Details to pass to the shader, bound to bindings 0 ... vertexBufferCount-1
+		//Separate layout: positions, texture coordinates, normals, tangents
+		//Interleaved layout: positions, interleaved normals/texture coordinates/tangents
+		lut::Buffer vertexBuffers[4];
+		std::uint32_t vertexBufferCount = 0;
 
 		//Index buffer storing indices
 		lut::Buffer indices;
@@ -145,6 +159,28 @@ namespace
 
 		//Store number of indices in mesh (needed for drawing)
 		size_t indexCount = 0;
+
+		//16-bit for all meshes with at most 65536 vertices
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+		//Vertex attribute decoding parameters
+		glsl::MeshDecode decode{};
+
+		//Size of vertex and index buffers, in bytes
+		VkDeviceSize bufferBytes = 0;
+	};
+
+	//Holds a loaded texture
+	struct TextureDetails
+	{
+		lut::Image image;
+		VkFormat format = VK_FORMAT_UNDEFINED;
+
+		//Size of all mip levels, in bytes
+		VkDeviceSize bytes = 0;
+
+		//True if the device could not sample the block compressed format
+		bool decompressed = false;
 	};
 
 	struct PushConstants
@@ -154,6 +190,8 @@ namespace
 		float lightColX, lightColY, lightColZ;
 	};
 
+	static_assert(sizeof(PushConstants) <= glsl::kMeshDecodeOffset, "PushConstants overlap MeshDecode");
+
 	// Local functions:
 	void update_user_state(UserState&, float aElapsedTime);
 
@@ -161,8 +199,10 @@ namespace
 	lut::RenderPass create_render_pass(lut::VulkanWindow const&);
 	
 	//Create mesh
-	MeshDetails create_mesh(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, glm::vec3 aPositions[], glm::vec2 aTexCoords[],
-							glm::vec3 aNormals[], std::uint32_t aIndices[], size_t aVertexCount, size_t aIndexCount, int aMaterialIndex, glm::vec4 aTangents[]);
+	MeshDetails create_mesh(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, BakedMeshView const& aMesh, bool aQuantized, bool aInterleaved);
+
+	//Load a baked (block compressed) texture, decompressing it on the CPU if the device cannot sample its format
+	TextureDetails load_baked_texture2d(lut::VulkanContext const& aContext, VkCommandPool aCmdPool, lut::Allocator const& aAllocator, char const* aPath);
 
 	//Create descriptor sets
 	lut::DescriptorSetLayout create_scene_descriptor_layout(lut::VulkanWindow const& aWindow);
@@ -172,7 +212,7 @@ namespace
 	lut::PipelineLayout create_default_pipeline_layout(lut::VulkanContext const&, VkDescriptorSetLayout, VkDescriptorSetLayout);
 
 	//Create pipeline
-	lut::Pipeline create_default_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, const char*, const char*, bool);
+	lut::Pipeline create_default_pipeline(lut::VulkanWindow const&, VkRenderPass, VkPipelineLayout, const char*, const char*, bool, bool aQuantized, bool aInterleaved);
 
 
 	//Create depth buffer
@@ -248,9 +288,19 @@ int main() try
 	//Create pipeline layout
 	lut::PipelineLayout pipeLayout = create_default_pipeline_layout(window, sceneLayout.handle, materialLayout.handle);
 
+	//Load model (the vertex input formats of the pipelines depend on whether it is quantized)
+	//The mesh data is memory mapped and copied straight into the staging buffers
+	BakedModelView model("assets/src/suntemple.comp5822mesh");
+
+	if (model.chunkRawBytes)
+	{
+		//Decode throughput is per thread (sections are decoded in parallel)
+		std::printf("Mesh sections: %zu kB => %zu kB, decoded at %.2f GB/s per thread\n", model.chunkBytes / 1024, model.chunkRawBytes / 1024, model.chunkRawBytes / (model.chunkDecodeSeconds * 1e9));
+	}
+
 	//Create pipeline
-	lut::Pipeline pipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kTextureFragShaderPath, false);
-	lut::Pipeline alphaPipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kAlphaMaskFragShaderPath, true);
+	lut::Pipeline pipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kTextureFragShaderPath, false, model.quantized, model.interleaved);
+	lut::Pipeline alphaPipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kAlphaMaskFragShaderPath, true, model.quantized, model.interleaved);
 	//Create depth buffer
 	auto [depthBuffer, depthBufferView] = create_depth_buffer(window, allocator);
 	
@@ -278,9 +328,6 @@ int main() try
 	//Create scene buffer
 	lut::Buffer sceneUBO = lut::create_buffer(allocator, sizeof(glsl::SceneUniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 0, VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE);
 
-	//Load model
-	BakedModel model = load_baked_model("assets/src/suntemple.comp5822mesh");
-	
 	//Make a list of all materials with alpha masks (i.e. those with valid alphaMaskTextureIDs)
 	std::vector<uint32_t> alphaTextures;
 	
@@ -298,6 +345,10 @@ int main() try
 
 	for (size_t i = 0; i < model.meshes.size(); i++)
 	{
+		//Meshes without triangles have nothing to draw (and zero-sized buffers are invalid)
+		if (0 == model.meshes[i].index_count())
+			continue;
+
 		bool hasAlphaMask = false;
 
 		for (uint32_t& index : alphaTextures)
@@ -310,48 +361,101 @@ int main() try
 
 		if (hasAlphaMask)
 		{
-			alphaMaskedMeshes.emplace_back(create_mesh(window, allocator, model.meshes.at(i).positions.data(),
-				model.meshes.at(i).texcoords.data(), model.meshes.at(i).normals.data(),
-				model.meshes.at(i).indices.data(), model.meshes.at(i).positions.size(),
-				model.meshes.at(i).indices.size(), model.meshes.at(i).materialId, model.meshes.at(i).tangents.data()));
+			alphaMaskedMeshes.emplace_back(create_mesh(window, allocator, model.meshes.at(i), model.quantized, model.interleaved));
 		}
 
 		else
 		{
 			//Create mesh and store in vector
-			meshes.emplace_back(create_mesh(window, allocator, model.meshes.at(i).positions.data(),
-				model.meshes.at(i).texcoords.data(), model.meshes.at(i).normals.data(),
-				model.meshes.at(i).indices.data(), model.meshes.at(i).positions.size(),
-				model.meshes.at(i).indices.size(), model.meshes.at(i).materialId, model.meshes.at(i).tangents.data()));
+			meshes.emplace_back(create_mesh(window, allocator, model.meshes.at(i), model.quantized, model.interleaved));
 
 		}
 
-		notAlphaMaskedMeshes.emplace_back(create_mesh(window, allocator, model.meshes.at(i).positions.data(),
-			model.meshes.at(i).texcoords.data(), model.meshes.at(i).normals.data(),
-			model.meshes.at(i).indices.data(), model.meshes.at(i).positions.size(),
-			model.meshes.at(i).indices.size(), model.meshes.at(i).materialId, model.meshes.at(i).tangents.data()));
+		notAlphaMaskedMeshes.emplace_back(create_mesh(window, allocator, model.meshes.at(i), model.quantized, model.interleaved));
 			}
 
+	//Everything is on the GPU now, so drop the CPU side geometry (unmaps the file)
+	model.release_geometry();
+
+	//Report how much memory the mesh data takes up (per copy of the scene)
+	VkDeviceSize meshBytes = 0;
+	for (auto const& mesh : notAlphaMaskedMeshes)
+		meshBytes += mesh.bufferBytes;
+
+	std::printf("Mesh data: %zu kB (%s vertex attributes, %s layout)\n", std::size_t(meshBytes / 1024), model.quantized ? "quantized" : "fp32", model.interleaved ? "interleaved" : "separate");
+
+	//Report the number of draws and material changes per frame (with alpha masking enabled)
+	std::size_t materialChanges = 0;
+	for (auto const* list : { &meshes, &alphaMaskedMeshes })
+	{
+		for (size_t i = 0; i < list->size(); i++)
+		{
+			if (0 == i || list->at(i).materialIndex != list->at(i - 1).materialIndex)
+				materialChanges++;
+		}
+	}
+
+	std::printf("Draws per frame: %zu, material changes: %zu\n", meshes.size() + alphaMaskedMeshes.size(), materialChanges);
+
 	//Load every texture in the model, and create image views for each
-	//This includes base colour, metallic, roughness and normal maps
+	//This includes base colour, packed roughness/metalness and normal maps
 	std::vector<lut::Image> images(model.textures.size());
 	std::vector<lut::ImageView> imageViews(images.size());
 
-	for (size_t i = 0; i < model.textures.size(); i+=4)
+	//Baked textures are block compressed and carry their own format and mip chain
+	//Textures copied verbatim by the bake (--copy-textures) are loaded as RGBA8 instead
+	if (!model.textures.empty() && is_baked_texture(model.textures[0].path.c_str()))
 	{
-		
-		images[i] = lut::load_image_texture2d(model.textures[i].path.c_str(), window, cpool.handle, allocator, VK_FORMAT_R8G8B8A8_SRGB);
-		imageViews[i] = lut::create_image_view_texture2d(window, images[i].image, VK_FORMAT_R8G8B8A8_SRGB);
+		VkDeviceSize textureBytes = 0;
+		std::size_t decompressed = 0;
 
-		images[i+1] = lut::load_image_texture2d(model.textures[i+1].path.c_str(), window, cpool.handle, allocator, VK_FORMAT_R8G8B8A8_UNORM);
-		imageViews[i+1] = lut::create_image_view_texture2d(window, images[i+1].image, VK_FORMAT_R8G8B8A8_UNORM);
+		for (size_t i = 0; i < model.textures.size(); i++)
+		{
+			auto texture = load_baked_texture2d(window, cpool.handle, allocator, model.textures[i].path.c_str());
 
-		images[i+2] = lut::load_image_texture2d(model.textures[i+2].path.c_str(), window, cpool.handle, allocator, VK_FORMAT_R8G8B8A8_UNORM);
-		imageViews[i+2] = lut::create_image_view_texture2d(window, images[i+2].image, VK_FORMAT_R8G8B8A8_UNORM);
+			imageViews[i] = lut::create_image_view_texture2d(window, texture.image.image, texture.format);
+			images[i] = std::move(texture.image);
 
-		images[i+3] = lut::load_image_texture2d(model.textures[i+3].path.c_str(), window, cpool.handle, allocator, VK_FORMAT_R8G8B8A8_UNORM);
-		imageViews[i+3] = lut::create_image_view_texture2d(window, images[i+3].image, VK_FORMAT_R8G8B8A8_UNORM);
+			textureBytes += texture.bytes;
+			if (texture.decompressed)
+				decompressed++;
+		}
 
+		std::printf("Texture data: %zu kB (%zu of %zu textures decompressed in software)\n", std::size_t(textureBytes / 1024), decompressed, model.textures.size());
+	}
+	else
+	{
+		//Pick the smallest format that holds the channels used by the shaders:
+		// - base colour (and alpha mask): RGBA8, sRGB
+		// - normal maps: R8G8, as the shaders reconstruct z
+		// - others by their baked channel count: R8 (e.g. roughness) or R8G8 (packed roughness/metalness)
+		std::vector<VkFormat> formats(model.textures.size(), VK_FORMAT_UNDEFINED);
+		for (auto const& material : model.materials)
+		{
+			formats.at(material.baseColorTextureId) = VK_FORMAT_R8G8B8A8_SRGB;
+			if (material.alphaMaskTextureId != 0xffffffff)
+				formats.at(material.alphaMaskTextureId) = VK_FORMAT_R8G8B8A8_SRGB;
+			if (material.normalMapTextureId != 0xffffffff)
+				formats.at(material.normalMapTextureId) = VK_FORMAT_R8G8_UNORM;
+		}
+
+		std::size_t formatCounts[3] = {}; //R8, R8G8, RGBA8
+		for (size_t i = 0; i < model.textures.size(); i++)
+		{
+			if (VK_FORMAT_UNDEFINED == formats[i])
+			{
+				auto const channels = model.textures[i].channels;
+				formats[i] = 1 == channels ? VK_FORMAT_R8_UNORM : 2 == channels ? VK_FORMAT_R8G8_UNORM : VK_FORMAT_R8G8B8A8_UNORM;
+			}
+
+			auto const format = formats[i];
+			formatCounts[VK_FORMAT_R8_UNORM == format ? 0 : VK_FORMAT_R8G8_UNORM == format ? 1 : 2]++;
+
+			images[i] = lut::load_image_texture2d(model.textures[i].path.c_str(), window, cpool.handle, allocator, format);
+			imageViews[i] = lut::create_image_view_texture2d(window, images[i].image, format);
+		}
+
+		std::printf("Uncompressed textures: %zu R8, %zu R8G8, %zu RGBA8\n", formatCounts[0], formatCounts[1], formatCounts[2]);
 	}
 
 	//Create descriptor pool
@@ -388,32 +492,27 @@ int main() try
 		//Allocate the descriptor set
 		meshDescriptorSets[i] = lut::alloc_desc_set(window, dpool.handle, materialLayout.handle);
 
-		VkDescriptorImageInfo imageInfo[4]{};
+		VkDescriptorImageInfo imageInfo[3]{};
 
 		//Base Colour
 		imageInfo[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		imageInfo[0].imageView = imageViews.at(model.materials[i].baseColorTextureId).handle;
 		imageInfo[0].sampler = defaultSampler.handle;
 
-		//Metalness
+		//Roughness and metalness
 		imageInfo[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo[1].imageView = imageViews.at(model.materials[i].metalnessTextureId).handle;
+		imageInfo[1].imageView = imageViews.at(model.materials[i].roughnessMetalnessTextureId).handle;
 		imageInfo[1].sampler = defaultSampler.handle;
 
-		//Roughness
+		//Normal map
 		imageInfo[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo[2].imageView = imageViews.at(model.materials[i].roughnessTextureId).handle;
+		imageInfo[2].imageView = imageViews.at(model.materials[i].normalMapTextureId).handle;
 		imageInfo[2].sampler = defaultSampler.handle;
 
-		//Normal map
-		imageInfo[3].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo[3].imageView = imageViews.at(model.materials[i].normalMapTextureId).handle;
-		imageInfo[3].sampler = defaultSampler.handle;
-
 		//Update the descriptor set
-		VkWriteDescriptorSet desc[4]{};
+		VkWriteDescriptorSet desc[3]{};
 
-		for (int j = 0; j < 4; j++)
+		for (int j = 0; j < 3; j++)
 		{
 			desc[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			desc[j].dstSet = meshDescriptorSets[i];
@@ -503,8 +602,8 @@ int main() try
 			if (changes.changedSize)
 			{
 				std::tie(depthBuffer, depthBufferView) = create_depth_buffer(window, allocator);
-				pipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kTextureFragShaderPath, false);
-				alphaPipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kAlphaMaskFragShaderPath, true);
+				pipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kTextureFragShaderPath, false, model.quantized, model.interleaved);
+				alphaPipe = create_default_pipeline(window, renderPass.handle, pipeLayout.handle, cfg::kVertexShaderPath, cfg::kAlphaMaskFragShaderPath, true, model.quantized, model.interleaved);
 			}
 				
 			framebuffers.clear();
@@ -618,18 +717,30 @@ int main() try
 
 		if (alphaMasking)
 		{
+			//Meshes are sorted by material when merged by the bake, so only rebind when the material changes
+			int boundMaterial = -1;
+
 			for (uint32_t i = 0; i < meshes.size(); i++)
 			{
 				//Bind the material descriptor set
-				vkCmdBindDescriptorSets(cbuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout.handle, 1, 1, &meshDescriptorSets[meshes.at(i).materialIndex], 0, nullptr);
+				if (meshes.at(i).materialIndex != boundMaterial)
+				{
+					vkCmdBindDescriptorSets(cbuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout.handle, 1, 1, &meshDescriptorSets[meshes.at(i).materialIndex], 0, nullptr);
+					boundMaterial = meshes.at(i).materialIndex;
+				}
 
-				VkBuffer meshBuffers[4] = { meshes.at(i).positions.buffer, meshes.at(i).texCoords.buffer, meshes.at(i).normals.buffer, meshes.at(i).tangents.buffer };
+				VkBuffer meshBuffers[4]{};
 				VkDeviceSize meshOffsets[4] = {};
+				for (uint32_t b = 0; b < meshes.at(i).vertexBufferCount; b++)
+					meshBuffers[b] = meshes.at(i).vertexBuffers[b].buffer;
 				//Bind vertex buffers
-				vkCmdBindVertexBuffers(cbuffers[imageIndex], 0, 4, meshBuffers, meshOffsets);
+				vkCmdBindVertexBuffers(cbuffers[imageIndex], 0, meshes.at(i).vertexBufferCount, meshBuffers, meshOffsets);
+
+				//Pass vertex decoding parameters
+				vkCmdPushConstants(cbuffers[imageIndex], pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, glsl::kMeshDecodeOffset, sizeof(glsl::MeshDecode), &meshes.at(i).decode);
 
 				//Bind index buffer
-				vkCmdBindIndexBuffer(cbuffers[imageIndex], meshes.at(i).indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdBindIndexBuffer(cbuffers[imageIndex], meshes.at(i).indices.buffer, 0, meshes.at(i).indexType);
 
 				vkCmdDrawIndexed(cbuffers[imageIndex], meshes.at(i).indexCount, 1, 0, 0, 0);
 			}
@@ -640,19 +751,30 @@ int main() try
 			//Pass push constants again
 			vkCmdPushConstants(cbuffers[imageIndex], pipeLayout.handle, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &pushConstants);
 
+			boundMaterial = -1;
+
 			for (size_t i = 0; i < alphaMaskedMeshes.size(); i++)
 			{
 				//Bind the material descriptor set
-				vkCmdBindDescriptorSets(cbuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout.handle, 1, 1, &meshDescriptorSets[alphaMaskedMeshes.at(i).materialIndex], 0, nullptr);
+				if (alphaMaskedMeshes.at(i).materialIndex != boundMaterial)
+				{
+					vkCmdBindDescriptorSets(cbuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout.handle, 1, 1, &meshDescriptorSets[alphaMaskedMeshes.at(i).materialIndex], 0, nullptr);
+					boundMaterial = alphaMaskedMeshes.at(i).materialIndex;
+				}
 
-				VkBuffer alphaMeshBuffers[4] = { alphaMaskedMeshes.at(i).positions.buffer, alphaMaskedMeshes.at(i).texCoords.buffer, alphaMaskedMeshes.at(i).normals.buffer, alphaMaskedMeshes.at(i).tangents.buffer };
+				VkBuffer alphaMeshBuffers[4]{};
 				VkDeviceSize alphaMeshOffsets[4] = {};
+				for (uint32_t b = 0; b < alphaMaskedMeshes.at(i).vertexBufferCount; b++)
+					alphaMeshBuffers[b] = alphaMaskedMeshes.at(i).vertexBuffers[b].buffer;
 
 				//Bind vertex buffers
-				vkCmdBindVertexBuffers(cbuffers[imageIndex], 0, 4, alphaMeshBuffers, alphaMeshOffsets);
+				vkCmdBindVertexBuffers(cbuffers[imageIndex], 0, alphaMaskedMeshes.at(i).vertexBufferCount, alphaMeshBuffers, alphaMeshOffsets);
+
+				//Pass vertex decoding parameters
+				vkCmdPushConstants(cbuffers[imageIndex], pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, glsl::kMeshDecodeOffset, sizeof(glsl::MeshDecode), &alphaMaskedMeshes.at(i).decode);
 
 				//Bind index buffer
-				vkCmdBindIndexBuffer(cbuffers[imageIndex], alphaMaskedMeshes.at(i).indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdBindIndexBuffer(cbuffers[imageIndex], alphaMaskedMeshes.at(i).indices.buffer, 0, alphaMaskedMeshes.at(i).indexType);
 
 				vkCmdDrawIndexed(cbuffers[imageIndex], alphaMaskedMeshes.at(i).indexCount, 1, 0, 0, 0);
 			}
@@ -660,18 +782,30 @@ int main() try
 
 		else
 		{
+			//Meshes are sorted by material when merged by the bake, so only rebind when the material changes
+			int boundMaterial = -1;
+
 			for (uint32_t i = 0; i < notAlphaMaskedMeshes.size(); i++)
 			{
 				//Bind the material descriptor set
-				vkCmdBindDescriptorSets(cbuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout.handle, 1, 1, &meshDescriptorSets[notAlphaMaskedMeshes.at(i).materialIndex], 0, nullptr);
+				if (notAlphaMaskedMeshes.at(i).materialIndex != boundMaterial)
+				{
+					vkCmdBindDescriptorSets(cbuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeLayout.handle, 1, 1, &meshDescriptorSets[notAlphaMaskedMeshes.at(i).materialIndex], 0, nullptr);
+					boundMaterial = notAlphaMaskedMeshes.at(i).materialIndex;
+				}
 
-				VkBuffer meshBuffers[4] = { notAlphaMaskedMeshes.at(i).positions.buffer, notAlphaMaskedMeshes.at(i).texCoords.buffer, notAlphaMaskedMeshes.at(i).normals.buffer, notAlphaMaskedMeshes.at(i).tangents.buffer };
+				VkBuffer meshBuffers[4]{};
 				VkDeviceSize meshOffsets[4] = {};
+				for (uint32_t b = 0; b < notAlphaMaskedMeshes.at(i).vertexBufferCount; b++)
+					meshBuffers[b] = notAlphaMaskedMeshes.at(i).vertexBuffers[b].buffer;
 				//Bind vertex buffers
-				vkCmdBindVertexBuffers(cbuffers[imageIndex], 0, 4, meshBuffers, meshOffsets);
+				vkCmdBindVertexBuffers(cbuffers[imageIndex], 0, notAlphaMaskedMeshes.at(i).vertexBufferCount, meshBuffers, meshOffsets);
+
+				//Pass vertex decoding parameters
+				vkCmdPushConstants(cbuffers[imageIndex], pipeLayout.handle, VK_SHADER_STAGE_VERTEX_BIT, glsl::kMeshDecodeOffset, sizeof(glsl::MeshDecode), &notAlphaMaskedMeshes.at(i).decode);
 
 				//Bind index buffer
-				vkCmdBindIndexBuffer(cbuffers[imageIndex], notAlphaMaskedMeshes.at(i).indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+				vkCmdBindIndexBuffer(cbuffers[imageIndex], notAlphaMaskedMeshes.at(i).indices.buffer, 0, notAlphaMaskedMeshes.at(i).indexType);
 
 				vkCmdDrawIndexed(cbuffers[imageIndex], notAlphaMaskedMeshes.at(i).indexCount, 1, 0, 0, 0);
 			}
@@ -1018,146 +1152,86 @@ namespace
 		return lut::RenderPass(aWindow.device, rpass);
 	}
 
-	MeshDetails create_mesh(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, glm::vec3 aPositions[], glm::vec2 aTexCoords[],
-		glm::vec3 aNormals[], std::uint32_t aIndices[], size_t aVertexCount, size_t aIndexCount, int aMaterialIndex, glm::vec4 aTangents[])
+	MeshDetails create_mesh(lut::VulkanContext const& aContext, lut::Allocator const& aAllocator, BakedMeshView const& aMesh, bool aQuantized, bool aInterleaved)
 	{
-		//Set required sizes for each detail
-		VkDeviceSize posSize = aVertexCount * sizeof(glm::vec3);
-		VkDeviceSize texSize = aVertexCount * sizeof(glm::vec2);
-		VkDeviceSize normSize = aVertexCount * sizeof(glm::vec3);
-		VkDeviceSize indexSize = aIndexCount * sizeof(std::uint32_t);
-
-		VkDeviceSize tangentSize = aVertexCount * sizeof(glm::vec4);
-
-
-		//Create buffers for position, texcoord, normal
-		lut::Buffer vertexPosGPU = lut::create_buffer(
-			aAllocator,
-			posSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			0, //No additional VmaAllocationCreateFlags
-			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE //Can also be VMA_MEMORY_USAGE_AUTO
-		);
+		size_t const vertexCount = aMesh.vertex_count();
+		size_t const indexCount = aMesh.index_count();
+		if (0 == vertexCount || 0 == indexCount)
+			throw lut::Error("create_mesh(): mesh has no vertices or indices");
 
-		lut::Buffer vertexTexGPU = lut::create_buffer(
-			aAllocator,
-			texSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			0, //No additional VmaAllocationCreateFlags
-			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE //Can also be VMA_MEMORY_USAGE_AUTO
-		);
+		bool const indices16 = sizeof(std::uint16_t) == aMesh.indexSize;
 
-		lut::Buffer vertexNormGPU = lut::create_buffer(
-			aAllocator,
-			normSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			0, //No additional VmaAllocationCreateFlags
-			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE //Can also be VMA_MEMORY_USAGE_AUTO
-		);
-
-		//Create indexed buffer for indices
-		lut::Buffer indexGPU = lut::create_buffer(
-			aAllocator,
-			indexSize,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			0,
-			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
-		);
-
-		lut::Buffer tangentGPU = lut::create_buffer(
-			aAllocator,
-			tangentSize,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			0, //No additional VmaAllocationCreateFlags
-			VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE //Can also be VMA_MEMORY_USAGE_AUTO
-		);
-
-		//Create staging buffers
-		lut::Buffer posStaging = lut::create_buffer(
-			aAllocator,
-			posSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-		);
-
-		lut::Buffer texStaging = lut::create_buffer(
-			aAllocator,
-			texSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-		);
-
-		lut::Buffer normStaging = lut::create_buffer(
-			aAllocator,
-			normSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-		);
-
-		lut::Buffer indexStaging = lut::create_buffer(
-			aAllocator,
-			indexSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-		);
-
-		lut::Buffer tangentStaging = lut::create_buffer(
-			aAllocator,
-			tangentSize,
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-		);
+		//Collect everything that needs uploading: the vertex streams in binding order, followed by the indices
+		//Quantized meshes are uploaded as-is and decoded in the vertex shader
+		struct Upload
+		{
+			void const* data;
+			VkDeviceSize size;
+			VkBufferUsageFlags usage;
+		};
 
-		//Map position memory
-		void* posPtr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, posStaging.allocation, &posPtr); VK_SUCCESS != res)
+		std::vector<Upload> uploads;
+		auto const add_stream = [&](void const* aData, VkDeviceSize aElementSize)
 		{
-			throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
-		}
+			uploads.push_back({ aData, vertexCount * aElementSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT });
+		};
 
-		std::memcpy(posPtr, aPositions, posSize);
-		vmaUnmapMemory(aAllocator.allocator, posStaging.allocation);
+		if (aQuantized)
+			add_stream(aMesh.qpositions.data(), sizeof(glm::u16vec4));
+		else
+			add_stream(aMesh.positions.data(), sizeof(glm::vec3));
 
-		//Map texcoord memory
-		void* texPtr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, texStaging.allocation, &texPtr); VK_SUCCESS != res)
+		if (aInterleaved)
 		{
-			throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+			uploads.push_back({ aMesh.attributes.data(), aMesh.attributes.size_bytes(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT });
 		}
-
-		std::memcpy(texPtr, aTexCoords, texSize);
-		vmaUnmapMemory(aAllocator.allocator, texStaging.allocation);
-
-		//Map normal memory
-		void* normPtr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, normStaging.allocation, &normPtr); VK_SUCCESS != res)
+		else if (aQuantized)
 		{
-			throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+			add_stream(aMesh.qtexcoords.data(), sizeof(glm::u16vec2));
+			add_stream(aMesh.qnormals.data(), sizeof(glm::i16vec2));
+			add_stream(aMesh.qtangents.data(), sizeof(glm::i16vec2));
 		}
-
-		std::memcpy(normPtr, aNormals, normSize);
-		vmaUnmapMemory(aAllocator.allocator, normStaging.allocation);
-
-		//Map index memory
-		void* indexPtr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, indexStaging.allocation, &indexPtr); VK_SUCCESS != res)
+		else
 		{
-			throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+			add_stream(aMesh.texcoords.data(), sizeof(glm::vec2));
+			add_stream(aMesh.normals.data(), sizeof(glm::vec3));
+			add_stream(aMesh.tangents.data(), sizeof(glm::vec4));
 		}
 
-		std::memcpy(indexPtr, aIndices, indexSize);
-		vmaUnmapMemory(aAllocator.allocator, indexStaging.allocation);
+		void const* indexData = indices16 ? static_cast<void const*>(aMesh.indices16.data()) : aMesh.indices.data();
+		uploads.push_back({ indexData, indexCount * aMesh.indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT });
+
+		//Create the on-GPU buffers and the staging buffers, and fill the latter
+		std::vector<lut::Buffer> gpuBuffers;
+		std::vector<lut::Buffer> stagingBuffers;
 
-		//Map tangent memory
-		void* tangentPtr = nullptr;
-		if (auto const res = vmaMapMemory(aAllocator.allocator, tangentStaging.allocation, &tangentPtr); VK_SUCCESS != res)
+		for (auto const& upload : uploads)
 		{
-			throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+			gpuBuffers.emplace_back(lut::create_buffer(
+				aAllocator,
+				upload.size,
+				upload.usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				0, //No additional VmaAllocationCreateFlags
+				VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE //Can also be VMA_MEMORY_USAGE_AUTO
+			));
+
+			stagingBuffers.emplace_back(lut::create_buffer(
+				aAllocator,
+				upload.size,
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+			));
+
+			void* ptr = nullptr;
+			if (auto const res = vmaMapMemory(aAllocator.allocator, stagingBuffers.back().allocation, &ptr); VK_SUCCESS != res)
+			{
+				throw lut::Error("Mapping memory for writing\n" "vmaMapMemory() returned %s", lut::to_string(res).c_str());
+			}
+
+			std::memcpy(ptr, upload.data, upload.size);
+			vmaUnmapMemory(aAllocator.allocator, stagingBuffers.back().allocation);
 		}
 
-		std::memcpy(tangentPtr, aTangents, tangentSize);
-		vmaUnmapMemory(aAllocator.allocator, tangentStaging.allocation);
-		
 		//Prepare for issuing the transfer commands that copy data from staging buffers to final on-GPU buffers
 		//First, ensure that Vulkan resources are alive until all transfers are completed
 		lut::Fence uploadComplete = lut::create_fence(aContext);
@@ -1179,76 +1253,25 @@ namespace
 		}
 
 		//Copy commands into buffer
-		VkBufferCopy pcopy{};
-		pcopy.size = posSize;
-
-		vkCmdCopyBuffer(uploadCmd, posStaging.buffer, vertexPosGPU.buffer, 1, &pcopy);
-
-		lut::buffer_barrier(
-			uploadCmd,
-			vertexPosGPU.buffer,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		);
-
-		VkBufferCopy tcopy{};
-		tcopy.size = texSize;
-
-		vkCmdCopyBuffer(uploadCmd, texStaging.buffer, vertexTexGPU.buffer, 1, &tcopy);
-
-		lut::buffer_barrier(
-			uploadCmd,
-			vertexTexGPU.buffer,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		);
-
-		VkBufferCopy ncopy{};
-		ncopy.size = normSize;
-
-		vkCmdCopyBuffer(uploadCmd, normStaging.buffer, vertexNormGPU.buffer, 1, &ncopy);
-
-		lut::buffer_barrier(
-			uploadCmd,
-			vertexNormGPU.buffer,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		);
-
-		VkBufferCopy icopy{};
-		icopy.size = indexSize;
-
-		vkCmdCopyBuffer(uploadCmd, indexStaging.buffer, indexGPU.buffer, 1, &icopy);
-
-		lut::buffer_barrier(
-			uploadCmd,
-			indexGPU.buffer,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		);
+		for (size_t i = 0; i < uploads.size(); i++)
+		{
+			VkBufferCopy copy{};
+			copy.size = uploads[i].size;
 
+			vkCmdCopyBuffer(uploadCmd, stagingBuffers[i].buffer, gpuBuffers[i].buffer, 1, &copy);
 
-		VkBufferCopy tangentcopy{};
-		tangentcopy.size = tangentSize;
+			bool const isIndex = (uploads[i].usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT) != 0;
 
-		vkCmdCopyBuffer(uploadCmd, tangentStaging.buffer, tangentGPU.buffer, 1, &tangentcopy);
+			lut::buffer_barrier(
+				uploadCmd,
+				gpuBuffers[i].buffer,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				isIndex ? VK_ACCESS_INDEX_READ_BIT : VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
+			);
+		}
 
-		lut::buffer_barrier(
-			uploadCmd,
-			tangentGPU.buffer,
-			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-			VK_PIPELINE_STAGE_TRANSFER_BIT,
-			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-		);
 		if (auto const res = vkEndCommandBuffer(uploadCmd); VK_SUCCESS != res)
 		{
 			throw lut::Error("Ending command buffer recording\n" "vkEndCommandBuffer() returned %s", lut::to_string(res).c_str());
@@ -1272,13 +1295,77 @@ namespace
 		}
 
 		MeshDetails ret;
-		ret.positions = std::move(vertexPosGPU);
-		ret.texCoords = std::move(vertexTexGPU);
-		ret.normals = std::move(vertexNormGPU);
-		ret.indices = std::move(indexGPU);
-		ret.tangents = std::move(tangentGPU);
-		ret.materialIndex = aMaterialIndex;
-		ret.indexCount = aIndexCount;
+		ret.vertexBufferCount = std::uint32_t(uploads.size() - 1);
+		for (std::uint32_t i = 0; i < ret.vertexBufferCount; i++)
+		{
+			ret.bufferBytes += uploads[i].size;
+			ret.vertexBuffers[i] = std::move(gpuBuffers[i]);
+		}
+
+		ret.indices = std::move(gpuBuffers.back());
+		ret.bufferBytes += uploads.back().size;
+		ret.materialIndex = aMesh.materialId;
+		ret.indexCount = indexCount;
+		ret.indexType = indices16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+		if (aQuantized)
+		{
+			ret.decode.posOffset = glm::vec4(aMesh.posMin, 0.f);
+			ret.decode.posScale = glm::vec4(aMesh.posMax - aMesh.posMin, 0.f);
+			ret.decode.texOffsetScale = glm::vec4(aMesh.texMin, aMesh.texMax - aMesh.texMin);
+		}
+		else
+		{
+			ret.decode.posOffset = glm::vec4(0.f);
+			ret.decode.posScale = glm::vec4(1.f);
+			ret.decode.texOffsetScale = glm::vec4(0.f, 0.f, 1.f, 1.f);
+		}
+
+		return ret;
+	}
+
+	TextureDetails load_baked_texture2d(lut::VulkanContext const& aContext, VkCommandPool aCmdPool, lut::Allocator const& aAllocator, char const* aPath)
+	{
+		auto texture = load_baked_texture(aPath);
+
+		auto const vk_format = [] (BakedTextureFormat aFormat) {
+			switch (aFormat)
+			{
+				case BakedTextureFormat::bc1_srgb: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+				case BakedTextureFormat::bc3_srgb: return VK_FORMAT_BC3_SRGB_BLOCK;
+				case BakedTextureFormat::bc4_unorm: return VK_FORMAT_BC4_UNORM_BLOCK;
+				case BakedTextureFormat::bc5_unorm: return VK_FORMAT_BC5_UNORM_BLOCK;
+				case BakedTextureFormat::rgba8_srgb: return VK_FORMAT_R8G8B8A8_SRGB;
+				case BakedTextureFormat::r8_unorm: return VK_FORMAT_R8_UNORM;
+				case BakedTextureFormat::r8g8_unorm: return VK_FORMAT_R8G8_UNORM;
+			}
+			return VK_FORMAT_UNDEFINED;
+		};
+
+		TextureDetails ret;
+		ret.format = vk_format(texture.format);
+
+		//BC formats require the textureCompressionBC feature, which is enabled when available
+		VkPhysicalDeviceFeatures features{};
+		vkGetPhysicalDeviceFeatures(aContext.physicalDevice, &features);
+
+		VkFormatProperties props{};
+		vkGetPhysicalDeviceFormatProperties(aContext.physicalDevice, ret.format, &props);
+
+		if (!features.textureCompressionBC || !(props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+		{
+			texture = decompress_baked_texture(texture);
+			ret.format = vk_format(texture.format);
+			ret.decompressed = true;
+		}
+
+		//The mip chain is stored in the file, so the levels are uploaded directly
+		std::vector<lut::ImageLevel> levels;
+		for (auto const& level : texture.levels)
+			levels.emplace_back(lut::ImageLevel{ level.width, level.height, level.offset });
+
+		ret.image = lut::upload_image_texture2d(aContext, aCmdPool, aAllocator, ret.format, texture.data.data(), texture.data.size(), levels);
+		ret.bytes = texture.data.size();
 
 		return ret;
 	}
@@ -1312,7 +1399,7 @@ namespace
 	lut::DescriptorSetLayout create_material_descriptor_layout(lut::VulkanWindow const& aWindow)
 	{
 		//Set up the bindings
-		VkDescriptorSetLayoutBinding bindings[4]{};
+		VkDescriptorSetLayoutBinding bindings[3]{};
 
 		//First binding - base colour
 		bindings[0].binding = 0; //Number must match the index of the corresponding *binding = N* declaration in shader
@@ -1320,24 +1407,18 @@ namespace
 		bindings[0].descriptorCount = 1;
 		bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		//Second binding - metalness
+		//Second binding - roughness (red) and metalness (green)
 		bindings[1].binding = 1; //Number must match the index of the corresponding *binding = N* declaration in shader
 		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		bindings[1].descriptorCount = 1;
 		bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		//Third binding - roughness
+		//Third binding - normal map
 		bindings[2].binding = 2; //Number must match the index of the corresponding *binding = N* declaration in shader
 		bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		bindings[2].descriptorCount = 1;
 		bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		//Fourth binding - normal map
-		bindings[3].binding = 3; //Number must match the index of the corresponding *binding = N* declaration in shader
-		bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		bindings[3].descriptorCount = 1;
-		bindings[3].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
 		//With bindings set, finish up the descriptor set layout properties
 		VkDescriptorSetLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1365,18 +1446,23 @@ namespace
 		};
 
 		//Create push constants
-		VkPushConstantRange pushConstantRange;
-		pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-		pushConstantRange.offset = 0;
-		pushConstantRange.size = sizeof(PushConstants);
+		//The fragment shader gets the lighting settings, the vertex shader the per-mesh decoding parameters
+		VkPushConstantRange pushConstantRanges[2]{};
+		pushConstantRanges[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRanges[0].offset = 0;
+		pushConstantRanges[0].size = sizeof(PushConstants);
+
+		pushConstantRanges[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		pushConstantRanges[1].offset = glsl::kMeshDecodeOffset;
+		pushConstantRanges[1].size = sizeof(glsl::MeshDecode);
 
 		//Finish up the pipeline layout properties
 		VkPipelineLayoutCreateInfo layoutInfo{};
 		layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		layoutInfo.setLayoutCount = sizeof(layouts) / sizeof(layouts[0]);
 		layoutInfo.pSetLayouts = layouts;
-		layoutInfo.pushConstantRangeCount = 1;
-		layoutInfo.pPushConstantRanges = &pushConstantRange;
+		layoutInfo.pushConstantRangeCount = sizeof(pushConstantRanges) / sizeof(pushConstantRanges[0]);
+		layoutInfo.pPushConstantRanges = pushConstantRanges;
 
 		//Create the pipeline layout
 		VkPipelineLayout layout = VK_NULL_HANDLE;
@@ -1388,7 +1474,7 @@ namespace
 		return lut::PipelineLayout(aContext.device, layout);
 	}
 
-	lut::Pipeline create_default_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, const char* vertexPath, const char* fragPath, bool isAlpha)
+	lut::Pipeline create_default_pipeline(lut::VulkanWindow const& aWindow, VkRenderPass aRenderPass, VkPipelineLayout aPipelineLayout, const char* vertexPath, const char* fragPath, bool isAlpha, bool aQuantized, bool aInterleaved)
 	{
 		lut::ShaderModule vert = lut::load_shader_module(aWindow, vertexPath);
 		lut::ShaderModule frag = lut::load_shader_module(aWindow, fragPath);
@@ -1401,6 +1487,22 @@ namespace
 		stages[0].module = vert.handle;
 		stages[0].pName = "main";
 
+		//Tell the vertex shader whether it needs to decode quantized attributes (constant_id = 0)
+		VkBool32 const quantized = aQuantized ? VK_TRUE : VK_FALSE;
+
+		VkSpecializationMapEntry specEntry{};
+		specEntry.constantID = 0;
+		specEntry.offset = 0;
+		specEntry.size = sizeof(VkBool32);
+
+		VkSpecializationInfo specInfo{};
+		specInfo.mapEntryCount = 1;
+		specInfo.pMapEntries = &specEntry;
+		specInfo.dataSize = sizeof(VkBool32);
+		specInfo.pData = &quantized;
+
+		stages[0].pSpecializationInfo = &specInfo;
+
 		stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 		stages[1].module = frag.handle;
@@ -1411,22 +1513,22 @@ namespace
 
 		//First input - vertex position
 		vertexInputs[0].binding = 0;
-		vertexInputs[0].stride = sizeof(float) * 3;
+		vertexInputs[0].stride = aQuantized ? sizeof(std::uint16_t) * 4 : sizeof(float) * 3;
 		vertexInputs[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		//Second input - texture coordinates
 		vertexInputs[1].binding = 1;
-		vertexInputs[1].stride = sizeof(float) * 2;
+		vertexInputs[1].stride = aQuantized ? sizeof(std::uint16_t) * 2 : sizeof(float) * 2;
 		vertexInputs[1].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		//Third input - vertex normals
 		vertexInputs[2].binding = 2;
-		vertexInputs[2].stride = sizeof(float) * 3;
+		vertexInputs[2].stride = aQuantized ? sizeof(std::int16_t) * 2 : sizeof(float) * 3;
 		vertexInputs[2].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		//Fourth input - tangents
 		vertexInputs[3].binding = 3;
-		vertexInputs[3].stride = sizeof(float) * 4;
+		vertexInputs[3].stride = aQuantized ? sizeof(std::int16_t) * 2 : sizeof(float) * 4;
 		vertexInputs[3].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 		//Describe the vertex input attributes
@@ -1435,31 +1537,54 @@ namespace
 		//Vertex Positions
 		vertexAttributes[0].binding = 0; //Must match binding above
 		vertexAttributes[0].location = 0; //Must match shader
-		vertexAttributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+		vertexAttributes[0].format = aQuantized ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
 		vertexAttributes[0].offset = 0;
 
 		//Texture Coordinates
 		vertexAttributes[1].binding = 1;
 		vertexAttributes[1].location = 1;
-		vertexAttributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+		vertexAttributes[1].format = aQuantized ? VK_FORMAT_R16G16_UNORM : VK_FORMAT_R32G32_SFLOAT;
 		vertexAttributes[1].offset = 0;
 
 		//Normals
 		vertexAttributes[2].binding = 2;
 		vertexAttributes[2].location = 2;
-		vertexAttributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
+		vertexAttributes[2].format = aQuantized ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
 		vertexAttributes[2].offset = 0;
 
 		//Tangents
 		vertexAttributes[3].binding = 3;
 		vertexAttributes[3].location = 3;
-		vertexAttributes[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		vertexAttributes[3].format = aQuantized ? VK_FORMAT_R16G16_SNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
 		vertexAttributes[3].offset = 0;
 
+		//Interleaved layout - positions stay in binding 0, the other attributes share binding 1
+		//Per vertex, these are stored in the order normal, texture coordinate, tangent
+		std::uint32_t bindingCount = 4;
+		if (aInterleaved)
+		{
+			std::uint32_t const normalSize = aQuantized ? sizeof(std::int16_t) * 2 : sizeof(float) * 3;
+			std::uint32_t const texSize = aQuantized ? sizeof(std::uint16_t) * 2 : sizeof(float) * 2;
+			std::uint32_t const tangentSize = aQuantized ? sizeof(std::int16_t) * 2 : sizeof(float) * 4;
+
+			vertexInputs[1].stride = normalSize + texSize + tangentSize;
+
+			vertexAttributes[1].binding = 1;
+			vertexAttributes[1].offset = normalSize;
+
+			vertexAttributes[2].binding = 1;
+			vertexAttributes[2].offset = 0;
+
+			vertexAttributes[3].binding = 1;
+			vertexAttributes[3].offset = normalSize + texSize;
+
+			bindingCount = 2;
+		}
+
 		//Summarize the shader's input details
 		VkPipelineVertexInputStateCreateInfo inputInfo{};
 		inputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		inputInfo.vertexBindingDescriptionCount = 4;
+		inputInfo.vertexBindingDescriptionCount = bindingCount;
 		inputInfo.pVertexBindingDescriptions = vertexInputs;
 		inputInfo.vertexAttributeDescriptionCount = 4;
 		inputInfo.pVertexAttributeDescriptions = vertexAttributes;
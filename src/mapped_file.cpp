@@ -0,0 +1,115 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#include "../labutils/error.hpp"
+namespace lut = labutils;
+
+MappedFile::MappedFile() noexcept = default;
+
+MappedFile::MappedFile( char const* aPath )
+{
+#	if defined(_WIN32)
+	HANDLE file = CreateFileA( aPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if( INVALID_HANDLE_VALUE == file )
+		throw lut::Error( "MappedFile(): unable to open '%s' (error %lu)", aPath, GetLastError() );
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( file, &size ) )
+	{
+		auto const err = GetLastError();
+		CloseHandle( file );
+		throw lut::Error( "MappedFile(): unable to query size of '%s' (error %lu)", aPath, err );
+	}
+
+	if( 0 == size.QuadPart )
+	{
+		CloseHandle( file );
+		return;
+	}
+
+	// The view keeps the file mapping alive; both handles can be closed.
+	HANDLE mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	CloseHandle( file );
+
+	if( !mapping )
+		throw lut::Error( "MappedFile(): unable to map '%s' (error %lu)", aPath, GetLastError() );
+
+	void* ptr = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+	auto const err = GetLastError();
+	CloseHandle( mapping );
+
+	if( !ptr )
+		throw lut::Error( "MappedFile(): unable to map '%s' (error %lu)", aPath, err );
+
+	mSize = std::size_t(size.QuadPart);
+#	else
+	int const fd = open( aPath, O_RDONLY );
+	if( -1 == fd )
+		throw lut::Error( "MappedFile(): unable to open '%s': %s", aPath, std::strerror(errno) );
+
+	struct stat st;
+	if( 0 != fstat( fd, &st ) )
+	{
+		auto const err = errno;
+		close( fd );
+		throw lut::Error( "MappedFile(): unable to query size of '%s': %s", aPath, std::strerror(err) );
+	}
+
+	if( 0 == st.st_size )
+	{
+		close( fd );
+		return;
+	}
+
+	// The mapping remains valid after the file is closed.
+	void* ptr = mmap( nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0 );
+	auto const err = errno;
+	close( fd );
+
+	if( MAP_FAILED == ptr )
+		throw lut::Error( "MappedFile(): unable to map '%s': %s", aPath, std::strerror(err) );
+
+	mSize = std::size_t(st.st_size);
+#	endif
+
+	mData = static_cast<std::uint8_t const*>(ptr);
+}
+
+MappedFile::~MappedFile()
+{
+	if( mData )
+	{
+#		if defined(_WIN32)
+		UnmapViewOfFile( mData );
+#		else
+		munmap( const_cast<std::uint8_t*>(mData), mSize );
+#		endif
+	}
+}
+
+MappedFile::MappedFile( MappedFile&& aOther ) noexcept
+	: mData( std::exchange( aOther.mData, nullptr ) )
+	, mSize( std::exchange( aOther.mSize, 0 ) )
+{}
+
+MappedFile& MappedFile::operator=( MappedFile&& aOther ) noexcept
+{
+	std::swap( mData, aOther.mData );
+	std::swap( mSize, aOther.mSize );
+	return *this;
+}
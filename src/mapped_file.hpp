@@ -0,0 +1,36 @@
+#ifndef MAPPED_FILE_HPP_E3A91C57_2B6F_4D08_8F4E_7C1D05B9A263
+#define MAPPED_FILE_HPP_E3A91C57_2B6F_4D08_8F4E_7C1D05B9A263
+
+#include <cstddef>
+#include <cstdint>
+
+/* Read-only memory mapping of a whole file.
+ *
+ * The file is mapped with mmap() / MapViewOfFile(). Pages are loaded by the
+ * OS as they are accessed, and no copy of the file is made on the heap. The
+ * mapping starts at a page boundary.
+ */
+class MappedFile
+{
+	public:
+		MappedFile() noexcept;
+		explicit MappedFile( char const* aPath );
+
+		~MappedFile();
+
+		MappedFile( MappedFile const& ) = delete;
+		MappedFile& operator= (MappedFile const&) = delete;
+
+		MappedFile( MappedFile&& ) noexcept;
+		MappedFile& operator= (MappedFile&&) noexcept;
+
+	public:
+		std::uint8_t const* data() const noexcept { return mData; }
+		std::size_t size() const noexcept { return mSize; }
+
+	private:
+		std::uint8_t const* mData = nullptr;
+		std::size_t mSize = 0;
+};
+
+#endif // MAPPED_FILE_HPP_E3A91C57_2B6F_4D08_8F4E_7C1D05B9A263
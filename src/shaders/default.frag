@@ -18,9 +18,8 @@ layout (set = 0, binding = 0, std140) uniform UScene
 }	uScene;
 
 layout(set = 1, binding = 0) uniform sampler2D uTexColor;
-layout(set = 1, binding = 1) uniform sampler2D uMetalness;
-layout(set = 1, binding = 2) uniform sampler2D uRoughness;
-layout(set = 1, binding = 3) uniform sampler2D uNormal;
+layout(set = 1, binding = 1) uniform sampler2D uRoughnessMetalness;
+layout(set = 1, binding = 2) uniform sampler2D uNormal;
 
 layout( push_constant ) uniform PushConstants {
 	int normalMapEnabled;
@@ -44,11 +43,16 @@ void main()
 	//Get all the parameters needed for light calculation
 	vec4 materialColour = vec4(texture(uTexColor, v2fTexCoord).rgb, 1.f);
 
-	//Get roughness and metalness from the respective maps
-	float roughness = texture(uRoughness, v2fTexCoord).r;
-	float metalness = texture(uMetalness, v2fTexCoord).r;
+	//Get roughness and metalness from the packed map (red and green respectively)
+	vec2 roughnessMetalness = texture(uRoughnessMetalness, v2fTexCoord).rg;
+	float roughness = roughnessMetalness.r;
+	float metalness = roughnessMetalness.g;
 
-	vec3 mappedNormals = texture(uNormal, v2fTexCoord).rgb;
+	//Normal maps only store x and y (BC5), so reconstruct the z (blue) channel
+	vec2 mappedXY = texture(uNormal, v2fTexCoord).rg;
+	vec2 unpackedXY = mappedXY * 2.0 - 1.0;
+	float unpackedZ = sqrt(max(0.0, 1.0 - dot(unpackedXY, unpackedXY)));
+	vec3 mappedNormals = vec3(mappedXY, unpackedZ * 0.5 + 0.5);
 
 	//Transform to global space using the tbn matrix
 	vec3 transformedNormals = normalize(tbn * mappedNormals);
@@ -1,8 +1,16 @@
 #version 450
 
-layout (location = 0) in vec3 iPosition;
+// Whether the mesh uses the quantized vertex format (see baked_model.hpp):
+//  - position: unorm16 xyz relative to the mesh bounds, w = bitangent sign
+//  - texcoord: unorm16 relative to the texture coordinate bounds
+//  - normal, tangent: octahedral encoding, snorm16 xy
+// With fp32 attributes, the unused components are filled in by the vertex
+// input stage (0 for y/z, 1 for w).
+layout(constant_id = 0) const bool kQuantized = false;
+
+layout (location = 0) in vec4 iPosition;
 layout(location = 1) in vec2 iTexCoord;
-layout(location = 2) in vec3 iNormal;
+layout(location = 2) in vec4 iNormal;
 layout(location = 3) in vec4 iTangent;
 
 layout (set = 0, binding = 0, std140) uniform UScene
@@ -15,27 +23,56 @@ layout (set = 0, binding = 0, std140) uniform UScene
 
 }	uScene;
 
+// Per-mesh decoding parameters; identity for fp32 meshes.
+layout( push_constant ) uniform MeshDecode {
+	layout(offset = 32) vec4 posOffset;
+	vec4 posScale;
+	vec4 texOffsetScale;
+
+} meshDecode;
+
 layout(location = 0) out vec2 v2fTexCoord;
 layout(location = 1) out vec3 oNormal;
 layout(location = 2) out vec3 fragPos;
 layout(location = 3) out mat3 tbn;
 
+// Must match oct_decode_() in bake/quantize_mesh.cpp
+vec3 oct_decode(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-v.z, 0.0);
+	v.xy += mix(vec2(t), vec2(-t), greaterThanEqual(v.xy, vec2(0.0)));
+	return normalize(v);
+}
+
 
 void main()
 {
-	v2fTexCoord = iTexCoord;
-	oNormal = iNormal;
-	gl_Position = uScene.projCam * vec4(iPosition, 1.f);
-	
+	vec3 position = meshDecode.posOffset.xyz + meshDecode.posScale.xyz * iPosition.xyz;
+	vec2 texCoord = meshDecode.texOffsetScale.xy + meshDecode.texOffsetScale.zw * iTexCoord;
+
+	vec3 normal = iNormal.xyz;
+	vec4 tangent = iTangent;
+
+	if (kQuantized)
+	{
+		normal = oct_decode(iNormal.xy);
+		tangent = vec4(oct_decode(iTangent.xy), iPosition.w * 2.0 - 1.0);
+	}
+
+	v2fTexCoord = texCoord;
+	oNormal = normal;
+	gl_Position = uScene.projCam * vec4(position, 1.f);
+
 	//Pass the position to the fragment
-	fragPos = iPosition;
+	fragPos = position;
 
 	//Create TBN matrix
 	//First calculate bitangent
-	vec3 bitangent = iTangent.w * cross(iNormal, iTangent.xyz);
+	vec3 bitangent = tangent.w * cross(normal, tangent.xyz);
 
 	//Create TBN matrix
-	mat3 tbnMatrix = mat3(iTangent.xyz, bitangent, iNormal);
+	mat3 tbnMatrix = mat3(tangent.xyz, bitangent, normal);
 
 	tbn = tbnMatrix;
 